@@ -147,6 +147,11 @@ cdef extern from "ode/ode.h":
     void dWorldSetAngularDamping (dWorldID, dReal scale)
     void dWorldImpulseToForce (dWorldID, dReal stepsize,
                                dReal ix, dReal iy, dReal iz, dVector3 force)
+    int dBodyStateRecordSize (unsigned fields)
+    int dWorldGetBodyStates (dWorldID, dBodyID *bodies, int count, unsigned fields,
+                             dReal *states, int stride, int *indices)
+    void dWorldSetBodyStates (dWorldID, dBodyID *bodies, int count, unsigned fields,
+                              dReal *states, int stride)
 
     # Body
     dBodyID dBodyCreate (dWorldID)
@@ -87,6 +87,13 @@ ContactApprox1_1    = 0x1000
 ContactApprox1_2    = 0x2000
 ContactApprox1    = 0x3000
 
+BodyStatePosition    = 0x01
+BodyStateQuaternion  = 0x02
+BodyStateRotation    = 0x04
+BodyStateLinearVel   = 0x08
+BodyStateAngularVel  = 0x10
+BodyStateChangedOnly = 0x100
+
 AMotorUser = dAMotorUser
 AMotorEuler = dAMotorEuler
 
@@ -1077,6 +1084,114 @@ cdef class World:
         dWorldImpulseToForce(self.wid, stepsize, impulse[0], impulse[1], impulse[2], force)
         return (force[0], force[1], force[2])
 
+    # getBodyStates
+    def getBodyStates(self, bodies, dReal[::1] states, int[::1] indices=None, fields=BodyStatePosition|BodyStateQuaternion):
+        """getBodyStates(bodies, states, indices=None, fields=BodyStatePosition|BodyStateQuaternion) -> int
+
+        Get the state of many bodies with a single call into ODE, and
+        return the number of records written.
+
+        The records are written into states, a writable buffer of
+        dReals (e.g. array.array('d') when ODE uses double precision,
+        'f' otherwise) that is reused from frame to frame. A record
+        holds the selected fields in the order position (3 floats),
+        quaternion (4), rotation (12, ODE's 3x4 layout), linear
+        velocity (3), angular velocity (3). If indices is given (a
+        buffer of C ints, e.g. array.array('i')) it receives the
+        position in bodies of the body of each record. With
+        BodyStateChangedOnly only the bodies that moved since they were
+        last reported with that flag are written.
+
+        If bodies is None, all the bodies of the world are reported, as
+        many as states has room for, most recently created first.
+
+        @param bodies: The bodies to report, or None
+        @param states: The destination
+        @param indices: The destination of the body indices, or None
+        @param fields: BodyStateXyz flags
+        @type bodies: sequence of Body objects
+        @type states: writable buffer of dReals
+        @type indices: writable buffer of ints
+        @type fields: int
+        """
+        cdef dBodyID* ids
+        cdef int* pindices
+        cdef int count, size, i
+
+        size = dBodyStateRecordSize(fields)
+        if bodies is None:
+            count = states.shape[0]//size
+        else:
+            count = len(bodies)
+            if states.shape[0]<count*size:
+                raise ValueError("states must hold %d floats"%(count*size))
+        if indices is None:
+            pindices = NULL
+        elif indices.shape[0]<count:
+            raise ValueError("indices must hold %d ints"%count)
+        else:
+            pindices = &indices[0]
+        if count==0:
+            return 0
+
+        if bodies is None:
+            return dWorldGetBodyStates(self.wid, NULL, count, fields, &states[0], size, pindices)
+
+        ids = <dBodyID*>malloc(count*sizeof(dBodyID))
+        try:
+            i = 0
+            for b in bodies:
+                ids[i] = (<Body>b).bid
+                i = i+1
+            return dWorldGetBodyStates(self.wid, ids, count, fields, &states[0], size, pindices)
+        finally:
+            free(ids)
+
+    # setBodyStates
+    def setBodyStates(self, bodies, const dReal[::1] states, fields=BodyStatePosition|BodyStateQuaternion):
+        """setBodyStates(bodies, states, fields=BodyStatePosition|BodyStateQuaternion)
+
+        Set the state of many bodies with a single call into ODE. states
+        is a buffer of dReals holding one record per body, laid out as
+        written by getBodyStates().
+
+        If bodies is None, the records are applied to the bodies of the
+        world in the order getBodyStates() reports them.
+
+        @param bodies: The bodies to update, or None
+        @param states: The new states
+        @param fields: BodyStateXyz flags
+        @type bodies: sequence of Body objects
+        @type states: buffer of dReals
+        @type fields: int
+        """
+        cdef dBodyID* ids
+        cdef int count, size, i
+
+        size = dBodyStateRecordSize(fields)
+        if bodies is None:
+            count = states.shape[0]//size
+        else:
+            count = len(bodies)
+            if states.shape[0]!=count*size:
+                raise ValueError("states must hold %d floats"%(count*size))
+        if count==0:
+            return
+
+        if bodies is None:
+            dWorldSetBodyStates(self.wid, NULL, count, fields, <dReal*>&states[0], size)
+            return
+
+        ids = <dBodyID*>malloc(count*sizeof(dBodyID))
+        try:
+            i = 0
+            for b in bodies:
+                ids[i] = (<Body>b).bid
+                i = i+1
+            dWorldSetBodyStates(self.wid, ids, count, fields, <dReal*>&states[0], size)
+        finally:
+            free(ids)
+
     # createBody
 #    def createBody(self):
 #        return Body(self)
@@ -1146,6 +1261,16 @@ cdef class Body:
         if self.bid!=NULL:
             dBodyDestroy(self.bid)
 
+    def _id(self):
+        """_id() -> int
+
+        Return the internal id of the body (dBodyID) as returned by
+        dBodyCreate().
+        """
+        cdef long id
+        id = <long>self.bid
+        return id
+
     def __getattr__(self, name):
         try:
             return self.userattribs[name]
@@ -0,0 +1,75 @@
+#!/usr/bin/env python
+
+# Smoke test of World.getBodyStates() and World.setBodyStates().
+# Run it from the directory the module was built in, e.g.
+#   python setup.py build_ext --inplace && python tests/test_bodystates.py
+
+import array
+import unittest
+
+import ode
+
+# array typecode matching dReal; getBodyStates() rejects the other one
+def realArray(size):
+    for typecode in ('d', 'f'):
+        states = array.array(typecode, [0.0] * size)
+        try:
+            ode.World().getBodyStates([], states)
+            return states
+        except ValueError:
+            pass
+    raise RuntimeError("no array type matches dReal")
+
+
+class BodyStatesTest(unittest.TestCase):
+
+    def setUp(self):
+        self.world = ode.World()
+        self.bodies = []
+        for i in range(5):
+            body = ode.Body(self.world)
+            body.setPosition((i, 2 * i, 3 * i))
+            body.setLinearVel((0, 0, -i))
+            self.bodies.append(body)
+
+    def testGetMatchesBodies(self):
+        fields = ode.BodyStatePosition | ode.BodyStateLinearVel
+        states = realArray(6 * len(self.bodies))
+        n = self.world.getBodyStates(self.bodies, states, None, fields)
+        self.assertEqual(n, len(self.bodies))
+        for i, body in enumerate(self.bodies):
+            self.assertEqual(tuple(states[6 * i:6 * i + 3]), body.getPosition())
+            self.assertEqual(tuple(states[6 * i + 3:6 * i + 6]), body.getLinearVel())
+
+    def testSetRoundTrip(self):
+        states = realArray(3 * len(self.bodies))
+        for i in range(len(self.bodies)):
+            states[3 * i:3 * i + 3] = array.array(states.typecode, [i, 0, 1])
+        self.world.setBodyStates(self.bodies, states, ode.BodyStatePosition)
+        for i, body in enumerate(self.bodies):
+            self.assertEqual(body.getPosition(), (i, 0, 1))
+
+    def testChangedOnly(self):
+        fields = ode.BodyStatePosition | ode.BodyStateChangedOnly
+        states = realArray(3 * len(self.bodies))
+        indices = array.array('i', [0] * len(self.bodies))
+        self.world.getBodyStates(self.bodies, states, indices, fields)
+
+        self.bodies[3].setPosition((7, 8, 9))
+        n = self.world.getBodyStates(self.bodies, states, indices, fields)
+        self.assertEqual(n, 1)
+        self.assertEqual(indices[0], 3)
+        self.assertEqual(tuple(states[0:3]), (7, 8, 9))
+
+    def testAllBodies(self):
+        states = realArray(3 * len(self.bodies))
+        n = self.world.getBodyStates(None, states, None, ode.BodyStatePosition)
+        self.assertEqual(n, len(self.bodies))
+
+    def testShortBuffer(self):
+        states = realArray(3)
+        self.assertRaises(ValueError, self.world.getBodyStates, self.bodies, states)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -298,6 +298,7 @@ ODE_API dSpaceID dGeomGetSpace (dGeomID);
  *  @li dSimpleSpaceClass
  *  @li dHashSpaceClass
  *  @li dQuadTreeSpaceClass
+ *  @li dOctreeSpaceClass
  *  @li dFirstUserClass
  *  @li dLastUserClass
  *
@@ -894,7 +895,8 @@ enum {
   dHashSpaceClass,
   dSweepAndPruneSpaceClass, // SAP
   dQuadTreeSpaceClass,
-  dLastSpaceClass = dQuadTreeSpaceClass,
+  dOctreeSpaceClass,
+  dLastSpaceClass = dOctreeSpaceClass,
 
   dFirstUserClass,
   dLastUserClass = dFirstUserClass + dMaxUserClasses - 1,
@@ -902,6 +904,90 @@ enum {
 };
 
 
+/* ************************************************************************ */
+/* collision statistics */
+
+/**
+ * @brief Collision counters of a pair of geom classes
+ *
+ * Broadphase counters are collected by spaces (see @ref dSpaceSetStatsEnabled):
+ * @c candidate_pairs is the number of geom pairs the space considered,
+ * @c filtered_pairs of them were skipped because the geoms are attached to the same body
+ * or because of their category/collide bits, and @c aabb_rejected_pairs were rejected
+ * by the AABB overlap test or by a geom's own AABB test. The remaining pairs
+ * were passed to the near callback.
+ *
+ * Narrowphase counters are collected by @ref dCollide (see @ref dSetColliderStatsEnabled):
+ * @c narrowphase_calls is the number of collider function invocations,
+ * @c narrowphase_time the time spent in them in seconds and @c contacts the number
+ * of contacts generated.
+ *
+ * @ingroup collide
+ */
+typedef struct dCollisionPairStats {
+  unsigned long candidate_pairs;
+  unsigned long filtered_pairs;
+  unsigned long aabb_rejected_pairs;
+  unsigned long narrowphase_calls;
+  unsigned long contacts;
+  double narrowphase_time;
+} dCollisionPairStats;
+
+/**
+ * @brief Enable or disable broadphase statistics collection for a space.
+ *
+ * Statistics are collected in collisions performed by the space itself
+ * (@ref dSpaceCollide and the space side of @ref dSpaceCollide2).
+ * Enabling a disabled collection resets the counters; disabling releases
+ * the memory used.
+ *
+ * @returns 1 for success and 0 for memory allocation failure.
+ * @sa dSpaceGetStats
+ * @ingroup collide
+ */
+ODE_API int dSpaceSetStatsEnabled (dSpaceID space, int enabled);
+ODE_API int dSpaceGetStatsEnabled (dSpaceID space);
+
+/**
+ * @brief Retrieve broadphase statistics of a space.
+ *
+ * The counters of a pair of classes @c c1 and @c c2 are stored in
+ * @c table[min(c1,c2)][max(c1,c2)]; cells below the diagonal stay zero.
+ *
+ * @returns 1 for success and 0 if statistics are not enabled for the space.
+ * @sa dSpaceSetStatsEnabled
+ * @ingroup collide
+ */
+ODE_API int dSpaceGetStats (dSpaceID space, dCollisionPairStats table[dGeomNumClasses][dGeomNumClasses]);
+ODE_API void dSpaceResetStats (dSpaceID space);
+
+/**
+ * @brief Enable or disable narrowphase statistics collection in @ref dCollide.
+ *
+ * The statistics are global for the library. The counters are updated without
+ * synchronization and they are only exact if no two threads call @ref dCollide
+ * at the same time while the collection is enabled.
+ * Enabling a disabled collection resets the counters.
+ *
+ * @sa dGetColliderStats
+ * @ingroup collide
+ */
+ODE_API void dSetColliderStatsEnabled (int enabled);
+ODE_API int dGetColliderStatsEnabled (void);
+
+/**
+ * @brief Retrieve narrowphase statistics collected by @ref dCollide.
+ *
+ * The table layout is the same as for @ref dSpaceGetStats.
+ *
+ * @returns 1 for success and 0 if the collection is not enabled.
+ * @sa dSetColliderStatsEnabled
+ * @ingroup collide
+ */
+ODE_API int dGetColliderStats (dCollisionPairStats table[dGeomNumClasses][dGeomNumClasses]);
+ODE_API void dResetColliderStats (void);
+
+
 /**
  * @defgroup collide_sphere Sphere Class
  * @ingroup collide
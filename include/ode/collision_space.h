@@ -24,6 +24,7 @@
 #define _ODE_COLLISION_SPACE_H_
 
 #include <ode/common.h>
+#include <ode/threading.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -53,6 +54,25 @@ ODE_API dSpaceID dSimpleSpaceCreate (dSpaceID space);
 ODE_API dSpaceID dHashSpaceCreate (dSpaceID space);
 ODE_API dSpaceID dQuadTreeSpaceCreate (dSpaceID space, const dVector3 Center, const dVector3 Extents, int Depth);
 
+/**
+ * @brief Creates a loose octree space.
+ *
+ * The octree partitions all three axes and creates its nodes only where
+ * there are geoms, so its memory follows the occupied cells. Unlike the
+ * quadtree space it is not limited to the initial region: the tree grows
+ * when geoms leave it and shrinks back when they return.
+ *
+ * @param space the space to insert the new space into, or 0
+ * @param Center center of the initial root cell
+ * @param Extents half sizes of the initial root cell; the cell is a cube
+ * with the largest of them
+ * @param Depth number of times the initial root cell may be split; this
+ * sets the smallest cell size
+ * @returns the new space
+ * @ingroup collide
+ */
+ODE_API dSpaceID dOctreeSpaceCreate (dSpaceID space, const dVector3 Center, const dVector3 Extents, int Depth);
+
 
 // SAP
 // Order XZY or ZXY usually works best, if your Y is up.
@@ -146,6 +166,77 @@ ODE_API void dSpaceSetManualCleanup (dSpaceID space, int mode);
 */
 ODE_API int dSpaceGetManualCleanup (dSpaceID space);
 
+/**
+* @brief Assign threading implementation to be used for cleaning a space.
+*
+* Before the broadphase runs, a space recomputes the AABBs of all the geoms
+* that have moved since the last collision check. With a threading
+* implementation serving several threads assigned, large batches of these
+* updates are split across the threads. The space structures themselves are
+* still updated serially. Child spaces use their own assignment.
+*
+* The same implementation runs the ray tests of @c dSpaceRaycastBatch.
+*
+* @warning The implementation must not be busy with another call (e.g.
+* stepping a world) while the space is being collided.
+*
+* @param space the space to modify
+* @param functions_info Pointer to threading functions structure, or NULL
+* to return to serial updates
+* @param threading_impl ID of threading implementation object, or NULL
+* @ingroup collide
+* @see dWorldSetStepThreadingImplementation
+* @see dSpaceRaycastBatch
+*/
+ODE_API void dSpaceSetThreadingImplementation (dSpaceID space, const dThreadingFunctionsInfo *functions_info, dThreadingImplementationID threading_impl);
+
+/**
+* @brief Closest hit of one ray of a @c dSpaceRaycastBatch call.
+* @ingroup collide
+*/
+typedef struct dRaycastHit {
+  dGeomID geom;         ///< the geom hit, or 0 if the ray hit nothing
+  dVector3 pos;         ///< the hit point
+  dVector3 normal;      ///< the surface normal at the hit point
+  dReal distance;       ///< distance of the hit from the ray origin
+  int triangle;         ///< index of the triangle hit on a trimesh, otherwise -1
+} dRaycastHit;
+
+/**
+* @brief Casts a batch of rays into a space and finds their closest hits.
+*
+* This gives the same hits as colliding a closest hit ray geom
+* (see @c dGeomRaySetClosestHit) with every geom of the space and keeping
+* the nearest contact, without creating a ray geom per ray. The rays are
+* processed in packets of neighbouring rays that share one broadphase
+* query, so rays that are next to each other in the arrays should also be
+* close in space (e.g. the beams of one scan line) for best performance.
+* The geoms of child spaces are tested too.
+*
+* If the space has a threading implementation assigned with
+* @c dSpaceSetThreadingImplementation, the ray tests are split across its
+* threads. The threads must have the collision data allocated
+* (@c dAllocateFlagCollisionData), and trimesh ray callbacks are then
+* called on them. Heightfields, user classes and, in builds without TLS
+* support, trimeshes are tested by one thread at a time.
+*
+* @param space the space to cast the rays into
+* @param count number of rays
+* @param origins ray origins, three values (x, y, z) per ray
+* @param directions ray directions, three values per ray; they need not
+* be normalized. A zero direction never hits.
+* @param lengths maximum length of each ray
+* @param collide_bits only geoms with category bits matching these are hit
+* @param hits the closest hit of each ray is written here; a ray that
+* hits nothing gets a zero @c geom and its length as @c distance
+* @returns the number of rays that hit something
+* @ingroup collide
+* @see dSpaceCollide2
+*/
+ODE_API int dSpaceRaycastBatch (dSpaceID space, int count,
+    const dReal *origins, const dReal *directions, const dReal *lengths,
+    unsigned long collide_bits, dRaycastHit *hits);
+
 ODE_API void dSpaceAdd (dSpaceID, dGeomID);
 ODE_API void dSpaceRemove (dSpaceID, dGeomID);
 ODE_API int dSpaceQuery (dSpaceID, dGeomID);
@@ -161,6 +252,7 @@ ODE_API dGeomID dSpaceGetGeom (dSpaceID, int i);
  *  @li dHashSpaceClass
  *  @li dSweepAndPruneSpaceClass
  *  @li dQuadTreeSpaceClass
+ *  @li dOctreeSpaceClass
  *  @li dFirstUserClass
  *  @li dLastUserClass
  *
@@ -163,11 +163,20 @@ ODE_API int dGeomTriMeshIsTCEnabled(dGeomID g, int geomClass);
 /*
  * Clears the internal temporal coherence caches. When a geom has its
  * collision checked with a trimesh once, data is stored inside the trimesh.
- * With large worlds with lots of seperate objects this list could get huge.
- * We should be able to do this automagically.
+ * The entries of geoms that stop colliding are dropped automatically (see
+ * below), this clears all of them at once.
  */
 ODE_API void dGeomTriMeshClearTCCache(dGeomID g);
 
+/*
+ * Sets after how many generations without a collision the temporal
+ * coherence cache entry of a geom is dropped. A generation passes when a
+ * cache has been used as many times as it has entries, i.e. roughly once
+ * per collision frame. The default is 8.
+ */
+ODE_API void dGeomTriMeshSetTCCacheMaxAge(dGeomID g, int maxAge);
+ODE_API int dGeomTriMeshGetTCCacheMaxAge(dGeomID g);
+
 
 /*
  * returns the TriMeshDataID
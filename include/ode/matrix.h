@@ -187,6 +187,29 @@ ODE_API void dLDLTRemove (dReal **A, const int *p, dReal *L, dReal *d,
 ODE_API void dRemoveRowCol (dReal *A, int n, int nskip, int r);
 
 
+/* instruction set levels the dense kernels (dDot, dSolveL1, dFactorLDLT and
+ * the functions built upon them, including the "big matrix" LCP solver) can
+ * use. the best level the CPU supports is selected automatically.
+ */
+enum dMatrixKernelsLevel {
+  dMatrixKernelsScalar = 0,
+  dMatrixKernelsSSE2,
+  dMatrixKernelsAVX
+};
+
+/* get the instruction set level currently used by the dense kernels. */
+ODE_API int dGetMatrixKernelsLevel (void);
+
+/* limit the instruction set level used by the dense kernels. the level is
+ * further reduced to what the CPU supports and the actually selected level
+ * is returned. the vectorized kernels sum products in a different order than
+ * the scalar ones, so selecting dMatrixKernelsScalar makes the results
+ * reproducible across machines. the function is not thread safe and should be
+ * called before any simulation starts.
+ */
+ODE_API int dSetMatrixKernelsLevel (int level);
+
+
 #if defined(__ODE__)
 
 void _dSetZero (dReal *a, size_t n);
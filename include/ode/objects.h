@@ -330,6 +330,182 @@ typedef struct
 */
 ODE_API int dWorldSetStepMemoryManager(dWorldID w, const dWorldStepMemoryFunctionsInfo *memfuncs);
 
+/**
+* @struct dWorldObjectMemoryFunctionsInfo
+* @brief World object memory manager descriptor structure
+*
+* This structure is intended to define the functions of memory manager to be used
+* for bodies and joints (except for joints allocated in joint groups) of a world.
+*
+* @c struct_size should be assigned the size of the structure
+*
+* @c alloc_block is a function to allocate memory block of given size.
+*
+* @c free_block is a function to delete existing memory block. It is always
+* passed the same size the block has been allocated with.
+*
+* @ingroup world
+* @see dWorldSetObjectMemoryManager
+*/
+typedef struct
+{
+  unsigned struct_size;
+  void *(*alloc_block)(size_t block_size);
+  void (*free_block)(void *block_pointer, size_t block_size);
+
+} dWorldObjectMemoryFunctionsInfo;
+
+/**
+* @brief Set memory manager for bodies and joints of the world
+*
+* By default, bodies and joints are allocated from library internal size-class
+* pools which are shared among all the worlds and are backed with @c dAlloc/@c dFree.
+* The function allows to direct these allocations of a particular world into
+* user provided functions (e.g. a per-world arena or a per-thread pool).
+*
+* Passing @a memfuncs argument as NULL results in memory manager being
+* reset to default one as if the world has been just created. The content of
+* @a memfuncs structure is copied internally and does not need to remain valid
+* after the call returns.
+*
+* Memory manager can only be changed while the world contains no bodies and no joints.
+* Otherwise the call fails.
+*
+* @param w The world to change object memory manager for.
+* @param memfuncs Null or a pointer to memory manager descriptor structure.
+* @returns 1 for success and 0 for failure.
+*
+* @ingroup world
+*/
+ODE_API int dWorldSetObjectMemoryManager(dWorldID w, const dWorldObjectMemoryFunctionsInfo *memfuncs);
+
+/**
+* @brief Phases of a world step timed by the step statistics
+*
+* @c dStepPhaseAutoDisable and @c dStepPhaseIslandBuild are executed serially
+* before the islands are stepped. The remaining phases are executed for every
+* island and their times are summed over all the islands and all the threads.
+*
+* @ingroup world
+* @see dWorldGetStepStats
+*/
+enum {
+  dStepPhaseAutoDisable = 0,  /* auto-disabling of bodies */
+  dStepPhaseIslandBuild,      /* island search and stepper memory estimation */
+  dStepPhaseAssembly,         /* inertia, Jacobian, system matrix and right hand side */
+  dStepPhaseSolve,            /* LCP/SOR solution and constraint forces */
+  dStepPhaseIntegration,      /* velocity and position update */
+
+  dStepPhase__MAX
+};
+
+/* Maximal number of threads per-thread statistics are reported for */
+#define dWORLDSTEPSTATS_MAX_THREADS 32
+
+/**
+* @struct dWorldStepThreadStats
+* @brief Island stepping statistics of a single thread
+*
+* @c busy_time is the time the thread spent in the stepper and @c idle_time is
+* the remainder of @c islands_time of the step. Times are in seconds.
+*
+* @ingroup world
+* @see dWorldStepStats
+*/
+typedef struct
+{
+  double busy_time;
+  double idle_time;
+  unsigned island_count;
+
+} dWorldStepThreadStats;
+
+/**
+* @struct dWorldStepStats
+* @brief Statistics of the last step of a world
+*
+* @c struct_size should be assigned the size of the structure by the caller.
+*
+* The times are in seconds and nest as follows. @c step_time is the total
+* time of the @c dWorldStep/@c dWorldQuickStep call. It includes the serial
+* phases (see @c phase_time), the memory reallocations and @c islands_time, which is
+* the time elapsed from start to end of parallel island processing. Each
+* thread's @c busy_time is a part of @c islands_time and the per-island
+* phase times add up to the sum of all threads' busy times.
+*
+* @c body_count and @c joint_count are the numbers of objects stepped in all
+* the islands. @c constraint_rows is the total number of constraint rows and
+* @c solver_iterations is the total number of SOR iterations executed (for
+* @c dWorldStep, which uses a direct LCP solver, the latter is always zero).
+*
+* @c thread_count is the number of threads islands were stepped with. Only
+* first @c dWORLDSTEPSTATS_MAX_THREADS of them are reported in @c threads.
+*
+* @ingroup world
+* @see dWorldGetStepStats
+*/
+typedef struct
+{
+  unsigned struct_size;
+
+  double step_time;
+  double islands_time;
+  double phase_time[dStepPhase__MAX];
+
+  unsigned island_count;
+  unsigned max_island_bodies;
+  unsigned max_island_joints;
+  unsigned body_count;
+  unsigned joint_count;
+  unsigned constraint_rows;
+  unsigned solver_iterations;
+
+  unsigned thread_count;
+  dWorldStepThreadStats threads[dWORLDSTEPSTATS_MAX_THREADS];
+
+} dWorldStepStats;
+
+/**
+* @brief Enable or disable collection of step statistics for a world
+*
+* When enabled, every @c dWorldStep and @c dWorldQuickStep call records phase
+* timings and island, row and thread statistics for the world. The overhead is a
+* few clock readings per island and is intended to be low enough for
+* the statistics to be left on in production builds.
+*
+* Collection is disabled by default. Disabling it releases the memory used.
+*
+* @param w The world to change statistics collection for.
+* @param enabled Non-zero to enable and zero to disable the collection.
+* @returns 1 for success and 0 for memory allocation failure.
+*
+* @ingroup world
+* @see dWorldGetStepStats
+*/
+ODE_API int dWorldSetStepStatsEnabled(dWorldID w, int enabled);
+
+/**
+* @brief Get whether step statistics are collected for a world
+* @ingroup world
+* @see dWorldSetStepStatsEnabled
+*/
+ODE_API int dWorldGetStepStatsEnabled(dWorldID w);
+
+/**
+* @brief Retrieve statistics of the last successful step of a world
+*
+* The structure is filled up to the size given in its @c struct_size field.
+*
+* @param w The world to query.
+* @param stats Pointer to structure to receive the statistics.
+* @returns 1 if statistics are available and 0 if the collection is disabled
+* or no successful step has been made since it was enabled.
+*
+* @ingroup world
+* @see dWorldSetStepStatsEnabled
+*/
+ODE_API int dWorldGetStepStats(dWorldID w, dWorldStepStats *stats);
+
 /**
  * @brief Assign threading implementation to be used for [quick]stepping the world.
  *
@@ -366,6 +542,29 @@ ODE_API void dWorldSetStepThreadingImplementation(dWorldID w, const dThreadingFu
  */
 ODE_API int dWorldStep (dWorldID w, dReal stepsize);
 
+/**
+ * @brief Step the world using a sparse factorization.
+ *
+ * This solves the same problem with the same accuracy as dWorldStep(), but
+ * the bilateral rows of the joints (other than contacts) are factorized with
+ * a block sparse LDL^T that follows the structure of the articulation. Only
+ * the remaining rows (contacts, limits and motors) go to the "big matrix" LCP
+ * solver, so both time and memory grow with the square or cube of their count
+ * alone. For large articulations with few contacts this is much faster than
+ * dWorldStep(); for islands consisting of contacts only it offers no gain.
+ *
+ * Failure result status means that the memory allocation has failed for operation.
+ * In such a case all the objects remain in unchanged state and simulation can be
+ * retried as soon as more memory is available.
+ *
+ * @param w The world to be stepped
+ * @param stepsize The number of seconds that the simulation has to advance.
+ * @returns 1 for success and 0 for failure
+ *
+ * @ingroup world
+ */
+ODE_API int dWorldSparseStep (dWorldID w, dReal stepsize);
+
 /**
  * @brief Quick-step the world.
  *
@@ -410,6 +609,111 @@ ODE_API int dWorldStep (dWorldID w, dReal stepsize);
 ODE_API int dWorldQuickStep (dWorldID w, dReal stepsize);
 
 
+/**
+ * @brief Get the buffer size needed to save the world state.
+ * @ingroup world
+ * @remarks
+ * The size depends on the number of bodies and joints in the world and
+ * on the bodies' auto-disable average sample counts.
+ * @sa dWorldSaveState()
+ */
+ODE_API size_t dWorldGetStateSize (dWorldID w);
+
+/**
+ * @brief Save the dynamic state of the world into a buffer.
+ * @ingroup world
+ * @remarks
+ * The state covers the positions, orientations and velocities of all
+ * bodies, their accumulated forces and torques, their enabled state and
+ * auto-disable counters and samples, the constraint forces (lambda) of all
+ * joints from the last step and the random seed used to order the
+ * constraints in dWorldQuickStep(). The buffer holds plain data and may be
+ * copied around freely.
+ *
+ * Object configuration (masses, joint parameters, world parameters) is not
+ * part of the state. Geoms follow their bodies.
+ *
+ * @param w The world to save
+ * @param buffer Destination, at least dWorldGetStateSize() bytes
+ * @param buffer_size The size of the buffer
+ * @returns The number of bytes written, or 0 if the buffer is too small
+ * @sa dWorldRestoreState()
+ */
+ODE_API size_t dWorldSaveState (dWorldID w, void *buffer, size_t buffer_size);
+
+/**
+ * @brief Restore the world state saved by dWorldSaveState().
+ * @ingroup world
+ * @remarks
+ * The world must contain the same bodies and joints, in the same order of
+ * creation, as when the state was saved; joints created after the save
+ * (e.g. contacts) must be removed first. After a restore, stepping the
+ * world with the same inputs reproduces the original steps bit by bit.
+ *
+ * @returns 1 on success, 0 if the state does not match the world, in
+ * which case the world is left unchanged.
+ */
+ODE_API int dWorldRestoreState (dWorldID w, const void *buffer, size_t buffer_size);
+
+
+/**
+ * @brief Body state fields for dWorldGetBodyStates() and dWorldSetBodyStates().
+ *
+ * A record holds the selected fields in the order listed here.
+ * @ingroup world
+ */
+enum {
+  dBodyStatePosition    = 0x01,  /**< position, 3 dReals */
+  dBodyStateQuaternion  = 0x02,  /**< orientation quaternion, 4 dReals */
+  dBodyStateRotation    = 0x04,  /**< rotation matrix, 12 dReals (dMatrix3 layout) */
+  dBodyStateLinearVel   = 0x08,  /**< linear velocity, 3 dReals */
+  dBodyStateAngularVel  = 0x10,  /**< angular velocity, 3 dReals */
+
+  dBodyStateChangedOnly = 0x100  /**< dWorldGetBodyStates() filter, see there */
+};
+
+/**
+ * @brief Get the number of dReals in a body state record with the given fields.
+ * @ingroup world
+ */
+ODE_API int dBodyStateRecordSize (unsigned fields);
+
+/**
+ * @brief Copy the state of many bodies into an array of records.
+ * @ingroup world
+ * @param w The world the bodies belong to
+ * @param bodies The bodies to report, or NULL for all bodies of the world
+ * (most recently created first)
+ * @param count The number of bodies in @a bodies, or, if @a bodies is NULL,
+ * the maximal number of records to write
+ * @param fields The dBodyStateXXX fields to copy. With dBodyStateChangedOnly
+ * only the bodies that have moved or had their state set since they were
+ * last reported with this flag are written.
+ * @param states The destination array
+ * @param stride The distance between records in dReals, at least
+ * dBodyStateRecordSize(fields)
+ * @param indices Optional; receives for each written record the index of
+ * its body in @a bodies (or in the world order if @a bodies is NULL).
+ * @returns The number of records written.
+ */
+ODE_API int dWorldGetBodyStates (dWorldID w, const dBodyID *bodies, int count, unsigned fields,
+                                 dReal *states, int stride, int *indices);
+
+/**
+ * @brief Set the state of many bodies from an array of records.
+ * @ingroup world
+ * @remarks
+ * Each field is applied like the matching dBodySetXXX() function. If both
+ * the quaternion and the rotation are given, the rotation wins.
+ * @param bodies The bodies to update, or NULL for the bodies of the world in
+ * the order dWorldGetBodyStates() reports them
+ * @param count The number of records
+ * @sa dWorldGetBodyStates()
+ */
+ODE_API void dWorldSetBodyStates (dWorldID w, const dBodyID *bodies, int count, unsigned fields,
+                                  const dReal *states, int stride);
+
+
 /**
 * @brief Converts an impulse to a force.
 * @ingroup world
@@ -465,6 +769,99 @@ ODE_API void dWorldSetQuickStepW (dWorldID, dReal over_relaxation);
  */
 ODE_API dReal dWorldGetQuickStepW (dWorldID);
 
+/* QuickStep solvers */
+enum {
+  dQuickStepSOR = 0,          /* rows are relaxed one at a time (default) */
+  dQuickStepBlockContacts,    /* contact rows are relaxed a contact at a time */
+  dQuickStepPGSCG             /* SOR sweeps refined with conjugate gradients */
+};
+
+/**
+ * @brief Set the solver the QuickStep method uses for the constraint forces.
+ * @ingroup world
+ * @remarks
+ * With @c dQuickStepBlockContacts the normal row of a contact and its
+ * friction rows (when the friction bounds follow the normal force, as with
+ * @c dContactApprox1) are solved together with a small direct solve and
+ * then projected onto the friction box, rather than relaxed as independent
+ * scalars. Friction generally converges in fewer iterations that way, which
+ * keeps resting contacts from creeping with fewer iterations. The
+ * over-relaxation parameter is not applied to the contact blocks. All other
+ * rows are solved as usual.
+ *
+ * @c dQuickStepPGSCG spends the first half of the iterations on the usual
+ * sweeps and the rest on conjugate gradient iterations (with a Jacobi
+ * preconditioner) over the bilateral rows, those without limits, stopping
+ * early once those have converged. Contacts and other rows with limits keep
+ * the values the sweeps found. This suits articulated bodies, such as long
+ * chains, whose rows are mostly bilateral and converge very slowly with
+ * sweeps alone.
+ * @param solver @c dQuickStepSOR (the default), @c dQuickStepBlockContacts
+ *        or @c dQuickStepPGSCG
+ */
+ODE_API void dWorldSetQuickStepSolver (dWorldID, int solver);
+
+/**
+ * @brief Get the solver the QuickStep method uses.
+ * @ingroup world
+ * @return @c dQuickStepSOR, @c dQuickStepBlockContacts or @c dQuickStepPGSCG
+ */
+ODE_API int dWorldGetQuickStepSolver (dWorldID);
+
+/* QuickStep row orders */
+enum {
+  dQuickStepRowsShuffled = 0, /* rows are reshuffled every few sweeps (default) */
+  dQuickStepRowsByBody        /* rows are grouped by body, shuffled only locally */
+};
+
+/**
+ * @brief Set the order in which the QuickStep method sweeps the constraint rows.
+ * @ingroup world
+ * @remarks
+ * By default the rows are reshuffled as a whole every eight sweeps, which
+ * makes every sweep visit the rows and the bodies they act on in random
+ * order. With @c dQuickStepRowsByBody the rows are instead rearranged once
+ * per step, visiting the bodies breadth first over the joints connecting
+ * them, so that rows acting on the same or neighbouring bodies are solved
+ * next to each other, and are only shuffled within small windows. This
+ * takes some more memory per step, but in large islands the sweeps then run
+ * through memory mostly in order.
+ * @param order @c dQuickStepRowsShuffled (the default) or @c dQuickStepRowsByBody
+ */
+ODE_API void dWorldSetQuickStepRowOrder (dWorldID, int order);
+
+/**
+ * @brief Get the order in which the QuickStep method sweeps the constraint rows.
+ * @ingroup world
+ * @return @c dQuickStepRowsShuffled or @c dQuickStepRowsByBody
+ */
+ODE_API int dWorldGetQuickStepRowOrder (dWorldID);
+
+/**
+ * @brief Enable or disable the QuickStep mixed precision mode.
+ * @ingroup world
+ * @remarks
+ * In double precision builds the QuickStep sweeps can hold and iterate the
+ * constraint rows in float, which halves the memory they go through on
+ * each sweep. The right hand side, the constraint forces applied to the
+ * bodies and the integration stay in double: the forces are computed in
+ * double from the multipliers the float sweeps leave. The multipliers are
+ * accurate to about the float precision of the row data, which is
+ * normally far below the error left by the limited number of iterations.
+ * The @c dQuickStepPGSCG refinement runs in double after the float sweeps.
+ * In single precision builds the setting has no effect.
+ * @param enabled 0 (the default) to iterate in the precision of dReal,
+ *        1 to iterate in float
+ */
+ODE_API void dWorldSetQuickStepMixedPrecision (dWorldID, int enabled);
+
+/**
+ * @brief Get whether the QuickStep mixed precision mode is enabled.
+ * @ingroup world
+ * @return 1 if the sweeps iterate in float, 0 otherwise
+ */
+ODE_API int dWorldGetQuickStepMixedPrecision (dWorldID);
+
 /* World contact parameter functions */
 
 /**
@@ -504,6 +901,24 @@ ODE_API void dWorldSetContactSurfaceLayer (dWorldID, dReal depth);
  */
 ODE_API dReal dWorldGetContactSurfaceLayer (dWorldID);
 
+/**
+ * @brief Set the time span the geoms of CCD enabled bodies are swept over.
+ * @ingroup world
+ * @param stepsize The default value is zero (no sweeping).
+ * @remarks
+ * Every dWorldStep(), dWorldQuickStep() and dWorldSparseStep() call stores
+ * its step size here, so it only needs to be set before the first step
+ * or when the next step size differs from the last one.
+ * @sa dBodySetCCDMode()
+ */
+ODE_API void dWorldSetCCDStepSize (dWorldID, dReal stepsize);
+
+/**
+ * @brief Get the time span the geoms of CCD enabled bodies are swept over.
+ * @ingroup world
+ */
+ODE_API dReal dWorldGetCCDStepSize (dWorldID);
+
 
 /**
  * @defgroup disable Automatic Enabling and Disabling
@@ -535,8 +950,36 @@ ODE_API dReal dWorldGetContactSurfaceLayer (dWorldID);
  * average samples count.
  *
  * Newly created bodies get these parameters from world.
+ *
+ * With the island auto-disable mode, a body is idle when its instantaneous
+ * velocities are below the average velocity thresholds and the velocity
+ * samples are not collected. An island is disabled as a whole once all of its
+ * bodies have been idle for long enough, and enabling any of its bodies
+ * enables all of them again, even if the joints connecting them (e.g. the
+ * contacts) are gone by then. Bodies with a zero average samples count or
+ * the auto-disable flag off keep their islands enabled.
  */
 
+/* Auto-disable modes */
+enum {
+  dAutoDisableBodies = 0,     /* bodies are disabled one by one (default) */
+  dAutoDisableIslands         /* islands are disabled as a whole */
+};
+
+/**
+ * @brief Set how the world decides what to auto-disable.
+ * @ingroup disable
+ * @param mode @c dAutoDisableBodies (the default) or @c dAutoDisableIslands
+ */
+ODE_API void dWorldSetAutoDisableMode (dWorldID, int mode);
+
+/**
+ * @brief Get the auto-disable mode of the world.
+ * @ingroup disable
+ * @return @c dAutoDisableBodies or @c dAutoDisableIslands
+ */
+ODE_API int dWorldGetAutoDisableMode (dWorldID);
+
 /**
  * @brief Get auto disable linear threshold for newly created bodies.
  * @ingroup disable
@@ -1516,6 +1959,36 @@ ODE_API int dBodyGetGyroscopicMode(dBodyID b);
 ODE_API void dBodySetGyroscopicMode(dBodyID b, int enabled);
 
 
+/**
+ * @brief Get the body's continuous collision detection state.
+ *
+ * @return nonzero if CCD is enabled, zero otherwise (default).
+ * @ingroup bodies
+ */
+ODE_API int dBodyGetCCDMode(dBodyID b);
+
+
+/**
+ * @brief Enable/disable continuous collision detection for the body.
+ *
+ * The AABBs of the body's geoms are swept by the linear velocity over
+ * the world's CCD step size, so that spaces report pairs the body will
+ * reach during the step. If such a pair does not touch at the current
+ * poses, dCollide() tests it again at poses sampled along the sweep and
+ * returns speculative contacts with negative depth (the remaining gap).
+ * Contact joints made from them only stop the bodies from closing more
+ * than the gap within the step, which keeps fast bodies from tunneling
+ * through thin geoms without raising the step rate.
+ *
+ * Only the linear motion is swept; rays are never swept.
+ *
+ * @param enabled   nonzero to enable CCD, 0 (default) to disable.
+ * @sa dWorldSetCCDStepSize()
+ * @ingroup bodies
+ */
+ODE_API void dBodySetCCDMode(dBodyID b, int enabled);
+
+
 
 
 /**
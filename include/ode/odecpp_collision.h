@@ -220,6 +220,21 @@ public:
 };
 
 
+class dOctreeSpace : public dSpace {
+  // intentionally undefined, don't use these
+  dOctreeSpace (dOctreeSpace &);
+  void operator= (dOctreeSpace &);
+
+public:
+  dOctreeSpace (const dVector3 center, const dVector3 extents, int depth)
+    { _id = (dGeomID) dOctreeSpaceCreate (0,center,extents,depth); }
+  dOctreeSpace (dSpace &space, const dVector3 center, const dVector3 extents, int depth)
+    { _id = (dGeomID) dOctreeSpaceCreate (space.id(),center,extents,depth); }
+  dOctreeSpace (dSpaceID space, const dVector3 center, const dVector3 extents, int depth)
+    { _id = (dGeomID) dOctreeSpaceCreate (space,center,extents,depth); }
+};
+
+
 class dSphere : public dGeom {
   // intentionally undefined, don't use these
   dSphere (dSphere &);
@@ -172,7 +172,8 @@ ODE_API void dExternalThreadingServeMultiThreadedImplementation(dThreadingImplem
  * multi-threaded threading implementations.
  *
  * The threads allocated inherit priority of caller thread. Their affinity is not
- * explicitly adjusted and gets the value the system assigns by default. Threads 
+ * explicitly adjusted and gets the value the system assigns by default 
+ * (see @c dThreadingAllocateThreadPoolWithConfig to assign it). Threads 
  * have their stack memory fully committed immediately on start. On POSIX platforms 
  * threads are started with all the possible signals blocked. Threads execute 
  * calls to @c dAllocateODEDataForThread with @p ode_data_allocate_flags 
@@ -195,6 +196,58 @@ ODE_API void dExternalThreadingServeMultiThreadedImplementation(dThreadingImplem
 ODE_API dThreadingThreadPoolID dThreadingAllocateThreadPool(unsigned thread_count, 
   size_t stack_size, unsigned int ode_data_allocate_flags, void *reserved/*=NULL*/);
 
+/**
+ * @struct dThreadingThreadPoolConfig
+ * @brief Optional configuration of a built-in thread pool.
+ *
+ * @c struct_size should be assigned the size of the structure.
+ *
+ * An idle pool thread serving an implementation normally blocks until a job is
+ * posted, and waking it up takes a system call on each side. With @c spin_count
+ * set, the thread first checks for a wakeup that many times, pausing between
+ * the checks, and blocks only if none came. With @c keep_hot set, the thread
+ * keeps checking and never blocks while serving, which gives the lowest
+ * latency for fixed rate stepping at the cost of fully occupying a processor
+ * per thread (the thread still yields its processor every once in a while).
+ *
+ * If @c cpu_count is not zero, thread @c i of the pool is bound to processor
+ * @c cpu_ids[i % cpu_count]. On platforms without thread affinity support
+ * the assignment is ignored.
+ *
+ * @ingroup threading
+ * @see dThreadingAllocateThreadPoolWithConfig
+ */
+typedef struct
+{
+  unsigned struct_size;
+
+  unsigned spin_count;
+  int keep_hot;
+
+  unsigned cpu_count;
+  const int *cpu_ids;
+
+} dThreadingThreadPoolConfig;
+
+/**
+ * @brief Creates an instance of built-in thread pool with a configuration.
+ *
+ * This is the same as @c dThreadingAllocateThreadPool with the threads
+ * waiting for jobs and placed as @p config tells.
+ *
+ * @param thread_count Number of threads to start in pool
+ * @param stack_size Size of stack to be used for every thread or 0 for system default value
+ * @param ode_data_allocate_flags Flags to be passed to @c dAllocateODEDataForThread on behalf of each thread
+ * @param config Pool configuration, or NULL for the defaults
+ * @returns ID of object allocated or NULL on failure
+ *
+ * @ingroup threading
+ * @see dThreadingAllocateThreadPool
+ * @see dThreadingThreadPoolGetThreadStats
+ */
+ODE_API dThreadingThreadPoolID dThreadingAllocateThreadPoolWithConfig(unsigned thread_count, 
+  size_t stack_size, unsigned int ode_data_allocate_flags, const dThreadingThreadPoolConfig *config);
+
 /**
  * @brief Commands an instance of built-in thread pool to serve a built-in multi-threaded 
  * threading implementation.
@@ -241,6 +294,57 @@ ODE_API void dThreadingThreadPoolServeMultiThreadedImplementation(dThreadingThre
  */
 ODE_API void dThreadingThreadPoolWaitIdleState(dThreadingThreadPoolID pool);
 
+/**
+ * @struct dThreadingThreadPoolThreadStats
+ * @brief Counters of a single pool thread while serving implementations.
+ *
+ * @c busy_time is the time the thread spent picking and running jobs and
+ * @c idle_time is the time it spent waiting for them, spinning or blocked.
+ * Times are in seconds. @c job_count is the number of jobs the thread ran and
+ * @c block_count is the number of times it had to block for a wakeup.
+ *
+ * @ingroup threading
+ * @see dThreadingThreadPoolGetThreadStats
+ */
+typedef struct
+{
+  double busy_time;
+  double idle_time;
+  unsigned long job_count;
+  unsigned long block_count;
+
+} dThreadingThreadPoolThreadStats;
+
+/**
+ * @brief Retrieves the counters of a pool thread.
+ *
+ * The threads update their counters without synchronization, so the values
+ * are only exact while the pool has no jobs to run (e.g. between steps).
+ * The idle time of a thread that is waiting is added when it wakes up.
+ *
+ * @param pool Thread pool ID
+ * @param thread_index Index of the thread in the pool
+ * @param out_stats Structure to receive the counters
+ * @returns 1 on success, 0 if the index is out of range or the pool is not available
+ *
+ * @ingroup threading
+ * @see dThreadingThreadPoolResetThreadStats
+ */
+ODE_API int dThreadingThreadPoolGetThreadStats(dThreadingThreadPoolID pool, unsigned thread_index, 
+  dThreadingThreadPoolThreadStats *out_stats);
+
+/**
+ * @brief Resets the counters of all the pool threads.
+ *
+ * Like reading, resetting is only exact while the pool has no jobs to run.
+ *
+ * @param pool Thread pool ID
+ *
+ * @ingroup threading
+ * @see dThreadingThreadPoolGetThreadStats
+ */
+ODE_API void dThreadingThreadPoolResetThreadStats(dThreadingThreadPoolID pool);
+
 /**
  * @brief Deletes a built-in thread pool instance.
  *
@@ -0,0 +1,138 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001,2002 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+
+/*
+
+Articulation benchmark: steps a long hinge chain hanging from the static
+environment, with every tenth link touching the ground, with dWorldStep and
+dWorldSparseStep and compares both the time and the resulting state.
+Results are printed one line per stepper as key=value pairs.
+
+Usage: bench_articulation [links [steps]]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <ode/ode.h>
+
+
+static void buildChain(dWorldID world, dBodyID *bodies, int links)
+{
+    dWorldSetGravity(world, 0, 0, REAL(-9.81));
+
+    for (int i = 0; i < links; ++i) {
+        dBodyID b = dBodyCreate(world);
+        dMass mass;
+        dMassSetBox(&mass, 1, REAL(0.9), REAL(0.2), REAL(0.2));
+        dBodySetMass(b, &mass);
+        dBodySetPosition(b, REAL(0.5) + i, 0, REAL(0.5));
+        bodies[i] = b;
+
+        dJointID j = dJointCreateHinge(world, 0);
+        dJointAttach(j, b, i != 0 ? bodies[i - 1] : 0);
+        dJointSetHingeAnchor(j, (dReal)i, 0, REAL(0.5));
+        dJointSetHingeAxis(j, 0, 1, 0);
+    }
+}
+
+static double runChain(bool sparse, int links, int steps, dReal *state)
+{
+    dWorldID world = dWorldCreate();
+    dJointGroupID contacts = dJointGroupCreate(0);
+    dBodyID *bodies = (dBodyID *)malloc(links * sizeof(dBodyID));
+    buildChain(world, bodies, links);
+
+    dStopwatch sw;
+    dStopwatchReset(&sw);
+
+    for (int step = 0; step < steps; ++step) {
+        for (int i = 9; i < links; i += 10) {
+            const dReal *pos = dBodyGetPosition(bodies[i]);
+            dContact contact;
+            memset(&contact, 0, sizeof(contact));
+            contact.surface.mode = dContactApprox1;
+            contact.surface.mu = 1;
+            contact.geom.pos[0] = pos[0];
+            contact.geom.pos[1] = pos[1];
+            contact.geom.pos[2] = pos[2] - REAL(0.1);
+            contact.geom.normal[2] = 1;
+            dJointAttach(dJointCreateContact(world, contacts, &contact), bodies[i], 0);
+        }
+
+        dStopwatchStart(&sw);
+        if (sparse) {
+            dWorldSparseStep(world, REAL(0.01));
+        } else {
+            dWorldStep(world, REAL(0.01));
+        }
+        dStopwatchStop(&sw);
+
+        dJointGroupEmpty(contacts);
+    }
+
+    for (int i = 0; i < links; ++i) {
+        memcpy(state + 3 * i, dBodyGetPosition(bodies[i]), 3 * sizeof(dReal));
+    }
+
+    free(bodies);
+    dJointGroupDestroy(contacts);
+    dWorldDestroy(world);
+
+    return dStopwatchTime(&sw);
+}
+
+
+int main(int argc, char **argv)
+{
+    int links = argc > 1 ? atoi(argv[1]) : 120;
+    int steps = argc > 2 ? atoi(argv[2]) : 50;
+
+    dInitODE2(0);
+    dAllocateODEDataForThread(dAllocateMaskAll);
+
+    dReal *state[2];
+    for (int run = 0; run < 2; ++run) {
+        bool sparse = run != 0;
+        state[run] = (dReal *)malloc(3 * links * sizeof(dReal));
+        double seconds = runChain(sparse, links, steps, state[run]);
+
+        double deviation = 0;
+        if (sparse) {
+            for (int i = 0; i < 3 * links; ++i) {
+                double d = fabs((double)(state[1][i] - state[0][i]));
+                if (d > deviation) deviation = d;
+            }
+        }
+
+        printf("bench=articulation stepper=%s links=%d steps=%d seconds=%.6f ms_per_step=%.3f max_deviation=%g\n",
+            sparse ? "sparse" : "step", links, steps, seconds, seconds * 1e3 / steps, deviation);
+    }
+
+    free(state[0]);
+    free(state[1]);
+
+    dCloseODE();
+    return 0;
+}
@@ -0,0 +1,149 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001,2002 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+
+/*
+
+Object churn benchmark: creates and destroys "debris" (bodies with geoms and
+joints) at high rates, the way particle/destruction effects do.
+
+Each frame a batch of bodies is created, every body gets a geom with an
+offset and is tied to its predecessor with a ball joint; then the oldest
+batch is destroyed. Results are printed one line per run as key=value pairs.
+
+The first run passes the world's bodies and joints to malloc() through
+dWorldSetObjectMemoryManager(), the second one leaves them in the pools.
+Geoms and their position records have no such override and come from the
+pools in both runs, so the difference is that of the bodies and joints
+only.
+
+Usage: bench_churn [frames [batch]]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ode/ode.h>
+
+
+static void *mallocAlloc(size_t block_size)
+{
+    return malloc(block_size);
+}
+
+static void mallocFree(void *block_pointer, size_t block_size)
+{
+    (void)block_size;
+    free(block_pointer);
+}
+
+
+struct Debris
+{
+    dBodyID body;
+    dGeomID geom;
+    dJointID joint;
+};
+
+
+static double runChurn(bool use_malloc, int frames, int batch)
+{
+    dWorldID world = dWorldCreate();
+    dSpaceID space = dHashSpaceCreate(0);
+
+    if (use_malloc) {
+        dWorldObjectMemoryFunctionsInfo memfuncs;
+        memfuncs.struct_size = sizeof(memfuncs);
+        memfuncs.alloc_block = &mallocAlloc;
+        memfuncs.free_block = &mallocFree;
+        dWorldSetObjectMemoryManager(world, &memfuncs);
+    }
+
+    // keep two batches alive so that frees interleave with allocations
+    const int live = 2 * batch;
+    Debris *debris = (Debris *)calloc(live, sizeof(Debris));
+
+    dStopwatch sw;
+    dStopwatchReset(&sw);
+    dStopwatchStart(&sw);
+
+    for (int frame = 0; frame < frames; ++frame) {
+        Debris *slot = debris + (frame & 1) * batch;
+
+        for (int i = 0; i < batch; ++i) {
+            Debris &d = slot[i];
+            if (d.body) {
+                dJointDestroy(d.joint);
+                dGeomDestroy(d.geom);
+                dBodyDestroy(d.body);
+            }
+        }
+
+        for (int i = 0; i < batch; ++i) {
+            Debris &d = slot[i];
+            d.body = dBodyCreate(world);
+            dBodySetPosition(d.body, (dReal)i, (dReal)frame, 0);
+            d.geom = (i & 1) ? dCreateSphere(space, REAL(0.5)) : dCreateBox(space, 1, 1, 1);
+            dGeomSetBody(d.geom, d.body);
+            dGeomSetOffsetPosition(d.geom, 0, 0, REAL(0.1));
+            d.joint = dJointCreateBall(world, 0);
+            dJointAttach(d.joint, d.body, i != 0 ? slot[i - 1].body : 0);
+        }
+    }
+
+    dStopwatchStop(&sw);
+
+    for (int i = 0; i < live; ++i) {
+        if (debris[i].body) {
+            dJointDestroy(debris[i].joint);
+            dGeomDestroy(debris[i].geom);
+            dBodyDestroy(debris[i].body);
+        }
+    }
+
+    free(debris);
+    dSpaceDestroy(space);
+    dWorldDestroy(world);
+
+    return dStopwatchTime(&sw);
+}
+
+
+int main(int argc, char **argv)
+{
+    int frames = argc > 1 ? atoi(argv[1]) : 2000;
+    int batch = argc > 2 ? atoi(argv[2]) : 500;
+
+    dInitODE2(0);
+    dAllocateODEDataForThread(dAllocateMaskAll);
+
+    for (int run = 0; run < 2; ++run) {
+        bool use_malloc = run == 0;
+        double seconds = runChurn(use_malloc, frames, batch);
+        double objects = (double)frames * batch;
+
+        printf("bench=churn bodies_joints_alloc=%s geoms_alloc=pool frames=%d batch=%d seconds=%.6f ns_per_debris=%.1f\n",
+            use_malloc ? "malloc" : "pool", frames, batch, seconds, seconds * 1e9 / objects);
+    }
+
+    dCloseODE();
+    return 0;
+}
@@ -0,0 +1,109 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001,2002 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+
+/*
+
+Geom-vs-space query benchmark: fills a space with static boxes scattered
+over a flat area and runs dSpaceCollide2() for short rays and small
+spheres placed at random, the way sensor and line of sight queries do.
+Results are printed one line per space kind as key=value pairs.
+
+Usage: bench_collide2 [geoms [queries]]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ode/ode.h>
+
+
+static void countCandidates(void *data, dGeomID o1, dGeomID o2)
+{
+    ++*(long *)data;
+}
+
+static double runQueries(dSpaceID space, int geoms, int queries, long *candidates)
+{
+    dReal extent = dSqrt((dReal)geoms) * 2;
+
+    dRandSetSeed(1);
+    for (int i = 0; i < geoms; ++i) {
+        dGeomID box = dCreateBox(space, 1, 1, 1);
+        dGeomSetPosition(box, (dRandReal() - REAL(0.5)) * extent,
+            (dRandReal() - REAL(0.5)) * extent, dRandReal() * 4);
+    }
+
+    dGeomID ray = dCreateRay(0, 10);
+    dGeomID sphere = dCreateSphere(0, 2);
+
+    dStopwatch sw;
+    dStopwatchReset(&sw);
+    dStopwatchStart(&sw);
+
+    *candidates = 0;
+    for (int q = 0; q < queries; ++q) {
+        dReal x = (dRandReal() - REAL(0.5)) * extent;
+        dReal y = (dRandReal() - REAL(0.5)) * extent;
+        dGeomRaySet(ray, x, y, 2, dRandReal() - REAL(0.5), dRandReal() - REAL(0.5), 0);
+        dSpaceCollide2(ray, (dGeomID)space, candidates, &countCandidates);
+        dGeomSetPosition(sphere, y, x, 2);
+        dSpaceCollide2(sphere, (dGeomID)space, candidates, &countCandidates);
+    }
+
+    dStopwatchStop(&sw);
+
+    dGeomDestroy(sphere);
+    dGeomDestroy(ray);
+    return dStopwatchTime(&sw);
+}
+
+
+int main(int argc, char **argv)
+{
+    int geoms = argc > 1 ? atoi(argv[1]) : 100000;
+    int queries = argc > 2 ? atoi(argv[2]) : 1000;
+
+    dInitODE2(0);
+    dAllocateODEDataForThread(dAllocateMaskAll);
+
+    // the octree starts with a region covering the scattered boxes
+    dReal half = dSqrt((dReal)geoms);
+    dVector3 center = { 0, 0, 0 }, extents = { half, half, half };
+
+    const char *names[4] = { "simple", "hash", "sap", "octree" };
+    for (int kind = 0; kind < 4; ++kind) {
+        dSpaceID space = kind == 0 ? dSimpleSpaceCreate(0)
+            : kind == 1 ? dHashSpaceCreate(0)
+            : kind == 2 ? dSweepAndPruneSpaceCreate(0, dSAP_AXES_XYZ)
+            : dOctreeSpaceCreate(0, center, extents, 8);
+
+        long candidates;
+        double seconds = runQueries(space, geoms, queries, &candidates);
+        dSpaceDestroy(space);
+
+        printf("bench=collide2 space=%s geoms=%d queries=%d seconds=%.6f us_per_query=%.3f candidates=%ld\n",
+            names[kind], geoms, queries, seconds, seconds * 1e6 / (2 * queries), candidates);
+    }
+
+    dCloseODE();
+    return 0;
+}
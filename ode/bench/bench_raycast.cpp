@@ -0,0 +1,169 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001,2002 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+
+/*
+
+Lidar benchmark: a hash space with a trimesh terrain and scattered boxes is
+scanned from its center by a spinning sensor, once with a closest hit ray
+geom per beam through dSpaceCollide2() and once with dSpaceRaycastBatch(),
+optionally with a thread pool. Results are printed one line per method as
+key=value pairs.
+
+Usage: bench_raycast [boxes [beams [threads]]]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <ode/ode.h>
+
+
+struct ClosestHit {
+    dGeomID ray;
+    dReal depth;
+    int hits;
+};
+
+static void closestHitCallback(void *data, dGeomID o1, dGeomID o2)
+{
+    ClosestHit *closest = (ClosestHit *)data;
+    if (dGeomIsSpace(o2)) {
+        dSpaceCollide2(o1, o2, data, &closestHitCallback);
+        return;
+    }
+
+    dContactGeom c;
+    if (dCollide(closest->ray, o2, 1, &c, sizeof(c)) && c.depth < closest->depth) {
+        closest->depth = c.depth;
+        closest->hits = 1;
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    int boxes = argc > 1 ? atoi(argv[1]) : 10000;
+    int beams = argc > 2 ? atoi(argv[2]) : 100000;
+    int threads = argc > 3 ? atoi(argv[3]) : 0;
+
+    dInitODE2(0);
+    dAllocateODEDataForThread(dAllocateMaskAll);
+
+    // a 64x64 cell terrain, 4 units per cell
+    const int N = 64;
+    std::vector<float> vertices;
+    std::vector<dTriIndex> indices;
+    for (int y = 0; y <= N; ++y) {
+        for (int x = 0; x <= N; ++x) {
+            vertices.push_back((float)(x - N / 2) * 4);
+            vertices.push_back((float)(y - N / 2) * 4);
+            vertices.push_back((float)((x * 7 + y * 3) % 5) * 0.2f);
+        }
+    }
+    for (int y = 0; y < N; ++y) {
+        for (int x = 0; x < N; ++x) {
+            dTriIndex i0 = y * (N + 1) + x;
+            dTriIndex triangles[6] = { i0, i0 + 1, i0 + N + 2, i0, i0 + N + 2, i0 + N + 1 };
+            indices.insert(indices.end(), triangles, triangles + 6);
+        }
+    }
+    dTriMeshDataID data = dGeomTriMeshDataCreate();
+    dGeomTriMeshDataBuildSingle(data, &vertices[0], 3 * sizeof(float), (int)vertices.size() / 3,
+        &indices[0], (int)indices.size(), 3 * sizeof(dTriIndex));
+
+    dSpaceID space = dHashSpaceCreate(0);
+    dCreateTriMesh(space, data, 0, 0, 0);
+    dRandSetSeed(1);
+    for (int i = 0; i < boxes; ++i) {
+        dGeomID box = dCreateBox(space, 1, 1, 2);
+        dGeomSetPosition(box, (dRandReal() - REAL(0.5)) * N * 4, (dRandReal() - REAL(0.5)) * N * 4, 2);
+    }
+
+    // 64 scan lines from 15 degrees up to 30 degrees down, 100 m range
+    std::vector<dReal> origins(beams * 3), dirs(beams * 3), lengths(beams, 100);
+    const int lines = 64;
+    int perLine = (beams + lines - 1) / lines;
+    for (int i = 0; i < beams; ++i) {
+        dReal azimuth = (dReal)(i % perLine) * 2 * (dReal)M_PI / perLine;
+        dReal elevation = REAL(0.26) - (dReal)(i / perLine) * REAL(0.78) / lines;
+        origins[i * 3 + 0] = 0;
+        origins[i * 3 + 1] = 0;
+        origins[i * 3 + 2] = 3;
+        dirs[i * 3 + 0] = dCos(azimuth) * dCos(elevation);
+        dirs[i * 3 + 1] = dSin(azimuth) * dCos(elevation);
+        dirs[i * 3 + 2] = dSin(elevation);
+    }
+
+    dStopwatch sw;
+    dStopwatchReset(&sw);
+    dStopwatchStart(&sw);
+
+    ClosestHit closest;
+    closest.ray = dCreateRay(0, 100);
+    dGeomRaySetClosestHit(closest.ray, 1);
+    int singleHits = 0;
+    for (int i = 0; i < beams; ++i) {
+        dGeomRaySet(closest.ray, origins[i * 3], origins[i * 3 + 1], origins[i * 3 + 2],
+            dirs[i * 3], dirs[i * 3 + 1], dirs[i * 3 + 2]);
+        closest.depth = lengths[i];
+        closest.hits = 0;
+        dSpaceCollide2(closest.ray, (dGeomID)space, &closest, &closestHitCallback);
+        singleHits += closest.hits;
+    }
+    dGeomDestroy(closest.ray);
+
+    dStopwatchStop(&sw);
+    double seconds = dStopwatchTime(&sw);
+    printf("bench=raycast method=single boxes=%d beams=%d seconds=%.6f us_per_ray=%.3f hits=%d\n",
+        boxes, beams, seconds, seconds * 1e6 / beams, singleHits);
+
+    dThreadingImplementationID threading = NULL;
+    dThreadingThreadPoolID pool = NULL;
+    if (threads > 1) {
+        threading = dThreadingAllocateMultiThreadedImplementation();
+        pool = dThreadingAllocateThreadPool(threads, 0, dAllocateFlagCollisionData, NULL);
+        dThreadingThreadPoolServeMultiThreadedImplementation(pool, threading);
+        dSpaceSetThreadingImplementation(space, dThreadingImplementationGetFunctions(threading), threading);
+    }
+
+    std::vector<dRaycastHit> hits(beams);
+    dStopwatchReset(&sw);
+    dStopwatchStart(&sw);
+    int batchHits = dSpaceRaycastBatch(space, beams, &origins[0], &dirs[0], &lengths[0], ~0ul, &hits[0]);
+    dStopwatchStop(&sw);
+    seconds = dStopwatchTime(&sw);
+    printf("bench=raycast method=batch threads=%d boxes=%d beams=%d seconds=%.6f us_per_ray=%.3f hits=%d\n",
+        threads > 1 ? threads : 1, boxes, beams, seconds, seconds * 1e6 / beams, batchHits);
+
+    if (threading) {
+        dSpaceSetThreadingImplementation(space, NULL, NULL);
+        dThreadingImplementationShutdownProcessing(threading);
+        dThreadingFreeThreadPool(pool);
+        dThreadingFreeImplementation(threading);
+    }
+
+    dSpaceDestroy(space);
+    dGeomTriMeshDataDestroy(data);
+    dCloseODE();
+    return 0;
+}
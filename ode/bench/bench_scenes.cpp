@@ -0,0 +1,729 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001,2002 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+
+/*
+
+Scene benchmark: headless versions of the demo scenes (boxstack, crash,
+space_stress, trimesh, heightfield, cards, chain and basket), built at
+several scales and stepped for a number of frames with dWorldQuickStep and
+dWorldStep in every kind of space. Each run starts from the same random
+seed, so runs of the same build are reproducible.
+
+Results are printed one line per run as key=value pairs: the time per frame
+spent in collision detection and in each phase of the step (from the step
+statistics), the contacts, constraint rows and islands per frame and the
+high-water mark of the step working memory. The trimesh and basket scenes
+are reported as skipped when the library is built without trimeshes, and
+crash and cards are run with dWorldQuickStep only.
+
+Usage: bench_scenes [frames [scene [max_scale [stepper [space]]]]]
+
+The scales run are 1, 2, 4... up to max_scale (4 by default). scene,
+stepper and space default to "all"; the steppers are "quick" and "step" and
+the spaces "simple", "hash", "sap", "quadtree" and "octree".
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <ode/ode.h>
+#include "../demo/basket_geom.h"
+
+
+#define MAX_CONTACTS 8
+#define DENSITY REAL(5.0)
+
+
+// the step working memory in use and its high-water mark
+static size_t g_stepMemoryInUse = 0;
+static size_t g_stepMemoryPeak = 0;
+
+static void *countingAlloc(size_t size)
+{
+    g_stepMemoryInUse += size;
+    if (g_stepMemoryInUse > g_stepMemoryPeak) g_stepMemoryPeak = g_stepMemoryInUse;
+    return malloc(size);
+}
+
+static void *countingShrink(void *block, size_t size, size_t smallerSize)
+{
+    g_stepMemoryInUse -= size - smallerSize;
+    return realloc(block, smallerSize);
+}
+
+static void countingFree(void *block, size_t size)
+{
+    g_stepMemoryInUse -= size;
+    free(block);
+}
+
+static void resetStepMemoryPeak()
+{
+    g_stepMemoryPeak = g_stepMemoryInUse;
+}
+
+
+struct Scene
+{
+    dWorldID world;
+    dSpaceID space;
+    dJointGroupID contacts;
+    dSurfaceParameters surface;
+    int iterations;
+    dReal stepSize;
+    int maxContacts;
+    unsigned long frameContacts;
+
+    // trimesh and heightfield data, and the arrays they refer to
+    std::vector<dTriMeshDataID> meshes;
+    std::vector<dHeightfieldDataID> heightfields;
+    std::vector<float> vertices;
+    std::vector<dTriIndex> indices;
+
+    // the crash scene fires a cannon ball every so many frames
+    dBodyID cannonBall;
+};
+
+typedef void SceneBuilder(Scene &scene, int scale);
+
+
+static void nearCallback(void *data, dGeomID o1, dGeomID o2)
+{
+    Scene *scene = (Scene *)data;
+
+    dBodyID b1 = dGeomGetBody(o1);
+    dBodyID b2 = dGeomGetBody(o2);
+    if (b1 && b2 && dAreConnectedExcluding(b1, b2, dJointTypeContact)) return;
+
+    dContact contact[MAX_CONTACTS];
+    int n = dCollide(o1, o2, scene->maxContacts, &contact[0].geom, sizeof(dContact));
+    for (int i = 0; i < n; ++i) {
+        contact[i].surface = scene->surface;
+        dJointID c = dJointCreateContact(scene->world, scene->contacts, contact + i);
+        dJointAttach(c, b1, b2);
+    }
+    scene->frameContacts += n;
+}
+
+
+static void setRandomRotation(dBodyID b)
+{
+    dMatrix3 R;
+    dRFromAxisAndAngle(R, dRandReal() * 2 - 1, dRandReal() * 2 - 1,
+        dRandReal() * 2 - 1, dRandReal() * 10 - 5);
+    dBodySetRotation(b, R);
+}
+
+// Drops an object like the ones the demos throw in with their keys: a box,
+// sphere, capsule or cylinder of random size, or for kind 4 a composite
+// of three of those held by geom transforms.
+static void dropObject(Scene &scene, int kind, dReal x, dReal y, dReal z)
+{
+    dBodyID b = dBodyCreate(scene.world);
+    dBodySetPosition(b, x, y, z);
+    setRandomRotation(b);
+
+    dReal sides[3];
+    for (int k = 0; k < 3; ++k) sides[k] = dRandReal() * REAL(0.5) + REAL(0.1);
+
+    dMass m;
+    dGeomID g;
+    switch (kind) {
+    case 0:
+        dMassSetBox(&m, DENSITY, sides[0], sides[1], sides[2]);
+        g = dCreateBox(scene.space, sides[0], sides[1], sides[2]);
+        break;
+    case 1:
+        dMassSetSphere(&m, DENSITY, sides[0] * REAL(0.5));
+        g = dCreateSphere(scene.space, sides[0] * REAL(0.5));
+        break;
+    case 2:
+        dMassSetCapsule(&m, DENSITY, 3, sides[0] * REAL(0.5), sides[1]);
+        g = dCreateCapsule(scene.space, sides[0] * REAL(0.5), sides[1]);
+        break;
+    case 3:
+        dMassSetCylinder(&m, DENSITY, 3, sides[0] * REAL(0.5), sides[1]);
+        g = dCreateCylinder(scene.space, sides[0] * REAL(0.5), sides[1]);
+        break;
+    default:
+        dMassSetBox(&m, DENSITY, 1, 1, 1);
+        for (int k = 0; k < 3; ++k) {
+            g = dCreateGeomTransform(scene.space);
+            dGeomTransformSetCleanup(g, 1);
+            dGeomID g2;
+            if (k == 0) {
+                g2 = dCreateSphere(0, sides[0] * REAL(0.5));
+            } else if (k == 1) {
+                g2 = dCreateBox(0, sides[0], sides[1], sides[2]);
+            } else {
+                g2 = dCreateCapsule(0, sides[0] * REAL(0.5), sides[1]);
+            }
+            dGeomSetPosition(g2, dRandReal() - REAL(0.5), dRandReal() - REAL(0.5), dRandReal() - REAL(0.5));
+            dGeomTransformSetGeom(g, g2);
+            dGeomSetBody(g, b);
+        }
+        dBodySetMass(b, &m);
+        return;
+    }
+    dBodySetMass(b, &m);
+    dGeomSetBody(g, b);
+}
+
+// Drops count objects in layers over a square area of the given half size,
+// one per cell of a grid wide enough that they do not start out overlapping.
+#define DROP_CELL REAL(1.25)
+
+static void dropObjects(Scene &scene, int count, int kinds, dReal extent, dReal z0)
+{
+    int cells = (int)(2 * extent / DROP_CELL);
+    if (cells < 1) cells = 1;
+    for (int i = 0; i < count; ++i) {
+        int layer = i / (cells * cells), cell = i % (cells * cells);
+        dReal x = -extent + (cell % cells + REAL(0.5)) * DROP_CELL + (dRandReal() - REAL(0.5)) * REAL(0.1);
+        dReal y = -extent + (cell / cells + REAL(0.5)) * DROP_CELL + (dRandReal() - REAL(0.5)) * REAL(0.1);
+        dropObject(scene, dRandInt(kinds), x, y, z0 + layer * DROP_CELL);
+    }
+}
+
+static void setDemoWorld(Scene &scene, dReal gravity)
+{
+    dWorldSetGravity(scene.world, 0, 0, gravity);
+    dWorldSetCFM(scene.world, REAL(1e-5));
+    dWorldSetAutoDisableFlag(scene.world, 1);
+    dWorldSetAutoDisableAverageSamplesCount(scene.world, 10);
+    dWorldSetContactMaxCorrectingVel(scene.world, REAL(0.1));
+    dWorldSetContactSurfaceLayer(scene.world, REAL(0.001));
+    // the lightest of the thin objects can otherwise spin up without bound
+    // once the pile has settled and long runs end in NaNs
+    dWorldSetMaxAngularSpeed(scene.world, 100);
+}
+
+
+// demo_boxstack: a pile of objects dropped on the ground
+static void buildBoxstack(Scene &scene, int scale)
+{
+    setDemoWorld(scene, REAL(-0.5));
+    scene.stepSize = REAL(0.02);
+    scene.surface.mode = dContactBounce | dContactSoftCFM;
+    scene.surface.mu = dInfinity;
+    scene.surface.bounce = REAL(0.1);
+    scene.surface.bounce_vel = REAL(0.1);
+    scene.surface.soft_cfm = REAL(0.01);
+
+    dCreatePlane(scene.space, 0, 0, 1, 0);
+    dropObjects(scene, 30 * scale, 4, REAL(1.5) * sqrt((double)scale), REAL(0.6));
+}
+
+// demo_crash: a brick wall shot at with a cannon ball
+static void buildCrash(Scene &scene, int scale)
+{
+    dWorldSetGravity(scene.world, 0, 0, REAL(-1.5));
+    dWorldSetCFM(scene.world, REAL(1e-5));
+    dWorldSetERP(scene.world, REAL(0.8));
+    scene.maxContacts = 4;
+    dWorldSetAutoDisableFlag(scene.world, 1);
+    dWorldSetAutoDisableLinearThreshold(scene.world, REAL(0.008));
+    dWorldSetAutoDisableAngularThreshold(scene.world, REAL(0.008));
+    dWorldSetAutoDisableSteps(scene.world, 10);
+    scene.surface.mode = dContactSlip1 | dContactSlip2 | dContactSoftERP | dContactSoftCFM | dContactApprox1;
+    scene.surface.mu = REAL(0.5);
+    scene.surface.slip1 = 0;
+    scene.surface.slip2 = 0;
+    scene.surface.soft_erp = REAL(0.8);
+    scene.surface.soft_cfm = REAL(0.01);
+
+    dCreatePlane(scene.space, 0, 0, 1, 0);
+
+    const dReal wallWidth = 12 * scale;
+    for (dReal z = REAL(0.5); z <= 10; z += 1) {
+        for (dReal y = (-wallWidth + z) / 2; y <= (wallWidth - z) / 2; y += 1) {
+            dBodyID b = dBodyCreate(scene.world);
+            dBodySetPosition(b, -20, y, z);
+            dMass m;
+            dMassSetBox(&m, 1, 1, 1, 1);
+            dBodySetMass(b, &m);
+            dGeomSetBody(dCreateBox(scene.space, 1, 1, 1), b);
+        }
+    }
+
+    dBodyID ball = dBodyCreate(scene.world);
+    dMass m;
+    dMassSetSphere(&m, 1, REAL(0.5));
+    dMassAdjust(&m, 10);
+    dBodySetMass(ball, &m);
+    dGeomSetBody(dCreateSphere(scene.space, REAL(0.5)), ball);
+    dBodySetPosition(ball, -10, 5, REAL(0.5));
+    scene.cannonBall = ball;
+}
+
+static void fireCannon(Scene &scene)
+{
+    dReal y = (dRandReal() * 2 - 1) * 4;
+    dBodyEnable(scene.cannonBall);
+    dBodySetPosition(scene.cannonBall, -10, y, 1);
+    dBodySetLinearVel(scene.cannonBall, -10, 0, 1);
+    dBodySetAngularVel(scene.cannonBall, 0, 0, 0);
+}
+
+// demo_space_stress: many objects, composites among them, scattered over a
+// large area
+static void buildSpaceStress(Scene &scene, int scale)
+{
+    setDemoWorld(scene, REAL(-0.5));
+    scene.maxContacts = 4;
+    scene.surface.mode = dContactBounce | dContactSoftCFM;
+    scene.surface.mu = dInfinity;
+    scene.surface.bounce = REAL(0.1);
+    scene.surface.bounce_vel = REAL(0.1);
+    scene.surface.soft_cfm = REAL(0.01);
+
+    dCreatePlane(scene.space, 0, 0, 1, 0);
+
+    const dReal extent = 10 * sqrt((double)scale);
+    const int count = 300 * scale;
+    for (int i = 0; i < count; ++i) {
+        dropObject(scene, dRandInt(5), (dRandReal() * 2 - 1) * extent,
+            (dRandReal() * 2 - 1) * extent, dRandReal() * 20 + 1);
+    }
+}
+
+// demo_trimesh: objects dropped on a trimesh terrain
+static void buildTrimesh(Scene &scene, int scale)
+{
+    setDemoWorld(scene, REAL(-0.5));
+    // fewer contacts than the demo, long dWorldStep runs diverge with more
+    scene.maxContacts = 4;
+    scene.surface.mode = dContactBounce | dContactSoftCFM;
+    scene.surface.mu = dInfinity;
+    scene.surface.bounce = REAL(0.1);
+    scene.surface.bounce_vel = REAL(0.1);
+    scene.surface.soft_cfm = REAL(0.01);
+
+    // a bumpy terrain of 2x2 cells
+    const int N = (int)(8 * sqrt((double)scale));
+    for (int y = 0; y <= N; ++y) {
+        for (int x = 0; x <= N; ++x) {
+            scene.vertices.push_back((float)(x - N / 2) * 2);
+            scene.vertices.push_back((float)(y - N / 2) * 2);
+            scene.vertices.push_back(0.3f * (float)(sin(x * 0.9) * cos(y * 0.7)));
+        }
+    }
+    for (int y = 0; y < N; ++y) {
+        for (int x = 0; x < N; ++x) {
+            dTriIndex i0 = y * (N + 1) + x, i1 = i0 + 1, i2 = i0 + N + 1, i3 = i2 + 1;
+            dTriIndex tri[6] = { i0, i1, i3, i0, i3, i2 };
+            scene.indices.insert(scene.indices.end(), tri, tri + 6);
+        }
+    }
+    dTriMeshDataID data = dGeomTriMeshDataCreate();
+    dGeomTriMeshDataBuildSingle(data, &scene.vertices[0], 3 * sizeof(float), (N + 1) * (N + 1),
+        &scene.indices[0], (int)scene.indices.size(), 3 * sizeof(dTriIndex));
+    scene.meshes.push_back(data);
+    dCreateTriMesh(scene.space, data, 0, 0, 0);
+
+    dropObjects(scene, 30 * scale, 4, (dReal)N * REAL(0.8), 2);
+}
+
+// demo_heightfield: objects dropped on the demo's hump shaped heightfield,
+// stretched with the scale
+static dReal humpHeight(void *data, int x, int z)
+{
+    const int *steps = (const int *)data;
+    dReal fx = ((dReal)x - (steps[0] - 1) / 2) / (dReal)(steps[0] - 1);
+    dReal fz = ((dReal)z - (steps[1] - 1) / 2) / (dReal)(steps[1] - 1);
+    return 1 - 16 * (fx * fx * fx + fz * fz * fz);
+}
+
+static void buildHeightfield(Scene &scene, int scale)
+{
+    setDemoWorld(scene, REAL(-0.5));
+    scene.surface.mode = dContactBounce | dContactSoftCFM;
+    scene.surface.mu = dInfinity;
+    scene.surface.bounce = REAL(0.1);
+    scene.surface.bounce_vel = REAL(0.1);
+    scene.surface.soft_cfm = REAL(0.01);
+
+    dCreatePlane(scene.space, 0, 0, 1, 0);
+
+    static int steps[2] = { 15, 31 };
+    const dReal stretch = sqrt((double)scale);
+    dHeightfieldDataID data = dGeomHeightfieldDataCreate();
+    dGeomHeightfieldDataBuildCallback(data, steps, &humpHeight, 4 * stretch, 8 * stretch,
+        steps[0], steps[1], 1, 0, 0, 0);
+    dGeomHeightfieldDataSetBounds(data, -4, 6);
+    scene.heightfields.push_back(data);
+
+    dGeomID hf = dCreateHeightfield(scene.space, data, 1);
+    dMatrix3 R;
+    dRFromAxisAndAngle(R, 1, 0, 0, M_PI / 2);
+    dGeomSetRotation(hf, R);
+
+    dropObjects(scene, 30 * scale, 4, 2 * stretch, 2);
+}
+
+// demo_cards: a house of cards
+static void buildCards(Scene &scene, int scale)
+{
+    dWorldSetGravity(scene.world, 0, 0, REAL(-0.5));
+    scene.iterations = 50;
+    scene.stepSize = REAL(0.01);
+    scene.surface.mode = dContactApprox1;
+    scene.surface.mu = 5;
+
+    dCreatePlane(scene.space, 0, 0, 1, 0);
+
+    const dReal cwidth = REAL(0.5), cthickness = REAL(0.02), clength = 1;
+    const int levels = 2 + 2 * scale;
+
+    dMatrix3 right, left, hrot;
+    const dReal angle = 20 * M_PI / 180;
+    dRFromAxisAndAngle(right, 1, 0, 0, -angle);
+    dRFromAxisAndAngle(left, 1, 0, 0, angle);
+    dRFromAxisAndAngle(hrot, 1, 0, 0, 91 * M_PI / 180);
+
+    const dReal eps = REAL(0.05);
+    const dReal vstep = cos(angle) * clength + eps;
+    const dReal hstep = sin(angle) * clength + eps;
+
+    for (int lvl = 0; lvl < levels; ++lvl) {
+        int n = levels - lvl;
+        dReal height = lvl * vstep + vstep / 2;
+        for (int i = 0; i < 2 * n + (n > 1 ? n - 1 : 0); ++i) {
+            dBodyID b = dBodyCreate(scene.world);
+            dMass m;
+            dMassSetBox(&m, 1, cwidth, cthickness, clength);
+            dBodySetMass(b, &m);
+            dGeomSetBody(dCreateBox(scene.space, cwidth, cthickness, clength), b);
+            if (i < 2 * n) {
+                // inclined cards
+                dBodySetPosition(b, 0, -n * hstep + hstep * i, height);
+                dBodySetRotation(b, (i % 2) ? left : right);
+            } else {
+                // horizontal cards
+                int h = i - 2 * n;
+                dBodySetPosition(b, 0, -(n - 1 - (clength - hstep) / 2) * hstep + 2 * hstep * h,
+                    height + vstep / 2);
+                dBodySetRotation(b, hrot);
+            }
+        }
+    }
+}
+
+// demo_chain2: chains of ball jointed boxes falling in a heap
+static void buildChain(Scene &scene, int scale)
+{
+    dWorldSetGravity(scene.world, 0, 0, REAL(-0.5));
+    dWorldSetCFM(scene.world, REAL(1e-5));
+    scene.surface.mode = 0;
+    scene.surface.mu = dInfinity;
+
+    dCreatePlane(scene.space, 0, 0, 1, 0);
+
+    const int links = 10;
+    const dReal side = REAL(0.2);
+    const int chains = 4 * scale;
+    for (int c = 0; c < chains; ++c) {
+        dReal y = (c % 4) * REAL(0.5) - REAL(0.75);
+        dReal z = 1 + (c / 4) * REAL(0.5);
+        dReal angle = (c / 4) * REAL(0.7);
+        dBodyID prev = 0;
+        for (int i = 0; i < links; ++i) {
+            dReal s = (i - links / 2) * side * REAL(1.2);
+            dBodyID b = dBodyCreate(scene.world);
+            dBodySetPosition(b, s * cos(angle) - y * sin(angle), s * sin(angle) + y * cos(angle), z);
+            dMass m;
+            dMassSetBox(&m, 1, side, side, side);
+            dMassAdjust(&m, 1);
+            dBodySetMass(b, &m);
+            dGeomSetBody(dCreateSphere(scene.space, REAL(0.1732)), b);
+            if (prev) {
+                const dReal *p1 = dBodyGetPosition(prev), *p2 = dBodyGetPosition(b);
+                dJointID j = dJointCreateBall(scene.world, 0);
+                dJointAttach(j, prev, b);
+                dJointSetBallAnchor(j, (p1[0] + p2[0]) / 2, (p1[1] + p2[1]) / 2, z);
+            }
+            prev = b;
+        }
+    }
+}
+
+// demo_basket: balls dropped along the ramp of the demo's basket mesh
+static void buildBasket(Scene &scene, int scale)
+{
+    dWorldSetGravity(scene.world, 0, 0, REAL(-9.8));
+    scene.iterations = 64;
+    scene.stepSize = REAL(0.01);
+    scene.surface.mode = dContactSoftERP | dContactSoftCFM | dContactApprox1 | dContactSlip1 | dContactSlip2;
+    scene.surface.mu = 50;
+    scene.surface.slip1 = REAL(0.7);
+    scene.surface.slip2 = REAL(0.7);
+    scene.surface.soft_erp = REAL(0.96);
+    scene.surface.soft_cfm = REAL(0.04);
+
+    (void)world_normals;
+    dTriMeshDataID data = dGeomTriMeshDataCreate();
+    dGeomTriMeshDataBuildSingle(data, world_vertices, 3 * sizeof(float),
+        sizeof(world_vertices) / (3 * sizeof(float)), world_indices,
+        sizeof(world_indices) / sizeof(dTriIndex), 3 * sizeof(dTriIndex));
+    scene.meshes.push_back(data);
+    dGeomID mesh = dCreateTriMesh(scene.space, data, 0, 0, 0);
+    dGeomSetPosition(mesh, 0, 0, REAL(0.5));
+
+    const dReal radius = REAL(0.14);
+    const int balls = 10 * scale;
+    for (int i = 0; i < balls; ++i) {
+        dBodyID b = dBodyCreate(scene.world);
+        dMass m;
+        dMassSetSphere(&m, 1, radius);
+        dBodySetMass(b, &m);
+        dGeomSetBody(dCreateSphere(scene.space, radius), b);
+        dBodySetPosition(b, (dRandReal() * 2 - 1) * REAL(0.2), REAL(3.4) - (i % 8) * REAL(0.35),
+            REAL(3.0) + (i / 8) * 3 * radius);
+    }
+}
+
+
+struct SceneKind
+{
+    const char *name;
+    SceneBuilder *build;
+    bool needsTrimesh;
+    bool quickStepOnly;
+};
+
+static const SceneKind g_scenes[] = {
+    { "boxstack", &buildBoxstack, false, false },
+    // the redundant contacts of the wall and of the larger card houses
+    // break the LCP of dWorldStep
+    { "crash", &buildCrash, false, true },
+    { "space_stress", &buildSpaceStress, false, false },
+    { "trimesh", &buildTrimesh, true, false },
+    { "heightfield", &buildHeightfield, false, false },
+    { "cards", &buildCards, false, true },
+    { "chain", &buildChain, false, false },
+    { "basket", &buildBasket, true, false },
+};
+
+static const char *const g_spaces[] = { "simple", "hash", "sap", "quadtree", "octree" };
+
+// Moves the geoms the scene was built with into a new space of the given
+// kind, sized to their bounds for the trees.
+static dSpaceID moveToSpace(dSpaceID from, const char *kind)
+{
+    dReal bounds[6] = { dInfinity, -dInfinity, dInfinity, -dInfinity, dInfinity, -dInfinity };
+    for (int i = 0; i < dSpaceGetNumGeoms(from); ++i) {
+        dReal aabb[6];
+        dGeomGetAABB(dSpaceGetGeom(from, i), aabb);
+        for (int k = 0; k < 3; ++k) {
+            if (aabb[2 * k] == -dInfinity || aabb[2 * k + 1] == dInfinity) continue;
+            if (aabb[2 * k] < bounds[2 * k]) bounds[2 * k] = aabb[2 * k];
+            if (aabb[2 * k + 1] > bounds[2 * k + 1]) bounds[2 * k + 1] = aabb[2 * k + 1];
+        }
+    }
+
+    // leave room for the objects to spread as they fall and scatter
+    dVector3 center, extents;
+    for (int k = 0; k < 3; ++k) {
+        center[k] = (bounds[2 * k] + bounds[2 * k + 1]) / 2;
+        extents[k] = (bounds[2 * k + 1] - bounds[2 * k]) + 10;
+    }
+
+    dSpaceID space;
+    if (!strcmp(kind, "simple")) {
+        space = dSimpleSpaceCreate(0);
+    } else if (!strcmp(kind, "hash")) {
+        space = dHashSpaceCreate(0);
+    } else if (!strcmp(kind, "sap")) {
+        space = dSweepAndPruneSpaceCreate(0, dSAP_AXES_XYZ);
+    } else if (!strcmp(kind, "quadtree")) {
+        space = dQuadTreeSpaceCreate(0, center, extents, 6);
+    } else {
+        space = dOctreeSpaceCreate(0, center, extents, 6);
+    }
+
+    while (dSpaceGetNumGeoms(from) != 0) {
+        dGeomID g = dSpaceGetGeom(from, 0);
+        dSpaceRemove(from, g);
+        dSpaceAdd(space, g);
+    }
+    return space;
+}
+
+
+struct RunResult
+{
+    double collideTime;
+    double stepTime;
+    double phaseTime[dStepPhase__MAX];
+    unsigned long contacts;
+    unsigned long rows;
+    unsigned long islands;
+    int bodies;
+    int geoms;
+};
+
+static void runScene(const SceneKind &kind, int scale, bool quick, const char *spaceKind, int frames,
+                     RunResult &result)
+{
+    dRandSetSeed(1);
+    memset(&result, 0, sizeof(result));
+
+    Scene scene;
+    scene.world = dWorldCreate();
+    scene.space = dSimpleSpaceCreate(0);
+    scene.contacts = dJointGroupCreate(0);
+    memset(&scene.surface, 0, sizeof(scene.surface));
+    scene.iterations = 20;
+    scene.stepSize = REAL(0.05);
+    scene.maxContacts = MAX_CONTACTS;
+    scene.frameContacts = 0;
+    scene.cannonBall = 0;
+
+    dWorldStepMemoryFunctionsInfo memfuncs;
+    memfuncs.struct_size = sizeof(memfuncs);
+    memfuncs.alloc_block = &countingAlloc;
+    memfuncs.shrink_block = &countingShrink;
+    memfuncs.free_block = &countingFree;
+    dWorldSetStepMemoryManager(scene.world, &memfuncs);
+    dWorldSetStepStatsEnabled(scene.world, 1);
+
+    kind.build(scene, scale);
+    dWorldSetQuickStepNumIterations(scene.world, scene.iterations);
+
+    // every body of the scenes has geoms, composites have several
+    std::vector<dBodyID> bodies;
+    result.geoms = dSpaceGetNumGeoms(scene.space);
+    for (int i = 0; i < result.geoms; ++i) {
+        dBodyID b = dGeomGetBody(dSpaceGetGeom(scene.space, i));
+        if (b) bodies.push_back(b);
+    }
+    std::sort(bodies.begin(), bodies.end());
+    result.bodies = (int)(std::unique(bodies.begin(), bodies.end()) - bodies.begin());
+
+    dSpaceID built = scene.space;
+    scene.space = moveToSpace(built, spaceKind);
+    dSpaceDestroy(built);
+
+    dStopwatch collide;
+    dStopwatchReset(&collide);
+
+    for (int frame = 0; frame < frames; ++frame) {
+        if (scene.cannonBall && frame % 50 == 0) fireCannon(scene);
+
+        scene.frameContacts = 0;
+        dStopwatchStart(&collide);
+        dSpaceCollide(scene.space, &scene, &nearCallback);
+        dStopwatchStop(&collide);
+        result.contacts += scene.frameContacts;
+
+        if (quick) {
+            dWorldQuickStep(scene.world, scene.stepSize);
+        } else {
+            dWorldStep(scene.world, scene.stepSize);
+        }
+
+        dWorldStepStats stats;
+        stats.struct_size = sizeof(stats);
+        if (dWorldGetStepStats(scene.world, &stats)) {
+            result.stepTime += stats.step_time;
+            for (int p = 0; p < dStepPhase__MAX; ++p) result.phaseTime[p] += stats.phase_time[p];
+            result.rows += stats.constraint_rows;
+            result.islands += stats.island_count;
+        }
+
+        dJointGroupEmpty(scene.contacts);
+    }
+    result.collideTime = dStopwatchTime(&collide);
+
+    dJointGroupDestroy(scene.contacts);
+    dSpaceDestroy(scene.space);
+    dWorldDestroy(scene.world);
+    for (size_t i = 0; i < scene.meshes.size(); ++i) dGeomTriMeshDataDestroy(scene.meshes[i]);
+    for (size_t i = 0; i < scene.heightfields.size(); ++i) dGeomHeightfieldDataDestroy(scene.heightfields[i]);
+}
+
+
+static bool selected(const char *filter, const char *name)
+{
+    return !strcmp(filter, "all") || !strcmp(filter, name);
+}
+
+int main(int argc, char **argv)
+{
+    int frames = argc > 1 ? atoi(argv[1]) : 100;
+    const char *sceneFilter = argc > 2 ? argv[2] : "all";
+    int maxScale = argc > 3 ? atoi(argv[3]) : 4;
+    const char *stepperFilter = argc > 4 ? argv[4] : "all";
+    const char *spaceFilter = argc > 5 ? argv[5] : "all";
+
+    dInitODE2(0);
+    dAllocateODEDataForThread(dAllocateMaskAll);
+    const bool haveTrimesh = dCheckConfiguration("ODE_EXT_trimesh") != 0;
+
+    for (size_t s = 0; s < sizeof(g_scenes) / sizeof(g_scenes[0]); ++s) {
+        const SceneKind &kind = g_scenes[s];
+        if (!selected(sceneFilter, kind.name)) continue;
+        if (kind.needsTrimesh && !haveTrimesh) {
+            printf("bench=scenes scene=%s skipped=no_trimesh\n", kind.name);
+            continue;
+        }
+
+        for (int scale = 1; scale <= maxScale; scale *= 2) {
+            for (int stepper = 0; stepper < 2; ++stepper) {
+                const char *stepperName = stepper == 0 ? "quick" : "step";
+                if (!selected(stepperFilter, stepperName)) continue;
+                if (stepper != 0 && kind.quickStepOnly) {
+                    if (scale == 1) printf("bench=scenes scene=%s stepper=%s skipped=unstable\n", kind.name, stepperName);
+                    continue;
+                }
+
+                for (size_t sp = 0; sp < sizeof(g_spaces) / sizeof(g_spaces[0]); ++sp) {
+                    if (!selected(spaceFilter, g_spaces[sp])) continue;
+
+                    resetStepMemoryPeak();
+                    RunResult r;
+                    runScene(kind, scale, stepper == 0, g_spaces[sp], frames, r);
+
+                    const double ms = 1e3 / frames;
+                    printf("bench=scenes scene=%s scale=%d stepper=%s space=%s frames=%d bodies=%d geoms=%d"
+                        " ms_per_frame=%.4f collide_ms=%.4f step_ms=%.4f autodisable_ms=%.4f island_build_ms=%.4f"
+                        " assembly_ms=%.4f solve_ms=%.4f integration_ms=%.4f contacts_per_frame=%.1f"
+                        " rows_per_frame=%.1f islands_per_frame=%.1f step_memory_peak=%lu\n",
+                        kind.name, scale, stepperName, g_spaces[sp], frames, r.bodies, r.geoms,
+                        (r.collideTime + r.stepTime) * ms, r.collideTime * ms, r.stepTime * ms,
+                        r.phaseTime[dStepPhaseAutoDisable] * ms, r.phaseTime[dStepPhaseIslandBuild] * ms,
+                        r.phaseTime[dStepPhaseAssembly] * ms, r.phaseTime[dStepPhaseSolve] * ms,
+                        r.phaseTime[dStepPhaseIntegration] * ms, (double)r.contacts / frames,
+                        (double)r.rows / frames, (double)r.islands / frames, (unsigned long)g_stepMemoryPeak);
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+
+    dCloseODE();
+    return 0;
+}
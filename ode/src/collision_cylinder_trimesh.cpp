@@ -967,7 +967,7 @@ int sCylinderTrimeshColliderData::TestCollisionForSingleTriangle(int ctContacts0
 #if dTRIMESH_OPCODE
 static void dQueryCTLPotentialCollisionTriangles(OBBCollider &Collider, 
                                                  sCylinderTrimeshColliderData &cData, dxGeom *Cylinder, dxTriMesh *Trimesh,
-                                                 OBBCache &BoxCache)
+                                                 OBBCache &BoxCache, dxTriMeshTCHolder<dxTriMesh::BoxTC> &BoxTCHolder)
 {
     const dVector3 &vCylinderPos = cData.m_vCylinderPos;
 
@@ -1009,21 +1009,10 @@ static void dQueryCTLPotentialCollisionTriangles(OBBCollider &Collider,
     // TC results
     if (Trimesh->doBoxTC) 
     {
-        dxTriMesh::BoxTC* BoxTC = 0;
-        for (int i = 0; i < Trimesh->BoxTCCache.size(); i++)
+        bool isNew;
+        dxTriMesh::BoxTC* BoxTC = BoxTCHolder.Obtain(Trimesh->BoxTCCache, Cylinder, isNew);
+        if (isNew)
         {
-            if (Trimesh->BoxTCCache[i].Geom == Cylinder)
-            {
-                BoxTC = &Trimesh->BoxTCCache[i];
-                break;
-            }
-        }
-        if (!BoxTC)
-        {
-            Trimesh->BoxTCCache.push(dxTriMesh::BoxTC());
-
-            BoxTC = &Trimesh->BoxTCCache[Trimesh->BoxTCCache.size() - 1];
-            BoxTC->Geom = Cylinder;
             BoxTC->FatCoeff = REAL(1.0);
         }
 
@@ -1059,7 +1048,9 @@ int dCollideCylinderTrimesh(dxGeom *o1, dxGeom *o2, int flags, dContactGeom *con
     TrimeshCollidersCache *pccColliderCache = GetTrimeshCollidersCache(uiTLSKind);
     OBBCollider& Collider = pccColliderCache->_OBBCollider;
 
-    dQueryCTLPotentialCollisionTriangles(Collider, cData, Cylinder, Trimesh, pccColliderCache->defaultBoxCache);
+    // The TC entry holds the results until the end of the function
+    dxTriMeshTCHolder<dxTriMesh::BoxTC> BoxTCHolder;
+    dQueryCTLPotentialCollisionTriangles(Collider, cData, Cylinder, Trimesh, pccColliderCache->defaultBoxCache, BoxTCHolder);
 
     // Retrieve data
     int TriCount = Collider.GetNbTouchedPrimitives();
@@ -40,6 +40,8 @@ for geometry objects
 #include "collision_trimesh_internal.h"
 #include "collision_space_internal.h"
 #include "odeou.h"
+#include "objectpool.h"
+#include "util.h"
 
 #ifdef dLIBCCD_ENABLED
 # include "collision_libccd.h"
@@ -55,50 +57,14 @@ for geometry objects
 
 // this struct records the parameters passed to dCollideSpaceGeom()
 
-#if dATOMICS_ENABLED 
-static volatile atomicptr s_cachedPosR = 0; // dxPosR *
-#endif // dATOMICS_ENABLED
-
 static inline dxPosR* dAllocPosr()
 {
-    dxPosR *retPosR;
-
-#if dATOMICS_ENABLED
-    retPosR = (dxPosR *)AtomicExchangePointer(&s_cachedPosR, NULL);
-
-    if (!retPosR)
-#endif
-    {
-        retPosR = (dxPosR*) dAlloc (sizeof(dxPosR));
-    }
-
-    return retPosR;
+    return (dxPosR*) dxObjectPool::allocBlock (sizeof(dxPosR));
 }
 
 static inline void dFreePosr(dxPosR *oldPosR)
 {
-#if dATOMICS_ENABLED
-    if (!AtomicCompareExchangePointer(&s_cachedPosR, NULL, (atomicptr)oldPosR))
-#endif
-    {
-        dFree(oldPosR, sizeof(dxPosR));
-    }
-}
-
-/*extern */void dClearPosrCache(void)
-{
-#if dATOMICS_ENABLED
-    // No threads should be accessing ODE at this time already,
-    // hence variable may be read directly.
-    dxPosR *existingPosR = (dxPosR *)s_cachedPosR;
-
-    if (existingPosR)
-    {
-        dFree(existingPosR, sizeof(dxPosR));
-
-        s_cachedPosR = 0;
-    }
-#endif
+    dxObjectPool::freeBlock (oldPosR, sizeof(dxPosR));
 }
 
 struct SpaceGeomColliderData {
@@ -141,6 +107,10 @@ struct dColliderEntry {
 static dColliderEntry colliders[dGeomNumClasses][dGeomNumClasses];
 static int colliders_initialized = 0;
 
+// narrowphase statistics, see dSetColliderStatsEnabled()
+static dxCollisionStats collider_stats;
+static int collider_stats_enabled = 0;
+
 
 // setCollider() will refuse to write over a collider entry once it has
 // been written.
@@ -283,6 +253,110 @@ void dSetColliderOverride (int i, int j, dColliderFn *fn)
     colliders[j][i].reverse = 1;
 }
 
+static int callCollider (dColliderEntry *ce, dxGeom *o1, dxGeom *o2, int flags, dContactGeom *contact, int skip)
+{
+    int count;
+    if (ce->reverse) {
+        count = (*ce->fn) (o2,o1,flags,contact,skip);
+        for (int i=0; i<count; i++) {
+            dContactGeom *c = CONTACT(contact,skip*i);
+            c->normal[0] = -c->normal[0];
+            c->normal[1] = -c->normal[1];
+            c->normal[2] = -c->normal[2];
+            dxGeom *tmp = c->g1;
+            c->g1 = c->g2;
+            c->g2 = tmp;
+            int tmpint = c->side1;
+            c->side1 = c->side2;
+            c->side2 = tmpint;
+        }
+    }
+    else {
+        count = (*ce->fn) (o1,o2,flags,contact,skip);
+    }
+    return count;
+}
+
+// upper limit for the number of poses a swept pair is tested at
+#define CCD_MAX_SAMPLES 16
+
+// number of samples needed for a geom moving by disp to never skip more
+// than half of its smallest extent between two successive poses.
+static int sweepSampleCount (const dxGeom *g, const dVector3 disp)
+{
+    dReal extent = dInfinity;
+    for (int i=0; i<3; i++) {
+        // g->aabb already includes the sweep
+        dReal e = g->aabb[i*2+1] - g->aabb[i*2] - dFabs(disp[i]);
+        if (e < extent) extent = e;
+    }
+    dReal length = dCalcVectorLength3(disp);
+    if (!(extent > 0)) return CCD_MAX_SAMPLES;
+
+    dReal samples = dCeil(length / (REAL(0.5) * extent));
+    return samples < CCD_MAX_SAMPLES ? (samples > 1 ? (int)samples : 1) : CCD_MAX_SAMPLES;
+}
+
+// test o1 and o2, of which at least one is swept and which do not touch
+// at their current poses, at poses sampled along their sweeps. contacts
+// found at the first touching pose are returned as speculative contacts:
+// they are moved back to the current poses, so their depth is negative.
+// the samples are taken on copies of the poses, the bodies are not touched.
+static int collideSwept (dColliderEntry *ce, dxGeom *o1, dxGeom *o2, int flags, dContactGeom *contact, int skip)
+{
+    // ray queries are about where the geoms are, not where they will be
+    if (o1->type == dRayClass || o2->type == dRayClass) return 0;
+
+    dVector3 disp1 = {0,0,0}, disp2 = {0,0,0};
+    bool swept1 = o1->getSweep(disp1);
+    bool swept2 = o2->getSweep(disp2);
+    if (!swept1 && !swept2) return 0;
+
+    int samples = 1;
+    if (swept1) samples = sweepSampleCount(o1,disp1);
+    if (swept2) {
+        int samples2 = sweepSampleCount(o2,disp2);
+        if (samples2 > samples) samples = samples2;
+    }
+
+    dxPosR *posr1 = o1->final_posr, *posr2 = o2->final_posr;
+    dxPosR sampled1 = *posr1, sampled2 = *posr2;
+    o1->final_posr = &sampled1;
+    o2->final_posr = &sampled2;
+
+    int count = 0;
+    dReal t = 0;
+    for (int k=1; k<=samples && count==0; k++) {
+        t = (dReal)k / (dReal)samples;
+        for (int i=0; i<3; i++) {
+            sampled1.pos[i] = posr1->pos[i] + disp1[i]*t;
+            sampled2.pos[i] = posr2->pos[i] + disp2[i]*t;
+        }
+        count = callCollider(ce,o1,o2,flags,contact,skip);
+    }
+
+    o1->final_posr = posr1;
+    o2->final_posr = posr2;
+
+    dVector3 r, back;
+    for (int i=0; i<3; i++) {
+        r[i] = (disp1[i] - disp2[i]) * t;
+        // the points go back with the swept geom, or half way with each if
+        // both are swept, so that they lie on it and give it no lever arm
+        // across the normal that it did not have at the sampled pose
+        back[i] = (swept1 && swept2 ? (disp1[i] + disp2[i]) * REAL(0.5) : disp1[i] + disp2[i]) * t;
+    }
+
+    for (int j=0; j<count; j++) {
+        dContactGeom *c = CONTACT(contact,skip*j);
+        // moving g1 back by r (relative to g2) changes the depth by r along the normal
+        dReal depth = c->depth + dCalcVectorDot3(r,c->normal) * (c->g1 == o1 ? 1 : -1);
+        c->depth = depth < 0 ? depth : 0;
+        for (int i=0; i<3; i++) c->pos[i] -= back[i];
+    }
+    return count;
+}
+
 /*
 *	NOTE!
 *	If it is necessary to add special processing mode without contact generation
@@ -314,28 +388,54 @@ int dCollide (dxGeom *o1, dxGeom *o2, int flags, dContactGeom *contact, int skip
     dColliderEntry *ce = &colliders[o1->type][o2->type];
     int count = 0;
     if (ce->fn) {
-        if (ce->reverse) {
-            count = (*ce->fn) (o2,o1,flags,contact,skip);
-            for (int i=0; i<count; i++) {
-                dContactGeom *c = CONTACT(contact,skip*i);
-                c->normal[0] = -c->normal[0];
-                c->normal[1] = -c->normal[1];
-                c->normal[2] = -c->normal[2];
-                dxGeom *tmp = c->g1;
-                c->g1 = c->g2;
-                c->g2 = tmp;
-                int tmpint = c->side1;
-                c->side1 = c->side2;
-                c->side2 = tmpint;
-            }
-        }
-        else {
-            count = (*ce->fn) (o1,o2,flags,contact,skip);
+        double starttime = collider_stats_enabled ? dxMonotonicTime() : 0;
+
+        count = callCollider(ce,o1,o2,flags,contact,skip);
+
+        // geoms of CCD bodies that are apart now may still meet in the step
+        if (count == 0)
+            count = collideSwept(ce,o1,o2,flags,contact,skip);
+
+        if (collider_stats_enabled) {
+            dCollisionPairStats &pairstats = collider_stats.getPairStats (o1->type,o2->type);
+            pairstats.narrowphase_calls++;
+            pairstats.contacts += count;
+            pairstats.narrowphase_time += dxMonotonicTime() - starttime;
         }
     }
     return count;
 }
 
+
+void dSetColliderStatsEnabled (int enabled)
+{
+    if (enabled && !collider_stats_enabled) {
+        collider_stats.reset();
+    }
+    collider_stats_enabled = (enabled != 0);
+}
+
+
+int dGetColliderStatsEnabled()
+{
+    return collider_stats_enabled;
+}
+
+
+int dGetColliderStats (dCollisionPairStats table[dGeomNumClasses][dGeomNumClasses])
+{
+    dAASSERT (table);
+    if (!collider_stats_enabled) return 0;
+    memcpy (table,collider_stats.pairs,sizeof(collider_stats.pairs));
+    return 1;
+}
+
+
+void dResetColliderStats()
+{
+    collider_stats.reset();
+}
+
 //****************************************************************************
 // dxGeom
 
@@ -462,6 +562,28 @@ void dxGeom::computePosr()
     dMultiply0_333 (final_posr->R,body->posr.R,offset_posr->R);
 }
 
+bool dxGeom::getSweep(dVector3 disp) const
+{
+    if (!body || !(body->flags & dxBodyCCD) || type == dRayClass) return false;
+
+    dReal dt = body->world->contactp.ccd_step;
+    disp[0] = body->lvel[0] * dt;
+    disp[1] = body->lvel[1] * dt;
+    disp[2] = body->lvel[2] * dt;
+    return disp[0] != 0 || disp[1] != 0 || disp[2] != 0;
+}
+
+void dxGeom::sweepAABB()
+{
+    dVector3 disp;
+    if (!getSweep(disp)) return;
+
+    for (int i=0; i<3; i++) {
+        if (disp[i] < 0) aabb[i*2] += disp[i];
+        else aabb[i*2+1] += disp[i];
+    }
+}
+
 bool dxGeom::controlGeometry(int controlClass, int controlCode, void *dataValue, int *dataSize)
 {
     dAASSERT(false && "Control class/code is not supported for current geom");
@@ -34,6 +34,9 @@ internal data structures and functions for collision detection.
 #include <ode/collision.h>
 #include "objects.h"
 #include "odetls.h"
+#include "array.h"
+#include "threading_base.h"
+#include <string.h>
 
 //****************************************************************************
 // constants and macros
@@ -112,6 +115,11 @@ struct dxGeom : public dBase {
     dxGeom (dSpaceID _space, int is_placeable);
     virtual ~dxGeom();
 
+    // geoms are allocated from the object pools
+    void *operator new (size_t size) { return dxObjectPool::allocBlock (size); }
+    void *operator new (size_t size, void *p) { return p; }
+    void operator delete (void *ptr, size_t size) { dxObjectPool::freeBlock (ptr,size); }
+
     // Set or clear GEOM_ZERO_SIZED flag
     void updateZeroSizedFlag(bool is_zero_sized) { gflags = is_zero_sized ? (gflags | GEOM_ZERO_SIZED) : (gflags & ~GEOM_ZERO_SIZED); }
     // Get parent space TLS kind
@@ -146,17 +154,25 @@ struct dxGeom : public dBase {
     // utility functions
 
     // compute the AABB only if it is not current. this function manipulates
-    // the GEOM_AABB_BAD flag.
+    // the GEOM_AABB_BAD flag. the AABBs of geoms on CCD bodies are swept
+    // by the body motion over the CCD step.
 
     void recomputeAABB() {
         if (gflags & GEOM_AABB_BAD) {
             // our aabb functions assume final_posr is up to date
             recomputePosr(); 
             computeAABB();
+            if (body && (body->flags & dxBodyCCD)) sweepAABB();
             gflags &= ~GEOM_AABB_BAD;
         }
     }
 
+    // get the displacement of this geom over the CCD step. returns false
+    // if the geom is not swept.
+    bool getSweep(dVector3 disp) const;
+    // extend aabb to cover the geom moved by its sweep.
+    void sweepAABB();
+
     // add and remove this geom from a linked list maintained by a space.
 
     void spaceAdd (dxGeom **first_ptr) {
@@ -197,7 +213,21 @@ struct dxGeom : public dBase {
 #define dSPACE_TLS_KIND_MANUAL_VALUE 0
 #endif
 
-struct dxSpace : public dxGeom {
+// per geom class pair collision counters (see dCollisionPairStats).
+// counters of a class pair are kept in the cell with the lower class first.
+
+struct dxCollisionStats : public dBase {
+    dCollisionPairStats pairs[dGeomNumClasses][dGeomNumClasses];
+
+    dxCollisionStats() { reset(); }
+
+    void reset() { memset (pairs,0,sizeof(pairs)); }
+    dCollisionPairStats &getPairStats (int class1, int class2)
+    { return class1 <= class2 ? pairs[class1][class2] : pairs[class2][class1]; }
+};
+
+
+struct dxSpace : public dxGeom, public dxThreadingBase, private dxIThreadingDefaultImplProvider {
     int count;			// number of geoms in this space
     dxGeom *first;		// first geom in list
     int cleanup;			// cleanup mode, 1=destroy geoms on exit
@@ -214,9 +244,20 @@ struct dxSpace : public dxGeom {
     // is locked.
     int lock_count;
 
+    dxCollisionStats *stats;	// broadphase statistics, 0 if not collected
+
+    // threaded AABB updates in cleanGeoms() and batched raycasts. the wait
+    // and the mutex are allocated on first use with the assigned threading
+    // implementation.
+    dCallWaitID call_wait;
+    dMutexGroupID raycast_mutex;	// serializes geoms not safe to test concurrently
+    dArray<dxGeom*> aabb_batch;	// dirty geoms collected for the update
+
     dxSpace (dSpaceID _space);
     ~dxSpace();
 
+    void AssignThreadingImpl(const dxThreadingFunctionsInfo *functions_info, dThreadingImplementationID threading_impl);
+
     void computeAABB();
 
     void setCleanup (int mode) { cleanup = (mode != 0); }
@@ -239,8 +280,23 @@ struct dxSpace : public dxGeom {
     // other space data structures that are required. this should clear the
     // GEOM_DIRTY and GEOM_AABB_BAD flags of all geoms.
 
+    void recomputeDirtyAABBs (dxGeom *const *geoms, int n);
+    void recomputeDirtyAABBs ();
+    // called by cleanGeoms() before its own pass. if the space has a threading
+    // implementation with several threads, the AABBs (and final posr-s) of
+    // the given dirty geoms, or of the dirty geoms at the front of the list,
+    // are computed in parallel. child spaces are skipped and the geoms are
+    // left dirty, the following serial pass cleans them as usual.
+
     virtual void collide (void *data, dNearCallback *callback)=0;
     virtual void collide2 (void *data, dxGeom *geom, dNearCallback *callback)=0;
+
+    dCallWaitID obtainCallWait();
+    // return the wait object for threaded calls, allocating it if needed.
+    // returns 0 if it could not be allocated.
+
+private: // dxIThreadingDefaultImplProvider
+    virtual const dxThreadingFunctionsInfo *RetrieveThreadingDefaultImpl(dThreadingImplementationID &out_default_impl);
 };
 
 
@@ -250,7 +306,6 @@ struct dxSpace : public dxGeom {
 void dInitColliders();
 void dFinitColliders();
 
-void dClearPosrCache(void);
 void dFinitUserClasses();
 
 
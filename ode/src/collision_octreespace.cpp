@@ -0,0 +1,653 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001-2003 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+
+/*
+
+Loose octree space.
+
+Every node of the tree covers a cubic cell and holds the geoms whose AABB
+center lies in the cell and whose AABB is not larger than the cell, the
+smallest such cell being chosen. A geom may thus stick out of its cell by up
+to half of the cell size, so the nodes are tested with loose bounds twice
+as large as their cells.
+
+Nodes are only created along the paths to the geoms and are freed again as
+they become empty, so the memory follows the occupied cells. A geom that
+falls outside of the root cell makes the tree grow upwards with new roots
+twice as large, and the tree shrinks back once that geom has left. Only the
+geoms with infinite AABBs are kept aside in a list that is tested against
+everything.
+
+*/
+
+#include <ode/common.h>
+#include <ode/matrix.h>
+#include <ode/collision_space.h>
+#include <ode/collision.h>
+#include "config.h"
+#include "collision_kernel.h"
+#include "collision_space_internal.h"
+#include "objectpool.h"
+
+
+#define GEOM_ENABLED(g) (((g)->gflags & GEOM_ENABLE_TEST_MASK) == GEOM_ENABLE_TEST_VALUE)
+
+// HACK: As in the quadtree space, geoms are linked in their node with 'next'
+// and keep a pointer to the node in 'tome'.
+#define GEOM_GET_NODE(g) ((OctreeNode*)(g)->tome)
+#define GEOM_SET_NODE(g,node) { (g)->tome = (dxGeom**)(node); }
+
+const int OCTANTS = 8;
+
+
+struct OctreeNode{
+    dReal mCenter[3];
+    dReal mHalfSize;	// Half of the cell size
+
+    OctreeNode* mParent;
+    OctreeNode* mChildren[OCTANTS];
+    int mSlot;		// Index of this node among the children of the parent
+
+    dxGeom* mFirst;	// Geoms held by this node
+    int mGeomCount;	// Number of geoms held by this node and its descendants
+
+    dReal mBounds[6];	// AABB of the enabled geoms of the subtree, set by collide()
+
+    void* operator new(size_t size) { return dxObjectPool::allocBlock(size); }
+    void operator delete(void* ptr, size_t size) { dxObjectPool::freeBlock(ptr, size); }
+
+    OctreeNode(const dReal* Center, dReal HalfSize, OctreeNode* Parent, int Slot);
+
+    int GetChildSlot(const dReal* Point) const;
+    bool InsideCell(const dReal* Point) const;
+    bool LooseOverlaps(const dReal* AABB) const;
+    bool BoundsOverlap(const dReal* AABB) const;
+
+    void AddGeom(dxGeom* g);
+    void DelGeom(dxGeom* g);
+};
+
+
+OctreeNode::OctreeNode(const dReal* Center, dReal HalfSize, OctreeNode* Parent, int Slot){
+    mCenter[0] = Center[0];
+    mCenter[1] = Center[1];
+    mCenter[2] = Center[2];
+    mHalfSize = HalfSize;
+
+    mParent = Parent;
+    for (int i = 0; i < OCTANTS; i++){
+        mChildren[i] = 0;
+    }
+    mSlot = Slot;
+
+    mFirst = 0;
+    mGeomCount = 0;
+}
+
+int OctreeNode::GetChildSlot(const dReal* Point) const{
+    return (Point[0] >= mCenter[0] ? 1 : 0) | (Point[1] >= mCenter[1] ? 2 : 0) | (Point[2] >= mCenter[2] ? 4 : 0);
+}
+
+bool OctreeNode::InsideCell(const dReal* Point) const{
+    for (int i = 0; i < 3; i++){
+        if (!(Point[i] >= mCenter[i] - mHalfSize && Point[i] < mCenter[i] + mHalfSize)) return false;
+    }
+    return true;
+}
+
+bool OctreeNode::LooseOverlaps(const dReal* AABB) const{
+    const dReal LooseSize = 2 * mHalfSize;
+    return AABB[0] <= mCenter[0] + LooseSize && AABB[1] >= mCenter[0] - LooseSize &&
+        AABB[2] <= mCenter[1] + LooseSize && AABB[3] >= mCenter[1] - LooseSize &&
+        AABB[4] <= mCenter[2] + LooseSize && AABB[5] >= mCenter[2] - LooseSize;
+}
+
+bool OctreeNode::BoundsOverlap(const dReal* AABB) const{
+    return AABB[0] <= mBounds[1] && AABB[1] >= mBounds[0] &&
+        AABB[2] <= mBounds[3] && AABB[3] >= mBounds[2] &&
+        AABB[4] <= mBounds[5] && AABB[5] >= mBounds[4];
+}
+
+void OctreeNode::AddGeom(dxGeom* g){
+    g->next = mFirst;
+    mFirst = g;
+    GEOM_SET_NODE(g, this);
+
+    // Now traverse upwards to tell that we have a geom
+    for (OctreeNode* Node = this; Node; Node = Node->mParent){
+        Node->mGeomCount++;
+    }
+}
+
+void OctreeNode::DelGeom(dxGeom* g){
+    dxGeom** Link = &mFirst;
+    while (*Link != g){
+        dIASSERT(*Link);
+        Link = &(*Link)->next;
+    }
+    *Link = g->next;
+
+    g->next = 0;
+    GEOM_SET_NODE(g, 0);
+
+    // Now traverse upwards to tell that we have lost a geom
+    for (OctreeNode* Node = this; Node; Node = Node->mParent){
+        Node->mGeomCount--;
+    }
+}
+
+
+static void DeleteTree(OctreeNode* Node){
+    for (int i = 0; i < OCTANTS; i++){
+        if (Node->mChildren[i]){
+            DeleteTree(Node->mChildren[i]);
+        }
+    }
+    delete Node;
+}
+
+// Tests g against the geoms of the subtree whose loose bounds overlap its AABB
+static void CollideSubtree(OctreeNode* Node, dxGeom* g1, void* UserData, dNearCallback* Callback, dxCollisionStats* Stats){
+    for (dxGeom* g2 = Node->mFirst; g2; g2 = g2->next){
+        if (GEOM_ENABLED(g2)){
+            collideAABBs(g2, g1, UserData, Callback, Stats);
+        }
+    }
+
+    for (int i = 0; i < OCTANTS; i++){
+        OctreeNode* Child = Node->mChildren[i];
+        if (Child && Child->LooseOverlaps(g1->aabb)){
+            CollideSubtree(Child, g1, UserData, Callback, Stats);
+        }
+    }
+}
+
+// Computes the bounds of the enabled geoms of the subtree, empty bounds
+// being inverted
+static void ComputeBounds(OctreeNode* Node){
+    dReal* Bounds = Node->mBounds;
+    for (int i = 0; i < 3; i++){
+        Bounds[i * 2] = dInfinity;
+        Bounds[i * 2 + 1] = -dInfinity;
+    }
+
+    for (dxGeom* g = Node->mFirst; g; g = g->next){
+        if (GEOM_ENABLED(g)){
+            for (int i = 0; i < 3; i++){
+                if (g->aabb[i * 2] < Bounds[i * 2]) Bounds[i * 2] = g->aabb[i * 2];
+                if (g->aabb[i * 2 + 1] > Bounds[i * 2 + 1]) Bounds[i * 2 + 1] = g->aabb[i * 2 + 1];
+            }
+        }
+    }
+
+    for (int c = 0; c < OCTANTS; c++){
+        OctreeNode* Child = Node->mChildren[c];
+        if (Child){
+            ComputeBounds(Child);
+            for (int i = 0; i < 3; i++){
+                if (Child->mBounds[i * 2] < Bounds[i * 2]) Bounds[i * 2] = Child->mBounds[i * 2];
+                if (Child->mBounds[i * 2 + 1] > Bounds[i * 2 + 1]) Bounds[i * 2 + 1] = Child->mBounds[i * 2 + 1];
+            }
+        }
+    }
+}
+
+// As CollideSubtree, but descends by the bounds set by ComputeBounds
+static void CollideBoundedSubtree(OctreeNode* Node, dxGeom* g1, void* UserData, dNearCallback* Callback, dxCollisionStats* Stats){
+    for (dxGeom* g2 = Node->mFirst; g2; g2 = g2->next){
+        if (GEOM_ENABLED(g2)){
+            collideAABBs(g2, g1, UserData, Callback, Stats);
+        }
+    }
+
+    for (int i = 0; i < OCTANTS; i++){
+        OctreeNode* Child = Node->mChildren[i];
+        if (Child && Child->BoundsOverlap(g1->aabb)){
+            CollideBoundedSubtree(Child, g1, UserData, Callback, Stats);
+        }
+    }
+}
+
+// Reports every pair of the subtree once, in the order of the nodes and of
+// their geom lists. A geom is tested against the geoms after it in its node
+// and the geoms of the descendants. The loose bounds let the geoms of
+// different subtrees overlap too, so it is also tested against the subtrees of
+// the siblings after its node and after each of its ancestors. The subtrees
+// are skipped by the bounds of their geoms, which are tighter than the loose
+// bounds.
+static void CollideTree(OctreeNode* Node, void* UserData, dNearCallback* Callback, dxCollisionStats* Stats){
+    for (dxGeom* g1 = Node->mFirst; g1; g1 = g1->next){
+        if (!GEOM_ENABLED(g1)) continue;
+
+        for (dxGeom* g2 = g1->next; g2; g2 = g2->next){
+            if (GEOM_ENABLED(g2)){
+                collideAABBs(g1, g2, UserData, Callback, Stats);
+            }
+        }
+
+        for (int i = 0; i < OCTANTS; i++){
+            OctreeNode* Child = Node->mChildren[i];
+            if (Child && Child->BoundsOverlap(g1->aabb)){
+                CollideBoundedSubtree(Child, g1, UserData, Callback, Stats);
+            }
+        }
+
+        for (OctreeNode* Current = Node; Current->mParent; Current = Current->mParent){
+            OctreeNode* Parent = Current->mParent;
+            for (int i = Current->mSlot + 1; i < OCTANTS; i++){
+                OctreeNode* Sibling = Parent->mChildren[i];
+                if (Sibling && Sibling->BoundsOverlap(g1->aabb)){
+                    CollideBoundedSubtree(Sibling, g1, UserData, Callback, Stats);
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < OCTANTS; i++){
+        OctreeNode* Child = Node->mChildren[i];
+        if (Child && Child->mBounds[0] <= Child->mBounds[1]){
+            CollideTree(Child, UserData, Callback, Stats);
+        }
+    }
+}
+
+
+//****************************************************************************
+// octree space
+
+struct dxOctreeSpace : public dxSpace{
+    OctreeNode* Root;
+    OctreeNode Outer;	// Geoms with infinite AABBs, not a part of the tree
+    OctreeNode Pending;	// Geoms added since the last clean, not placed yet
+
+    dReal InitialCenter[3];
+    dReal InitialHalfSize;	// The tree does not shrink below the initial root
+    dReal MinHalfSize;	// Cells are not split below this size
+
+    dArray<dxGeom*> DirtyList;
+
+    dxOctreeSpace(dSpaceID _space, const dVector3 Center, const dVector3 Extents, int Depth);
+    ~dxOctreeSpace();
+
+    dxGeom* getGeom(int i);
+
+    void add(dxGeom* g);
+    void remove(dxGeom* g);
+    void dirty(dxGeom* g);
+
+    void computeAABB();
+
+    void cleanGeoms();
+    void collide(void* UserData, dNearCallback* Callback);
+    void collide2(void* UserData, dxGeom* g1, dNearCallback* Callback);
+
+    OctreeNode* FindNode(const dReal* AABB);
+    void GrowRoot(const dReal* Point, dReal Radius);
+    void ShrinkRoot();
+    void Prune(OctreeNode* Node);
+
+    dxGeom* GetFirstGeom();
+    dxGeom* GetNextGeom(dxGeom* g);
+    static OctreeNode* GetNextNode(OctreeNode* Node);
+};
+
+
+dxOctreeSpace::dxOctreeSpace(dSpaceID _space, const dVector3 Center, const dVector3 Extents, int Depth) : dxSpace(_space), Outer(Center, dInfinity, 0, -1), Pending(Center, dInfinity, 0, -1){
+    type = dOctreeSpaceClass;
+
+    dReal HalfSize = Extents[0];
+    if (Extents[1] > HalfSize) HalfSize = Extents[1];
+    if (Extents[2] > HalfSize) HalfSize = Extents[2];
+    if (!(HalfSize > 0)) HalfSize = REAL(1.0);
+
+    InitialCenter[0] = Center[0];
+    InitialCenter[1] = Center[1];
+    InitialCenter[2] = Center[2];
+    InitialHalfSize = HalfSize;
+    MinHalfSize = (dReal)ldexp(HalfSize, -(Depth > 0 ? Depth : 0));
+
+    Root = new OctreeNode(InitialCenter, InitialHalfSize, 0, -1);
+
+    // Init AABB. We initialize to infinity because the tree grows to hold any geom.
+    aabb[0] = -dInfinity;
+    aabb[1] = dInfinity;
+    aabb[2] = -dInfinity;
+    aabb[3] = dInfinity;
+    aabb[4] = -dInfinity;
+    aabb[5] = dInfinity;
+}
+
+dxOctreeSpace::~dxOctreeSpace(){
+    CHECK_NOT_LOCKED(this);
+    // dxSpace destructor only sees the geoms in 'first', do it here
+    for (dxGeom* g; (g = GetFirstGeom()) != 0; ){
+        if (cleanup) dGeomDestroy(g);
+        else remove(g);
+    }
+    DeleteTree(Root);
+}
+
+dxGeom* dxOctreeSpace::GetFirstGeom(){
+    if (Pending.mFirst) return Pending.mFirst;
+    if (Outer.mFirst) return Outer.mFirst;
+    if (Root->mGeomCount == 0) return 0;
+
+    // Nodes are freed when they become empty, so the first node in
+    // pre-order with geoms is not far
+    for (OctreeNode* Node = Root; Node; Node = GetNextNode(Node)){
+        if (Node->mFirst) return Node->mFirst;
+    }
+    return 0;
+}
+
+// Returns the node following Node in pre-order
+OctreeNode* dxOctreeSpace::GetNextNode(OctreeNode* Node){
+    for (int i = 0; i < OCTANTS; i++){
+        if (Node->mChildren[i]) return Node->mChildren[i];
+    }
+    for (; Node->mParent; Node = Node->mParent){
+        OctreeNode* Parent = Node->mParent;
+        for (int i = Node->mSlot + 1; i < OCTANTS; i++){
+            if (Parent->mChildren[i]) return Parent->mChildren[i];
+        }
+    }
+    return 0;
+}
+
+dxGeom* dxOctreeSpace::GetNextGeom(dxGeom* g){
+    if (g->next) return g->next;
+
+    OctreeNode* Node = GEOM_GET_NODE(g);
+    if (Node == &Pending && Outer.mFirst) return Outer.mFirst;
+    Node = (Node == &Pending || Node == &Outer) ? Root : GetNextNode(Node);
+    for (; Node; Node = GetNextNode(Node)){
+        if (Node->mFirst) return Node->mFirst;
+    }
+    return 0;
+}
+
+dxGeom* dxOctreeSpace::getGeom(int Index){
+    dUASSERT(Index >= 0 && Index < count, "index out of range");
+
+    // Sequential enumeration is cheap, anything else starts over
+    if (current_geom && current_index == Index - 1){
+        current_geom = GetNextGeom(current_geom);
+    }
+    else if (!(current_geom && current_index == Index)){
+        current_geom = GetFirstGeom();
+        for (int i = 0; i < Index; i++){
+            current_geom = GetNextGeom(current_geom);
+        }
+    }
+    current_index = Index;
+    return current_geom;
+}
+
+void dxOctreeSpace::add(dxGeom* g){
+    CHECK_NOT_LOCKED(this);
+    dAASSERT(g);
+    dUASSERT(g->parent_space == 0 && g->next == 0, "geom is already in a space");
+
+    g->gflags |= GEOM_DIRTY | GEOM_AABB_BAD;
+    DirtyList.push(g);
+
+    // The AABB is not known yet, the geom moves into the tree when cleaned
+    g->parent_space = this;
+    Pending.AddGeom(g);
+    count++;
+
+    // enumerator has been invalidated
+    current_geom = 0;
+
+    dGeomMoved(this);
+}
+
+void dxOctreeSpace::remove(dxGeom* g){
+    CHECK_NOT_LOCKED(this);
+    dAASSERT(g);
+    dUASSERT(g->parent_space == this,"object is not in this space");
+
+    // remove
+    OctreeNode* Node = GEOM_GET_NODE(g);
+    Node->DelGeom(g);
+    Prune(Node);
+    ShrinkRoot();
+    count--;
+
+    for (int i = 0; i < DirtyList.size(); i++){
+        if (DirtyList[i] == g){
+            DirtyList.remove(i);
+            --i;
+        }
+    }
+
+    // safeguard
+    g->next = 0;
+    g->tome = 0;
+    g->parent_space = 0;
+
+    // enumerator has been invalidated
+    current_geom = 0;
+
+    // the bounding box of this space (and that of all the parents) may have
+    // changed as a consequence of the removal.
+    dGeomMoved(this);
+}
+
+void dxOctreeSpace::dirty(dxGeom* g){
+    DirtyList.push(g);
+}
+
+void dxOctreeSpace::computeAABB(){
+    //
+}
+
+// Returns the node the AABB belongs to, creating the nodes on the way
+OctreeNode* dxOctreeSpace::FindNode(const dReal* AABB){
+    if (!(AABB[0] > -dInfinity && AABB[1] < dInfinity &&
+        AABB[2] > -dInfinity && AABB[3] < dInfinity &&
+        AABB[4] > -dInfinity && AABB[5] < dInfinity)){
+        return &Outer;
+    }
+
+    dReal Point[3], Radius = 0;
+    for (int i = 0; i < 3; i++){
+        Point[i] = (AABB[i * 2] + AABB[i * 2 + 1]) * REAL(0.5);
+        dReal Half = (AABB[i * 2 + 1] - AABB[i * 2]) * REAL(0.5);
+        if (Half > Radius) Radius = Half;
+    }
+
+    GrowRoot(Point, Radius);
+
+    OctreeNode* Node = Root;
+    for (;;){
+        const dReal ChildHalfSize = Node->mHalfSize * REAL(0.5);
+        if (ChildHalfSize < Radius || ChildHalfSize < MinHalfSize) break;
+
+        int Slot = Node->GetChildSlot(Point);
+        OctreeNode* Child = Node->mChildren[Slot];
+        if (!Child){
+            dReal ChildCenter[3];
+            ChildCenter[0] = Node->mCenter[0] + ((Slot & 1) ? ChildHalfSize : -ChildHalfSize);
+            ChildCenter[1] = Node->mCenter[1] + ((Slot & 2) ? ChildHalfSize : -ChildHalfSize);
+            ChildCenter[2] = Node->mCenter[2] + ((Slot & 4) ? ChildHalfSize : -ChildHalfSize);
+            Child = new OctreeNode(ChildCenter, ChildHalfSize, Node, Slot);
+            Node->mChildren[Slot] = Child;
+        }
+        Node = Child;
+    }
+    return Node;
+}
+
+// Adds roots twice as large until the root cell holds the point and is
+// large enough for the radius
+void dxOctreeSpace::GrowRoot(const dReal* Point, dReal Radius){
+    while (!(Radius <= Root->mHalfSize && Root->InsideCell(Point))){
+        const dReal HalfSize = Root->mHalfSize;
+        dReal Center[3];
+        for (int i = 0; i < 3; i++){
+            Center[i] = Root->mCenter[i] + (Point[i] >= Root->mCenter[i] ? HalfSize : -HalfSize);
+        }
+
+        OctreeNode* NewRoot = new OctreeNode(Center, HalfSize * 2, 0, -1);
+        int Slot = NewRoot->GetChildSlot(Root->mCenter);
+        NewRoot->mChildren[Slot] = Root;
+        NewRoot->mGeomCount = Root->mGeomCount;
+        Root->mParent = NewRoot;
+        Root->mSlot = Slot;
+        Root = NewRoot;
+    }
+}
+
+// Drops the roots that only lead to a single child, back to the initial size
+void dxOctreeSpace::ShrinkRoot(){
+    while (Root->mFirst == 0 && Root->mHalfSize > InitialHalfSize){
+        OctreeNode* Only = 0;
+        int ChildCount = 0;
+        for (int i = 0; i < OCTANTS; i++){
+            if (Root->mChildren[i]){
+                Only = Root->mChildren[i];
+                ChildCount++;
+            }
+        }
+
+        if (ChildCount > 1) break;
+
+        delete Root;
+        if (ChildCount == 0){
+            Root = new OctreeNode(InitialCenter, InitialHalfSize, 0, -1);
+            break;
+        }
+        Only->mParent = 0;
+        Only->mSlot = -1;
+        Root = Only;
+    }
+}
+
+// Frees the empty nodes from Node upwards
+void dxOctreeSpace::Prune(OctreeNode* Node){
+    if (Node == &Outer || Node == &Pending) return;
+
+    while (Node != Root && Node->mGeomCount == 0){
+        OctreeNode* Parent = Node->mParent;
+        Parent->mChildren[Node->mSlot] = 0;
+        DeleteTree(Node);
+        Node = Parent;
+    }
+}
+
+void dxOctreeSpace::cleanGeoms(){
+    // compute the AABBs of all dirty geoms, and clear the dirty flags
+    lock_count++;
+    recomputeDirtyAABBs(DirtyList.data(), DirtyList.size());
+
+    // All the pending geoms are in the dirty list, unlink them at once rather
+    // than one by one from the head of the list
+    for (dxGeom* g = Pending.mFirst; g; ){
+        dxGeom* Next = g->next;
+        g->next = 0;
+        GEOM_SET_NODE(g, 0);
+        g = Next;
+    }
+    Pending.mFirst = 0;
+    Pending.mGeomCount = 0;
+
+    for (int i = 0; i < DirtyList.size(); i++){
+        dxGeom* g = DirtyList[i];
+        if (IS_SPACE(g)){
+            ((dxSpace*)g)->cleanGeoms();
+        }
+        g->recomputeAABB();
+        g->gflags &= (~(GEOM_DIRTY|GEOM_AABB_BAD));
+
+        // Find the new node first, so that the path is not freed and created again
+        OctreeNode* NewNode = FindNode(g->aabb);
+        OctreeNode* OldNode = GEOM_GET_NODE(g);
+        if (!OldNode){
+            NewNode->AddGeom(g);
+        }
+        else if (NewNode != OldNode){
+            OldNode->DelGeom(g);
+            NewNode->AddGeom(g);
+            Prune(OldNode);
+        }
+    }
+    DirtyList.setSize(0);
+    ShrinkRoot();
+
+    lock_count--;
+}
+
+void dxOctreeSpace::collide(void* UserData, dNearCallback* Callback){
+    dAASSERT(Callback);
+
+    lock_count++;
+    cleanGeoms();
+
+    if (Root->mGeomCount > 1){
+        ComputeBounds(Root);
+        CollideTree(Root, UserData, Callback, stats);
+    }
+
+    // The infinite geoms are tested against everything
+    for (dxGeom* g1 = Outer.mFirst; g1; g1 = g1->next){
+        if (!GEOM_ENABLED(g1)) continue;
+        for (dxGeom* g2 = g1->next; g2; g2 = g2->next){
+            if (GEOM_ENABLED(g2)){
+                collideAABBs(g1, g2, UserData, Callback, stats);
+            }
+        }
+        for (OctreeNode* Node = Root; Node; Node = GetNextNode(Node)){
+            for (dxGeom* g2 = Node->mFirst; g2; g2 = g2->next){
+                if (GEOM_ENABLED(g2)){
+                    collideAABBs(g1, g2, UserData, Callback, stats);
+                }
+            }
+        }
+    }
+
+    lock_count--;
+}
+
+void dxOctreeSpace::collide2(void* UserData, dxGeom* g1, dNearCallback* Callback){
+    dAASSERT(g1 && Callback);
+
+    lock_count++;
+    cleanGeoms();
+    g1->recomputeAABB();
+
+    if (Root->LooseOverlaps(g1->aabb)){
+        CollideSubtree(Root, g1, UserData, Callback, stats);
+    }
+
+    for (dxGeom* g2 = Outer.mFirst; g2; g2 = g2->next){
+        if (GEOM_ENABLED(g2)){
+            collideAABBs(g2, g1, UserData, Callback, stats);
+        }
+    }
+
+    lock_count--;
+}
+
+dSpaceID dOctreeSpaceCreate(dxSpace* space, const dVector3 Center, const dVector3 Extents, int Depth){
+    return new dxOctreeSpace(space, Center, Extents, Depth);
+}
@@ -57,10 +57,10 @@ public:
 
     void Create(const dReal MinX, const dReal MaxX, const dReal MinZ, const dReal MaxZ, Block* Parent, int Depth, Block*& Blocks);
 
-    void Collide(void* UserData, dNearCallback* Callback);
-    void Collide(dGeomID g1, dGeomID g2, void* UserData, dNearCallback* Callback);
+    void Collide(void* UserData, dNearCallback* Callback, dxCollisionStats* Stats);
+    void Collide(dGeomID g1, dGeomID g2, void* UserData, dNearCallback* Callback, dxCollisionStats* Stats);
 
-    void CollideLocal(dGeomID g2, void* UserData, dNearCallback* Callback);
+    void CollideLocal(dGeomID g2, void* UserData, dNearCallback* Callback, dxCollisionStats* Stats);
 
     void AddObject(dGeomID Object);
     void DelObject(dGeomID Object);
@@ -174,7 +174,7 @@ void Block::Create(const dReal MinX, const dReal MaxX, const dReal MinZ, const d
     else mChildren = 0;
 }
 
-void Block::Collide(void* UserData, dNearCallback* Callback){
+void Block::Collide(void* UserData, dNearCallback* Callback, dxCollisionStats* Stats){
 #ifdef DRAWBLOCKS
     DrawBlock(this);
 #endif
@@ -182,7 +182,7 @@ void Block::Collide(void* UserData, dNearCallback* Callback){
     dxGeom* g = mFirst;
     while (g){
         if (GEOM_ENABLED(g)){
-            Collide(g, g->next, UserData, Callback);
+            Collide(g, g->next, UserData, Callback, Stats);
         }
         g = g->next;
     }
@@ -194,20 +194,20 @@ void Block::Collide(void* UserData, dNearCallback* Callback){
             if (CurrentChild.mGeomCount <= 1){	// Early out
                 continue;
             }
-            CurrentChild.Collide(UserData, Callback);
+            CurrentChild.Collide(UserData, Callback, Stats);
         }
     }
 }
 
 // Note: g2 is assumed to be in this Block
-void Block::Collide(dxGeom* g1, dxGeom* g2, void* UserData, dNearCallback* Callback){
+void Block::Collide(dxGeom* g1, dxGeom* g2, void* UserData, dNearCallback* Callback, dxCollisionStats* Stats){
 #ifdef DRAWBLOCKS
     DrawBlock(this);
 #endif
     // Collide against local list
     while (g2){
         if (GEOM_ENABLED(g2)){
-            collideAABBs (g1, g2, UserData, Callback);
+            collideAABBs (g1, g2, UserData, Callback, Stats);
         }
         g2 = g2->next;
     }
@@ -232,17 +232,17 @@ void Block::Collide(dxGeom* g1, dxGeom* g2, void* UserData, dNearCallback* Callb
                     g1->aabb[AXIS1 * 2 + 0] >= CurrentChild.mMaxZ ||
                     g1->aabb[AXIS1 * 2 + 1] < CurrentChild.mMinZ) continue;
             }
-            CurrentChild.Collide(g1, CurrentChild.mFirst, UserData, Callback);
+            CurrentChild.Collide(g1, CurrentChild.mFirst, UserData, Callback, Stats);
         }
     }
 }
 
-void Block::CollideLocal(dxGeom* g2, void* UserData, dNearCallback* Callback){
+void Block::CollideLocal(dxGeom* g2, void* UserData, dNearCallback* Callback, dxCollisionStats* Stats){
     // Collide against local list
     dxGeom* g1 = mFirst;
     while (g1){
         if (GEOM_ENABLED(g1)){
-            collideAABBs (g1, g2, UserData, Callback);
+            collideAABBs (g1, g2, UserData, Callback, Stats);
         }
         g1 = g1->next;
     }
@@ -543,6 +543,7 @@ void dxQuadTreeSpace::computeAABB(){
 void dxQuadTreeSpace::cleanGeoms(){
     // compute the AABBs of all dirty geoms, and clear the dirty flags
     lock_count++;
+    recomputeDirtyAABBs(DirtyList.data(), DirtyList.size());
 
     for (int i = 0; i < DirtyList.size(); i++){
         dxGeom* g = DirtyList[i];
@@ -565,7 +566,7 @@ void dxQuadTreeSpace::collide(void* UserData, dNearCallback* Callback){
     lock_count++;
     cleanGeoms();
 
-    Blocks[0].Collide(UserData, Callback);
+    Blocks[0].Collide(UserData, Callback, stats);
 
     lock_count--;
 }
@@ -596,16 +597,16 @@ void dxQuadTreeSpace::collide2(void* UserData, dxGeom* g2, dNearCallback* Callba
 
         // Collide against block and its children
         DataCallback dc = {UserData, Callback};
-        CurrentBlock->Collide(g2, CurrentBlock->mFirst, &dc, swap_callback);
+        CurrentBlock->Collide(g2, CurrentBlock->mFirst, &dc, swap_callback, stats);
 
         // Collide against parents
         while ((CurrentBlock = CurrentBlock->mParent))
-            CurrentBlock->CollideLocal(g2, UserData, Callback);
+            CurrentBlock->CollideLocal(g2, UserData, Callback, stats);
 
     }
     else {
         DataCallback dc = {UserData, Callback};
-        Blocks[0].Collide(g2, Blocks[0].mFirst, &dc, swap_callback);
+        Blocks[0].Collide(g2, Blocks[0].mFirst, &dc, swap_callback, stats);
     }
 
     lock_count--;
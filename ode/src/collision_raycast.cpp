@@ -0,0 +1,394 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001,2002 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+
+/*
+
+batched ray casts against a space.
+
+the rays are grouped in packets of neighbouring rays. each packet queries
+the broadphase once with the bounds of all its rays, and then every ray of
+the packet is tested against the candidates of the packet: first against
+their AABBs, then with the regular ray colliders. the ray keeps being
+shortened to its closest hit, so farther candidates are rejected by the
+AABB test and by the colliders themselves.
+
+the broadphase queries modify the space data structures (locks, query
+stamps), so they run on the calling thread, a block of packets at a time.
+the ray tests of a block are then split across the threads of the space
+threading implementation, each thread using its own ray geom.
+
+*/
+
+#include <ode/common.h>
+#include <ode/matrix.h>
+#include <ode/odemath.h>
+#include <ode/collision_space.h>
+#include <ode/collision.h>
+#include "config.h"
+#include "collision_kernel.h"
+#include "collision_space_internal.h"
+#include "collision_std.h"
+#include "array.h"
+#include "util.h"
+#include "odeou.h"
+
+
+// number of rays sharing one broadphase query
+#define RAYCAST_PACKET_SIZE 16
+
+// number of packets whose candidates are collected before the ray tests
+// run. this bounds the memory of the candidate lists.
+#define RAYCAST_BLOCK_PACKETS 64
+
+// contacts requested from a collider for one ray. the closest hit colliders
+// return one, heightfields can return more.
+#define RAYCAST_MAX_CONTACTS 8
+
+// slack of the ray-AABB test, so that rays grazing an AABB face are still
+// passed to the colliders
+#define RAYCAST_AABB_SLACK REAL(1e-4)
+
+
+//****************************************************************************
+// broadphase
+
+// a geom standing for the bounds of a ray packet in the space queries. it
+// is never passed to the colliders.
+
+struct dxRayPacketBounds : public dxGeom {
+    dxRayPacketBounds (unsigned long collide_bits) : dxGeom (0,0)
+    {
+        type = dRayClass;
+        gflags &= ~(GEOM_DIRTY | GEOM_AABB_BAD);
+        // only the category bits of the other geoms are checked
+        category_bits = 0;
+        this->collide_bits = collide_bits;
+    }
+
+    void computeAABB() {}
+};
+
+
+struct dxRaycastCollector {
+    dxRayPacketBounds *bounds;
+    dArray<dxGeom*> *candidates;
+};
+
+
+static void collectCandidate (void *data, dxGeom *o1, dxGeom *o2)
+{
+    dxRaycastCollector *collector = (dxRaycastCollector *)data;
+    dxGeom *g = (o1 == collector->bounds) ? o2 : o1;
+
+    if (IS_SPACE(g)) {
+        ((dxSpace *)g)->collide2 (data, collector->bounds, &collectCandidate);
+    }
+    else {
+        collector->candidates->push (g);
+    }
+}
+
+
+//****************************************************************************
+// ray tests
+
+static inline bool rayHitsAABB (const dReal *origin, const dReal *dir,
+                                dReal length, const dReal *aabb)
+{
+    dReal tmin = 0, tmax = length + RAYCAST_AABB_SLACK;
+
+    for (int axis = 0; axis < 3; axis++) {
+        dReal lo = aabb[axis*2] - RAYCAST_AABB_SLACK;
+        dReal hi = aabb[axis*2+1] + RAYCAST_AABB_SLACK;
+        if (dir[axis] == 0) {
+            if (origin[axis] < lo || origin[axis] > hi) return false;
+            continue;
+        }
+
+        dReal inv = REAL(1.0) / dir[axis];
+        dReal t1 = (lo - origin[axis]) * inv;
+        dReal t2 = (hi - origin[axis]) * inv;
+        if (t1 > t2) {
+            dReal tmp = t1;
+            t1 = t2;
+            t2 = tmp;
+        }
+        if (t1 > tmin) tmin = t1;
+        if (t2 < tmax) tmax = t2;
+        if (tmin > tmax) return false;
+    }
+
+    return true;
+}
+
+
+// geoms whose colliders keep state in the geom or in global caches, and
+// that must not be tested by several threads at a time
+
+static inline bool needsRaycastLock (const dxGeom *g)
+{
+    if (g->type == dHeightfieldClass || g->type >= dFirstUserClass) {
+        return true;
+    }
+#if !dTLS_ENABLED
+    if (g->type == dTriMeshClass) {
+        return true;
+    }
+#endif
+    return false;
+}
+
+
+struct dxRaycastCallContext {
+    dxSpace *space;
+    dMutexGroupID mutex;		// 0 when the tests run on one thread
+
+    const dReal *origins;
+    const dReal *directions;
+    const dReal *lengths;
+    dRaycastHit *hits;
+    int count;
+
+    // the current block: candidates of packet i of the block are
+    // candidates[packet_ends[i-1]..packet_ends[i]-1]
+    int first_packet;
+    int packet_count;
+    const int *packet_ends;
+    dxGeom *const *candidates;
+    volatile atomicptr next_packet;
+
+    static int ThreadedGroup_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee)
+    {
+        // Do nothing - it's just a wrapper call
+        return true;
+    }
+
+    static int ThreadedJob_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee)
+    {
+        static_cast<dxRaycastCallContext *>(callContext)->ThreadedJob();
+        return true;
+    }
+
+    void ThreadedJob()
+    {
+        // one ray geom per job, moved from ray to ray
+        dxRay ray (0,0);
+        dGeomRaySetClosestHit (&ray,1);
+
+        for (size_t packet; (packet = ObtainNextPacket()) != (size_t)packet_count; ) {
+            int begin = packet ? packet_ends[packet-1] : 0;
+            int end = packet_ends[packet];
+            int firstRay = (first_packet + (int)packet) * RAYCAST_PACKET_SIZE;
+            int lastRay = firstRay + RAYCAST_PACKET_SIZE;
+            if (lastRay > count) lastRay = count;
+
+            for (int i = firstRay; i != lastRay; i++) {
+                CastRay (&ray, i, candidates + begin, end - begin);
+            }
+        }
+    }
+
+    size_t ObtainNextPacket()
+    {
+        size_t packet;
+
+        while (true) {
+            packet = (size_t)next_packet;
+            if (packet == (size_t)packet_count) {
+                break;
+            }
+
+            if (AtomicCompareExchangePointer(&next_packet, (atomicptr)packet, (atomicptr)(packet + 1))) {
+                break;
+            }
+        }
+
+        return packet;
+    }
+
+    void CastRay (dxRay *ray, int i, dxGeom *const *geoms, int n)
+    {
+        dRaycastHit *hit = hits + i;
+        hit->geom = 0;
+        dSetZero (hit->pos,4);
+        dSetZero (hit->normal,4);
+        hit->distance = lengths[i];
+        hit->triangle = -1;
+
+        dVector3 dir;
+        dCopyVector3 (dir, directions + i*3);
+        if (n == 0 || lengths[i] <= 0 || !dSafeNormalize3 (dir)) return;
+
+        dReal *pos = ray->final_posr->pos;
+        dReal *R = ray->final_posr->R;
+        dCopyVector3 (pos, origins + i*3);
+        R[0*4+2] = dir[0];
+        R[1*4+2] = dir[1];
+        R[2*4+2] = dir[2];
+        ray->length = lengths[i];
+        ray->computeAABB();
+
+        dContactGeom contacts[RAYCAST_MAX_CONTACTS];
+        for (int j = 0; j < n; j++) {
+            dxGeom *g = geoms[j];
+            if (!rayHitsAABB (pos, dir, ray->length, g->aabb)) continue;
+
+            bool locked = mutex && needsRaycastLock (g);
+            if (locked) space->LockMutexGroupMutex (mutex, 0);
+            int num = dCollide (ray, g, RAYCAST_MAX_CONTACTS, contacts, sizeof(dContactGeom));
+            if (locked) space->UnlockMutexGroupMutex (mutex, 0);
+
+            for (int k = 0; k < num; k++) {
+                const dContactGeom &c = contacts[k];
+                if (hit->geom && c.depth >= hit->distance) continue;
+                hit->geom = g;
+                dCopyVector3 (hit->pos, c.pos);
+                dCopyVector3 (hit->normal, c.normal);
+                hit->distance = c.depth;
+                hit->triangle = (g->type == dTriMeshClass) ? c.side1 : -1;
+            }
+
+            // farther geoms can be skipped from now on
+            if (hit->geom && hit->distance < ray->length) {
+                ray->length = hit->distance;
+                ray->computeAABB();
+            }
+        }
+    }
+};
+
+
+//****************************************************************************
+// public API
+
+int dSpaceRaycastBatch (dxSpace *space, int count,
+                        const dReal *origins, const dReal *directions, const dReal *lengths,
+                        unsigned long collide_bits, dRaycastHit *hits)
+{
+    dAASSERT (space && count >= 0);
+    dUASSERT (dGeomIsSpace(space),"argument not a space");
+    dAASSERT (count == 0 || (origins && directions && lengths && hits));
+    CHECK_NOT_LOCKED (space);
+
+    if (count == 0) return 0;
+
+    // all the AABBs must be valid before the threads read them
+    space->cleanGeoms();
+
+    const int packetCount = (count + RAYCAST_PACKET_SIZE - 1) / RAYCAST_PACKET_SIZE;
+
+    dxRaycastCallContext callContext;
+    callContext.space = space;
+    callContext.mutex = 0;
+    callContext.origins = origins;
+    callContext.directions = directions;
+    callContext.lengths = lengths;
+    callContext.hits = hits;
+    callContext.count = count;
+
+    unsigned threadCount = space->RetrieveThreadingThreadCount();
+    dCallWaitID wait = 0;
+    if (threadCount > 1 && space->PreallocateResourcesForThreadedCalls(threadCount + 1)) {
+        wait = space->obtainCallWait();
+        if (wait && !space->raycast_mutex) {
+            space->raycast_mutex = space->AllocMutexGroup(1, NULL);
+        }
+        callContext.mutex = space->raycast_mutex;
+        if (!callContext.mutex) wait = 0;
+    }
+
+    dxRayPacketBounds bounds (collide_bits);
+    dArray<dxGeom*> candidates;
+    dArray<int> packetEnds;
+    dxRaycastCollector collector;
+    collector.bounds = &bounds;
+    collector.candidates = &candidates;
+
+    for (int firstPacket = 0; firstPacket < packetCount; firstPacket += RAYCAST_BLOCK_PACKETS) {
+        int blockPackets = packetCount - firstPacket;
+        if (blockPackets > RAYCAST_BLOCK_PACKETS) blockPackets = RAYCAST_BLOCK_PACKETS;
+
+        candidates.setSize (0);
+        packetEnds.setSize (0);
+        for (int packet = firstPacket; packet != firstPacket + blockPackets; packet++) {
+            int firstRay = packet * RAYCAST_PACKET_SIZE;
+            int lastRay = firstRay + RAYCAST_PACKET_SIZE;
+            if (lastRay > count) lastRay = count;
+
+            dReal *aabb = bounds.aabb;
+            aabb[0] = aabb[2] = aabb[4] = dInfinity;
+            aabb[1] = aabb[3] = aabb[5] = -dInfinity;
+            for (int i = firstRay; i != lastRay; i++) {
+                dVector3 dir;
+                dCopyVector3 (dir, directions + i*3);
+                if (lengths[i] <= 0 || !dSafeNormalize3 (dir)) continue;
+                for (int axis = 0; axis < 3; axis++) {
+                    dReal a = origins[i*3+axis];
+                    dReal b = a + dir[axis] * lengths[i];
+                    if (b < a) {
+                        dReal tmp = a;
+                        a = b;
+                        b = tmp;
+                    }
+                    if (a < aabb[axis*2]) aabb[axis*2] = a;
+                    if (b > aabb[axis*2+1]) aabb[axis*2+1] = b;
+                }
+            }
+
+            // a packet of rays that cannot hit anything gets no candidates
+            if (aabb[0] <= aabb[1]) {
+                space->collide2 (&collector, &bounds, &collectCandidate);
+            }
+            packetEnds.push (candidates.size());
+        }
+
+        callContext.first_packet = firstPacket;
+        callContext.packet_count = blockPackets;
+        callContext.packet_ends = packetEnds.data();
+        callContext.candidates = candidates.data();
+        callContext.next_packet = 0;
+
+        if (wait) {
+            unsigned jobCount = threadCount;
+            if (jobCount > (unsigned)blockPackets) jobCount = (unsigned)blockPackets;
+
+            dCallReleaseeID groupReleasee;
+            // First post a group call with dependency count set to number of jobs
+            space->PostThreadedCall(NULL, &groupReleasee, jobCount, NULL, wait,
+                &dxRaycastCallContext::ThreadedGroup_Callback, (void *)&callContext, 0, "Raycast Group");
+
+            space->PostThreadedCallsGroup(NULL, jobCount, groupReleasee,
+                &dxRaycastCallContext::ThreadedJob_Callback, (void *)&callContext, "Raycast Job");
+
+            space->WaitThreadedCallExclusively(NULL, wait, NULL, "Raycast Wait");
+        }
+        else {
+            callContext.ThreadedJob();
+        }
+    }
+
+    int hitCount = 0;
+    for (int i = 0; i < count; i++) {
+        if (hits[i].geom) hitCount++;
+    }
+    return hitCount;
+}
@@ -180,6 +180,11 @@ private:
     */
     void BoxPruning( int count, const dxGeom** geoms, dArray< Pair >& pairs );
 
+    /**
+    *	Builds the collide2() query index from the clean geoms.
+    */
+    void BuildQueryIndex();
+
 
     //--------------------------------------------------------------------------
     // Implementation Data
@@ -207,6 +212,16 @@ private:
     // NOTE: this is float not dReal because of the OPCODE radix sorter
     dArray< float > poslist;
     RaixSortContext	sortContext;
+
+    // The collide2() query index: the clean geoms with finite AABBs sorted by
+    // their minimum on the primary axis. It is kept between queries and is
+    // rebuilt only after the space contents have changed.
+    bool QueryIndexValid;
+    dArray<dxGeom*> QueryGeomList;	// geoms sorted by primary axis minimum
+    dArray<float> QueryPosList;		// primary axis minimums, rounded to float
+    dArray<dxGeom*> QueryLinearList;	// infinite and very large geoms, tested with every query
+    dReal QueryMaxExtent;			// largest primary axis extent in QueryGeomList
+    RaixSortContext	querySortContext;
 };
 
 // Creation
@@ -231,17 +246,23 @@ dSpaceID dSweepAndPruneSpaceCreate( dxSpace* space, int axisorder ) {
 *  A bit of repetitive work - similar to collideAABBs, but doesn't check
 *  if AABBs intersect (because SAP returns pairs with overlapping AABBs).
 */
-static void collideGeomsNoAABBs( dxGeom *g1, dxGeom *g2, void *data, dNearCallback *callback )
+static void collideGeomsNoAABBs( dxGeom *g1, dxGeom *g2, void *data, dNearCallback *callback, dxCollisionStats *stats )
 {
     dIASSERT( (g1->gflags & GEOM_AABB_BAD)==0 );
     dIASSERT( (g2->gflags & GEOM_AABB_BAD)==0 );
 
-    // no contacts if both geoms on the same body, and the body is not 0
-    if (g1->body == g2->body && g1->body) return;
+    dCollisionPairStats *pairstats = 0;
+    if (stats) {
+        pairstats = &stats->getPairStats( g1->type, g2->type );
+        pairstats->candidate_pairs++;
+    }
 
-    // test if the category and collide bitfields match
-    if ( ((g1->category_bits & g2->collide_bits) ||
+    // no contacts if both geoms on the same body, and the body is not 0
+    // and test if the category and collide bitfields match
+    if ( (g1->body == g2->body && g1->body) ||
+        ((g1->category_bits & g2->collide_bits) ||
         (g2->category_bits & g1->collide_bits)) == 0) {
+            if (pairstats) pairstats->filtered_pairs++;
             return;
     }
 
@@ -250,8 +271,10 @@ static void collideGeomsNoAABBs( dxGeom *g1, dxGeom *g2, void *data, dNearCallba
 
     // check if either object is able to prove that it doesn't intersect the
     // AABB of the other
-    if (g1->AABBTest (g2,bounds2) == 0) return;
-    if (g2->AABBTest (g1,bounds1) == 0) return;
+    if (g1->AABBTest (g2,bounds2) == 0 || g2->AABBTest (g1,bounds1) == 0) {
+        if (pairstats) pairstats->aabb_rejected_pairs++;
+        return;
+    }
 
     // the objects might actually intersect - call the space callback function
     callback (data,g1,g2);
@@ -273,6 +296,9 @@ dxSAPSpace::dxSAPSpace( dSpaceID _space, int axisorder ) : dxSpace( _space )
     ax0idx = ( ( axisorder ) & 3 ) << 1;
     ax1idx = ( ( axisorder >> 2 ) & 3 ) << 1;
     ax2idx = ( ( axisorder >> 4 ) & 3 ) << 1;
+
+    QueryIndexValid = false;
+    QueryMaxExtent = 0;
 }
 
 dxSAPSpace::~dxSAPSpace()
@@ -315,6 +341,7 @@ void dxSAPSpace::add( dxGeom* g )
 
     g->parent_space = this;
     this->count++;
+    QueryIndexValid = false;
 
     dGeomMoved(this);
 }
@@ -351,6 +378,7 @@ void dxSAPSpace::remove( dxGeom* g )
         GeomList.setSize( geomSize-1 );
     }
     count--;
+    QueryIndexValid = false;
 
     // safeguard
     g->parent_space = 0;
@@ -365,6 +393,8 @@ void dxSAPSpace::dirty( dxGeom* g )
     dAASSERT(g);
     dUASSERT(g->parent_space == this,"object is not in this space");
 
+    QueryIndexValid = false;
+
     // check if already dirtied
     int dirtyIdx = GEOM_GET_DIRTY_IDX(g);
     if( dirtyIdx != GEOM_INVALID_IDX )
@@ -400,6 +430,7 @@ void dxSAPSpace::cleanGeoms()
     // compute the AABBs of all dirty geoms, clear the dirty flags,
     // remove from dirty list, place into geom list
     lock_count++;
+    recomputeDirtyAABBs( DirtyList.data(), DirtyList.size() );
 
     int geomSize = GeomList.size();
     GeomList.setSize( geomSize + dirtySize ); // ensure space in geom list
@@ -468,7 +499,7 @@ void dxSAPSpace::collide( void *data, dNearCallback *callback )
         const Pair& pair = overlapBoxes[ j ];
         dxGeom* g1 = TmpGeomList[ pair.id0 ];
         dxGeom* g2 = TmpGeomList[ pair.id1 ];
-        collideGeomsNoAABBs( g1, g2, data, callback );
+        collideGeomsNoAABBs( g1, g2, data, callback, stats );
     }
 
     int infSize = TmpInfGeomList.size();
@@ -482,36 +513,130 @@ void dxSAPSpace::collide( void *data, dNearCallback *callback )
         // collide infinite ones
         for( n = m+1; n < infSize; ++n ) {
             dxGeom* g2 = TmpInfGeomList[n];
-            collideGeomsNoAABBs( g1, g2, data, callback );
+            collideGeomsNoAABBs( g1, g2, data, callback, stats );
         }
 
         // collide infinite ones with normal ones
         for( n = 0; n < normSize; ++n ) {
             dxGeom* g2 = TmpGeomList[n];
-            collideGeomsNoAABBs( g1, g2, data, callback );
+            collideGeomsNoAABBs( g1, g2, data, callback, stats );
         }
     }
 
     lock_count--;
 }
 
+void dxSAPSpace::BuildQueryIndex()
+{
+    int geom_count = GeomList.size();
+    int axis0min = ax0idx, axis0max = ax0idx + 1;
+
+    // the geoms much larger than average along the primary axis would
+    // widen the search window of every query, keep them aside
+    dReal extentSum = 0;
+    int finiteCount = 0;
+    for ( int i = 0; i < geom_count; ++i ) {
+        const dReal *bounds = GeomList[i]->aabb;
+        if ( bounds[axis0min] != -dInfinity && bounds[axis0max] != dInfinity ) {
+            extentSum += bounds[axis0max] - bounds[axis0min];
+            finiteCount++;
+        }
+    }
+    dReal largeExtent = finiteCount ? 8 * extentSum / finiteCount : 0;
+
+    TmpGeomList.setSize(0);
+    QueryLinearList.setSize(0);
+    QueryMaxExtent = 0;
+    for ( int i = 0; i < geom_count; ++i ) {
+        dxGeom* g = GeomList[i];
+        const dReal *bounds = g->aabb;
+        if ( bounds[axis0min] == -dInfinity || bounds[axis0max] == dInfinity ) {
+            QueryLinearList.push( g );
+            continue;
+        }
+        dReal extent = bounds[axis0max] - bounds[axis0min];
+        if ( extent > largeExtent ) {
+            QueryLinearList.push( g );
+            continue;
+        }
+        if ( extent > QueryMaxExtent )
+            QueryMaxExtent = extent;
+        TmpGeomList.push( g );
+    }
+
+    // sort the rest by the primary axis minimum
+    int sortedCount = TmpGeomList.size();
+    poslist.setSize( sortedCount );
+    for ( int i = 0; i < sortedCount; ++i )
+        poslist[ i ] = (float)TmpGeomList[i]->aabb[ axis0min ];
+
+    QueryGeomList.setSize( sortedCount );
+    QueryPosList.setSize( sortedCount );
+    if ( sortedCount > 0 ) {
+        const uint32* Sorted = querySortContext.RadixSort( poslist.data(), sortedCount );
+        for ( int i = 0; i < sortedCount; ++i ) {
+            QueryGeomList[ i ] = TmpGeomList[ Sorted[i] ];
+            QueryPosList[ i ] = poslist[ Sorted[i] ];
+        }
+    }
+
+    QueryIndexValid = true;
+}
+
 void dxSAPSpace::collide2( void *data, dxGeom *geom, dNearCallback *callback )
 {
     dAASSERT (geom && callback);
 
-    // TODO: This is just a simple N^2 implementation
-
     lock_count++;
 
     cleanGeoms();
     geom->recomputeAABB();
 
-    // intersect bounding boxes
-    int geom_count = GeomList.size();
-    for ( int i = 0; i < geom_count; ++i ) {
-        dxGeom* g = GeomList[i];
+    if ( !QueryIndexValid )
+        BuildQueryIndex();
+
+    const dReal *bounds = geom->aabb;
+    int sortedCount = QueryGeomList.size();
+
+    if ( bounds[ax0idx] == -dInfinity || bounds[ax0idx+1] == dInfinity ) {
+        // the query spans the whole primary axis
+        for ( int i = 0; i < sortedCount; ++i ) {
+            dxGeom* g = QueryGeomList[i];
+            if ( GEOM_ENABLED(g) )
+                collideAABBs (g,geom,data,callback,stats);
+        }
+    }
+    else if ( sortedCount > 0 ) {
+        // Rounding to float preserves the order of the positions, so all the
+        // geoms with the minimum not above the query maximum are before the
+        // first position greater than the rounded query maximum.
+        float queryMax = (float)bounds[ax0idx+1];
+        int lo = 0, hi = sortedCount;
+        while ( lo < hi ) {
+            int mid = (lo + hi) >> 1;
+            if ( QueryPosList[mid] <= queryMax )
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        // Walk back until the minimums are too small for any geom to reach
+        // the query minimum (with a margin for the rounding of the extents).
+        dReal stop = bounds[ax0idx] - QueryMaxExtent;
+        stop -= (dFabs(bounds[ax0idx]) + QueryMaxExtent) * REAL(1e-5);
+        float stopPos = (float)stop;
+        for ( int i = lo - 1; i >= 0 && QueryPosList[i] >= stopPos; --i ) {
+            dxGeom* g = QueryGeomList[i];
+            if ( GEOM_ENABLED(g) )
+                collideAABBs (g,geom,data,callback,stats);
+        }
+    }
+
+    int linearCount = QueryLinearList.size();
+    for ( int i = 0; i < linearCount; ++i ) {
+        dxGeom* g = QueryLinearList[i];
         if ( GEOM_ENABLED(g) )
-            collideAABBs (g,geom,data,callback);
+            collideAABBs (g,geom,data,callback,stats);
     }
 
     lock_count--;
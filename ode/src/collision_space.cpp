@@ -33,7 +33,9 @@ spaces
 #include "config.h"
 #include "collision_kernel.h"
 #include "collision_space_internal.h"
+#include "array.h"
 #include "util.h"
+#include "odeou.h"
 
 #ifdef _MSC_VER
 #pragma warning(disable:4291)  // for VC++, no complaints about "no matching operator delete found"
@@ -89,6 +91,11 @@ dxSpace::dxSpace (dSpaceID _space) : dxGeom (_space,0)
     current_index = 0;
     current_geom = 0;
     lock_count = 0;
+    stats = 0;
+    call_wait = 0;
+    raycast_mutex = 0;
+
+    SetThreadingDefaultImplProvider(this);
 }
 
 
@@ -110,6 +117,158 @@ dxSpace::~dxSpace()
             remove (g);
         }
     }
+    delete stats;
+
+    if (call_wait) {
+        FreeThreadedCallWait(call_wait);
+    }
+    if (raycast_mutex) {
+        FreeMutexGroup(raycast_mutex);
+    }
+}
+
+
+void dxSpace::AssignThreadingImpl(const dxThreadingFunctionsInfo *functions_info, dThreadingImplementationID threading_impl)
+{
+    // the wait and mutex objects belong to the old implementation
+    if (call_wait) {
+        FreeThreadedCallWait(call_wait);
+        call_wait = 0;
+    }
+    if (raycast_mutex) {
+        FreeMutexGroup(raycast_mutex);
+        raycast_mutex = 0;
+    }
+
+    dxThreadingBase::AssignThreadingImpl(functions_info, threading_impl);
+}
+
+
+const dxThreadingFunctionsInfo *dxSpace::RetrieveThreadingDefaultImpl(dThreadingImplementationID &out_default_impl)
+{
+    // the default is the self-threaded implementation of the worlds, which
+    // keeps the AABB updates serial
+    return dxWorld::RetrieveDefaultThreading(out_default_impl);
+}
+
+
+//****************************************************************************
+// threaded AABB updates
+
+// the geoms are handed out to the threads in chunks of this size, and a
+// batch must have at least two chunks per thread to be worth the threading
+#define AABB_CHUNK_SIZE 64
+
+struct dxSpaceAABBsCallContext {
+    dxGeom *const *geoms;
+    size_t count;
+    volatile atomicptr next_chunk;
+
+    dxSpaceAABBsCallContext(dxGeom *const *_geoms, size_t _count):
+        geoms(_geoms), count(_count), next_chunk(0)
+    {
+    }
+
+    static int ThreadedGroup_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee)
+    {
+        // Do nothing - it's just a wrapper call
+        return true;
+    }
+
+    static int ThreadedJob_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee)
+    {
+        static_cast<dxSpaceAABBsCallContext *>(callContext)->ThreadedJob();
+        return true;
+    }
+
+    void ThreadedJob()
+    {
+        const size_t chunkCount = (count + AABB_CHUNK_SIZE - 1) / AABB_CHUNK_SIZE;
+
+        for (size_t chunk; (chunk = ObtainNextChunk(chunkCount)) != chunkCount; ) {
+            size_t end = (chunk + 1) * AABB_CHUNK_SIZE;
+            if (end > count) end = count;
+            for (size_t i = chunk * AABB_CHUNK_SIZE; i != end; i++) {
+                dxGeom *g = geoms[i];
+                // child spaces have to be cleaned first, that is left to the
+                // serial pass
+                if (!IS_SPACE(g)) {
+                    g->recomputeAABB();
+                }
+            }
+        }
+    }
+
+    size_t ObtainNextChunk(size_t chunkCount)
+    {
+        size_t chunk;
+
+        while (true) {
+            chunk = (size_t)next_chunk;
+            if (chunk == chunkCount) {
+                break;
+            }
+
+            if (AtomicCompareExchangePointer(&next_chunk, (atomicptr)chunk, (atomicptr)(chunk + 1))) {
+                break;
+            }
+        }
+
+        return chunk;
+    }
+};
+
+
+dCallWaitID dxSpace::obtainCallWait()
+{
+    if (!call_wait) {
+        call_wait = AllocThreadedCallWait();
+    }
+    return call_wait;
+}
+
+
+void dxSpace::recomputeDirtyAABBs (dxGeom *const *geoms, int n)
+{
+    if (n < 2 * AABB_CHUNK_SIZE) return;
+
+    unsigned threadCount = RetrieveThreadingThreadCount();
+    if (threadCount < 2) return;
+
+    unsigned jobCount = (unsigned)(n / (2 * AABB_CHUNK_SIZE));
+    if (jobCount > threadCount) jobCount = threadCount;
+
+    // on any failure the serial pass still computes all the AABBs
+    if (!PreallocateResourcesForThreadedCalls(jobCount + 1)) return;
+
+    dCallWaitID wait = obtainCallWait();
+    if (!wait) return;
+
+    dxSpaceAABBsCallContext callContext(geoms, (size_t)n);
+
+    dCallReleaseeID groupReleasee;
+    // First post a group call with dependency count set to number of jobs
+    PostThreadedCall(NULL, &groupReleasee, jobCount, NULL, wait, 
+        &dxSpaceAABBsCallContext::ThreadedGroup_Callback, (void *)&callContext, 0, "Space AABBs Group");
+
+    PostThreadedCallsGroup(NULL, jobCount, groupReleasee, 
+        &dxSpaceAABBsCallContext::ThreadedJob_Callback, (void *)&callContext, "Space AABBs Job");
+
+    WaitThreadedCallExclusively(NULL, wait, NULL, "Space AABBs Wait");
+}
+
+
+void dxSpace::recomputeDirtyAABBs ()
+{
+    // the dirty geoms come first in the list
+    if (first == 0 || (first->gflags & GEOM_DIRTY) == 0) return;
+    if (RetrieveThreadingThreadCount() < 2) return;
+
+    aabb_batch.setSize(0);
+    for (dxGeom *g=first; g && (g->gflags & GEOM_DIRTY); g=g->next) {
+        aabb_batch.push(g);
+    }
+    recomputeDirtyAABBs (aabb_batch.data(), aabb_batch.size());
 }
 
 
@@ -233,6 +392,7 @@ void dxSimpleSpace::cleanGeoms()
 {
     // compute the AABBs of all dirty geoms, and clear the dirty flags
     lock_count++;
+    recomputeDirtyAABBs();
     for (dxGeom *g=first; g && (g->gflags & GEOM_DIRTY); g=g->next) {
         if (IS_SPACE(g)) {
             ((dxSpace*)g)->cleanGeoms();
@@ -256,7 +416,7 @@ void dxSimpleSpace::collide (void *data, dNearCallback *callback)
         if (GEOM_ENABLED(g1)){
             for (dxGeom *g2=g1->next; g2; g2=g2->next) {
                 if (GEOM_ENABLED(g2)){
-                    collideAABBs (g1,g2,data,callback);
+                    collideAABBs (g1,g2,data,callback,stats);
                 }
             }
         }
@@ -278,7 +438,7 @@ void dxSimpleSpace::collide2 (void *data, dxGeom *geom,
     // intersect bounding boxes
     for (dxGeom *g=first; g; g=g->next) {
         if (GEOM_ENABLED(g)){
-            collideAABBs (g,geom,data,callback);
+            collideAABBs (g,geom,data,callback,stats);
         }
     }
 
@@ -302,22 +462,26 @@ static const long int prime[NUM_PRIMES] = {1L,2L,3L,7L,13L,31L,61L,127L,251L,509
 67108859L,134217689L,268435399L,536870909L,1073741789L};
 
 
-// an axis aligned bounding box in the hash table
-struct dxAABB {
-    dxAABB *next;		// next in the list of all AABBs
+// a geom in the hash space. entries persist between the collision calls,
+// an entry is only placed again when its geom has moved.
+struct dxHashEntry {
+    dxGeom *geom;		// corresponding geometry object, 0 for free entries
+    int list;		// the level list this entry is in, -1 if not placed yet
     int level;		// the level this is stored in (cell size = 2^level)
     int dbounds[6];	// AABB bounds, discretized to cell size
-    dxGeom *geom;		// corresponding geometry object (AABB stored here)
-    int index;		// index of this AABB, starting from 0
+    int first_node;	// first of the nodes of this entry, -1 if none
+    int prev,next;	// links in the level list (next links the free entries)
+    unsigned stamp;	// number of the last collide2() query that tested this entry
 };
 
 
-// a hash table node that represents an AABB that intersects a particular cell
-// at a particular level
-struct Node {
-    Node *next;		// next node in hash table collision list, 0 if none
-    int x,y,z;		// cell position in space, discretized to cell size
-    dxAABB *aabb;		// axis aligned bounding box that intersects this cell
+// a hash table node that represents an entry that intersects a particular
+// cell at a particular level
+struct dxHashNode {
+    int prev,next;	// links in the hash table bucket, -1 if none
+    int level,x,y,z;	// cell level and position in space, discretized to cell size
+    int entry;		// entry that intersects this cell, -1 for free nodes
+    int entry_next;	// next node of the same entry (next free node for free nodes)
 };
 
 
@@ -352,30 +516,96 @@ static int findLevel (dReal bounds[6])
 
 
 // find a virtual memory address for a cell at the given level and x,y,z
-// position.
-// @@@ currently this is not very sophisticated, e.g. the scaling
-// factors could be better designed to avoid collisions, and they should
-// probably depend on the hash table physical size.
+// position. the coordinates are scrambled with large odd multipliers so that
+// neighbouring cells spread over the whole table.
 
 static unsigned long getVirtualAddress (int level, int x, int y, int z)
 {
-    return level*1000 + x*100 + y*10 + z;
+    return ((unsigned long)x * 73856093UL) ^ ((unsigned long)y * 19349663UL) ^
+        ((unsigned long)z * 83492791UL) ^ ((unsigned long)level * 2654435761UL);
+}
+
+
+// return the hash table size for the given number of nodes: a prime > 2*n
+
+static int findTableSize (int n)
+{
+    int i;
+    for (i=0; i<NUM_PRIMES; i++) {
+        if (prime[i] >= (2*n)) break;
+    }
+    if (i >= NUM_PRIMES) i = NUM_PRIMES-1;
+    return prime[i];
+}
+
+
+// return nonzero if x,y,z is the lowest cell of the intersection of the
+// discrete bounds a and b
+
+static inline int isFirstSharedCell (const int a[6], const int b[6], int x, int y, int z)
+{
+    return x == (a[0] > b[0] ? a[0] : b[0]) &&
+        y == (a[2] > b[2] ? a[2] : b[2]) &&
+        z == (a[4] > b[4] ? a[4] : b[4]);
+}
+
+
+// the home slot of a geom in the entry map
+
+static inline int getMapSlot (const dxGeom *geom, int mask)
+{
+    unsigned long h = (unsigned long)((size_t)geom >> 3) * 2654435761UL;
+    return (int)((h ^ (h >> 16)) & mask);
 }
 
 //****************************************************************************
 // hash space
 
+// the hash table is kept between the collision calls. the geoms moved since
+// the last call are re-inserted when the space is cleaned, so the cost of
+// keeping the table up to date follows the number of moved geoms rather
+// than the total. the entries and the cell nodes are pooled in arrays and
+// linked by index, which keeps the memory on the heap and bounded by the
+// largest contents the space has had.
+
 struct dxHashSpace : public dxSpace {
     int global_minlevel;	// smallest hash table level to put AABBs in
     int global_maxlevel;	// objects that need a level larger than this will be
     // put in a "big objects" list instead of a hash table
 
+    // the entries are kept in level lists: list L-global_minlevel holds the
+    // entries of level L and the last list holds the big boxes.
+    dArray<dxHashEntry> entries;
+    dArray<dxHashNode> nodes;
+    dArray<int> table;		// bucket heads, -1 if empty
+    dArray<int> entry_map;	// open addressing map of geoms to entries, -1 if empty
+    dArray<int> list_head;	// first entry of each level list, -1 if empty
+    dArray<int> list_count;	// number of entries in each level list
+    int free_entry,free_node;	// heads of the free lists, -1 if empty
+    int num_entries,num_nodes;	// number of entries and nodes in use
+    int place_all;		// 1 if all geoms have to be placed, not just the dirty ones
+    unsigned query_stamp;	// number of the current collide2() query
+
     dxHashSpace (dSpaceID _space);
     void setLevels (int minlevel, int maxlevel);
     void getLevels (int *minlevel, int *maxlevel);
+    void add (dxGeom *);
+    void remove (dxGeom *);
     void cleanGeoms();
     void collide (void *data, dNearCallback *callback);
     void collide2 (void *data, dxGeom *geom, dNearCallback *callback);
+
+    int getNumLevels() const { return global_maxlevel - global_minlevel + 1; }
+    void resetTable();
+    int findEntry (const dxGeom *geom) const;
+    void mapEntry (int e);
+    void unmapEntry (int e);
+    void growEntryMap();
+    void insertNode (int e, int level, int x, int y, int z);
+    void growTable();
+    void placeEntry (int e);
+    void unplaceEntry (int e);
+    void collideLevel (int level, dxGeom *geom, void *data, dNearCallback *callback);
 };
 
 
@@ -384,14 +614,22 @@ dxHashSpace::dxHashSpace (dSpaceID _space) : dxSpace (_space)
     type = dHashSpaceClass;
     global_minlevel = -3;
     global_maxlevel = 10;
+    free_entry = -1;
+    num_entries = 0;
+    query_stamp = 0;
+    resetTable();
 }
 
 
 void dxHashSpace::setLevels (int minlevel, int maxlevel)
 {
     dAASSERT (minlevel <= maxlevel);
-    global_minlevel = minlevel;
-    global_maxlevel = maxlevel;
+    if (minlevel != global_minlevel || maxlevel != global_maxlevel) {
+        CHECK_NOT_LOCKED (this);
+        global_minlevel = minlevel;
+        global_maxlevel = maxlevel;
+        resetTable();
+    }
 }
 
 
@@ -402,180 +640,374 @@ void dxHashSpace::getLevels (int *minlevel, int *maxlevel)
 }
 
 
-void dxHashSpace::cleanGeoms()
+// empty the hash table and the level lists. all the entries will be placed
+// again by the next cleanGeoms().
+
+void dxHashSpace::resetTable()
 {
-    // compute the AABBs of all dirty geoms, and clear the dirty flags
-    lock_count++;
-    for (dxGeom *g=first; g && (g->gflags & GEOM_DIRTY); g=g->next) {
-        if (IS_SPACE(g)) {
-            ((dxSpace*)g)->cleanGeoms();
-        }
-        g->recomputeAABB();
-        g->gflags &= (~(GEOM_DIRTY|GEOM_AABB_BAD));
+    int i,numlists = getNumLevels() + 1;
+    list_head.setSize (numlists);
+    list_count.setSize (numlists);
+    for (i=0; i < numlists; i++) {
+        list_head[i] = -1;
+        list_count[i] = 0;
     }
-    lock_count--;
+
+    nodes.setSize (0);
+    free_node = -1;
+    num_nodes = 0;
+    int sz = findTableSize (8*num_entries);
+    table.setSize (sz);
+    for (i=0; i < sz; i++) table[i] = -1;
+
+    for (i=0; i < entries.size(); i++) {
+        entries[i].list = -1;
+        entries[i].first_node = -1;
+    }
+    place_all = 1;
 }
 
 
-void dxHashSpace::collide (void *data, dNearCallback *callback)
+int dxHashSpace::findEntry (const dxGeom *geom) const
 {
-    dAASSERT(this && callback);
-    dxGeom *geom;
-    dxAABB *aabb;
-    int i,maxlevel;
+    int mask = entry_map.size() - 1;
+    for (int i = getMapSlot (geom,mask); ; i = (i+1) & mask) {
+        int e = entry_map[i];
+        dIASSERT (e >= 0);
+        if (entries[e].geom == geom) return e;
+    }
+}
 
-    // 0 or 1 geoms can't collide with anything
-    if (count < 2) return;
 
-    lock_count++;
-    cleanGeoms();
+void dxHashSpace::mapEntry (int e)
+{
+    if (2*(num_entries+1) > entry_map.size()) growEntryMap();
+    int mask = entry_map.size() - 1;
+    int i = getMapSlot (entries[e].geom,mask);
+    while (entry_map[i] >= 0) i = (i+1) & mask;
+    entry_map[i] = e;
+}
 
-    // create a list of auxiliary information for all geom axis aligned bounding
-    // boxes. set the level for all AABBs. put AABBs larger than the space's
-    // global_maxlevel in the big_boxes list, check everything else against
-    // that list at the end. for AABBs that are not too big, record the maximum
-    // level that we need.
-
-    int n = 0;			// number of AABBs in main list
-    dxAABB *first_aabb = 0;	// list of AABBs in hash table
-    dxAABB *big_boxes = 0;	// list of AABBs too big for hash table
-    maxlevel = global_minlevel - 1;
-    for (geom = first; geom; geom=geom->next) {
-        if (!GEOM_ENABLED(geom)){
-            continue;
-        }
-        dxAABB *aabb = (dxAABB*) ALLOCA (sizeof(dxAABB));
-        aabb->geom = geom;
-        // compute level, but prevent cells from getting too small
-        int level = findLevel (geom->aabb);
-        if (level < global_minlevel) level = global_minlevel;
-        if (level <= global_maxlevel) {
-            // aabb goes in main list
-            aabb->next = first_aabb;
-            first_aabb = aabb;
-            aabb->level = level;
-            if (level > maxlevel) maxlevel = level;
-            // cellsize = 2^level
-            dReal cellsize = (dReal) ldexp (1.0,level);
-            // discretize AABB position to cell size
-            for (i=0; i < 6; i++) aabb->dbounds[i] = (int)
-                floor (geom->aabb[i]/cellsize);
-            // set AABB index
-            aabb->index = n;
-            n++;
-        }
-        else {
-            // aabb is too big, put it in the big_boxes list. we don't care about
-            // setting level, dbounds, index, or the maxlevel
-            aabb->next = big_boxes;
-            big_boxes = aabb;
+
+void dxHashSpace::unmapEntry (int e)
+{
+    int mask = entry_map.size() - 1;
+    int i = getMapSlot (entries[e].geom,mask);
+    while (entry_map[i] != e) i = (i+1) & mask;
+
+    // close the gap: move back any later entry of the probe sequence that
+    // would not be found any more
+    for (int j = (i+1) & mask; entry_map[j] >= 0; j = (j+1) & mask) {
+        int k = getMapSlot (entries[entry_map[j]].geom,mask);
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) continue;
+        entry_map[i] = entry_map[j];
+        i = j;
+    }
+    entry_map[i] = -1;
+}
+
+
+void dxHashSpace::growEntryMap()
+{
+    int size = entry_map.size() ? 2*entry_map.size() : 64;
+    entry_map.setSize (size);
+    int i;
+    for (i=0; i < size; i++) entry_map[i] = -1;
+    for (i=0; i < entries.size(); i++) {
+        if (entries[i].geom) {
+            int j = getMapSlot (entries[i].geom,size-1);
+            while (entry_map[j] >= 0) j = (j+1) & (size-1);
+            entry_map[j] = i;
         }
     }
+}
 
-    // for `n' objects, an n*n array of bits is used to record if those objects
-    // have been intersection-tested against each other yet. this array can
-    // grow large with high n, but oh well...
-    int tested_rowsize = (n+7) >> 3;	// number of bytes needed for n bits
-    unsigned char *tested = (unsigned char *) ALLOCA (n * tested_rowsize);
-    memset (tested,0,n * tested_rowsize);
 
-    // create a hash table to store all AABBs. each AABB may take up to 8 cells.
-    // we use chaining to resolve collisions, but we use a relatively large table
-    // to reduce the chance of collisions.
+void dxHashSpace::add (dxGeom *geom)
+{
+    dxSpace::add (geom);
 
-    // compute hash table size sz to be a prime > 8*n
-    for (i=0; i<NUM_PRIMES; i++) {
-        if (prime[i] >= (8*n)) break;
+    int e;
+    if (free_entry >= 0) {
+        e = free_entry;
+        free_entry = entries[e].next;
+    }
+    else {
+        e = entries.size();
+        entries.setSize (e+1);
     }
-    if (i >= NUM_PRIMES) i = NUM_PRIMES-1;	// probably pointless
-    int sz = prime[i];
+    dxHashEntry &entry = entries[e];
+    entry.geom = geom;
+    entry.list = -1;
+    entry.first_node = -1;
+    entry.stamp = 0;
+    mapEntry (e);
+    num_entries++;
+}
+
+
+void dxHashSpace::remove (dxGeom *geom)
+{
+    dxSpace::remove (geom);
+
+    int e = findEntry (geom);
+    unplaceEntry (e);
+    unmapEntry (e);
+    entries[e].geom = 0;
+    entries[e].next = free_entry;
+    free_entry = e;
+    num_entries--;
+}
+
+
+void dxHashSpace::insertNode (int e, int level, int x, int y, int z)
+{
+    int n;
+    if (free_node >= 0) {
+        n = free_node;
+        free_node = nodes[n].entry_next;
+    }
+    else {
+        n = nodes.size();
+        nodes.setSize (n+1);
+    }
+    num_nodes++;
+
+    dxHashNode &node = nodes[n];
+    node.level = level;
+    node.x = x;
+    node.y = y;
+    node.z = z;
+    node.entry = e;
+    node.entry_next = entries[e].first_node;
+    entries[e].first_node = n;
+
+    unsigned long hi = getVirtualAddress (level,x,y,z) % table.size();
+    node.prev = -1;
+    node.next = table[hi];
+    if (node.next >= 0) nodes[node.next].prev = n;
+    table[hi] = n;
+
+    if (num_nodes > table.size()) growTable();
+}
 
-    // allocate and initialize hash table node pointers
-    Node **table = (Node **) ALLOCA (sizeof(Node*) * sz);
-    for (i=0; i<sz; i++) table[i] = 0;
 
-    // add each AABB to the hash table (may need to add it to up to 8 cells)
-    for (aabb=first_aabb; aabb; aabb=aabb->next) {
-        int *dbounds = aabb->dbounds;
+void dxHashSpace::growTable()
+{
+    int sz = findTableSize (num_nodes);
+    if (sz <= table.size()) return;
+    table.setSize (sz);
+    int i;
+    for (i=0; i < sz; i++) table[i] = -1;
+    for (i=0; i < nodes.size(); i++) {
+        dxHashNode &node = nodes[i];
+        if (node.entry < 0) continue;
+        unsigned long hi = getVirtualAddress (node.level,node.x,node.y,node.z) % sz;
+        node.prev = -1;
+        node.next = table[hi];
+        if (node.next >= 0) nodes[node.next].prev = i;
+        table[hi] = i;
+    }
+}
+
+
+// put an entry in the level list and the cells matching its geom's AABB.
+// nothing is done if they have not changed.
+
+void dxHashSpace::placeEntry (int e)
+{
+    dxHashEntry &entry = entries[e];
+    dxGeom *geom = entry.geom;
+    int i,numlevels = getNumLevels();
+
+    // compute level, but prevent cells from getting too small
+    int level = findLevel (geom->aabb);
+    if (level < global_minlevel) level = global_minlevel;
+    int list,dbounds[6];
+    if (level <= global_maxlevel) {
+        list = level - global_minlevel;
+        // cellsize = 2^level
+        dReal cellsize = (dReal) ldexp (1.0,level);
+        // discretize AABB position to cell size
+        for (i=0; i < 6; i++) dbounds[i] = (int)
+            floor (geom->aabb[i]/cellsize);
+    }
+    else {
+        // the AABB is too big for the hash table
+        list = numlevels;
+        level = MAXINT;
+        for (i=0; i < 6; i++) dbounds[i] = 0;
+    }
+
+    if (entry.list == list && memcmp (entry.dbounds,dbounds,sizeof(dbounds)) == 0) {
+        return;
+    }
+
+    unplaceEntry (e);
+
+    entry.list = list;
+    entry.level = level;
+    memcpy (entry.dbounds,dbounds,sizeof(dbounds));
+    entry.prev = -1;
+    entry.next = list_head[list];
+    if (entry.next >= 0) entries[entry.next].prev = e;
+    list_head[list] = e;
+    list_count[list]++;
+
+    if (list < numlevels) {
+        // add the entry to the hash table (may need to add it to up to 8 cells)
         for (int xi = dbounds[0]; xi <= dbounds[1]; xi++) {
             for (int yi = dbounds[2]; yi <= dbounds[3]; yi++) {
                 for (int zi = dbounds[4]; zi <= dbounds[5]; zi++) {
-                    // get the hash index
-                    unsigned long hi = getVirtualAddress (aabb->level,xi,yi,zi) % sz;
-                    // add a new node to the hash table
-                    Node *node = (Node*) ALLOCA (sizeof (Node));
-                    node->x = xi;
-                    node->y = yi;
-                    node->z = zi;
-                    node->aabb = aabb;
-                    node->next = table[hi];
-                    table[hi] = node;
+                    insertNode (e,level,xi,yi,zi);
                 }
             }
         }
     }
+}
+
+
+// take an entry out of its level list and its cells
+
+void dxHashSpace::unplaceEntry (int e)
+{
+    dxHashEntry &entry = entries[e];
+    if (entry.list < 0) return;
+
+    int sz = table.size();
+    for (int n = entry.first_node; n >= 0; ) {
+        dxHashNode &node = nodes[n];
+        if (node.prev >= 0) {
+            nodes[node.prev].next = node.next;
+        }
+        else {
+            table[getVirtualAddress (node.level,node.x,node.y,node.z) % sz] = node.next;
+        }
+        if (node.next >= 0) nodes[node.next].prev = node.prev;
+
+        int next = node.entry_next;
+        node.entry = -1;
+        node.entry_next = free_node;
+        free_node = n;
+        num_nodes--;
+        n = next;
+    }
+    entry.first_node = -1;
+
+    if (entry.prev >= 0) entries[entry.prev].next = entry.next;
+    else list_head[entry.list] = entry.next;
+    if (entry.next >= 0) entries[entry.next].prev = entry.prev;
+    list_count[entry.list]--;
+    entry.list = -1;
+}
+
+
+void dxHashSpace::cleanGeoms()
+{
+    // compute the AABBs of all dirty geoms, clear the dirty flags and move
+    // the geoms to their new cells
+    lock_count++;
+    recomputeDirtyAABBs();
+    for (dxGeom *g=first; g; g=g->next) {
+        if (g->gflags & GEOM_DIRTY) {
+            if (IS_SPACE(g)) {
+                ((dxSpace*)g)->cleanGeoms();
+            }
+            g->recomputeAABB();
+            g->gflags &= (~(GEOM_DIRTY|GEOM_AABB_BAD));
+        }
+        else if (!place_all) {
+            break;
+        }
+        placeEntry (findEntry (g));
+    }
+    place_all = 0;
+    lock_count--;
+}
+
+
+void dxHashSpace::collide (void *data, dNearCallback *callback)
+{
+    dAASSERT(this && callback);
+    int i,k;
+
+    // 0 or 1 geoms can't collide with anything
+    if (count < 2) return;
+
+    lock_count++;
+    cleanGeoms();
+
+    int numlevels = getNumLevels();
+    int maxlevel = global_minlevel - 1;
+    for (k=0; k < numlevels; k++) {
+        if (list_count[k]) maxlevel = global_minlevel + k;
+    }
 
-    // now that all AABBs are loaded into the hash table, we do the actual
-    // collision detection. for all AABBs, check for other AABBs in the
-    // same cells for collisions, and then check for other AABBs in all
-    // intersecting higher level cells.
+    // for all AABBs, check for other AABBs in the same cells for collisions,
+    // and then check for other AABBs in all intersecting higher level cells.
+    // a pair sharing several cells is only reported in the first of them,
+    // and a pair on the same level is only reported by its lower entry.
 
     int db[6];			// discrete bounds at current level
-    for (aabb=first_aabb; aabb; aabb=aabb->next) {
-        // we are searching for collisions with aabb
-        for (i=0; i<6; i++) db[i] = aabb->dbounds[i];
-        for (int level = aabb->level; level <= maxlevel; level++) {
-            for (int xi = db[0]; xi <= db[1]; xi++) {
-                for (int yi = db[2]; yi <= db[3]; yi++) {
-                    for (int zi = db[4]; zi <= db[5]; zi++) {
-                        // get the hash index
-                        unsigned long hi = getVirtualAddress (level,xi,yi,zi) % sz;
-                        // search all nodes at this index
-                        Node *node;
-                        for (node = table[hi]; node; node=node->next) {
-                            // node points to an AABB that may intersect aabb
-                            if (node->aabb == aabb) continue;
-                            if (node->aabb->level == level &&
-                                node->x == xi && node->y == yi && node->z == zi) {
-                                    // see if aabb and node->aabb have already been tested
-                                    // against each other
-                                    unsigned char mask;
-                                    if (aabb->index <= node->aabb->index) {
-                                        i = (aabb->index * tested_rowsize)+(node->aabb->index >> 3);
-                                        mask = 1 << (node->aabb->index & 7);
-                                    }
-                                    else {
-                                        i = (node->aabb->index * tested_rowsize)+(aabb->index >> 3);
-                                        mask = 1 << (aabb->index & 7);
-                                    }
-                                    dIASSERT (i >= 0 && i < (tested_rowsize*n));
-                                    if ((tested[i] & mask)==0) {
-                                        collideAABBs (aabb->geom,node->aabb->geom,data,callback);
-                                    }
-                                    tested[i] |= mask;
+    for (k=0; k < numlevels; k++) {
+        for (int a = list_head[k]; a >= 0; a = entries[a].next) {
+            const dxHashEntry &aabb = entries[a];
+            if (!GEOM_ENABLED(aabb.geom)) continue;
+            // we are searching for collisions with aabb
+            for (i=0; i<6; i++) db[i] = aabb.dbounds[i];
+            for (int level = aabb.level; level <= maxlevel; level++) {
+                if (list_count[level - global_minlevel]) {
+                    int sz = table.size();
+                    for (int xi = db[0]; xi <= db[1]; xi++) {
+                        for (int yi = db[2]; yi <= db[3]; yi++) {
+                            for (int zi = db[4]; zi <= db[5]; zi++) {
+                                // search all nodes at this index
+                                unsigned long hi = getVirtualAddress (level,xi,yi,zi) % sz;
+                                for (int n = table[hi]; n >= 0; n = nodes[n].next) {
+                                    const dxHashNode &node = nodes[n];
+                                    if (node.level != level || node.x != xi ||
+                                        node.y != yi || node.z != zi) continue;
+                                    int b = node.entry;
+                                    if (b == a || (level == aabb.level && b < a)) continue;
+                                    const dxHashEntry &other = entries[b];
+                                    if (!GEOM_ENABLED(other.geom)) continue;
+                                    if (!isFirstSharedCell (db,other.dbounds,xi,yi,zi)) continue;
+                                    collideAABBs (aabb.geom,other.geom,data,callback,stats);
+                                }
                             }
                         }
                     }
                 }
+                // get the discrete bounds for the next level up
+                for (i=0; i<6; i++) db[i] >>= 1;
             }
-            // get the discrete bounds for the next level up
-            for (i=0; i<6; i++) db[i] >>= 1;
         }
     }
 
-    // every AABB in the normal list must now be intersected against every
-    // AABB in the big_boxes list. so let's hope there are not too many objects
-    // in the big_boxes list.
-    for (aabb=first_aabb; aabb; aabb=aabb->next) {
-        for (dxAABB *aabb2=big_boxes; aabb2; aabb2=aabb2->next) {
-            collideAABBs (aabb->geom,aabb2->geom,data,callback);
+    // every AABB in the normal lists must now be intersected against every
+    // AABB in the big boxes list. so let's hope there are not too many objects
+    // in the big boxes list.
+    int biglist = list_head[numlevels];
+    if (biglist >= 0) {
+        for (k=0; k < numlevels; k++) {
+            for (int a = list_head[k]; a >= 0; a = entries[a].next) {
+                dxGeom *g1 = entries[a].geom;
+                if (!GEOM_ENABLED(g1)) continue;
+                for (int b = biglist; b >= 0; b = entries[b].next) {
+                    dxGeom *g2 = entries[b].geom;
+                    if (GEOM_ENABLED(g2)) collideAABBs (g1,g2,data,callback,stats);
+                }
+            }
         }
-    }
 
-    // intersected all AABBs in the big_boxes list together
-    for (aabb=big_boxes; aabb; aabb=aabb->next) {
-        for (dxAABB *aabb2=aabb->next; aabb2; aabb2=aabb2->next) {
-            collideAABBs (aabb->geom,aabb2->geom,data,callback);
+        // intersected all AABBs in the big boxes list together
+        for (int a = biglist; a >= 0; a = entries[a].next) {
+            dxGeom *g1 = entries[a].geom;
+            if (!GEOM_ENABLED(g1)) continue;
+            for (int b = entries[a].next; b >= 0; b = entries[b].next) {
+                dxGeom *g2 = entries[b].geom;
+                if (GEOM_ENABLED(g2)) collideAABBs (g1,g2,data,callback,stats);
+            }
         }
     }
 
@@ -583,21 +1015,91 @@ void dxHashSpace::collide (void *data, dNearCallback *callback)
 }
 
 
+// collide geom with the AABBs of the given level. the cells that geom
+// covers are looked up in the hash table, unless there are more of them
+// than AABBs in the level, in which case the AABBs are just scanned.
+// either way the work does not exceed the size of the level.
+
+void dxHashSpace::collideLevel (int level, dxGeom *geom,
+                                void *data, dNearCallback *callback)
+{
+    int k = level - global_minlevel;
+    if (list_count[k] == 0) return;
+
+    // compute the number of cells covered, in floating point as it can be huge
+    dReal cellsize = (dReal) ldexp (1.0,level);
+    dReal fdb[6];
+    for (int i=0; i < 6; i++) fdb[i] = dFloor (geom->aabb[i]/cellsize);
+    dReal numcells = (fdb[1] - fdb[0] + 1) * (fdb[3] - fdb[2] + 1) * (fdb[5] - fdb[4] + 1);
+
+    if (!(numcells <= (dReal)list_count[k])) {
+        for (int a = list_head[k]; a >= 0; a = entries[a].next) {
+            dxGeom *g = entries[a].geom;
+            if (GEOM_ENABLED(g)) collideAABBs (g,geom,data,callback,stats);
+        }
+        return;
+    }
+
+    int db[6];
+    for (int j=0; j < 6; j++) db[j] = (int) fdb[j];
+    int sz = table.size();
+    for (int xi = db[0]; xi <= db[1]; xi++) {
+        for (int yi = db[2]; yi <= db[3]; yi++) {
+            for (int zi = db[4]; zi <= db[5]; zi++) {
+                unsigned long hi = getVirtualAddress (level,xi,yi,zi) % sz;
+                for (int n = table[hi]; n >= 0; n = nodes[n].next) {
+                    const dxHashNode &node = nodes[n];
+                    if (node.level != level || node.x != xi ||
+                        node.y != yi || node.z != zi) continue;
+                    dxHashEntry &aabb = entries[node.entry];
+                    // an AABB may occupy several of the cells, test it once
+                    if (aabb.stamp == query_stamp) continue;
+                    aabb.stamp = query_stamp;
+                    if (GEOM_ENABLED(aabb.geom)) {
+                        collideAABBs (aabb.geom,geom,data,callback,stats);
+                    }
+                }
+            }
+        }
+    }
+}
+
+
 void dxHashSpace::collide2 (void *data, dxGeom *geom,
                             dNearCallback *callback)
 {
     dAASSERT (geom && callback);
 
-    // this could take advantage of the hash structure to avoid
-    // O(n2) complexity, but it does not yet.
-
     lock_count++;
     cleanGeoms();
     geom->recomputeAABB();
 
-    // intersect bounding boxes
-    for (dxGeom *g=first; g; g=g->next) {
-        if (GEOM_ENABLED(g)) collideAABBs (g,geom,data,callback);
+    if (++query_stamp == 0) {
+        // the stamps have wrapped around, forget the old ones
+        for (int a=0; a < entries.size(); a++) entries[a].stamp = 0;
+        query_stamp = 1;
+    }
+
+    int numlevels = getNumLevels();
+    if (findLevel (geom->aabb) == MAXINT) {
+        // an infinite AABB covers everything
+        for (int k=0; k < numlevels; k++) {
+            for (int a = list_head[k]; a >= 0; a = entries[a].next) {
+                dxGeom *g = entries[a].geom;
+                if (GEOM_ENABLED(g)) collideAABBs (g,geom,data,callback,stats);
+            }
+        }
+    }
+    else {
+        for (int level = global_minlevel; level <= global_maxlevel; level++) {
+            collideLevel (level,geom,data,callback);
+        }
+    }
+
+    // intersect with the big boxes
+    for (int a = list_head[numlevels]; a >= 0; a = entries[a].next) {
+        dxGeom *g = entries[a].geom;
+        if (GEOM_ENABLED(g)) collideAABBs (g,geom,data,callback,stats);
     }
 
     lock_count--;
@@ -690,6 +1192,57 @@ int dSpaceGetManualCleanup (dSpaceID space)
     return space->getManualCleanup();
 }
 
+void dSpaceSetThreadingImplementation (dSpaceID space, const dThreadingFunctionsInfo *functions_info, dThreadingImplementationID threading_impl)
+{
+    dAASSERT (space);
+    dUASSERT (dGeomIsSpace(space),"argument not a space");
+    dUASSERT (!functions_info || functions_info->struct_size >= sizeof(*functions_info), "Bad threading functions info");
+    CHECK_NOT_LOCKED (space);
+    space->AssignThreadingImpl(functions_info, threading_impl);
+}
+
+int dSpaceSetStatsEnabled (dSpaceID space, int enabled)
+{
+    dAASSERT (space);
+    dUASSERT (dGeomIsSpace(space),"argument not a space");
+    CHECK_NOT_LOCKED (space);
+
+    if (enabled) {
+        if (!space->stats) {
+            space->stats = new dxCollisionStats;
+            if (!space->stats) return 0;
+        }
+    }
+    else {
+        delete space->stats;
+        space->stats = 0;
+    }
+    return 1;
+}
+
+int dSpaceGetStatsEnabled (dSpaceID space)
+{
+    dAASSERT (space);
+    dUASSERT (dGeomIsSpace(space),"argument not a space");
+    return space->stats != 0;
+}
+
+int dSpaceGetStats (dSpaceID space, dCollisionPairStats table[dGeomNumClasses][dGeomNumClasses])
+{
+    dAASSERT (space && table);
+    dUASSERT (dGeomIsSpace(space),"argument not a space");
+    if (!space->stats) return 0;
+    memcpy (table,space->stats->pairs,sizeof(space->stats->pairs));
+    return 1;
+}
+
+void dSpaceResetStats (dSpaceID space)
+{
+    dAASSERT (space);
+    dUASSERT (dGeomIsSpace(space),"argument not a space");
+    if (space->stats) space->stats->reset();
+}
+
 void dSpaceAdd (dxSpace *space, dxGeom *g)
 {
     dAASSERT (space);
@@ -827,7 +1380,7 @@ void dSpaceCollide2 (dxGeom *g1, dxGeom *g2, void *data,
             // make sure they have valid AABBs
             g1->recomputeAABB();
             g2->recomputeAABB();
-            collideAABBs(g1,g2, data, callback);
+            collideAABBs(g1,g2, data, callback, 0);
         }
     }
 }
@@ -40,23 +40,31 @@ stuff common to all spaces
 // called if the two AABBs inhabit the same hash table cells.
 // this only calls the callback function if the AABBs actually
 // intersect. if a geom has an AABB test function, that is called to
-// provide a further refinement of the intersection.
+// provide a further refinement of the intersection. if stats is not 0,
+// the outcome is counted there.
 //
 // NOTE: this assumes that the geom AABBs are valid on entry
 // and that both geoms are enabled.
 
 static inline void collideAABBs (dxGeom *g1, dxGeom *g2,
-                                 void *data, dNearCallback *callback)
+                                 void *data, dNearCallback *callback,
+                                 dxCollisionStats *stats)
 {
     dIASSERT((g1->gflags & GEOM_AABB_BAD)==0);
     dIASSERT((g2->gflags & GEOM_AABB_BAD)==0);
 
-    // no contacts if both geoms on the same body, and the body is not 0
-    if (g1->body == g2->body && g1->body) return;
+    dCollisionPairStats *pairstats = 0;
+    if (stats) {
+        pairstats = &stats->getPairStats (g1->type,g2->type);
+        pairstats->candidate_pairs++;
+    }
 
-    // test if the category and collide bitfields match
-    if ( ((g1->category_bits & g2->collide_bits) ||
+    // no contacts if both geoms on the same body, and the body is not 0
+    // and test if the category and collide bitfields match
+    if ((g1->body == g2->body && g1->body) ||
+        ((g1->category_bits & g2->collide_bits) ||
         (g2->category_bits & g1->collide_bits)) == 0) {
+            if (pairstats) pairstats->filtered_pairs++;
             return;
     }
 
@@ -68,15 +76,15 @@ static inline void collideAABBs (dxGeom *g1, dxGeom *g2,
         bounds1[2] > bounds2[3] ||
         bounds1[3] < bounds2[2] ||
         bounds1[4] > bounds2[5] ||
-        bounds1[5] < bounds2[4]) {
+        bounds1[5] < bounds2[4] ||
+        // check if either object is able to prove that it doesn't intersect the
+        // AABB of the other
+        g1->AABBTest (g2,bounds2) == 0 ||
+        g2->AABBTest (g1,bounds1) == 0) {
+            if (pairstats) pairstats->aabb_rejected_pairs++;
             return;
     }
 
-    // check if either object is able to prove that it doesn't intersect the
-    // AABB of the other
-    if (g1->AABBTest (g2,bounds2) == 0) return;
-    if (g2->AABBTest (g1,bounds1) == 0) return;
-
     // the objects might actually intersect - call the space callback function
     callback (data,g1,g2);
 }
@@ -1142,7 +1142,7 @@ int sTrimeshBoxColliderData::TestCollisionForSingleTriangle(int ctContacts0, int
 #if dTRIMESH_OPCODE
 static void dQueryBTLPotentialCollisionTriangles(OBBCollider &Collider, 
                                                  const sTrimeshBoxColliderData &cData, dxTriMesh *TriMesh, dxGeom *BoxGeom,
-                                                 OBBCache &BoxCache)
+                                                 OBBCache &BoxCache, dxTriMeshTCHolder<dxTriMesh::BoxTC> &BoxTCHolder)
 {
     // get source hull position, orientation and half size
     const dMatrix3& mRotBox=*(const dMatrix3*)dGeomGetRotation(BoxGeom);
@@ -1188,18 +1188,9 @@ static void dQueryBTLPotentialCollisionTriangles(OBBCollider &Collider,
 
     // TC results
     if (TriMesh->doBoxTC) {
-        dxTriMesh::BoxTC* BoxTC = 0;
-        for (int i = 0; i < TriMesh->BoxTCCache.size(); i++){
-            if (TriMesh->BoxTCCache[i].Geom == BoxGeom){
-                BoxTC = &TriMesh->BoxTCCache[i];
-                break;
-            }
-        }
-        if (!BoxTC){
-            TriMesh->BoxTCCache.push(dxTriMesh::BoxTC());
-
-            BoxTC = &TriMesh->BoxTCCache[TriMesh->BoxTCCache.size() - 1];
-            BoxTC->Geom = BoxGeom;
+        bool isNew;
+        dxTriMesh::BoxTC* BoxTC = BoxTCHolder.Obtain(TriMesh->BoxTCCache, BoxGeom, isNew);
+        if (isNew){
             BoxTC->FatCoeff = 1.1f; // Pierre recommends this, instead of 1.0
         }
 
@@ -1230,8 +1221,10 @@ int dCollideBTL(dxGeom* g1, dxGeom* BoxGeom, int Flags, dContactGeom* Contacts,
     TrimeshCollidersCache *pccColliderCache = GetTrimeshCollidersCache(uiTLSKind);
     OBBCollider& Collider = pccColliderCache->_OBBCollider;
 
+    // The TC entry holds the results until the end of the function
+    dxTriMeshTCHolder<dxTriMesh::BoxTC> BoxTCHolder;
     dQueryBTLPotentialCollisionTriangles(Collider, cData, TriMesh, BoxGeom,
-        pccColliderCache->defaultBoxCache);
+        pccColliderCache->defaultBoxCache, BoxTCHolder);
 
     if (!Collider.GetContactStatus()) {
         // no collision occurred
@@ -969,7 +969,7 @@ int sTrimeshCapsuleColliderData::TestCollisionForSingleTriangle(int ctContacts0,
 
 static void dQueryCCTLPotentialCollisionTriangles(OBBCollider &Collider, 
                                                   const sTrimeshCapsuleColliderData &cData, dxTriMesh *TriMesh, dxGeom *Capsule,
-                                                  OBBCache &BoxCache)
+                                                  OBBCache &BoxCache, dxTriMeshTCHolder<dxTriMesh::BoxTC> &BoxTCHolder)
 {
     // It is a potential issue to explicitly cast to float 
     // if custom width floating point type is introduced in OPCODE.
@@ -1008,18 +1008,9 @@ static void dQueryCCTLPotentialCollisionTriangles(OBBCollider &Collider,
 
     // TC results
     if (TriMesh->doBoxTC) {
-        dxTriMesh::BoxTC* BoxTC = 0;
-        for (int i = 0; i < TriMesh->BoxTCCache.size(); i++){
-            if (TriMesh->BoxTCCache[i].Geom == Capsule){
-                BoxTC = &TriMesh->BoxTCCache[i];
-                break;
-            }
-        }
-        if (!BoxTC){
-            TriMesh->BoxTCCache.push(dxTriMesh::BoxTC());
-
-            BoxTC = &TriMesh->BoxTCCache[TriMesh->BoxTCCache.size() - 1];
-            BoxTC->Geom = Capsule;
+        bool isNew;
+        dxTriMesh::BoxTC* BoxTC = BoxTCHolder.Obtain(TriMesh->BoxTCCache, Capsule, isNew);
+        if (isNew){
             BoxTC->FatCoeff = 1.0f;
         }
 
@@ -1056,8 +1047,10 @@ int dCollideCCTL(dxGeom *o1, dxGeom *o2, int flags, dContactGeom *contact, int s
     OBBCollider& Collider = pccColliderCache->_OBBCollider;
 
     // Will it better to use LSS here? -> confirm Pierre.
+    // The TC entry holds the results until the end of the function
+    dxTriMeshTCHolder<dxTriMesh::BoxTC> BoxTCHolder;
     dQueryCCTLPotentialCollisionTriangles(Collider, cData, 
-        TriMesh, Capsule, pccColliderCache->defaultBoxCache);
+        TriMesh, Capsule, pccColliderCache->defaultBoxCache, BoxTCHolder);
 
     if (Collider.GetContactStatus()) 
     {
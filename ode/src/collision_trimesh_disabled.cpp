@@ -122,6 +122,8 @@ dTriTriMergeCallback* dGeomTriMeshGetTriMergeCallback(dGeomID g) { return 0; }
 void dGeomTriMeshEnableTC(dGeomID g, int geomClass, int enable) {}
 int dGeomTriMeshIsTCEnabled(dGeomID g, int geomClass) { return 0; }
 void dGeomTriMeshClearTCCache(dGeomID g) {}
+void dGeomTriMeshSetTCCacheMaxAge(dGeomID g, int maxAge) {}
+int dGeomTriMeshGetTCCacheMaxAge(dGeomID g) { return 0; }
 
 dTriMeshDataID dGeomTriMeshGetTriMeshDataID(dGeomID g) { return 0; }
 
@@ -375,6 +375,17 @@ void dGeomTriMeshClearTCCache(dGeomID g){
     Geom->ClearTCCache();
 }
 
+void dGeomTriMeshSetTCCacheMaxAge(dGeomID g, int maxAge)
+{
+    dUASSERT(g && g->type == dTriMeshClass, "argument not a trimesh");
+}
+
+int dGeomTriMeshGetTCCacheMaxAge(dGeomID g)
+{
+    dUASSERT(g && g->type == dTriMeshClass, "argument not a trimesh");
+    return 0;
+}
+
 /*
 * returns the TriMeshDataID
 */
@@ -50,6 +50,10 @@ using namespace Opcode;
 #include "odetls.h"
 #endif
 
+#if dATOMICS_ENABLED
+#include "odeou.h"
+#endif
+
 
 
 
@@ -313,6 +317,202 @@ struct dxTriMeshData  : public dBase
 #endif  // dTRIMESH_GIMPACT
 };
 
+#if dTRIMESH_OPCODE
+
+// Temporal coherence caches of a trimesh, one entry per geom colliding with
+// it. The entries are found by hashing the geom pointers, and the ones that
+// are not used for MaxAge generations are freed. A generation passes when the
+// cache has served as many lookups as it holds entries, which is about once
+// per collision frame. The lookups are serialized with a spin lock so that
+// different geoms may collide with the trimesh from several threads; an
+// entry obtained for a collision is not freed until it is released.
+
+enum {
+    TCCACHE_DEFAULT_MAX_AGE = 8,
+    TCCACHE_MIN_CAPACITY = 16,
+};
+
+template<class tTC>
+class dxTriMeshTCCache
+{
+public:
+    dxTriMeshTCCache(): m_Slots(NULL), m_Capacity(0), m_Count(0), m_Generation(0),
+        m_LookupsLeft(TCCACHE_MIN_CAPACITY), m_MaxAge(TCCACHE_DEFAULT_MAX_AGE)
+#if dATOMICS_ENABLED
+        , m_Lock(0)
+#endif
+    {
+    }
+
+    ~dxTriMeshTCCache() { Clear(); }
+
+    unsigned GetMaxAge() const { return m_MaxAge; }
+    void SetMaxAge(unsigned MaxAge) { m_MaxAge = MaxAge != 0 ? MaxAge : 1; }
+    unsigned GetSize() const { return m_Count; }
+
+    // Returns the entry of the geom, creating it if necessary. A new entry
+    // has Geom set and is otherwise default constructed. The entry must be
+    // released after the collision, see dxTriMeshTCHolder.
+    tTC *Obtain(dxGeom *Geom, bool &IsNew)
+    {
+        Lock();
+
+        tTC *Entry = Lookup(Geom);
+        IsNew = (Entry == NULL);
+        if (IsNew) {
+            if ((m_Count + 1) * 2 > m_Capacity) {
+                Rehash(m_Capacity != 0 ? m_Capacity * 2 : TCCACHE_MIN_CAPACITY);
+            }
+
+            Entry = new tTC();
+            Entry->Geom = Geom;
+            Insert(Entry);
+            m_Count++;
+        }
+        Entry->Stamp = m_Generation;
+        Entry->InUse = true;
+
+        if (--m_LookupsLeft == 0) {
+            NextGeneration();
+        }
+
+        Unlock();
+        return Entry;
+    }
+
+    void Release(tTC *Entry)
+    {
+        Lock();
+        Entry->InUse = false;
+        Unlock();
+    }
+
+    void Clear()
+    {
+        for (unsigned i = 0; i < m_Capacity; i++) {
+            delete m_Slots[i];
+        }
+        delete[] m_Slots;
+
+        m_Slots = NULL;
+        m_Capacity = 0;
+        m_Count = 0;
+        m_LookupsLeft = TCCACHE_MIN_CAPACITY;
+    }
+
+private:
+    static unsigned HashGeom(const dxGeom *Geom)
+    {
+        size_t Bits = (size_t)Geom;
+        return (unsigned)(Bits >> 4) * 2654435761U ^ (unsigned)(Bits >> 20);
+    }
+
+    tTC *Lookup(const dxGeom *Geom) const
+    {
+        if (m_Count == 0) return NULL;
+
+        const unsigned Mask = m_Capacity - 1;
+        for (unsigned i = HashGeom(Geom) & Mask; m_Slots[i] != NULL; i = (i + 1) & Mask) {
+            if (m_Slots[i]->Geom == Geom) return m_Slots[i];
+        }
+        return NULL;
+    }
+
+    void Insert(tTC *Entry)
+    {
+        const unsigned Mask = m_Capacity - 1;
+        unsigned i = HashGeom(Entry->Geom) & Mask;
+        while (m_Slots[i] != NULL) i = (i + 1) & Mask;
+        m_Slots[i] = Entry;
+    }
+
+    // Moves the entries into a table of the given capacity (a power of two)
+    void Rehash(unsigned Capacity)
+    {
+        tTC **OldSlots = m_Slots;
+        unsigned OldCapacity = m_Capacity;
+
+        m_Slots = new tTC *[Capacity];
+        m_Capacity = Capacity;
+        for (unsigned i = 0; i < Capacity; i++) m_Slots[i] = NULL;
+
+        for (unsigned i = 0; i < OldCapacity; i++) {
+            if (OldSlots[i] != NULL) Insert(OldSlots[i]);
+        }
+        delete[] OldSlots;
+    }
+
+    // Frees the entries that have not been used for MaxAge generations
+    void NextGeneration()
+    {
+        m_Generation++;
+
+        unsigned Removed = 0;
+        for (unsigned i = 0; i < m_Capacity; i++) {
+            tTC *Entry = m_Slots[i];
+            if (Entry != NULL && !Entry->InUse && m_Generation - Entry->Stamp > m_MaxAge) {
+                delete Entry;
+                m_Slots[i] = NULL;
+                Removed++;
+            }
+        }
+
+        if (Removed != 0) {
+            m_Count -= Removed;
+            // Probe chains were broken, rebuild the table (shrinking it if it
+            // became sparse)
+            unsigned Capacity = m_Capacity;
+            while (Capacity > TCCACHE_MIN_CAPACITY && m_Count * 8 < Capacity) Capacity /= 2;
+            Rehash(Capacity);
+        }
+
+        m_LookupsLeft = m_Count > TCCACHE_MIN_CAPACITY ? m_Count : TCCACHE_MIN_CAPACITY;
+    }
+
+#if dATOMICS_ENABLED
+    void Lock() { while (!AtomicCompareExchange(&m_Lock, 0, 1)) {} }
+    void Unlock() { AtomicDecrementNoResult(&m_Lock); }
+#else
+    void Lock() {}
+    void Unlock() {}
+#endif
+
+private:
+    tTC **m_Slots;
+    unsigned m_Capacity;
+    unsigned m_Count;
+    unsigned m_Generation;
+    unsigned m_LookupsLeft;	// Until the next generation
+    unsigned m_MaxAge;
+#if dATOMICS_ENABLED
+    volatile atomicord32 m_Lock;
+#endif
+};
+
+// Keeps a cache entry in use until the end of the scope, i.e. for as long as
+// the collider results stored in it are being read
+template<class tTC>
+class dxTriMeshTCHolder
+{
+public:
+    dxTriMeshTCHolder(): m_Cache(NULL), m_Entry(NULL) {}
+    ~dxTriMeshTCHolder() { if (m_Entry != NULL) m_Cache->Release(m_Entry); }
+
+    tTC *Obtain(dxTriMeshTCCache<tTC> &Cache, dxGeom *Geom, bool &IsNew)
+    {
+        dIASSERT(m_Entry == NULL);
+        m_Cache = &Cache;
+        m_Entry = Cache.Obtain(Geom, IsNew);
+        return m_Entry;
+    }
+
+private:
+    dxTriMeshTCCache<tTC> *m_Cache;
+    tTC *m_Entry;
+};
+
+#endif // dTRIMESH_OPCODE
+
 struct dxTriMesh : public dxGeom{
     // Callbacks
     dTriCallback* Callback;
@@ -355,18 +555,24 @@ struct dxTriMesh : public dxGeom{
     // Temporal coherence
     struct SphereTC : public SphereCache{
         dxGeom* Geom;
+        unsigned Stamp;	// Generation of the last use
+        bool InUse;
     };
-    dArray<SphereTC> SphereTCCache;
+    dxTriMeshTCCache<SphereTC> SphereTCCache;
 
     struct BoxTC : public OBBCache{
         dxGeom* Geom;
+        unsigned Stamp;	// Generation of the last use
+        bool InUse;
     };
-    dArray<BoxTC> BoxTCCache;
+    dxTriMeshTCCache<BoxTC> BoxTCCache;
 
     struct CapsuleTC : public LSSCache{
         dxGeom* Geom;
+        unsigned Stamp;	// Generation of the last use
+        bool InUse;
     };
-    dArray<CapsuleTC> CapsuleTCCache;
+    dxTriMeshTCCache<CapsuleTC> CapsuleTCCache;
 #endif // dTRIMESH_OPCODE
 
 #if dTRIMESH_GIMPACT
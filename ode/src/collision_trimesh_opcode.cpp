@@ -580,25 +580,9 @@ dxTriMesh::~dxTriMesh(){
 void dxTriMesh::ClearTCCache()
 {
 #if dTRIMESH_ENABLED
-    /* dxTriMesh::ClearTCCache uses dArray's setSize(0) to clear the caches -
-    but the destructor isn't called when doing this, so we would leak.
-    So, call the previous caches' containers' destructors by hand first. */
-    int i, n;
-    n = SphereTCCache.size();
-    for( i = 0; i < n; ++i ) {
-        SphereTCCache[i].~SphereTC();
-    }
-    SphereTCCache.setSize(0);
-    n = BoxTCCache.size();
-    for( i = 0; i < n; ++i ) {
-        BoxTCCache[i].~BoxTC();
-    }
-    BoxTCCache.setSize(0);
-    n = CapsuleTCCache.size();
-    for( i = 0; i < n; ++i ) {
-        CapsuleTCCache[i].~CapsuleTC();
-    }
-    CapsuleTCCache.setSize(0);
+    SphereTCCache.Clear();
+    BoxTCCache.Clear();
+    CapsuleTCCache.Clear();
 #endif // dTRIMESH_ENABLED
 }
 
@@ -828,6 +812,25 @@ void dGeomTriMeshClearTCCache(dGeomID g){
     Geom->ClearTCCache();
 }
 
+void dGeomTriMeshSetTCCacheMaxAge(dGeomID g, int maxAge)
+{
+    dUASSERT(g && g->type == dTriMeshClass, "argument not a trimesh");
+    dUASSERT(maxAge > 0, "the age must be positive");
+
+    dxTriMesh* Geom = (dxTriMesh*)g;
+    Geom->SphereTCCache.SetMaxAge((unsigned)maxAge);
+    Geom->BoxTCCache.SetMaxAge((unsigned)maxAge);
+    Geom->CapsuleTCCache.SetMaxAge((unsigned)maxAge);
+}
+
+int dGeomTriMeshGetTCCacheMaxAge(dGeomID g)
+{
+    dUASSERT(g && g->type == dTriMeshClass, "argument not a trimesh");
+
+    dxTriMesh* Geom = (dxTriMesh*)g;
+    return (int)Geom->SphereTCCache.GetMaxAge();
+}
+
 /*
 * returns the TriMeshDataID
 */
@@ -271,21 +271,10 @@ int dCollideSTL(dxGeom* g1, dxGeom* SphereGeom, int Flags, dContactGeom* Contact
     Matrix4x4 amatrix;
 
     // TC results
+    dxTriMeshTCHolder<dxTriMesh::SphereTC> sphereTCHolder;
     if (TriMesh->doSphereTC) {
-        dxTriMesh::SphereTC* sphereTC = 0;
-        for (int i = 0; i < TriMesh->SphereTCCache.size(); i++){
-            if (TriMesh->SphereTCCache[i].Geom == SphereGeom){
-                sphereTC = &TriMesh->SphereTCCache[i];
-                break;
-            }
-        }
-
-        if (!sphereTC){
-            TriMesh->SphereTCCache.push(dxTriMesh::SphereTC());
-
-            sphereTC = &TriMesh->SphereTCCache[TriMesh->SphereTCCache.size() - 1];
-            sphereTC->Geom = SphereGeom;
-        }
+        bool isNew;
+        dxTriMesh::SphereTC* sphereTC = sphereTCHolder.Obtain(TriMesh->SphereTCCache, SphereGeom, isNew);
 
         // Intersect
         Collider.SetTemporalCoherence(true);
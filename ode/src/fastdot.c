@@ -24,9 +24,10 @@
 
 #include "ode/matrix.h"
 #include "config.h"
+#include "fastsimd.h"
 
 
-dReal _dDot (const dReal *a, const dReal *b, int n)
+dReal _dDotScalar (const dReal *a, const dReal *b, int n)
 {  
     dReal p0,q0,m0,p1,q1,m1,sum;
     sum = 0;
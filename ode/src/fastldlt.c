@@ -24,6 +24,7 @@
 
 #include "ode/matrix.h"
 #include "config.h"
+#include "fastsimd.h"
 
 /* solve L*X=B, with B containing 1 right hand sides.
  * L is an n*n lower triangular matrix with ones on the diagonal.
@@ -191,7 +192,7 @@ static void dSolveL1_2 (const dReal *L, dReal *B, int n, int lskip1)
 }
 
 
-void _dFactorLDLT (dReal *A, dReal *d, int n, int nskip1)
+void _dFactorLDLTScalar (dReal *A, dReal *d, int n, int nskip1)
 {  
     int i,j;
     dReal sum,*ell,*dee,dd,p1,p2,q1,q2,Z11,m11,Z21,m21,Z22,m22;
@@ -24,6 +24,7 @@
 
 #include "ode/matrix.h"
 #include "config.h"
+#include "fastsimd.h"
 
 /* solve L*X=B, with B containing 1 right hand sides.
  * L is an n*n lower triangular matrix with ones on the diagonal.
@@ -35,7 +36,7 @@
  * if this is in the factorizer source file, n must be a multiple of 4.
  */
 
-void _dSolveL1 (const dReal *L, dReal *B, int n, int lskip1)
+void _dSolveL1Scalar (const dReal *L, dReal *B, int n, int lskip1)
 {  
     /* declare variables - Z matrix, p and q vectors, etc */
     dReal Z11,Z21,Z31,Z41,p1,q1,p2,p3,p4,*ex;
@@ -0,0 +1,329 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001,2002 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+
+/*
+
+Runtime dispatch of the dense matrix kernels to SSE2/AVX implementations.
+
+The vectorized kernels are compiled with per-function target attributes, so
+the library itself does not need to be built with -msse2/-mavx and still runs
+on any CPU. The instruction set is chosen with CPUID on the first use.
+
+*/
+
+#include <ode/common.h>
+#include <ode/matrix.h>
+#include "config.h"
+#include "fastsimd.h"
+
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define dxSIMD_X86_ENABLED 1
+#define dxSIMD_TARGET(isa) __attribute__((target(isa)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && _MSC_VER >= 1600 && (defined(_M_X64) || defined(_M_IX86))
+#define dxSIMD_X86_ENABLED 1
+#define dxSIMD_TARGET(isa)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+
+typedef dReal dxDotFunction (const dReal *a, const dReal *b, int n);
+typedef void dxSolveL1Function (const dReal *L, dReal *B, int n, int lskip1);
+typedef void dxFactorLDLTFunction (dReal *A, dReal *d, int n, int nskip1);
+
+struct dxMatrixKernels
+{
+    dxDotFunction *dot;
+    dxSolveL1Function *solveL1;
+    dxFactorLDLTFunction *factorLDLT;
+};
+
+
+#if dxSIMD_X86_ENABLED
+
+//****************************************************************************
+// SSE2
+
+#define dxSIMD_ATTR dxSIMD_TARGET("sse2")
+#define dxSIMD_NAME(name) name##SSE2
+
+#if defined(dSINGLE)
+
+dxSIMD_ATTR static inline float HorizontalSumSSE2 (__m128 v)
+{
+    __m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(v, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    sums = _mm_add_ss(sums, shuf);
+    return _mm_cvtss_f32(sums);
+}
+
+#define dxVEC               __m128
+#define dxVEC_WIDTH         4
+#define dxVEC_ZERO()        _mm_setzero_ps()
+#define dxVEC_LOAD(p)       _mm_loadu_ps(p)
+#define dxVEC_STORE(p, v)   _mm_storeu_ps(p, v)
+#define dxVEC_ADD(a, b)     _mm_add_ps(a, b)
+#define dxVEC_MUL(a, b)     _mm_mul_ps(a, b)
+#define dxVEC_HSUM(v)       HorizontalSumSSE2(v)
+
+#else // #if !defined(dSINGLE)
+
+dxSIMD_ATTR static inline double HorizontalSumSSE2 (__m128d v)
+{
+    return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+#define dxVEC               __m128d
+#define dxVEC_WIDTH         2
+#define dxVEC_ZERO()        _mm_setzero_pd()
+#define dxVEC_LOAD(p)       _mm_loadu_pd(p)
+#define dxVEC_STORE(p, v)   _mm_storeu_pd(p, v)
+#define dxVEC_ADD(a, b)     _mm_add_pd(a, b)
+#define dxVEC_MUL(a, b)     _mm_mul_pd(a, b)
+#define dxVEC_HSUM(v)       HorizontalSumSSE2(v)
+
+#endif // #if !defined(dSINGLE)
+
+#include "fastsimdimpl.h"
+
+#undef dxSIMD_ATTR
+#undef dxSIMD_NAME
+#undef dxVEC
+#undef dxVEC_WIDTH
+#undef dxVEC_ZERO
+#undef dxVEC_LOAD
+#undef dxVEC_STORE
+#undef dxVEC_ADD
+#undef dxVEC_MUL
+#undef dxVEC_HSUM
+
+
+//****************************************************************************
+// AVX
+
+#define dxSIMD_ATTR dxSIMD_TARGET("avx")
+#define dxSIMD_NAME(name) name##AVX
+
+#if defined(dSINGLE)
+
+dxSIMD_ATTR static inline float HorizontalSumAVX (__m256 v)
+{
+    __m128 sums = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    __m128 shuf = _mm_shuffle_ps(sums, sums, _MM_SHUFFLE(2, 3, 0, 1));
+    sums = _mm_add_ps(sums, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    sums = _mm_add_ss(sums, shuf);
+    return _mm_cvtss_f32(sums);
+}
+
+#define dxVEC               __m256
+#define dxVEC_WIDTH         8
+#define dxVEC_ZERO()        _mm256_setzero_ps()
+#define dxVEC_LOAD(p)       _mm256_loadu_ps(p)
+#define dxVEC_STORE(p, v)   _mm256_storeu_ps(p, v)
+#define dxVEC_ADD(a, b)     _mm256_add_ps(a, b)
+#define dxVEC_MUL(a, b)     _mm256_mul_ps(a, b)
+#define dxVEC_HSUM(v)       HorizontalSumAVX(v)
+
+#else // #if !defined(dSINGLE)
+
+dxSIMD_ATTR static inline double HorizontalSumAVX (__m256d v)
+{
+    __m128d sums = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(sums, _mm_unpackhi_pd(sums, sums)));
+}
+
+#define dxVEC               __m256d
+#define dxVEC_WIDTH         4
+#define dxVEC_ZERO()        _mm256_setzero_pd()
+#define dxVEC_LOAD(p)       _mm256_loadu_pd(p)
+#define dxVEC_STORE(p, v)   _mm256_storeu_pd(p, v)
+#define dxVEC_ADD(a, b)     _mm256_add_pd(a, b)
+#define dxVEC_MUL(a, b)     _mm256_mul_pd(a, b)
+#define dxVEC_HSUM(v)       HorizontalSumAVX(v)
+
+#endif // #if !defined(dSINGLE)
+
+#include "fastsimdimpl.h"
+
+#undef dxSIMD_ATTR
+#undef dxSIMD_NAME
+#undef dxVEC
+#undef dxVEC_WIDTH
+#undef dxVEC_ZERO
+#undef dxVEC_LOAD
+#undef dxVEC_STORE
+#undef dxVEC_ADD
+#undef dxVEC_MUL
+#undef dxVEC_HSUM
+
+
+//****************************************************************************
+// CPU feature detection
+
+static void QueryCPUID (unsigned leaf, unsigned regs[4])
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, (int)leaf);
+    regs[0] = info[0]; regs[1] = info[1]; regs[2] = info[2]; regs[3] = info[3];
+#elif defined(__i386__) && defined(__PIC__)
+    // ebx is the PIC register and must be preserved
+    __asm__ __volatile__ (
+        "xchgl %%ebx, %1\n"
+        "cpuid\n"
+        "xchgl %%ebx, %1\n"
+        : "=a" (regs[0]), "=r" (regs[1]), "=c" (regs[2]), "=d" (regs[3])
+        : "a" (leaf), "c" (0));
+#else
+    __asm__ __volatile__ (
+        "cpuid\n"
+        : "=a" (regs[0]), "=b" (regs[1]), "=c" (regs[2]), "=d" (regs[3])
+        : "a" (leaf), "c" (0));
+#endif
+}
+
+static unsigned long long QueryXCR0 ()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned lo, hi;
+    // xgetbv opcode, for assemblers that do not know the mnemonic
+    __asm__ __volatile__ (".byte 0x0f, 0x01, 0xd0" : "=a" (lo), "=d" (hi) : "c" (0));
+    return ((unsigned long long)hi << 32) | lo;
+#endif
+}
+
+static int DetectSupportedLevel ()
+{
+    int level = dMatrixKernelsScalar;
+
+    unsigned regs[4];
+    QueryCPUID(0, regs);
+
+    if (regs[0] >= 1) {
+        QueryCPUID(1, regs);
+
+        const unsigned ecx = regs[2], edx = regs[3];
+        if (edx & (1U << 26)) {
+            level = dMatrixKernelsSSE2;
+
+            // AVX requires the OS to save the YMM state (OSXSAVE and XCR0 bits 1, 2)
+            if ((ecx & (1U << 28)) && (ecx & (1U << 27)) && (QueryXCR0() & 6) == 6) {
+                level = dMatrixKernelsAVX;
+            }
+        }
+    }
+
+    return level;
+}
+
+
+#else // #if !dxSIMD_X86_ENABLED
+
+
+static int DetectSupportedLevel ()
+{
+    return dMatrixKernelsScalar;
+}
+
+
+#endif // #if !dxSIMD_X86_ENABLED
+
+
+//****************************************************************************
+// dispatching
+
+static const dxMatrixKernels g_matrixKernels[] =
+{
+    { &_dDotScalar, &_dSolveL1Scalar, &_dFactorLDLTScalar },
+#if dxSIMD_X86_ENABLED
+    { &DotSSE2, &SolveL1SSE2, &FactorLDLTSSE2 },
+    { &DotAVX, &SolveL1AVX, &FactorLDLTAVX },
+#endif
+};
+
+static const dxMatrixKernels *g_selectedKernels = NULL;
+static int g_selectedLevel = dMatrixKernelsScalar;
+static int g_supportedLevel = -1;
+
+
+static int GetSupportedLevel ()
+{
+    // Several threads may get here at once but they would all store the same value
+    if (g_supportedLevel < 0) {
+        g_supportedLevel = DetectSupportedLevel();
+    }
+    return g_supportedLevel;
+}
+
+static int SelectKernels (int level)
+{
+    int supportedLevel = GetSupportedLevel();
+    int selectedLevel = level < dMatrixKernelsScalar ? dMatrixKernelsScalar : level > supportedLevel ? supportedLevel : level;
+
+    g_selectedLevel = selectedLevel;
+    g_selectedKernels = &g_matrixKernels[selectedLevel];
+    return selectedLevel;
+}
+
+static inline const dxMatrixKernels *GetKernels ()
+{
+    const dxMatrixKernels *kernels = g_selectedKernels;
+    if (kernels == NULL) {
+        SelectKernels(dMatrixKernelsAVX);
+        kernels = g_selectedKernels;
+    }
+    return kernels;
+}
+
+
+dReal _dDot (const dReal *a, const dReal *b, int n)
+{
+    return GetKernels()->dot(a, b, n);
+}
+
+void _dSolveL1 (const dReal *L, dReal *B, int n, int lskip1)
+{
+    GetKernels()->solveL1(L, B, n, lskip1);
+}
+
+void _dFactorLDLT (dReal *A, dReal *d, int n, int nskip1)
+{
+    GetKernels()->factorLDLT(A, d, n, nskip1);
+}
+
+
+int dGetMatrixKernelsLevel ()
+{
+    GetKernels();
+    return g_selectedLevel;
+}
+
+int dSetMatrixKernelsLevel (int level)
+{
+    return SelectKernels(level);
+}
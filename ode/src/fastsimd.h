@@ -0,0 +1,53 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001,2002 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+
+/*
+
+Runtime selection of the dense matrix kernels.
+
+The scalar implementations in fastdot.c, fastlsolve.c and fastldlt.c are
+kept as the reference and as the fallback for CPUs (and compilers) without
+vector instruction support. _dDot(), _dSolveL1() and _dFactorLDLT() dispatch
+to the best implementation available.
+
+*/
+
+#ifndef _ODE_FASTSIMD_H_
+#define _ODE_FASTSIMD_H_
+
+#include <ode/common.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+dReal _dDotScalar (const dReal *a, const dReal *b, int n);
+void _dSolveL1Scalar (const dReal *L, dReal *B, int n, int lskip1);
+void _dFactorLDLTScalar (dReal *A, dReal *d, int n, int nskip1);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
@@ -0,0 +1,145 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001,2002 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+
+/*
+
+Vectorized dense kernels. This file is included by fastsimd.cpp once per
+instruction set with the following macros defined:
+
+    dxSIMD_ATTR          function attributes enabling the instruction set
+    dxSIMD_NAME(name)    decorates a kernel name with the instruction set
+    dxVEC                vector type of dReal-s
+    dxVEC_WIDTH          number of dReal-s in dxVEC
+    dxVEC_ZERO()         vector of zeros
+    dxVEC_LOAD(p)        unaligned load
+    dxVEC_STORE(p, v)    unaligned store
+    dxVEC_ADD(a, b)      elementwise sum
+    dxVEC_MUL(a, b)      elementwise product
+    dxVEC_HSUM(v)        sum of all the elements
+
+The algorithms are the same as in the scalar code, except that the
+factorizer processes one row at a time (each row being solved with the
+blocked L1 solver), as the vector units take care of the inner products.
+
+*/
+
+
+/* returns a.b for vectors of length n */
+dxSIMD_ATTR static dReal dxSIMD_NAME(Dot) (const dReal *a, const dReal *b, int n)
+{
+    dxVEC acc0 = dxVEC_ZERO(), acc1 = dxVEC_ZERO();
+    int j = 0;
+    for (; j <= n - 2*dxVEC_WIDTH; j += 2*dxVEC_WIDTH) {
+        acc0 = dxVEC_ADD(acc0, dxVEC_MUL(dxVEC_LOAD(a + j), dxVEC_LOAD(b + j)));
+        acc1 = dxVEC_ADD(acc1, dxVEC_MUL(dxVEC_LOAD(a + j + dxVEC_WIDTH), dxVEC_LOAD(b + j + dxVEC_WIDTH)));
+    }
+    if (j <= n - dxVEC_WIDTH) {
+        acc0 = dxVEC_ADD(acc0, dxVEC_MUL(dxVEC_LOAD(a + j), dxVEC_LOAD(b + j)));
+        j += dxVEC_WIDTH;
+    }
+    dReal sum = dxVEC_HSUM(dxVEC_ADD(acc0, acc1));
+    for (; j < n; ++j) sum += a[j] * b[j];
+    return sum;
+}
+
+
+/* computes the products of four consecutive rows of L (lskip apart) with the
+ * vector b of length n and stores them into Z[0..3] */
+dxSIMD_ATTR static void dxSIMD_NAME(Dot4) (const dReal *L, int lskip, const dReal *b, int n, dReal *Z)
+{
+    const dReal *ell0 = L, *ell1 = L + lskip, *ell2 = L + 2*lskip, *ell3 = L + 3*lskip;
+    dxVEC acc0 = dxVEC_ZERO(), acc1 = dxVEC_ZERO(), acc2 = dxVEC_ZERO(), acc3 = dxVEC_ZERO();
+    int j = 0;
+    for (; j <= n - dxVEC_WIDTH; j += dxVEC_WIDTH) {
+        dxVEC q = dxVEC_LOAD(b + j);
+        acc0 = dxVEC_ADD(acc0, dxVEC_MUL(dxVEC_LOAD(ell0 + j), q));
+        acc1 = dxVEC_ADD(acc1, dxVEC_MUL(dxVEC_LOAD(ell1 + j), q));
+        acc2 = dxVEC_ADD(acc2, dxVEC_MUL(dxVEC_LOAD(ell2 + j), q));
+        acc3 = dxVEC_ADD(acc3, dxVEC_MUL(dxVEC_LOAD(ell3 + j), q));
+    }
+    dReal Z1 = dxVEC_HSUM(acc0), Z2 = dxVEC_HSUM(acc1), Z3 = dxVEC_HSUM(acc2), Z4 = dxVEC_HSUM(acc3);
+    for (; j < n; ++j) {
+        dReal q = b[j];
+        Z1 += ell0[j] * q;
+        Z2 += ell1[j] * q;
+        Z3 += ell2[j] * q;
+        Z4 += ell3[j] * q;
+    }
+    Z[0] = Z1; Z[1] = Z2; Z[2] = Z3; Z[3] = Z4;
+}
+
+
+/* solve L*X=B, with B containing 1 right hand side. see fastlsolve.c */
+dxSIMD_ATTR static void dxSIMD_NAME(SolveL1) (const dReal *L, dReal *B, int n, int lskip1)
+{
+    int i = 0;
+    /* compute all 4 x 1 blocks of X */
+    for (; i <= n - 4; i += 4) {
+        dReal Z[4];
+        const dReal *ell = L + i*lskip1;
+        dxSIMD_NAME(Dot4) (ell, lskip1, B, i, Z);
+        /* finish computing the X(i) block */
+        dReal *ex = B + i;
+        ell += i;
+        dReal Z11 = ex[0] - Z[0];
+        ex[0] = Z11;
+        dReal Z21 = ex[1] - Z[1] - ell[lskip1]*Z11;
+        ex[1] = Z21;
+        dReal Z31 = ex[2] - Z[2] - ell[2*lskip1]*Z11 - ell[1+2*lskip1]*Z21;
+        ex[2] = Z31;
+        dReal Z41 = ex[3] - Z[3] - ell[3*lskip1]*Z11 - ell[1+3*lskip1]*Z21 - ell[2+3*lskip1]*Z31;
+        ex[3] = Z41;
+    }
+    /* compute rows at end that are not a multiple of block size */
+    for (; i < n; ++i) {
+        B[i] -= dxSIMD_NAME(Dot) (L + i*lskip1, B, i);
+    }
+}
+
+
+/* factorize A = L*D*L'. see fastldlt.c */
+dxSIMD_ATTR static void dxSIMD_NAME(FactorLDLT) (dReal *A, dReal *d, int n, int nskip1)
+{
+    for (int i = 0; i < n; ++i) {
+        dReal *ell = A + i*nskip1;
+        /* solve L*(D*l)=a, l is the scaled elements in 1 x i block at A(i,0) */
+        dxSIMD_NAME(SolveL1) (A, ell, i, nskip1);
+        /* scale the elements of the row, and also compute Z = l*D*l' */
+        dxVEC acc = dxVEC_ZERO();
+        int j = 0;
+        for (; j <= i - dxVEC_WIDTH; j += dxVEC_WIDTH) {
+            dxVEC p = dxVEC_LOAD(ell + j);
+            dxVEC q = dxVEC_MUL(p, dxVEC_LOAD(d + j));
+            dxVEC_STORE(ell + j, q);
+            acc = dxVEC_ADD(acc, dxVEC_MUL(p, q));
+        }
+        dReal Z11 = dxVEC_HSUM(acc);
+        for (; j < i; ++j) {
+            dReal p = ell[j];
+            dReal q = p * d[j];
+            ell[j] = q;
+            Z11 += p * q;
+        }
+        /* solve for diagonal 1 x 1 block at A(i,i) */
+        d[i] = dRecip(ell[i] - Z11);
+    }
+}
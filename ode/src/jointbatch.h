@@ -0,0 +1,187 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001,2002 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+
+
+/*
+
+Joint Jacobian assembly by joint type.
+
+Rather than fetching the constraint rows with a virtual getInfo2() call per
+joint in island order, the steppers sort the active joints of an island by
+type first and then walk every run of same-typed joints with a loop
+specialized for that type. For the common types
+(contacts, balls, hinges and fixed joints) the loop calls the implementation
+directly rather than through the virtual table, so the indirect branch is
+gone and the stepper side of the loop (row pointer setup, findex adjustment,
+feedback copies) is instantiated once per type. Other types share a generic
+loop with the virtual call.
+
+The stepper supplies the row layout: an object with
+
+    dxJoint::Info2 *begin(const dJointWithInfo1 *ji);
+    void end(const dJointWithInfo1 *ji);
+
+begin() points the Info2 at the rows of the joint in the stepper's own
+Jacobian arrays and end() does whatever the stepper needs after the joint
+has filled them in.
+
+*/
+
+
+#ifndef _ODE_JOINTBATCH_H_
+#define _ODE_JOINTBATCH_H_
+
+#include <ode/common.h>
+#include "joints/joint.h"
+#include "joints/contact.h"
+#include "joints/ball.h"
+#include "joints/hinge.h"
+#include "joints/fixed.h"
+#include "util.h"
+
+
+struct dJointWithInfo1
+{
+    dxJoint *joint;
+    dxJoint::Info1 info;
+    int8 type;      // joint type, set by SortJointInfosByType()
+};
+
+
+// Returns a copy of the joint infos allocated from the arena and stably
+// sorted by joint type. With keepNubGroups the joints are only reordered
+// within the purely unbounded, mixed and purely LCP groups (in that order),
+// which is the layout dInternalStepIsland_x2() builds for its LCP solver.
+static inline 
+dJointWithInfo1 *SortJointInfosByType(dxWorldProcessMemArena *memarena, 
+                                      dJointWithInfo1 *jointiinfos, size_t nj, bool keepNubGroups)
+{
+    enum { TYPE_COUNT = dJointTypeDHinge + 1, GROUP_COUNT = 3 };
+
+    size_t bucketstarts[GROUP_COUNT * TYPE_COUNT];
+    for (unsigned int k = 0; k != GROUP_COUNT * TYPE_COUNT; ++k) bucketstarts[k] = 0;
+
+    dJointWithInfo1 *const jiend = jointiinfos + nj;
+    for (dJointWithInfo1 *jicurr = jointiinfos; jicurr != jiend; ++jicurr) {
+        int type = jicurr->joint->type();
+        dIASSERT(type >= 0 && type < TYPE_COUNT);
+        jicurr->type = (int8)type;
+
+        unsigned int group = !keepNubGroups ? 0 
+            : jicurr->info.nub == jicurr->info.m ? 0 : jicurr->info.nub != 0 ? 1 : 2;
+        bucketstarts[group * TYPE_COUNT + type] += 1;
+    }
+
+    size_t bucketpos = 0;
+    for (unsigned int k = 0; k != GROUP_COUNT * TYPE_COUNT; ++k) {
+        size_t bucketsize = bucketstarts[k];
+        bucketstarts[k] = bucketpos;
+        bucketpos += bucketsize;
+    }
+
+    dJointWithInfo1 *sorted = memarena->AllocateArray<dJointWithInfo1>(nj);
+    for (const dJointWithInfo1 *jicurr = jointiinfos; jicurr != jiend; ++jicurr) {
+        unsigned int group = !keepNubGroups ? 0 
+            : jicurr->info.nub == jicurr->info.m ? 0 : jicurr->info.nub != 0 ? 1 : 2;
+        sorted[bucketstarts[group * TYPE_COUNT + jicurr->type]++] = *jicurr;
+    }
+
+    return sorted;
+}
+
+
+template<class TJoint>
+struct dxJointInfo2Call
+{
+    static void getInfo2(dxJoint *joint, dxJoint::Info2 *info)
+    {
+        // Qualified call: bound at compile time, no virtual dispatch
+        static_cast<TJoint *>(joint)->TJoint::getInfo2(info);
+    }
+};
+
+template<>
+struct dxJointInfo2Call<dxJoint>
+{
+    static void getInfo2(dxJoint *joint, dxJoint::Info2 *info)
+    {
+        joint->getInfo2(info);
+    }
+};
+
+
+template<class TJoint, class TRowLayout>
+void FillJointInfo2Run(TRowLayout &layout, 
+                       const dJointWithInfo1 *jicurr, const dJointWithInfo1 *jiend)
+{
+    for (; jicurr != jiend; ++jicurr) {
+        dxJoint::Info2 *info = layout.begin(jicurr);
+        dxJointInfo2Call<TJoint>::getInfo2(jicurr->joint, info);
+        layout.end(jicurr);
+    }
+}
+
+// Fills in the constraint rows of the joints, which must have been sorted
+// with SortJointInfosByType(), one run of same-typed joints at a time.
+template<class TRowLayout>
+void FillJointInfo2ByType(TRowLayout &layout, const dJointWithInfo1 *jointiinfos, size_t nj)
+{
+    const dJointWithInfo1 *jicurr = jointiinfos;
+    const dJointWithInfo1 *const jiend = jicurr + nj;
+    while (jicurr != jiend) {
+        const int8 type = jicurr->type;
+        const dJointWithInfo1 *jirunend = jicurr + 1;
+        while (jirunend != jiend && jirunend->type == type) ++jirunend;
+
+        switch (type) {
+            case dJointTypeContact: {
+                FillJointInfo2Run<dxJointContact>(layout, jicurr, jirunend);
+                break;
+            }
+
+            case dJointTypeBall: {
+                FillJointInfo2Run<dxJointBall>(layout, jicurr, jirunend);
+                break;
+            }
+
+            case dJointTypeHinge: {
+                FillJointInfo2Run<dxJointHinge>(layout, jicurr, jirunend);
+                break;
+            }
+
+            case dJointTypeFixed: {
+                FillJointInfo2Run<dxJointFixed>(layout, jicurr, jirunend);
+                break;
+            }
+
+            default: {
+                FillJointInfo2Run<dxJoint>(layout, jicurr, jirunend);
+                break;
+            }
+        }
+
+        jicurr = jirunend;
+    }
+}
+
+
+#endif // #ifndef _ODE_JOINTBATCH_H_
@@ -185,6 +185,7 @@ void
 dxJointAMotor::getSureMaxInfo( SureMaxInfo* info )
 {
     info->max_m = num;
+    info->min_nub = 0;
 }
 
 
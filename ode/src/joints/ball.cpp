@@ -43,6 +43,7 @@ void
 dxJointBall::getSureMaxInfo( SureMaxInfo* info )
 {
     info->max_m = 3;
+    info->min_nub = 3;
 }
 
 
@@ -41,12 +41,37 @@ void
 dxJointContact::getSureMaxInfo( SureMaxInfo* info )
 {
     info->max_m = 3; // ...as the actual m is very likely to hit the maximum
+    info->min_nub = 0;
+}
+
+
+// A contact with negative depth attached to a body in CCD mode is a
+// speculative one generated from a swept test: the geoms do not touch yet
+// and the contact only keeps them from closing more than the remaining gap
+// during the step.
+bool
+dxJointContact::isSpeculative() const
+{
+    if ( contact.geom.depth >= 0 )
+        return false;
+
+    return ( node[0].body && ( node[0].body->flags & dxBodyCCD ) )
+        || ( node[1].body && ( node[1].body->flags & dxBodyCCD ) );
 }
 
 
 void
 dxJointContact::getInfo1( dxJoint::Info1 *info )
 {
+    // speculative contacts have no friction until the geoms really touch
+    if ( isSpeculative() )
+    {
+        the_m = 1;
+        info->m = 1;
+        info->nub = 0;
+        return;
+    }
+
     // make sure mu's >= 0, then calculate number of constraint rows and number
     // of unbounded rows.
     int m = 1, nub = 0;
@@ -135,16 +160,25 @@ dxJointContact::getInfo2( dxJoint::Info2 *info )
     if ( contact.surface.mode & dContactMotionN )
         motionN = contact.surface.motionN;
 
-    const dReal pushout = k * depth + motionN;
-    info->c[rowNormal] = pushout;
+    const bool speculative = isSpeculative();
+    if ( speculative )
+    {
+        // allow the bodies to approach by no more than the remaining gap
+        info->c[rowNormal] = info->fps * contact.geom.depth + motionN;
+    }
+    else
+    {
+        const dReal pushout = k * depth + motionN;
+        info->c[rowNormal] = pushout;
 
-    // note: this cap should not limit bounce velocity
-    const dReal maxvel = world->contactp.max_vel;
-    if ( info->c[rowNormal] > maxvel )
-        info->c[rowNormal] = maxvel;
+        // note: this cap should not limit bounce velocity
+        const dReal maxvel = world->contactp.max_vel;
+        if ( info->c[rowNormal] > maxvel )
+            info->c[rowNormal] = maxvel;
+    }
 
     // deal with bounce
-    if ( contact.surface.mode & dContactBounce )
+    if ( ( contact.surface.mode & dContactBounce ) && !speculative )
     {
         // calculate outgoing velocity (-ve for incoming contact)
         dReal outgoing = dCalcVectorDot3( info->J1l, node[0].body->lvel )
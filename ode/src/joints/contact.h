@@ -38,6 +38,8 @@ struct dxJointContact : public dxJoint
     virtual void getInfo2( Info2* info );
     virtual dJointType type() const;
     virtual size_t size() const;
+
+    bool isSpeculative() const;
 };
 
 
@@ -45,6 +45,7 @@ void
 dxJointDBall::getSureMaxInfo( SureMaxInfo* info )
 {
     info->max_m = 1;
+    info->min_nub = 1;
 }
 void
 dxJointDBall::getInfo1( dxJoint::Info1 *info )
@@ -42,6 +42,7 @@ void
 dxJointDHinge::getSureMaxInfo( SureMaxInfo* info )
 {
     info->max_m = 4;
+    info->min_nub = 4;
 }
 
 
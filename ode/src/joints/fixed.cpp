@@ -45,6 +45,7 @@ void
 dxJointFixed::getSureMaxInfo( SureMaxInfo* info )
 {
     info->max_m = 6;
+    info->min_nub = 6;
 }
 
 
@@ -47,7 +47,13 @@ dxJointHinge::dxJointHinge( dxWorld *w ) :
 void 
 dxJointHinge::getSureMaxInfo( SureMaxInfo* info )
 {
-    info->max_m = 6;
+    // the 6th row is only there with a motor or with the limits enabled
+    if ( limot.fmax > 0 ||
+        (( limot.lostop >= -M_PI || limot.histop <= M_PI ) &&
+        limot.lostop <= limot.histop ))
+        info->max_m = 6;
+    else info->max_m = 5;
+    info->min_nub = 5;
 }
 
 
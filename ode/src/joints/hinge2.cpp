@@ -75,6 +75,7 @@ void
 dxJointHinge2::getSureMaxInfo( SureMaxInfo* info )
 {
     info->max_m = 6;
+    info->min_nub = 4;
 }
 
 
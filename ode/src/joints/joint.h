@@ -128,6 +128,11 @@ struct dxJoint : public dObject
         // for calculations if that smaller value is returned.
 
         int8 max_m; // Estimate of maximal `m' in Info1
+
+        // The value of `min_nub' must ALWAYS be not greater than the value of
+        // `nub' the getInfo1 call can generate, so that `max_m - min_nub'
+        // bounds the number of rows that may be bounded.
+        int8 min_nub; // Estimate of minimal `nub' in Info1
     };
 
 
@@ -70,6 +70,7 @@ void
 dxJointLMotor::getSureMaxInfo( SureMaxInfo* info )
 {
     info->max_m = num;
+    info->min_nub = 0;
 }
 
 void
@@ -39,6 +39,7 @@ void
 dxJointNull::getSureMaxInfo( SureMaxInfo* info )
 {
     info->max_m = 0;
+    info->min_nub = 0;
 }
 
 
@@ -176,6 +176,7 @@ void
 dxJointPiston::getSureMaxInfo( SureMaxInfo* info )
 {
     info->max_m = 6;
+    info->min_nub = 4;
 }
 
 
@@ -65,6 +65,7 @@ void
 dxJointPlane2D::getSureMaxInfo( SureMaxInfo* info )
 {
     info->max_m = 6;
+    info->min_nub = 3;
 }
 
 
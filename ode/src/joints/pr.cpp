@@ -181,6 +181,7 @@ void
 dxJointPR::getSureMaxInfo( SureMaxInfo* info )
 {
     info->max_m = 6;
+    info->min_nub = 4;
 }
 
 
@@ -210,6 +210,7 @@ void
 dxJointPU::getSureMaxInfo( SureMaxInfo* info )
 {
     info->max_m = 6;
+    info->min_nub = 3;
 }
 
 
@@ -109,7 +109,13 @@ dReal dJointGetSliderPositionRate ( dJointID j )
 void 
 dxJointSlider::getSureMaxInfo( SureMaxInfo* info )
 {
-    info->max_m = 6;
+    // the 6th row is only there with a motor or with the limits enabled
+    if ( limot.fmax > 0 ||
+        (( limot.lostop > -dInfinity || limot.histop < dInfinity ) &&
+        limot.lostop <= limot.histop ))
+        info->max_m = 6;
+    else info->max_m = 5;
+    info->min_nub = 5;
 }
 
 
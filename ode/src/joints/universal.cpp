@@ -259,6 +259,7 @@ void
 dxJointUniversal::getSureMaxInfo( SureMaxInfo* info )
 {
     info->max_m = 6;
+    info->min_nub = 4;
 }
 
 
@@ -0,0 +1,387 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001,2002 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+
+/*
+
+Size-class object pools implementation.
+
+*/
+
+#include <ode/common.h>
+#include <ode/memory.h>
+#include "config.h"
+#include "objectpool.h"
+#include "odeou.h"
+#include "odetls.h"
+#include "error.h"
+
+
+//****************************************************************************
+// shared pool state
+
+struct dxObjectPoolFreeBlock
+{
+    dxObjectPoolFreeBlock *m_next;
+};
+
+struct dxObjectPoolSlab
+{
+    dxObjectPoolSlab *m_next;
+};
+
+struct dxObjectPoolClass
+{
+    dxObjectPoolFreeBlock *m_freeList;
+    char *m_carvePointer;       // unused remainder of the slab last assigned to the class
+    char *m_carveEnd;
+    size_t m_blocksInUse;       // blocks given out to users and to thread caches
+};
+
+#define dOBJECTPOOL_SLAB_HEADER_SIZE \
+    ((sizeof(dxObjectPoolSlab) + dOBJECTPOOL_GRANULARITY - 1) & ~((size_t)dOBJECTPOOL_GRANULARITY - 1))
+
+static dxObjectPoolClass g_aPoolClasses[dOBJECTPOOL_CLASS_COUNT];
+
+#if dATOMICS_ENABLED
+static volatile atomicord32 g_aPoolClassLocks[dOBJECTPOOL_CLASS_COUNT];
+static volatile atomicptr g_pSlabList = NULL; // dxObjectPoolSlab *
+#else
+static dxObjectPoolSlab *g_pSlabList = NULL;
+#endif
+static size_t g_nSlabCount = 0;
+
+
+static inline unsigned GetSizeClass(size_t size)
+{
+    dIASSERT(size != 0 && size <= dOBJECTPOOL_MAX_BLOCK_SIZE);
+    return (unsigned)((size - 1) / dOBJECTPOOL_GRANULARITY);
+}
+
+static inline size_t GetClassBlockSize(unsigned sizeClass)
+{
+    return (size_t)(sizeClass + 1) * dOBJECTPOOL_GRANULARITY;
+}
+
+static inline void LockPoolClass(unsigned sizeClass)
+{
+#if dATOMICS_ENABLED
+    while (!AtomicCompareExchange(&g_aPoolClassLocks[sizeClass], 0, 1))
+    {
+        // busy-wait: the lock is only held for a few list operations
+    }
+#endif
+}
+
+static inline void UnlockPoolClass(unsigned sizeClass)
+{
+#if dATOMICS_ENABLED
+    dIVERIFY(AtomicCompareExchange(&g_aPoolClassLocks[sizeClass], 1, 0));
+#endif
+}
+
+static void RegisterSlab(dxObjectPoolSlab *slab)
+{
+#if dATOMICS_ENABLED
+    while (true)
+    {
+        dxObjectPoolSlab *head = (dxObjectPoolSlab *)g_pSlabList;
+        slab->m_next = head;
+
+        if (AtomicCompareExchangePointer(&g_pSlabList, (atomicptr)head, (atomicptr)slab))
+        {
+            break;
+        }
+    }
+#else
+    slab->m_next = g_pSlabList;
+    g_pSlabList = slab;
+#endif
+}
+
+
+// Must be called with the class locked.
+// Returns a chain of up to maxcount blocks linked via m_next and their actual count.
+static dxObjectPoolFreeBlock *ExtractClassBlocks(unsigned sizeClass, unsigned maxcount, unsigned &outcount)
+{
+    dxObjectPoolClass &pc = g_aPoolClasses[sizeClass];
+    const size_t blocksize = GetClassBlockSize(sizeClass);
+
+    dxObjectPoolFreeBlock *first = NULL, **last = &first;
+    unsigned count = 0;
+
+    for (; count != maxcount && pc.m_freeList != NULL; ++count) {
+        dxObjectPoolFreeBlock *block = pc.m_freeList;
+        pc.m_freeList = block->m_next;
+        *last = block;
+        last = &block->m_next;
+    }
+
+    for (; count != maxcount; ++count) {
+        if ((size_t)(pc.m_carveEnd - pc.m_carvePointer) < blocksize) {
+            dxObjectPoolSlab *slab = (dxObjectPoolSlab *)dAlloc(dOBJECTPOOL_SLAB_SIZE);
+            if (slab == NULL) {
+                break;
+            }
+
+            RegisterSlab(slab);
+            g_nSlabCount++; // statistics only, races are harmless
+
+            // the tail of the previous slab (if any) is smaller than a block and is abandoned
+            pc.m_carvePointer = (char *)slab + dOBJECTPOOL_SLAB_HEADER_SIZE;
+            pc.m_carveEnd = (char *)slab + dOBJECTPOOL_SLAB_SIZE;
+        }
+
+        dxObjectPoolFreeBlock *block = (dxObjectPoolFreeBlock *)pc.m_carvePointer;
+        pc.m_carvePointer += blocksize;
+        *last = block;
+        last = &block->m_next;
+    }
+
+    *last = NULL;
+    pc.m_blocksInUse += count;
+    outcount = count;
+    return first;
+}
+
+// Must be called with the class locked.
+static void ReturnClassBlocks(unsigned sizeClass, dxObjectPoolFreeBlock *first, dxObjectPoolFreeBlock *last, unsigned count)
+{
+    dxObjectPoolClass &pc = g_aPoolClasses[sizeClass];
+
+    dIASSERT(pc.m_blocksInUse >= count);
+    last->m_next = pc.m_freeList;
+    pc.m_freeList = first;
+    pc.m_blocksInUse -= count;
+}
+
+
+//****************************************************************************
+// per-thread caches
+
+struct dxObjectPoolThreadCache
+{
+    dxObjectPoolFreeBlock *m_aFreeLists[dOBJECTPOOL_CLASS_COUNT];
+    unsigned m_auFreeCounts[dOBJECTPOOL_CLASS_COUNT];
+};
+
+static inline dxObjectPoolThreadCache *GetCurrentThreadCache()
+{
+    dxObjectPoolThreadCache *cache = NULL;
+
+#if dTLS_ENABLED
+    for (unsigned tk = OTK__MIN; tk != OTK__MAX; ++tk) {
+        if (COdeTls::IsInitialized((EODETLSKIND)tk)) {
+            cache = COdeTls::GetObjectPoolCache((EODETLSKIND)tk);
+            if (cache != NULL) {
+                break;
+            }
+        }
+    }
+#endif
+
+    return cache;
+}
+
+static void *AllocFromThreadCache(dxObjectPoolThreadCache *cache, unsigned sizeClass)
+{
+    dxObjectPoolFreeBlock *block = cache->m_aFreeLists[sizeClass];
+
+    if (block == NULL) {
+        unsigned count;
+
+        LockPoolClass(sizeClass);
+        block = ExtractClassBlocks(sizeClass, dOBJECTPOOL_CACHE_BATCH, count);
+        UnlockPoolClass(sizeClass);
+
+        if (block == NULL) {
+            return NULL;
+        }
+
+        cache->m_auFreeCounts[sizeClass] = count;
+    }
+
+    cache->m_aFreeLists[sizeClass] = block->m_next;
+    cache->m_auFreeCounts[sizeClass] -= 1;
+    return block;
+}
+
+static void FreeToThreadCache(dxObjectPoolThreadCache *cache, unsigned sizeClass, void *ptr)
+{
+    dxObjectPoolFreeBlock *block = (dxObjectPoolFreeBlock *)ptr;
+    block->m_next = cache->m_aFreeLists[sizeClass];
+    cache->m_aFreeLists[sizeClass] = block;
+
+    if (++cache->m_auFreeCounts[sizeClass] == 2 * dOBJECTPOOL_CACHE_BATCH) {
+        // give a batch back so that caches do not hoard blocks freed by other threads
+        dxObjectPoolFreeBlock *first = cache->m_aFreeLists[sizeClass], *last = first;
+        for (unsigned i = 1; i != dOBJECTPOOL_CACHE_BATCH; ++i) {
+            last = last->m_next;
+        }
+
+        cache->m_aFreeLists[sizeClass] = last->m_next;
+        cache->m_auFreeCounts[sizeClass] -= dOBJECTPOOL_CACHE_BATCH;
+
+        LockPoolClass(sizeClass);
+        ReturnClassBlocks(sizeClass, first, last, dOBJECTPOOL_CACHE_BATCH);
+        UnlockPoolClass(sizeClass);
+    }
+}
+
+
+//****************************************************************************
+// dxObjectPool
+
+/*static */
+void *dxObjectPool::allocBlock(size_t size)
+{
+    if (size > dOBJECTPOOL_MAX_BLOCK_SIZE || size == 0) {
+        return dAlloc(size);
+    }
+
+    const unsigned sizeClass = GetSizeClass(size);
+
+    dxObjectPoolThreadCache *cache = GetCurrentThreadCache();
+    if (cache != NULL) {
+        return AllocFromThreadCache(cache, sizeClass);
+    }
+
+    unsigned count;
+
+    LockPoolClass(sizeClass);
+    void *block = ExtractClassBlocks(sizeClass, 1, count);
+    UnlockPoolClass(sizeClass);
+
+    return block;
+}
+
+/*static */
+void dxObjectPool::freeBlock(void *ptr, size_t size)
+{
+    if (ptr == NULL) {
+        return;
+    }
+
+    if (size > dOBJECTPOOL_MAX_BLOCK_SIZE || size == 0) {
+        dFree(ptr, size);
+        return;
+    }
+
+    const unsigned sizeClass = GetSizeClass(size);
+
+    dxObjectPoolThreadCache *cache = GetCurrentThreadCache();
+    if (cache != NULL) {
+        FreeToThreadCache(cache, sizeClass, ptr);
+        return;
+    }
+
+    dxObjectPoolFreeBlock *block = (dxObjectPoolFreeBlock *)ptr;
+
+    LockPoolClass(sizeClass);
+    ReturnClassBlocks(sizeClass, block, block, 1);
+    UnlockPoolClass(sizeClass);
+}
+
+
+/*static */
+void dxObjectPool::releaseUnusedMemory()
+{
+    // No threads should be accessing ODE at this time already,
+    // hence the variables may be accessed directly.
+    if (getBlocksInUse() != 0) {
+        // Some objects are still alive (or cached by threads that have not been
+        // cleaned up). The slabs can't be released then.
+        return;
+    }
+
+    dxObjectPoolSlab *slab = (dxObjectPoolSlab *)g_pSlabList;
+    g_pSlabList = NULL;
+    g_nSlabCount = 0;
+
+    while (slab != NULL) {
+        dxObjectPoolSlab *next = slab->m_next;
+        dFree(slab, dOBJECTPOOL_SLAB_SIZE);
+        slab = next;
+    }
+
+    for (unsigned sizeClass = 0; sizeClass != dOBJECTPOOL_CLASS_COUNT; ++sizeClass) {
+        dxObjectPoolClass &pc = g_aPoolClasses[sizeClass];
+        pc.m_freeList = NULL;
+        pc.m_carvePointer = NULL;
+        pc.m_carveEnd = NULL;
+    }
+}
+
+
+/*static */
+dxObjectPoolThreadCache *dxObjectPool::allocThreadCache()
+{
+    dxObjectPoolThreadCache *cache = (dxObjectPoolThreadCache *)dAlloc(sizeof(dxObjectPoolThreadCache));
+
+    if (cache != NULL) {
+        for (unsigned sizeClass = 0; sizeClass != dOBJECTPOOL_CLASS_COUNT; ++sizeClass) {
+            cache->m_aFreeLists[sizeClass] = NULL;
+            cache->m_auFreeCounts[sizeClass] = 0;
+        }
+    }
+
+    return cache;
+}
+
+/*static */
+void dxObjectPool::freeThreadCache(dxObjectPoolThreadCache *cache)
+{
+    for (unsigned sizeClass = 0; sizeClass != dOBJECTPOOL_CLASS_COUNT; ++sizeClass) {
+        dxObjectPoolFreeBlock *first = cache->m_aFreeLists[sizeClass];
+
+        if (first != NULL) {
+            dxObjectPoolFreeBlock *last = first;
+            while (last->m_next != NULL) {
+                last = last->m_next;
+            }
+
+            LockPoolClass(sizeClass);
+            ReturnClassBlocks(sizeClass, first, last, cache->m_auFreeCounts[sizeClass]);
+            UnlockPoolClass(sizeClass);
+        }
+    }
+
+    dFree(cache, sizeof(dxObjectPoolThreadCache));
+}
+
+
+/*static */
+size_t dxObjectPool::getBlocksInUse()
+{
+    size_t result = 0;
+
+    for (unsigned sizeClass = 0; sizeClass != dOBJECTPOOL_CLASS_COUNT; ++sizeClass) {
+        result += g_aPoolClasses[sizeClass].m_blocksInUse;
+    }
+
+    return result;
+}
+
+/*static */
+size_t dxObjectPool::getSlabMemorySize()
+{
+    return g_nSlabCount * dOBJECTPOOL_SLAB_SIZE;
+}
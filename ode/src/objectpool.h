@@ -0,0 +1,76 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001,2002 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+
+/*
+
+Size-class pools for the small objects that are created and destroyed at
+high rates: bodies, joints, geoms and geom position/rotation records.
+
+Blocks are carved from slabs obtained with dAlloc() and recycled through
+per-size-class free lists shared by all threads. If TLS is enabled, each
+thread that had ODE data allocated for it additionally keeps a small
+private cache per size class, so the shared lists (and their locks) are
+only touched once per a batch of allocations.
+
+*/
+
+
+#ifndef _ODE_OBJECTPOOL_H_
+#define _ODE_OBJECTPOOL_H_
+
+#include <ode/common.h>
+
+
+// size classes are multiples of this many bytes
+#define dOBJECTPOOL_GRANULARITY     16
+// blocks larger than this are passed directly to dAlloc()/dFree()
+#define dOBJECTPOOL_MAX_BLOCK_SIZE  1024
+#define dOBJECTPOOL_CLASS_COUNT     (dOBJECTPOOL_MAX_BLOCK_SIZE / dOBJECTPOOL_GRANULARITY)
+// size of memory chunks the blocks are carved from
+#define dOBJECTPOOL_SLAB_SIZE       16384
+// number of blocks moved between a thread cache and the shared lists at once
+#define dOBJECTPOOL_CACHE_BATCH     16
+
+
+struct dxObjectPoolThreadCache;
+
+
+class dxObjectPool
+{
+public:
+    static void *allocBlock(size_t size);
+    static void freeBlock(void *ptr, size_t size);
+
+    // Releases the slabs if there are no blocks in use. Called on library closure.
+    static void releaseUnusedMemory();
+
+    static dxObjectPoolThreadCache *allocThreadCache();
+    static void freeThreadCache(dxObjectPoolThreadCache *cache);
+
+    // Number of pooled blocks currently handed out.
+    static size_t getBlocksInUse();
+    // Total size of slabs allocated for the pools.
+    static size_t getSlabMemorySize();
+};
+
+
+#endif // #ifndef _ODE_OBJECTPOOL_H_
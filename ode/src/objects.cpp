@@ -31,6 +31,7 @@
 
 #include "objects.h"
 #include "util.h"
+#include "stepstats.h"
 #include "threading_impl.h"
 
 
@@ -73,13 +74,23 @@ dxDampingParameters::dxDampingParameters(void *):
 
 dxQuickStepParameters::dxQuickStepParameters(void *):
     num_iterations(20),
-    w(REAL(1.3))
+    w(REAL(1.3)),
+    solver(dQuickStepSOR),
+    row_order(dQuickStepRowsShuffled),
+    mixed_precision(0)
 {
 }
 
 dxContactParameters::dxContactParameters(void *):
     max_vel(dInfinity),
-    min_depth(REAL(0.0))
+    min_depth(REAL(0.0)),
+    ccd_step(REAL(0.0))
+{
+}
+
+dxObjectMemoryManager::dxObjectMemoryManager(void *):
+    alloc_block(&dxObjectPool::allocBlock),
+    free_block(&dxObjectPool::freeBlock)
 {
 }
 
@@ -90,16 +101,20 @@ dxWorld::dxWorld():
     firstjoint(NULL),
     nb(0),
     nj(0),
+    active_bodies(),
     global_erp(dWORLD_DEFAULT_GLOBAL_ERP),
     global_cfm(dWORLD_DEFAULT_GLOBAL_CFM),
     adis(NULL),
+    adis_mode(dAutoDisableBodies),
     body_flags(0),
     islands_max_threads(dWORLDSTEP_THREADCOUNT_UNLIMITED),
     wmem(NULL),
     qs(NULL),
     contactp(NULL),
     dampingp(NULL),
-    max_angular_speed(dInfinity)
+    max_angular_speed(dInfinity),
+    objmem(NULL),
+    stepstats(NULL)
 {
     dxThreadingBase::SetThreadingDefaultImplProvider(this);
 
@@ -113,6 +128,68 @@ dxWorld::~dxWorld()
         wmem->CleanupWorldReferences(this);
         wmem->Release();
     }
+
+    delete stepstats;
+}
+
+static void addActiveBody(dArray<dxBody *> &active_bodies, dxBody *b)
+{
+    if (b->active_index < 0) {
+        b->active_index = active_bodies.size();
+        active_bodies.push(b);
+    }
+    b->flags &= ~dxBodyDisabled;
+}
+
+void dxWorld::enableBody(dxBody *b)
+{
+    dIASSERT(b->world == this);
+    if (b->sleep_next != NULL) {
+        // wake up the island the body fell asleep with
+        dxBody *curr = b;
+        do {
+            dxBody *next = curr->sleep_next;
+            curr->sleep_next = NULL;
+            curr->adis_stepsleft = curr->adis.idle_steps;
+            curr->adis_timeleft = curr->adis.idle_time;
+            addActiveBody(active_bodies, curr);
+            curr = next;
+        } while (curr != b);
+    }
+    else {
+        addActiveBody(active_bodies, b);
+    }
+}
+
+void dxWorld::disableBody(dxBody *b)
+{
+    dIASSERT(b->world == this);
+    b->flags |= dxBodyDisabled;
+    removeActiveBody(b);
+}
+
+void dxWorld::removeActiveBody(dxBody *b)
+{
+    int index = b->active_index;
+    if (index >= 0) {
+        // move the last body into the freed position
+        int last = active_bodies.size() - 1;
+        dxBody *moved = active_bodies[last];
+        active_bodies[index] = moved;
+        moved->active_index = index;
+        active_bodies.setSize(last);
+        b->active_index = -1;
+    }
+}
+
+void dxWorld::removeSleepingBody(dxBody *b)
+{
+    if (b->sleep_next != NULL) {
+        dxBody *prev = b;
+        while (prev->sleep_next != b) prev = prev->sleep_next;
+        if (prev != b) prev->sleep_next = b->sleep_next;
+        b->sleep_next = NULL;
+    }
 }
 
 bool dxWorld::InitializeDefaultThreading()
@@ -176,9 +253,14 @@ dxWorldProcessContext *dxWorld::UnsafeGetWorldProcessingContext() const
     return wmem->GetWorldProcessingContext();
 }
 
-const dxThreadingFunctionsInfo *dxWorld::RetrieveThreadingDefaultImpl(dThreadingImplementationID &out_default_impl)
+const dxThreadingFunctionsInfo *dxWorld::RetrieveDefaultThreading(dThreadingImplementationID &out_default_impl)
 {
     out_default_impl = g_world_default_threading_impl;
     return g_world_default_threading_functions;
 }
 
+const dxThreadingFunctionsInfo *dxWorld::RetrieveThreadingDefaultImpl(dThreadingImplementationID &out_default_impl)
+{
+    return RetrieveDefaultThreading(out_default_impl);
+}
+
@@ -31,11 +31,13 @@
 #include <ode/mass.h>
 #include "error.h"
 #include "array.h"
+#include "objectpool.h"
 #include "threading_base.h"
 
 
 class dxStepWorkingMemory;
 class dxWorldProcessContext;
+class dxStepStats;
 
 // some body flags
 
@@ -49,6 +51,8 @@ enum {
     dxBodyAngularDamping =            64, // use angular damping
     dxBodyMaxAngularSpeed =           128,// use maximum angular speed
     dxBodyGyroscopic =                256,// use gyroscopic term
+    dxBodyCCD =                       512,// sweep geoms by the velocity (CCD)
+    dxBodyStateChanged =              1024,// moved since last reported as changed
 };
 
 
@@ -106,6 +110,9 @@ struct dxDampingParameters {
 struct dxQuickStepParameters {
     int num_iterations;		// number of SOR iterations to perform
     dReal w;			// the SOR over-relaxation parameter
+    int solver;			// dQuickStepXXX solver
+    int row_order;		// dQuickStepRowsXXX row order
+    int mixed_precision;	// iterate the rows in float in double precision builds
 
     dxQuickStepParameters() {}
     explicit dxQuickStepParameters(void *);
@@ -116,11 +123,21 @@ struct dxQuickStepParameters {
 struct dxContactParameters {
     dReal max_vel;		// maximum correcting velocity
     dReal min_depth;		// thickness of 'surface layer'
+    dReal ccd_step;		// time span CCD bodies are swept over
 
     dxContactParameters() {}
     explicit dxContactParameters(void *);
 };
 
+// memory manager used to allocate bodies and joints of a world
+struct dxObjectMemoryManager {
+    void *(*alloc_block)(size_t block_size);
+    void (*free_block)(void *block_pointer, size_t block_size);
+
+    dxObjectMemoryManager() {}
+    explicit dxObjectMemoryManager(void *);
+};
+
 // position vector and rotation matrix for geometry objects that are not
 // connected to bodies.
 struct dxPosR {
@@ -153,6 +170,8 @@ struct dxBody : public dObject {
     void (*moved_callback)(dxBody*); // let the user know the body moved
     dxDampingParameters dampingp; // damping parameters, depends on flags
     dReal max_angular_speed;      // limit the angular velocity to this magnitude
+    int active_index;             // position in world->active_bodies, -1 if disabled
+    dxBody *sleep_next;           // ring of the bodies of a sleeping island, NULL if none
 
     dxBody(dxWorld *w);
 };
@@ -162,10 +181,12 @@ struct dxWorld : public dBase, public dxThreadingBase, private dxIThreadingDefau
     dxBody *firstbody;		// body linked list
     dxJoint *firstjoint;		// joint linked list
     int nb,nj;			// number of bodies and joints in lists
+    dArray<dxBody *> active_bodies; // enabled bodies, in no particular order
     dVector3 gravity;		// gravity vector (m/s/s)
     dReal global_erp;		// global error reduction parameter
     dReal global_cfm;		// global constraint force mixing parameter
     dxAutoDisable adis;		// auto-disable parameters
+    int adis_mode;		// dAutoDisableBodies or dAutoDisableIslands
     int body_flags;               // flags for new bodies
     unsigned islands_max_threads; // maximum threads to allocate for island processing
     dxStepWorkingMemory *wmem; // Working memory object for dWorldStep/dWorldQuickStep
@@ -174,6 +195,8 @@ struct dxWorld : public dBase, public dxThreadingBase, private dxIThreadingDefau
     dxContactParameters contactp;
     dxDampingParameters dampingp; // damping parameters
     dReal max_angular_speed;      // limit the angular velocity to this magnitude
+    dxObjectMemoryManager objmem; // allocator for bodies and non-group joints
+    dxStepStats *stepstats;       // step statistics, NULL if not collected
 
 
     dxWorld();
@@ -181,11 +204,24 @@ struct dxWorld : public dBase, public dxThreadingBase, private dxIThreadingDefau
 
     static bool InitializeDefaultThreading();
     static void FinalizeDefaultThreading();
+    static const dxThreadingFunctionsInfo *RetrieveDefaultThreading(dThreadingImplementationID &out_default_impl);
 
     void AssignThreadingImpl(const dxThreadingFunctionsInfo *functions_info, dThreadingImplementationID threading_impl);
     unsigned GetThreadingIslandsMaxThreadsCount(unsigned *out_active_thread_count_ptr=NULL) const;
     dxWorldProcessContext *UnsafeGetWorldProcessingContext() const;
 
+    // The dxBodyDisabled flag is only changed with these, to keep the active
+    // body set in sync. The stepping code visits the active bodies and the
+    // joints attached to them only. Enabling a body of a sleeping island
+    // enables the whole island.
+    void enableBody(dxBody *b);
+    void disableBody(dxBody *b);
+    void removeActiveBody(dxBody *b);
+    void removeSleepingBody(dxBody *b);
+
+    void *allocObjectBlock(size_t size) { return objmem.alloc_block(size); }
+    void freeObjectBlock(void *ptr, size_t size) { objmem.free_block(ptr, size); }
+
 private: // dxIThreadingDefaultImplProvider
     virtual const dxThreadingFunctionsInfo *RetrieveThreadingDefaultImpl(dThreadingImplementationID &out_default_impl);
 };
@@ -37,7 +37,9 @@
 #include "joints/joints.h"
 #include "step.h"
 #include "quickstep.h"
+#include "sparsestep.h"
 #include "util.h"
+#include "stepstats.h"
 #include "odetls.h"
 
 // misc defines
@@ -153,6 +155,19 @@ static void checkWorld (dxWorld *w)
     for (j=w->firstjoint; j; j=(dxJoint*)j->next) n++;
     if (w->nj != n) dDebug (0,"joint count incorrect");
 
+    // check the active body set matches the disabled flags
+    n = 0;
+    for (b=w->firstbody; b; b=(dxBody*)b->next) {
+        if ((b->flags & dxBodyDisabled) == 0) {
+            if (b->active_index < 0 || b->active_index >= w->active_bodies.size()
+                || w->active_bodies[b->active_index] != b)
+                dDebug (0,"enabled body not in active set");
+            n++;
+        }
+        else if (b->active_index >= 0) dDebug (0,"disabled body in active set");
+    }
+    if (w->active_bodies.size() != n) dDebug (0,"active body count incorrect");
+
     // set all tag values to a known value
     int count = generateWorldCheckTag();
     for (b=w->firstbody; b; b=(dxBody*)b->next) b->tag = count;
@@ -238,7 +253,9 @@ dxWorld* dBodyGetWorld (dxBody * b)
 dxBody *dBodyCreate (dxWorld *w)
 {
     dAASSERT (w);
-    dxBody *b = new dxBody(w);
+    void *mem = w->allocObjectBlock (sizeof(dxBody));
+    if (mem == NULL) return NULL;
+    dxBody *b = new (mem) dxBody(w);
     b->firstjoint = 0;
     b->flags = 0;
     b->geom = 0;
@@ -261,6 +278,9 @@ dxBody *dBodyCreate (dxWorld *w)
     dSetZero (b->finite_rot_axis,4);
     addObjectToList (b,(dObject **) &w->firstbody);
     w->nb++;
+    b->active_index = -1;
+    b->sleep_next = 0;
+    w->enableBody (b);
 
     // set auto-disable parameters
     b->average_avel_buffer = b->average_lvel_buffer = 0; // no buffer at beginning
@@ -278,7 +298,7 @@ dxBody *dBodyCreate (dxWorld *w)
     b->flags |= w->body_flags & dxBodyMaxAngularSpeed;
     b->max_angular_speed = w->max_angular_speed;
 
-    b->flags |= dxBodyGyroscopic;
+    b->flags |= dxBodyGyroscopic | dxBodyStateChanged;
 
     return b;
 }
@@ -311,6 +331,8 @@ void dBodyDestroy (dxBody *b)
     }
     removeObjectFromList (b);
     b->world->nb--;
+    b->world->removeActiveBody (b);
+    b->world->removeSleepingBody (b);
 
     // delete the average buffers
     if(b->average_lvel_buffer)
@@ -324,7 +346,9 @@ void dBodyDestroy (dxBody *b)
         b->average_avel_buffer = 0;
     }
 
-    delete b;
+    dxWorld *w = b->world;
+    b->~dxBody();
+    w->freeObjectBlock (b,sizeof(dxBody));
 }
 
 
@@ -348,6 +372,7 @@ void dBodySetPosition (dBodyID b, dReal x, dReal y, dReal z)
     b->posr.pos[0] = x;
     b->posr.pos[1] = y;
     b->posr.pos[2] = z;
+    b->flags |= dxBodyStateChanged;
 
     // notify all attached geoms that this body has moved
     for (dxGeom *geom = b->geom; geom; geom = dGeomGetBodyNext (geom))
@@ -363,6 +388,7 @@ void dBodySetRotation (dBodyID b, const dMatrix3 R)
     dOrthogonalizeR(b->posr.R);
     dRtoQ (R, b->q);
     dNormalize4 (b->q);
+    b->flags |= dxBodyStateChanged;
 
     // notify all attached geoms that this body has moved
     for (dxGeom *geom = b->geom; geom; geom = dGeomGetBodyNext (geom))
@@ -379,6 +405,7 @@ void dBodySetQuaternion (dBodyID b, const dQuaternion q)
     b->q[3] = q[3];
     dNormalize4 (b->q);
     dQtoR (b->q,b->posr.R);
+    b->flags |= dxBodyStateChanged;
 
     // notify all attached geoms that this body has moved
     for (dxGeom *geom = b->geom; geom; geom = dGeomGetBodyNext (geom))
@@ -392,6 +419,13 @@ void dBodySetLinearVel  (dBodyID b, dReal x, dReal y, dReal z)
     b->lvel[0] = x;
     b->lvel[1] = y;
     b->lvel[2] = z;
+    b->flags |= dxBodyStateChanged;
+
+    // swept AABBs depend on the velocity
+    if (b->flags & dxBodyCCD) {
+        for (dxGeom *geom = b->geom; geom; geom = dGeomGetBodyNext (geom))
+            dGeomMoved (geom);
+    }
 }
 
 
@@ -401,6 +435,7 @@ void dBodySetAngularVel (dBodyID b, dReal x, dReal y, dReal z)
     b->avel[0] = x;
     b->avel[1] = y;
     b->avel[2] = z;
+    b->flags |= dxBodyStateChanged;
 }
 
 
@@ -844,7 +879,7 @@ int dBodyIsKinematic (dBodyID b)
 void dBodyEnable (dBodyID b)
 {
     dAASSERT (b);
-    b->flags &= ~dxBodyDisabled;
+    b->world->enableBody (b);
     b->adis_stepsleft = b->adis.idle_steps;
     b->adis_timeleft = b->adis.idle_time;
     // no code for average-processing needed here
@@ -854,7 +889,7 @@ void dBodyEnable (dBodyID b)
 void dBodyDisable (dBodyID b)
 {
     dAASSERT (b);
-    b->flags |= dxBodyDisabled;
+    b->world->disableBody (b);
 }
 
 
@@ -990,7 +1025,7 @@ void dBodySetAutoDisableFlag (dBodyID b, int do_auto_disable)
     {
         b->flags &= ~dxBodyAutoDisable;
         // (mg) we should also reset the IsDisabled state to correspond to the DoDisabling flag
-        b->flags &= ~dxBodyDisabled;
+        b->world->enableBody (b);
         b->adis.idle_steps = dWorldGetAutoDisableSteps(b->world);
         b->adis.idle_time = dWorldGetAutoDisableTime(b->world);
         // resetting the average calculations too
@@ -1143,6 +1178,25 @@ void dBodySetGyroscopicMode(dBodyID b, int enabled)
 }
 
 
+int dBodyGetCCDMode(dBodyID b)
+{
+    dAASSERT(b);
+    return (b->flags & dxBodyCCD) != 0;
+}
+
+void dBodySetCCDMode(dBodyID b, int enabled)
+{
+    dAASSERT(b);
+    if (enabled)
+        b->flags |= dxBodyCCD;
+    else
+        b->flags &= ~dxBodyCCD;
+
+    for (dxGeom *geom = b->geom; geom; geom = dGeomGetBodyNext (geom))
+        dGeomMoved (geom);
+}
+
+
 
 //****************************************************************************
 // joints
@@ -1156,7 +1210,8 @@ dxJoint* createJoint(dWorldID w, dJointGroupID group)
     if (group) {
         j = group->alloc<T>(w);
     } else {
-        j = new T(w);
+        void *mem = w->allocObjectBlock (sizeof(T));
+        j = mem != NULL ? new (mem) T(w) : NULL;
     }
     return j;
 }
@@ -1272,15 +1327,20 @@ dxJoint * dJointCreateDHinge (dWorldID w, dJointGroupID group)
 
 static void FinalizeAndDestroyJointInstance(dxJoint *j, bool delete_it)
 {
+    dxWorld *w = j->world;
     // if any group joints have their world pointer set to 0, their world was
     // previously destroyed. no special handling is required for these joints.
-    if (j->world != NULL) {
+    if (w != NULL) {
         removeJointReferencesFromAttachedBodies (j);
         removeObjectFromList (j);
-        j->world->nj--;
+        w->nj--;
     }
     if (delete_it) { 
-        delete j;
+        // joints out of groups are always allocated by their world
+        dIASSERT (w != NULL);
+        size_t sz = j->size();
+        j->~dxJoint();
+        w->freeObjectBlock (j,sz);
     } else {
         j->~dxJoint();
     }
@@ -1597,7 +1657,7 @@ void dWorldDestroy (dxWorld *w)
             // TODO: shouldn't we call dJointDestroy()?
             size_t sz = j->size();
             j->~dxJoint();
-            dFree (j,sz);
+            w->freeObjectBlock (j,sz);
         }
         j = nextj;
     }
@@ -1780,6 +1840,65 @@ int dWorldSetStepMemoryManager(dWorldID w, const dWorldStepMemoryFunctionsInfo *
     return result;
 }
 
+int dWorldSetObjectMemoryManager(dWorldID w, const dWorldObjectMemoryFunctionsInfo *memfuncs)
+{
+    dUASSERT (w,"bad world argument");
+    dUASSERT (!memfuncs || memfuncs->struct_size >= sizeof(*memfuncs), "Bad memory functions info");
+    dUASSERT (!memfuncs || (memfuncs->alloc_block && memfuncs->free_block), "Bad memory functions info");
+
+    // objects must be freed with the same functions they have been allocated with
+    dUASSERT (w->firstbody == NULL && w->firstjoint == NULL, "world must have no bodies or joints to change object memory manager");
+    if (w->firstbody != NULL || w->firstjoint != NULL) {
+        return 0;
+    }
+
+    if (memfuncs) {
+        w->objmem.alloc_block = memfuncs->alloc_block;
+        w->objmem.free_block = memfuncs->free_block;
+    }
+    else {
+        w->objmem = dxObjectMemoryManager(NULL);
+    }
+
+    return 1;
+}
+
+int dWorldSetStepStatsEnabled(dWorldID w, int enabled)
+{
+    dUASSERT (w,"bad world argument");
+
+    if (enabled) {
+        if (w->stepstats == NULL) {
+            w->stepstats = new dxStepStats();
+            if (w->stepstats == NULL) {
+                return 0;
+            }
+        }
+    }
+    else {
+        delete w->stepstats;
+        w->stepstats = NULL;
+    }
+
+    return 1;
+}
+
+int dWorldGetStepStatsEnabled(dWorldID w)
+{
+    dUASSERT (w,"bad world argument");
+
+    return w->stepstats != NULL;
+}
+
+int dWorldGetStepStats(dWorldID w, dWorldStepStats *stats)
+{
+    dUASSERT (w,"bad world argument");
+    dUASSERT (stats && stats->struct_size >= sizeof(stats->struct_size), "Bad step statistics structure");
+
+    dxStepStats *stepstats = w->stepstats;
+    return stepstats != NULL && stepstats->GetLastStats(stats);
+}
+
 void dWorldSetStepThreadingImplementation(dWorldID w, 
                                           const dxThreadingFunctionsInfo *functions_info, dThreadingImplementationID threading_impl)
 {
@@ -1795,8 +1914,13 @@ int dWorldStep (dWorldID w, dReal stepsize)
     dUASSERT (w,"bad world argument");
     dUASSERT (stepsize > 0,"stepsize must be > 0");
 
+    w->contactp.ccd_step = stepsize;
+
     bool result = false;
 
+    dxStepStats *stepstats = w->stepstats;
+    if (stepstats != NULL) stepstats->BeginStep();
+
     dxWorldProcessIslandsInfo islandsinfo;
     if (dxReallocateWorldProcessContext (w, islandsinfo, stepsize, &dxEstimateStepMemoryRequirements))
     {
@@ -1806,6 +1930,34 @@ int dWorldStep (dWorldID w, dReal stepsize)
         }
     }
 
+    if (stepstats != NULL) stepstats->EndStep(result);
+
+    return result;
+}
+
+int dWorldSparseStep (dWorldID w, dReal stepsize)
+{
+    dUASSERT (w,"bad world argument");
+    dUASSERT (stepsize > 0,"stepsize must be > 0");
+
+    w->contactp.ccd_step = stepsize;
+
+    bool result = false;
+
+    dxStepStats *stepstats = w->stepstats;
+    if (stepstats != NULL) stepstats->BeginStep();
+
+    dxWorldProcessIslandsInfo islandsinfo;
+    if (dxReallocateWorldProcessContext (w, islandsinfo, stepsize, &dxEstimateSparseStepMemoryRequirements))
+    {
+        if (dxProcessIslands (w, islandsinfo, stepsize, &dxSparseStepper))
+        {
+            result = true;
+        }
+    }
+
+    if (stepstats != NULL) stepstats->EndStep(result);
+
     return result;
 }
 
@@ -1814,8 +1966,13 @@ int dWorldQuickStep (dWorldID w, dReal stepsize)
     dUASSERT (w,"bad world argument");
     dUASSERT (stepsize > 0,"stepsize must be > 0");
 
+    w->contactp.ccd_step = stepsize;
+
     bool result = false;
 
+    dxStepStats *stepstats = w->stepstats;
+    if (stepstats != NULL) stepstats->BeginStep();
+
     dxWorldProcessIslandsInfo islandsinfo;
     if (dxReallocateWorldProcessContext (w, islandsinfo, stepsize, &dxEstimateQuickStepMemoryRequirements))
     {
@@ -1825,6 +1982,8 @@ int dWorldQuickStep (dWorldID w, dReal stepsize)
         }
     }
 
+    if (stepstats != NULL) stepstats->EndStep(result);
+
     return result;
 }
 
@@ -1914,6 +2073,21 @@ void dWorldSetAutoDisableTime (dWorldID w, dReal time)
 }
 
 
+void dWorldSetAutoDisableMode (dWorldID w, int mode)
+{
+    dAASSERT(w);
+    dUASSERT(mode == dAutoDisableBodies || mode == dAutoDisableIslands, "invalid auto-disable mode");
+    w->adis_mode = mode;
+}
+
+
+int dWorldGetAutoDisableMode (dWorldID w)
+{
+    dAASSERT(w);
+    return w->adis_mode;
+}
+
+
 int dWorldGetAutoDisableFlag (dWorldID w)
 {
     dAASSERT(w);
@@ -2041,6 +2215,50 @@ dReal dWorldGetQuickStepW (dWorldID w)
 }
 
 
+void dWorldSetQuickStepSolver (dWorldID w, int solver)
+{
+    dAASSERT(w);
+    dUASSERT(solver == dQuickStepSOR || solver == dQuickStepBlockContacts || solver == dQuickStepPGSCG, "invalid QuickStep solver");
+    w->qs.solver = solver;
+}
+
+
+int dWorldGetQuickStepSolver (dWorldID w)
+{
+    dAASSERT(w);
+    return w->qs.solver;
+}
+
+
+void dWorldSetQuickStepRowOrder (dWorldID w, int order)
+{
+    dAASSERT(w);
+    dUASSERT(order == dQuickStepRowsShuffled || order == dQuickStepRowsByBody, "invalid QuickStep row order");
+    w->qs.row_order = order;
+}
+
+
+int dWorldGetQuickStepRowOrder (dWorldID w)
+{
+    dAASSERT(w);
+    return w->qs.row_order;
+}
+
+
+void dWorldSetQuickStepMixedPrecision (dWorldID w, int enabled)
+{
+    dAASSERT(w);
+    w->qs.mixed_precision = enabled != 0;
+}
+
+
+int dWorldGetQuickStepMixedPrecision (dWorldID w)
+{
+    dAASSERT(w);
+    return w->qs.mixed_precision;
+}
+
+
 void dWorldSetContactMaxCorrectingVel (dWorldID w, dReal vel)
 {
     dAASSERT(w);
@@ -2068,6 +2286,21 @@ dReal dWorldGetContactSurfaceLayer (dWorldID w)
     return w->contactp.min_depth;
 }
 
+
+void dWorldSetCCDStepSize (dWorldID w, dReal stepsize)
+{
+    dAASSERT(w);
+    dUASSERT (stepsize >= 0,"stepsize must be >= 0");
+    w->contactp.ccd_step = stepsize;
+}
+
+
+dReal dWorldGetCCDStepSize (dWorldID w)
+{
+    dAASSERT(w);
+    return w->contactp.ccd_step;
+}
+
 //****************************************************************************
 // testing
 
@@ -37,6 +37,7 @@ ODE initialization/finalization code
 #include "odetls.h"
 #include "odeou.h"
 #include "objects.h"
+#include "objectpool.h"
 #include "util.h"
 
 
@@ -88,6 +89,7 @@ static inline bool IsODEAnyModeInitialized()
 enum
 {
     TLD_INTERNAL_COLLISIONDATA_ALLOCATED = 0x00000001,
+    TLD_INTERNAL_OBJECTPOOLCACHE_ALLOCATED = 0x00000002,
 };
 
 static bool AllocateThreadBasicDataIfNecessary(EODEINITMODE imInitMode)
@@ -111,6 +113,23 @@ static bool AllocateThreadBasicDataIfNecessary(EODEINITMODE imInitMode)
             }
         }
 
+        if ((uDataAllocationFlags & TLD_INTERNAL_OBJECTPOOLCACHE_ALLOCATED) == 0)
+        {
+            dxObjectPoolThreadCache *pocPoolCache = dxObjectPool::allocThreadCache();
+            if (!pocPoolCache)
+            {
+                break;
+            }
+
+            if (!COdeTls::AssignObjectPoolCache(tkTlsKind, pocPoolCache))
+            {
+                dxObjectPool::freeThreadCache(pocPoolCache);
+                break;
+            }
+
+            COdeTls::SignalDataAllocationFlags(tkTlsKind, TLD_INTERNAL_OBJECTPOOLCACHE_ALLOCATED);
+        }
+
 #endif // #if dTLS_ENABLED
 
         bResult = true;
@@ -130,9 +149,9 @@ static void FreeThreadBasicDataOnFailureIfNecessary(EODEINITMODE imInitMode)
 
         const unsigned uDataAllocationFlags = COdeTls::GetDataAllocationFlags(tkTlsKind);
 
-        if (uDataAllocationFlags == 0)
+        if ((uDataAllocationFlags & ~TLD_INTERNAL_OBJECTPOOLCACHE_ALLOCATED) == 0)
         {
-            // So far, only free TLS slot, if no subsystems have data allocated
+            // So far, only free TLS slot, if no subsystems other than the basic ones have data allocated
             COdeTls::CleanupForThread();
         }
     }
@@ -371,7 +390,6 @@ static void CloseODEForMode(EODEINITMODE imInitMode)
 
     if (!bAnyModeStillInitialized)
     {
-        dClearPosrCache();
         dFinitUserClasses();
         dFinitColliders();
 
@@ -392,11 +410,15 @@ static void CloseODEForMode(EODEINITMODE imInitMode)
 
 #if dTLS_ENABLED
     EODETLSKIND tkTLSKindToFinalize = g_atkTLSKindsByInitMode[imInitMode];
+    // Return blocks cached by the closing thread so that the pools can be released
+    COdeTls::DestroyObjectPoolCache(tkTLSKindToFinalize);
     COdeTls::Finalize(tkTLSKindToFinalize);
 #endif
 
     if (!bAnyModeStillInitialized)
     {
+        dxObjectPool::releaseUnusedMemory();
+
 #if dATOMICS_ENABLED
         COdeOu::FinalizeAtomics();
 #endif
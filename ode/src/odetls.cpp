@@ -36,6 +36,7 @@ ODE Thread Local Storage access stub implementation.
 #include "odemath.h"
 #include "odetls.h"
 #include "collision_trimesh_internal.h"
+#include "objectpool.h"
 #include "util.h"
 
 
@@ -123,6 +124,28 @@ void COdeTls::DestroyTrimeshCollidersCache(EODETLSKIND tkTLSKind)
 }
 
 
+bool COdeTls::AssignObjectPoolCache(EODETLSKIND tkTLSKind, dxObjectPoolThreadCache *pocInstance)
+{
+    dIASSERT(!CThreadLocalStorage::GetStorageValue(m_ahtkStorageKeys[tkTLSKind], OTI_OBJECT_POOL_CACHE));
+
+    bool bResult = CThreadLocalStorage::SetStorageValue(m_ahtkStorageKeys[tkTLSKind], OTI_OBJECT_POOL_CACHE, (tlsvaluetype)pocInstance, &COdeTls::FreeObjectPoolCache_Callback);
+    return bResult;
+}
+
+void COdeTls::DestroyObjectPoolCache(EODETLSKIND tkTLSKind)
+{
+    dxObjectPoolThreadCache *pocCacheInstance = (dxObjectPoolThreadCache *)CThreadLocalStorage::GetStorageValue(m_ahtkStorageKeys[tkTLSKind], OTI_OBJECT_POOL_CACHE);
+
+    if (pocCacheInstance)
+    {
+        // Clear the slot first so that the blocks are not routed back into the cache being freed
+        CThreadLocalStorage::UnsafeSetStorageValue(m_ahtkStorageKeys[tkTLSKind], OTI_OBJECT_POOL_CACHE, (tlsvaluetype)NULL);
+
+        dxObjectPool::freeThreadCache(pocCacheInstance);
+    }
+}
+
+
 //////////////////////////////////////////////////////////////////////////
 // Value type destructors
 
@@ -141,6 +164,12 @@ void COdeTls::FreeTrimeshCollidersCache_Callback(tlsvaluetype vValueData)
     FreeTrimeshCollidersCache(pccCacheInstance);
 }
 
+void COdeTls::FreeObjectPoolCache_Callback(tlsvaluetype vValueData)
+{
+    dxObjectPoolThreadCache *pocCacheInstance = (dxObjectPoolThreadCache *)vValueData;
+    dxObjectPool::freeThreadCache(pocCacheInstance);
+}
+
 
 #endif // #if dTLS_ENABLED
 
@@ -43,6 +43,7 @@ ODE Thread Local Storage access stub interface.
 
 
 struct TrimeshCollidersCache;
+struct dxObjectPoolThreadCache;
 
 
 enum EODETLSKIND
@@ -61,6 +62,7 @@ enum EODETLSITEM
 {
     OTI_DATA_ALLOCATION_FLAGS,
     OTI_TRIMESH_TRIMESH_COLLIDER_CACHE,
+    OTI_OBJECT_POOL_CACHE,
 
     OTI__MAX,
 };
@@ -74,6 +76,8 @@ public:
 
     static void CleanupForThread();
 
+    static bool IsInitialized(EODETLSKIND tkTLSKind) { return m_ahtkStorageKeys[tkTLSKind] != 0; }
+
 public:
     static unsigned GetDataAllocationFlags(EODETLSKIND tkTLSKind)
     {
@@ -98,17 +102,27 @@ public:
         return (TrimeshCollidersCache *)CThreadLocalStorage::UnsafeGetStorageValue(m_ahtkStorageKeys[tkTLSKind], OTI_TRIMESH_TRIMESH_COLLIDER_CACHE);
     }
 
+    static dxObjectPoolThreadCache *GetObjectPoolCache(EODETLSKIND tkTLSKind)
+    {
+        // Must be a safe call as the pools are used by threads that have no TLS slot allocated
+        return (dxObjectPoolThreadCache *)CThreadLocalStorage::GetStorageValue(m_ahtkStorageKeys[tkTLSKind], OTI_OBJECT_POOL_CACHE);
+    }
+
 public:
     static bool AssignDataAllocationFlags(EODETLSKIND tkTLSKind, unsigned uInitializationFlags);
 
     static bool AssignTrimeshCollidersCache(EODETLSKIND tkTLSKind, TrimeshCollidersCache *pccInstance);
     static void DestroyTrimeshCollidersCache(EODETLSKIND tkTLSKind);
 
+    static bool AssignObjectPoolCache(EODETLSKIND tkTLSKind, dxObjectPoolThreadCache *pocInstance);
+    static void DestroyObjectPoolCache(EODETLSKIND tkTLSKind);
+
 private:
     static void FreeTrimeshCollidersCache(TrimeshCollidersCache *pccCacheInstance);
 
 private:
     static void _OU_CONVENTION_CALLBACK FreeTrimeshCollidersCache_Callback(tlsvaluetype vValueData);
+    static void _OU_CONVENTION_CALLBACK FreeObjectPoolCache_Callback(tlsvaluetype vValueData);
 
 private:
     static HTLSKEY				m_ahtkStorageKeys[OTK__MAX];
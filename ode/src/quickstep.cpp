@@ -22,7 +22,6 @@
 
 #include <ode/common.h>
 #include <ode/rotation.h>
-#include <ode/timer.h>
 #include <ode/error.h>
 #include <ode/matrix.h>
 #include <ode/misc.h>
@@ -30,8 +29,15 @@
 #include "odemath.h"
 #include "objects.h"
 #include "joints/joint.h"
+#include "jointbatch.h"
 #include "lcp.h"
 #include "util.h"
+#include "stepstats.h"
+
+#if defined(dDOUBLE) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#include <xmmintrin.h>
+#define dxQUICKSTEP_FLUSH_TO_ZERO 1
+#endif
 
 typedef const dReal *dRealPtr;
 typedef dReal *dRealMutablePtr;
@@ -63,6 +69,12 @@ typedef dReal *dRealMutablePtr;
 
 #define RANDOMLY_REORDER_CONSTRAINTS 1
 
+// for the SOR method:
+// the number of consecutive rows shuffled among themselves when the rows
+// are in body locality order (dQuickStepRowsByBody).
+
+#define LOCAL_REORDER_WINDOW 32
+
 //****************************************************************************
 // special matrix multipliers
 
@@ -100,15 +112,6 @@ static void Multiply1_12q1 (dReal *A, const dReal *B, const dReal *C, unsigned i
     A[5] = f;
 }
 
-//***************************************************************************
-// testing stuff
-
-#ifdef TIMING
-#define IFTIMING(x) x
-#else
-#define IFTIMING(x) ((void)0)
-#endif
-
 //***************************************************************************
 // various common computations involving the matrix J
 
@@ -136,7 +139,7 @@ static void compute_invM_JT (unsigned int m, dRealPtr J, dRealMutablePtr iMJ, in
 }
 
 // compute out = inv(M)*J'*in.
-#ifdef WARM_STARTING
+#if defined(WARM_STARTING) || defined(dDOUBLE)
 static void multiply_invM_JT (unsigned int m, unsigned int nb, dRealMutablePtr iMJ, int *jb,
                               dRealPtr in, dRealMutablePtr out)
 {
@@ -181,28 +184,26 @@ static void multiply_J (unsigned int m, dRealPtr J, int *jb,
 }
 
 
-// compute out = (J*inv(M)*J' + cfm)*in.
-// use z as an nb*6 temporary.
-#ifdef WARM_STARTING
-static void multiply_J_invM_JT (unsigned int m, unsigned int nb, dRealMutablePtr J, dRealMutablePtr iMJ, int *jb,
-                                dRealPtr cfm, dRealMutablePtr z, dRealMutablePtr in, dRealMutablePtr out)
-{
-    multiply_invM_JT (m,nb,iMJ,jb,in,z);
-    multiply_J (m,J,jb,z,out);
-
-    // add cfm
-    for (unsigned int i=0; i<m; i++) out[i] += cfm[i] * in[i];
-}
-#endif
-
 //***************************************************************************
-// conjugate gradient method with jacobi preconditioner
-// THIS IS EXPERIMENTAL CODE that doesn't work too well, so it is ifdefed out.
+// conjugate gradient refinement with jacobi preconditioner
+//
+// used by the dQuickStepPGSCG solver after the SOR sweeps. the bilateral
+// rows (those without limits) are taken as the free set, the rest keep the
+// lambda the sweeps left them. the free rows are then solved with CG on the
+// system (J*inv(M)*J' + cfm) restricted to them, which converges much faster
+// than the sweeps on long chains of mostly bilateral rows. the rows with
+// limits are not refined: a contact's rows, solved freely, can move far off
+// their limits along directions the other contacts make nearly redundant,
+// and clamping them back afterwards does not make up for that.
+//
+// J and b are expected as SOR_LCP leaves them: every row scaled by its
+// Ad[i] = w / (A[i][i] + cfm[i]), which is passed in as Ad. Adcfm is
+// Ad[i]*cfm[i]. since the preconditioner is the inverse of the diagonal,
+// applying it to a true residual gives the scaled one back (up to the
+// constant w, which does not change the CG iterates).
 //
 // adding CFM seems to be critically important to this method.
 
-#ifdef USE_CG_LCP
-
 static inline dReal dot (unsigned int n, dRealPtr x, dRealPtr y)
 {
     dReal sum=0;
@@ -210,98 +211,100 @@ static inline dReal dot (unsigned int n, dRealPtr x, dRealPtr y)
     return sum;
 }
 
-
-// x = y + z*alpha
-
-static inline void add (unsigned int n, dRealMutablePtr x, dRealPtr y, dRealPtr z, dReal alpha)
+// compute (J*inv(M)*J')[i]*x * Ad[i] given fx = inv(M)*J'*x
+static inline dReal ScaledRowProduct (unsigned int i, dRealPtr J, const int *jb, dRealPtr fx)
 {
-    for (unsigned int i=0; i<n; i++) x[i] = y[i] + z[i]*alpha;
+    dReal sum = 0;
+    dRealPtr J_ptr = J + (size_t)i*12;
+    dRealPtr fx_ptr = fx + 6*(size_t)(unsigned)jb[(size_t)i*2];
+    for (unsigned int j=0; j<6; j++) sum += J_ptr[j] * fx_ptr[j];
+    int b2 = jb[(size_t)i*2+1];
+    if (b2 != -1) {
+        fx_ptr = fx + 6*(size_t)(unsigned)b2;
+        for (unsigned int j=0; j<6; j++) sum += J_ptr[6+j] * fx_ptr[j];
+    }
+    return sum;
 }
 
-static void CG_LCP (dxWorldProcessMemArena *memarena,
-                    unsigned int m, unsigned int nb, dRealMutablePtr J, int *jb, dxBody * const *body,
-                    dRealPtr invI, dRealMutablePtr lambda, dRealMutablePtr fc, dRealMutablePtr b,
-                    dRealMutablePtr lo, dRealMutablePtr hi, dRealPtr cfm, int *findex,
-                    dxQuickStepParameters *qs)
+// fc += inv(M)*J'[i] * delta
+static inline void AddRowForce (unsigned int i, dRealPtr iMJ, const int *jb,
+                                dReal delta, dRealMutablePtr fc)
 {
-    const unsigned int num_iterations = qs->num_iterations;
-
-    // precompute iMJ = inv(M)*J'
-    dReal *iMJ = memarena->AllocateArray<dReal> ((size_t)m*12);
-    compute_invM_JT (m,J,iMJ,jb,body,invI);
-
-    dReal last_rho = 0;
-    dReal *r = memarena->AllocateArray<dReal> (m);
-    dReal *z = memarena->AllocateArray<dReal> (m);
-    dReal *p = memarena->AllocateArray<dReal> (m);
-    dReal *q = memarena->AllocateArray<dReal> (m);
-
-    // precompute 1 / diagonals of A
-    dReal *Ad = memarena->AllocateArray<dReal> (m);
-    dRealPtr iMJ_ptr = iMJ;
-    dRealPtr J_ptr = J;
-    for (unsigned int i=0; i<m; i++) {
-        dReal sum = 0;
-        for (unsigned int j=0; j<6; j++) sum += iMJ_ptr[j] * J_ptr[j];
-        if (jb[(size_t)i*2+1] != -1) {
-            for (unsigned int j=6; j<12; j++) sum += iMJ_ptr[j] * J_ptr[j];
-        }
-        iMJ_ptr += 12;
-        J_ptr += 12;
-        Ad[i] = REAL(1.0) / (sum + cfm[i]);
+    dRealPtr iMJ_ptr = iMJ + (size_t)i*12;
+    dRealMutablePtr fc_ptr = fc + 6*(size_t)(unsigned)jb[(size_t)i*2];
+    for (unsigned int j=0; j<6; j++) fc_ptr[j] += delta * iMJ_ptr[j];
+    int b2 = jb[(size_t)i*2+1];
+    if (b2 != -1) {
+        fc_ptr = fc + 6*(size_t)(unsigned)b2;
+        for (unsigned int j=0; j<6; j++) fc_ptr[j] += delta * iMJ_ptr[6+j];
     }
+}
 
-#ifdef WARM_STARTING
-    // compute residual r = b - A*lambda
-    multiply_J_invM_JT (m,nb,J,iMJ,jb,cfm,fc,lambda,r);
-    for (unsigned int k=0; k<m; k++) r[k] = b[k] - r[k];
-#else
-    dSetZero (lambda,m);
-    memcpy (r,b,(size_t)m*sizeof(dReal));		// residual r = b - A*lambda
-#endif
+// returns the number of CG iterations performed
+static unsigned int CG_RefineFreeRows (dxWorldProcessMemArena *memarena,
+                                       const unsigned int m, const unsigned int nb, dRealPtr J, dRealPtr iMJ, const int *jb,
+                                       dRealMutablePtr lambda, dRealMutablePtr fc, dRealPtr b,
+                                       dRealPtr lo, dRealPtr hi, dRealPtr Ad, dRealPtr Adcfm, const int *findex,
+                                       const unsigned int num_iterations)
+{
+    unsigned int iteration = 0;
 
-    for (unsigned int iteration=0; iteration < num_iterations; iteration++) {
-        for (unsigned int i=0; i<m; i++) z[i] = r[i]*Ad[i];	// z = inv(M)*r
-        dReal rho = dot (m,r,z);		// rho = r'*z
-
-        // @@@
-        // we must check for convergence, otherwise rho will go to 0 if
-        // we get an exact solution, which will introduce NaNs into the equations.
-        if (rho < 1e-10) {
-            printf ("CG returned at iteration %d\n",iteration);
-            break;
+    BEGIN_STATE_SAVE(memarena, cgstate) {
+        // pick the free rows
+        unsigned int *freerows = memarena->AllocateArray<unsigned int> (m);
+        unsigned int nfree = 0;
+        for (unsigned int i=0; i<m; i++) {
+            if (findex[i] == -1 && lo[i] == -dInfinity && hi[i] == dInfinity) freerows[nfree++] = i;
         }
 
-        if (iteration==0) {
-            memcpy (p,z,(size_t)m*sizeof(dReal));	// p = z
-        }
-        else {
-            add (m,p,z,p,rho/last_rho);	// p = z + (rho/last_rho)*p
-        }
+        if (nfree != 0) {
+            dReal *r = memarena->AllocateArray<dReal> (nfree);
+            dReal *z = memarena->AllocateArray<dReal> (nfree);
+            dReal *p = memarena->AllocateArray<dReal> (nfree);
+            dReal *q = memarena->AllocateArray<dReal> (nfree);
+            dReal *fp = memarena->AllocateArray<dReal> ((size_t)nb*6);
+
+            // r = b - A*lambda over the free rows, z = inv(diag(A))*r
+            for (unsigned int k=0; k<nfree; k++) {
+                unsigned int i = freerows[k];
+                z[k] = b[i] - lambda[i]*Adcfm[i] - ScaledRowProduct (i,J,jb,fc);
+                r[k] = z[k] / Ad[i];
+            }
+            memcpy (p,z,(size_t)nfree*sizeof(dReal));
+            dReal rho = dot (nfree,r,z);
+            const dReal rho_tolerance = rho * REAL(1e-12);
+
+            for (; iteration < num_iterations && rho > rho_tolerance; iteration++) {
+                // fp = inv(M)*J'*p, q = (J*inv(M)*J' + cfm)*p
+                dSetZero (fp,(size_t)nb*6);
+                for (unsigned int k=0; k<nfree; k++) AddRowForce (freerows[k],iMJ,jb,p[k],fp);
+                for (unsigned int k=0; k<nfree; k++) {
+                    unsigned int i = freerows[k];
+                    q[k] = (ScaledRowProduct (i,J,jb,fp) + p[k]*Adcfm[i]) / Ad[i];
+                }
 
-        // compute q = (J*inv(M)*J')*p
-        multiply_J_invM_JT (m,nb,J,iMJ,jb,cfm,fc,p,q);
+                dReal pq = dot (nfree,p,q);
+                if (!(pq > 0)) break;
+                dReal alpha = rho / pq;
 
-        dReal alpha = rho/dot (m,p,q);		// alpha = rho/(p'*q)
-        add (m,lambda,lambda,p,alpha);		// lambda = lambda + alpha*p
-        add (m,r,r,q,-alpha);			// r = r - alpha*q
-        last_rho = rho;
-    }
+                for (unsigned int k=0; k<nfree; k++) {
+                    lambda[freerows[k]] += alpha * p[k];
+                    r[k] -= alpha * q[k];
+                    z[k] = r[k] * Ad[freerows[k]];
+                }
+                for (size_t j=0; j<(size_t)nb*6; j++) fc[j] += alpha * fp[j];
 
-    // compute fc = inv(M)*J'*lambda
-    multiply_invM_JT (m,nb,iMJ,jb,lambda,fc);
+                dReal last_rho = rho;
+                rho = dot (nfree,r,z);
+                dReal beta = rho / last_rho;
+                for (unsigned int k=0; k<nfree; k++) p[k] = z[k] + beta * p[k];
+            }
+        }
+    } END_STATE_SAVE(memarena, cgstate);
 
-#if 0
-    // measure solution error
-    multiply_J_invM_JT (m,nb,J,iMJ,jb,cfm,fc,lambda,r);
-    dReal error = 0;
-    for (unsigned int i=0; i<m; i++) error += dFabs(r[i] - b[i]);
-    printf ("lambda error = %10.6e\n",error);
-#endif
+    return iteration;
 }
 
-#endif
-
 //***************************************************************************
 // SOR-LCP method
 
@@ -310,7 +313,8 @@ static void CG_LCP (dxWorldProcessMemArena *memarena,
 // jb is an array of first and second body numbers for each constraint row
 // invI is the global frame inverse inertia for each body (stacked 3x3 matrices)
 //
-// this returns lambda and fc (the constraint force).
+// this returns lambda and fc (the constraint force), and the number of
+// iterations performed.
 // note: fc is returned as inv(M)*J'*lambda, the constraint force is actually J'*lambda
 //
 // b, lo and hi are modified on exit
@@ -339,98 +343,269 @@ static int compare_index_error (const void *a, const void *b)
 
 #endif
 
-static void SOR_LCP (dxWorldProcessMemArena *memarena,
-                     const unsigned int m, const unsigned int nb, dRealMutablePtr J, int *jb, dxBody * const *body,
-                     dRealPtr invI, dRealMutablePtr lambda, dRealMutablePtr fc, dRealMutablePtr b,
-                     dRealPtr lo, dRealPtr hi, dRealPtr cfm, const int *findex,
-                     const dxQuickStepParameters *qs)
+// a contact normal row together with the friction rows bound to it by
+// findex. the dQuickStepBlockContacts solver relaxes the rows of a block
+// together with a direct 3x3 solve instead of one at a time.
+struct dxContactRowBlock {
+    unsigned int row;       // index of the normal row, the friction rows follow it
+    unsigned int size;      // 2 or 3 rows
+    dReal K[9];             // rows of (J*inv(M)*J' + cfm) for the block, 3x3 padded with identity
+    dReal Kinv[9];          // inverse of K
+    dReal rscale[3];        // 1/Ad of the rows, to undo the scaling of J and b
+};
+
+
+// find the contact blocks and precompute their matrices. rowblock receives,
+// for every row, the index of the block it heads, -2 for the friction rows
+// of a block and -1 for the rows that are relaxed on their own.
+// this must be done before J is scaled by Ad.
+static unsigned int BuildContactRowBlocks (dxContactRowBlock *blocks, int *rowblock,
+                                           const unsigned int m, dRealPtr J, dRealPtr iMJ, const int *jb,
+                                           dRealPtr Ad, dRealPtr lo, dRealPtr cfm, const int *findex)
 {
-#ifdef WARM_STARTING
-    {
-        // for warm starting, this seems to be necessary to prevent
-        // jerkiness in motor-driven joints. i have no idea why this works.
-        for (unsigned int i=0; i<m; i++) lambda[i] *= 0.9;
-    }
-#else
-    dSetZero (lambda,m);
-#endif
+    for (unsigned int i=0; i<m; i++) rowblock[i] = -1;
+
+    unsigned int nblocks = 0;
+    for (unsigned int i=0; i+1<m; i++) {
+        if (findex[i] != -1 || lo[i] != 0 || findex[i+1] != (int)i) continue;
+
+        unsigned int size = (i+2<m && findex[i+2] == (int)i) ? 3 : 2;
+        dIASSERT (jb[(size_t)(i+1)*2] == jb[(size_t)i*2] && jb[(size_t)(i+1)*2+1] == jb[(size_t)i*2+1]);
+
+        dxContactRowBlock *blk = blocks + nblocks;
+        blk->row = i;
+        blk->size = size;
+
+        const bool twobodies = jb[(size_t)i*2+1] != -1;
+        dReal *K = blk->K;
+        for (unsigned int k=0; k<3; k++) {
+            for (unsigned int l=0; l<3; l++) {
+                if (k >= size || l >= size) {
+                    K[k*3+l] = (k == l) ? REAL(1.0) : REAL(0.0);
+                    continue;
+                }
+                dRealPtr J_ptr = J + (size_t)(i+k)*12;
+                dRealPtr iMJ_ptr = iMJ + (size_t)(i+l)*12;
+                dReal sum = 0;
+                for (unsigned int j=0; j<6; j++) sum += J_ptr[j] * iMJ_ptr[j];
+                if (twobodies) {
+                    for (unsigned int j=6; j<12; j++) sum += J_ptr[j] * iMJ_ptr[j];
+                }
+                K[k*3+l] = (k == l) ? sum + cfm[i+k] : sum;
+            }
+        }
 
-    // precompute iMJ = inv(M)*J'
-    dReal *iMJ = memarena->AllocateArray<dReal> ((size_t)m*12);
-    compute_invM_JT (m,J,iMJ,jb,body,invI);
+        // the cofactor inverse. K is positive definite, so a determinant that
+        // is tiny next to the product of the diagonal means the rows are
+        // nearly dependent and are better off being relaxed one by one.
+        dReal *Kinv = blk->Kinv;
+        Kinv[0] = K[4]*K[8] - K[5]*K[7];
+        Kinv[1] = K[2]*K[7] - K[1]*K[8];
+        Kinv[2] = K[1]*K[5] - K[2]*K[4];
+        Kinv[3] = K[5]*K[6] - K[3]*K[8];
+        Kinv[4] = K[0]*K[8] - K[2]*K[6];
+        Kinv[5] = K[2]*K[3] - K[0]*K[5];
+        Kinv[6] = K[3]*K[7] - K[4]*K[6];
+        Kinv[7] = K[1]*K[6] - K[0]*K[7];
+        Kinv[8] = K[0]*K[4] - K[1]*K[3];
+        dReal det = K[0]*Kinv[0] + K[1]*Kinv[3] + K[2]*Kinv[6];
+        if (!(det > REAL(1e-6) * K[0] * K[4] * K[8])) continue;
+        dReal det_recip = dRecip(det);
+        for (unsigned int k=0; k<9; k++) Kinv[k] *= det_recip;
+
+        for (unsigned int k=0; k<size; k++) blk->rscale[k] = dRecip(Ad[i+k]);
+
+        rowblock[i] = (int)nblocks;
+        for (unsigned int k=1; k<size; k++) rowblock[i+k] = -2;
+        nblocks++;
+        i += size - 1;
+    }
 
-    // compute fc=(inv(M)*J')*lambda. we will incrementally maintain fc
-    // as we change lambda.
-#ifdef WARM_STARTING
-    multiply_invM_JT (m,nb,iMJ,jb,lambda,fc);
-#else
-    dSetZero (fc,(size_t)nb*6);
-#endif
+    return nblocks;
+}
 
-    dReal *Ad = memarena->AllocateArray<dReal> (m);
 
-    {
-        const dReal sor_w = qs->w;		// SOR over-relaxation parameter
-        // precompute 1 / diagonals of A
-        dRealPtr iMJ_ptr = iMJ;
-        dRealPtr J_ptr = J;
-        for (unsigned int i=0; i<m; J_ptr += 12, iMJ_ptr += 12, i++) {
-            dReal sum = 0;
-            for (unsigned int j=0; j<6; j++) sum += iMJ_ptr[j] * J_ptr[j];
-            if (jb[(size_t)i*2+1] != -1) {
-                for (unsigned int k=6; k<12; k++) sum += iMJ_ptr[k] * J_ptr[k];
-            }
-            Ad[i] = sor_w / (sum + cfm[i]);
+// relax the rows of a contact block together: solve the block for the
+// unconstrained update, and if that leaves the friction box, solve the
+// normal row again with the friction clamped, then clamp the friction to
+// the bounds of the new normal force. the update is not over-relaxed, the
+// projection does not stay stable with it.
+template<typename TReal>
+static void SolveContactRowBlock (const dxContactRowBlock *blk,
+                                  const TReal *J, const TReal *iMJ, TReal *lambda,
+                                  TReal *fc_ptr1, TReal *fc_ptr2,
+                                  const TReal *b, const TReal *hi, const TReal *Ad)
+{
+    const unsigned int row = blk->row, size = blk->size;
+
+    // the blocks have 1 to 3 rows, the unused entries stay zero
+    dReal r[3] = { 0, 0, 0 }, old_lambda[3] = { 0, 0, 0 }, new_lambda[3] = { 0, 0, 0 };
+    for (unsigned int k=0; k<size; k++) {
+        const unsigned int index = row + k;
+        old_lambda[k] = lambda[index];
+
+        dReal delta = b[index] - old_lambda[k]*Ad[index];
+        const TReal *J_ptr = J + (size_t)index*12;
+        delta -=fc_ptr1[0] * J_ptr[0] + fc_ptr1[1] * J_ptr[1] +
+            fc_ptr1[2] * J_ptr[2] + fc_ptr1[3] * J_ptr[3] +
+            fc_ptr1[4] * J_ptr[4] + fc_ptr1[5] * J_ptr[5];
+        if (fc_ptr2) {
+            delta -=fc_ptr2[0] * J_ptr[6] + fc_ptr2[1] * J_ptr[7] +
+                fc_ptr2[2] * J_ptr[8] + fc_ptr2[3] * J_ptr[9] +
+                fc_ptr2[4] * J_ptr[10] + fc_ptr2[5] * J_ptr[11];
         }
+        r[k] = delta * blk->rscale[k];
     }
 
-    {
-        // NOTE: This may seem unnecessary but it's indeed an optimization 
-        // to move multiplication by Ad[i] and cfm[i] out of iteration loop.
+    const dReal *Kinv = blk->Kinv;
+    for (unsigned int k=0; k<size; k++) {
+        new_lambda[k] = old_lambda[k] + Kinv[k*3]*r[0] + Kinv[k*3+1]*r[1] + Kinv[k*3+2]*r[2];
+    }
 
-        // scale J and b by Ad
-        dRealMutablePtr J_ptr = J;
-        for (unsigned int i=0; i<m; J_ptr += 12, i++) {
-            dReal Ad_i = Ad[i];
-            for (unsigned int j=0; j<12; j++) {
-                J_ptr[j] *= Ad_i;
-            }
-            b[i] *= Ad_i;
-            // scale Ad by CFM. N.B. this should be done last since it is used above
-            Ad[i] = Ad_i * cfm[i];
-        }
+    bool inside = new_lambda[0] >= 0;
+    for (unsigned int k=1; inside && k<size; k++) {
+        inside = dFabs(new_lambda[k]) <= dFabs(hi[row+k] * new_lambda[0]);
     }
 
+    if (!inside) {
+        const dReal *K = blk->K;
+        dReal free_lambda[3] = { 0, 0, 0 };
+        dReal normal = new_lambda[0] > 0 ? new_lambda[0] : REAL(0.0);
+        dReal rn = r[0];
+        for (unsigned int k=1; k<size; k++) {
+            free_lambda[k] = new_lambda[k];
+            const dReal bound = dFabs(hi[row+k] * normal);
+            const dReal friction = free_lambda[k] < -bound ? -bound : (free_lambda[k] > bound ? bound : free_lambda[k]);
+            rn -= K[k] * (friction - old_lambda[k]);
+        }
 
-    // order to solve constraint rows in
-    IndexError *order = memarena->AllocateArray<IndexError> (m);
+        normal = old_lambda[0] + rn / K[0];
+        new_lambda[0] = normal > 0 ? normal : REAL(0.0);
+        for (unsigned int k=1; k<size; k++) {
+            const dReal bound = dFabs(hi[row+k] * new_lambda[0]);
+            new_lambda[k] = free_lambda[k] < -bound ? -bound : (free_lambda[k] > bound ? bound : free_lambda[k]);
+        }
+    }
 
-#ifndef REORDER_CONSTRAINTS
-    {
-        // make sure constraints with findex < 0 come first.
-        IndexError *orderhead = order, *ordertail = order + (m - 1);
+    for (unsigned int k=0; k<size; k++) {
+        const unsigned int index = row + k;
+        const TReal delta = (TReal)(new_lambda[k] - old_lambda[k]);
+        lambda[index] = (TReal)new_lambda[k];
+
+        const TReal *iMJ_ptr = iMJ + (size_t)index*12;
+        fc_ptr1[0] += delta * iMJ_ptr[0];
+        fc_ptr1[1] += delta * iMJ_ptr[1];
+        fc_ptr1[2] += delta * iMJ_ptr[2];
+        fc_ptr1[3] += delta * iMJ_ptr[3];
+        fc_ptr1[4] += delta * iMJ_ptr[4];
+        fc_ptr1[5] += delta * iMJ_ptr[5];
+        if (fc_ptr2) {
+            fc_ptr2[0] += delta * iMJ_ptr[6];
+            fc_ptr2[1] += delta * iMJ_ptr[7];
+            fc_ptr2[2] += delta * iMJ_ptr[8];
+            fc_ptr2[3] += delta * iMJ_ptr[9];
+            fc_ptr2[4] += delta * iMJ_ptr[10];
+            fc_ptr2[5] += delta * iMJ_ptr[11];
+        }
+    }
+}
 
-        // Fill the array from both ends
+// Fills roworder with the rows in body locality order: the bodies are
+// visited breadth first over the graph the rows make, and each body emits
+// the rows acting on it that have not been emitted yet. The rows of a joint
+// act on the same bodies, so they stay together and in their order.
+static void ComputeBodyLocalRowOrder (dxWorldProcessMemArena *memarena, unsigned int *roworder,
+                                      unsigned int m, unsigned int nb, const int *jb)
+{
+    BEGIN_STATE_SAVE(memarena, orderstate) {
+        // bucket the rows by the bodies they act on
+        unsigned int *bodyrowstart = memarena->AllocateArray<unsigned int> (nb + 1);
+        memset (bodyrowstart, 0, (size_t)(nb + 1) * sizeof(unsigned int));
         for (unsigned int i=0; i<m; i++) {
-            if (findex[i] == -1) {
-                orderhead->index = i; // Place them at the front
-                ++orderhead;
-            } else {
-                ordertail->index = i; // Place them at the end
-                --ordertail;
+            int b1 = jb[(size_t)i*2];
+            int b2 = jb[(size_t)i*2+1];
+            bodyrowstart[b1 + 1]++;
+            if (b2 != -1) bodyrowstart[b2 + 1]++;
+        }
+        for (unsigned int k=0; k<nb; k++) bodyrowstart[k + 1] += bodyrowstart[k];
+
+        unsigned int *bodyrows = memarena->AllocateArray<unsigned int> (bodyrowstart[nb]);
+        unsigned int *bodyrowend = memarena->AllocateArray<unsigned int> (nb);
+        memcpy (bodyrowend, bodyrowstart, (size_t)nb * sizeof(unsigned int));
+        for (unsigned int i=0; i<m; i++) {
+            int b1 = jb[(size_t)i*2];
+            int b2 = jb[(size_t)i*2+1];
+            bodyrows[bodyrowend[b1]++] = i;
+            if (b2 != -1) bodyrows[bodyrowend[b2]++] = i;
+        }
+
+        unsigned int *queue = memarena->AllocateArray<unsigned int> (nb);
+        bool *bodyseen = memarena->AllocateArray<bool> (nb);
+        memset (bodyseen, 0, (size_t)nb * sizeof(bool));
+        bool *rowdone = memarena->AllocateArray<bool> (m);
+        memset (rowdone, 0, (size_t)m * sizeof(bool));
+
+        unsigned int rowcount = 0;
+        for (unsigned int root=0; root<nb; root++) {
+            if (bodyseen[root]) continue;
+            bodyseen[root] = true;
+
+            unsigned int queuehead = 0, queuetail = 0;
+            queue[queuetail++] = root;
+            while (queuehead != queuetail) {
+                unsigned int bi = queue[queuehead++];
+                for (unsigned int k=bodyrowstart[bi]; k<bodyrowstart[bi + 1]; k++) {
+                    unsigned int i = bodyrows[k];
+                    if (rowdone[i]) continue;
+                    rowdone[i] = true;
+                    roworder[rowcount++] = i;
+
+                    int b1 = jb[(size_t)i*2];
+                    int other = (b1 != (int)bi) ? b1 : jb[(size_t)i*2+1];
+                    if (other != -1 && !bodyseen[other]) {
+                        bodyseen[other] = true;
+                        queue[queuetail++] = (unsigned int)other;
+                    }
+                }
             }
         }
-        dIASSERT (orderhead-ordertail==1);
-    }
+        dIASSERT (rowcount == m);
+    } END_STATE_SAVE(memarena, orderstate);
+}
+
+// the SOR sweeps over the rows, in the given order, on J and b scaled by Ad
+// and with Ad scaled by cfm, as SOR_LCP sets them up. TReal is the type the
+// row arrays are held and iterated in, so that the sweeps can run in float
+// when dReal is double.
+#ifdef dDOUBLE
+
+// flushes float results that would be denormal to zero while in scope. the
+// small updates of rows near rest readily produce denormals, which slowed
+// the float sweeps down about threefold.
+struct dxFloatFlushToZeroScope
+{
+#ifdef dxQUICKSTEP_FLUSH_TO_ZERO
+    unsigned int m_savedcsr;
+    dxFloatFlushToZeroScope(): m_savedcsr(_mm_getcsr()) { _mm_setcsr(m_savedcsr | _MM_FLUSH_ZERO_ON); }
+    ~dxFloatFlushToZeroScope() { _mm_setcsr(m_savedcsr); }
 #endif
+};
+
+#endif // #ifdef dDOUBLE
 
+template<typename TReal>
+static void SOR_Iterate (dxWorldProcessMemArena *memarena,
+                         const unsigned int m, const unsigned int num_iterations, IndexError *order, bool localshuffle,
+                         const TReal *J, const TReal *iMJ, const int *jb, TReal *lambda, TReal *fc,
+                         const TReal *b, const TReal *lo, const TReal *hi, const TReal *Ad, const int *findex,
+                         const dxContactRowBlock *blocks, const int *rowblock)
+{
 #ifdef REORDER_CONSTRAINTS
     // the lambda computed at the previous iteration.
     // this is used to measure error for when we are reordering the indexes.
-    dReal *last_lambda = memarena->AllocateArray<dReal> (m);
+    TReal *last_lambda = memarena->AllocateArray<TReal> (m);
 #endif
 
-    const unsigned int num_iterations = qs->num_iterations;
     for (unsigned int iteration=0; iteration < num_iterations; iteration++) {
 
 #ifdef REORDER_CONSTRAINTS
@@ -468,30 +643,43 @@ static void SOR_LCP (dxWorldProcessMemArena *memarena,
         //@@@ potential optimization: swap lambda and last_lambda pointers rather
         //    than copying the data. we must make sure lambda is properly
         //    returned to the caller
-        memcpy (last_lambda,lambda,(size_t)m*sizeof(dReal));
+        memcpy (last_lambda,lambda,(size_t)m*sizeof(TReal));
 #endif
 #ifdef RANDOMLY_REORDER_CONSTRAINTS
         if ((iteration & 7) == 0) {
-            for (unsigned int i=1; i<m; i++) {
-                int swapi = dRandInt(i+1);
-                IndexError tmp = order[i];
-                order[i] = order[swapi];
-                order[swapi] = tmp;
+            if (localshuffle) {
+                // only shuffle the rows within windows, to keep the locality
+                for (unsigned int start=0; start<m; start+=LOCAL_REORDER_WINDOW) {
+                    IndexError *window = order + start;
+                    unsigned int size = (m - start < LOCAL_REORDER_WINDOW) ? m - start : LOCAL_REORDER_WINDOW;
+                    for (unsigned int i=1; i<size; i++) {
+                        int swapi = dRandInt(i+1);
+                        IndexError tmp = window[i];
+                        window[i] = window[swapi];
+                        window[swapi] = tmp;
+                    }
+                }
+            }
+            else {
+                for (unsigned int i=1; i<m; i++) {
+                    int swapi = dRandInt(i+1);
+                    IndexError tmp = order[i];
+                    order[i] = order[swapi];
+                    order[swapi] = tmp;
+                }
             }
         }
 #endif
 
         for (unsigned int i=0; i<m; i++) {
-            // @@@ potential optimization: we could pre-sort J and iMJ, thereby
-            //     linearizing access to those arrays. hmmm, this does not seem
-            //     like a win, but we should think carefully about our memory
-            //     access pattern.
+            // N.B. with dQuickStepRowsByBody J and iMJ are pre-sorted, which
+            //     linearizes the access to those arrays and to fc.
 
             unsigned int index = order[i].index;
 
-            dRealMutablePtr fc_ptr1;
-            dRealMutablePtr fc_ptr2;
-            dReal delta;
+            TReal *fc_ptr1;
+            TReal *fc_ptr2;
+            TReal delta;
 
             {
                 int b1 = jb[(size_t)index*2];
@@ -500,12 +688,22 @@ static void SOR_LCP (dxWorldProcessMemArena *memarena,
                 fc_ptr2 = (b2 != -1) ? fc + 6*(size_t)(unsigned)b2 : NULL;
             }
 
-            dReal old_lambda = lambda[index];
+            if (rowblock != NULL) {
+                // the friction rows of a block are relaxed along with its normal row
+                int blockindex = rowblock[index];
+                if (blockindex == -2) continue;
+                if (blockindex >= 0) {
+                    SolveContactRowBlock (blocks + blockindex,J,iMJ,lambda,fc_ptr1,fc_ptr2,b,hi,Ad);
+                    continue;
+                }
+            }
+
+            TReal old_lambda = lambda[index];
 
             {
                 delta = b[index] - old_lambda*Ad[index];
 
-                dRealPtr J_ptr = J + (size_t)index*12;
+                const TReal *J_ptr = J + (size_t)index*12;
                 // @@@ potential optimization: SIMD-ize this and the b2 >= 0 case
                 delta -=fc_ptr1[0] * J_ptr[0] + fc_ptr1[1] * J_ptr[1] +
                     fc_ptr1[2] * J_ptr[2] + fc_ptr1[3] * J_ptr[3] +
@@ -520,7 +718,7 @@ static void SOR_LCP (dxWorldProcessMemArena *memarena,
             }
 
             {
-                dReal hi_act, lo_act;
+                TReal hi_act, lo_act;
 
                 // set the limits for this constraint. 
                 // this is the place where the QuickStep method differs from the
@@ -540,7 +738,7 @@ static void SOR_LCP (dxWorldProcessMemArena *memarena,
                 // compute lambda and clamp it to [lo,hi].
                 // @@@ potential optimization: does SSE have clamping instructions
                 //     to save test+jump penalties here?
-                dReal new_lambda = old_lambda + delta;
+                TReal new_lambda = old_lambda + delta;
                 if (new_lambda < lo_act) {
                     delta = lo_act-old_lambda;
                     lambda[index] = lo_act;
@@ -559,7 +757,7 @@ static void SOR_LCP (dxWorldProcessMemArena *memarena,
             //delta *= ramp;
 
             {
-                dRealPtr iMJ_ptr = iMJ + (size_t)index*12;
+                const TReal *iMJ_ptr = iMJ + (size_t)index*12;
                 // update fc.
                 // @@@ potential optimization: SIMD for this and the b2 >= 0 case
                 fc_ptr1[0] += delta * iMJ_ptr[0];
@@ -583,17 +781,264 @@ static void SOR_LCP (dxWorldProcessMemArena *memarena,
     }
 }
 
-struct dJointWithInfo1
+static unsigned int SOR_LCP (dxWorldProcessMemArena *memarena,
+                             const unsigned int m, const unsigned int nb, dRealMutablePtr J, int *jb, dxBody * const *body,
+                             dRealPtr invI, dRealMutablePtr lambda, dRealMutablePtr fc, dRealMutablePtr b,
+                             dRealPtr lo, dRealPtr hi, dRealPtr cfm, const int *findex,
+                             const dxQuickStepParameters *qs)
+{
+#ifdef WARM_STARTING
+    {
+        // for warm starting, this seems to be necessary to prevent
+        // jerkiness in motor-driven joints. i have no idea why this works.
+        for (unsigned int i=0; i<m; i++) lambda[i] *= 0.9;
+    }
+#else
+    dSetZero (lambda,m);
+#endif
+
+    // with the rows in body locality order, the sweeps below run through the
+    // row arrays nearly in order rather than jump around them. the rows are
+    // permuted into copies here, and lambda is put back in order at the end
+    unsigned int *roworder = NULL;
+    dRealMutablePtr lambda_out = lambda;
+    if (qs->row_order == dQuickStepRowsByBody) {
+        roworder = memarena->AllocateArray<unsigned int> (m);
+        ComputeBodyLocalRowOrder (memarena,roworder,m,nb,jb);
+
+        unsigned int *rowpos = memarena->AllocateArray<unsigned int> (m);
+        for (unsigned int k=0; k<m; k++) rowpos[roworder[k]] = k;
+
+        dReal *J_local = memarena->AllocateArray<dReal> ((size_t)m*12);
+        int *jb_local = memarena->AllocateArray<int> ((size_t)m*2);
+        dReal *lambda_local = memarena->AllocateArray<dReal> (m);
+        dReal *b_local = memarena->AllocateArray<dReal> (m);
+        dReal *lo_local = memarena->AllocateArray<dReal> (m);
+        dReal *hi_local = memarena->AllocateArray<dReal> (m);
+        dReal *cfm_local = memarena->AllocateArray<dReal> (m);
+        int *findex_local = memarena->AllocateArray<int> (m);
+        for (unsigned int k=0; k<m; k++) {
+            unsigned int i = roworder[k];
+            memcpy (J_local + (size_t)k*12, J + (size_t)i*12, 12 * sizeof(dReal));
+            jb_local[(size_t)k*2] = jb[(size_t)i*2];
+            jb_local[(size_t)k*2+1] = jb[(size_t)i*2+1];
+            lambda_local[k] = lambda[i];
+            b_local[k] = b[i];
+            lo_local[k] = lo[i];
+            hi_local[k] = hi[i];
+            cfm_local[k] = cfm[i];
+            findex_local[k] = (findex[i] != -1) ? (int)rowpos[findex[i]] : -1;
+        }
+        J = J_local; jb = jb_local; lambda = lambda_local; b = b_local;
+        lo = lo_local; hi = hi_local; cfm = cfm_local; findex = findex_local;
+    }
+
+    // precompute iMJ = inv(M)*J'
+    dReal *iMJ = memarena->AllocateArray<dReal> ((size_t)m*12);
+    compute_invM_JT (m,J,iMJ,jb,body,invI);
+
+    // compute fc=(inv(M)*J')*lambda. we will incrementally maintain fc
+    // as we change lambda.
+#ifdef WARM_STARTING
+    multiply_invM_JT (m,nb,iMJ,jb,lambda,fc);
+#else
+    dSetZero (fc,(size_t)nb*6);
+#endif
+
+    dReal *Ad = memarena->AllocateArray<dReal> (m);
+
+    {
+        const dReal sor_w = qs->w;		// SOR over-relaxation parameter
+        // precompute 1 / diagonals of A
+        dRealPtr iMJ_ptr = iMJ;
+        dRealPtr J_ptr = J;
+        for (unsigned int i=0; i<m; J_ptr += 12, iMJ_ptr += 12, i++) {
+            dReal sum = 0;
+            for (unsigned int j=0; j<6; j++) sum += iMJ_ptr[j] * J_ptr[j];
+            if (jb[(size_t)i*2+1] != -1) {
+                for (unsigned int k=6; k<12; k++) sum += iMJ_ptr[k] * J_ptr[k];
+            }
+            Ad[i] = sor_w / (sum + cfm[i]);
+        }
+    }
+
+    // the contact blocks, if the solver relaxes them as a whole
+    dxContactRowBlock *blocks = NULL;
+    int *rowblock = NULL;
+    if (qs->solver == dQuickStepBlockContacts) {
+        blocks = memarena->AllocateArray<dxContactRowBlock> (m/2);
+        rowblock = memarena->AllocateArray<int> (m);
+        unsigned int nblocks = BuildContactRowBlocks (blocks,rowblock,m,J,iMJ,jb,Ad,lo,cfm,findex);
+        if (nblocks == 0) rowblock = NULL;
+    }
+
+    // the row scales, if the CG refinement is to follow. the sweeps get the
+    // first half of the iterations and CG the rest
+    dReal *Adrow = NULL;
+    unsigned int num_iterations = qs->num_iterations, num_cg_iterations = 0;
+    if (qs->solver == dQuickStepPGSCG) {
+        Adrow = memarena->AllocateArray<dReal> (m);
+        num_cg_iterations = num_iterations / 2;
+        num_iterations -= num_cg_iterations;
+    }
+
+    {
+        // NOTE: This may seem unnecessary but it's indeed an optimization 
+        // to move multiplication by Ad[i] and cfm[i] out of iteration loop.
+
+        // scale J and b by Ad
+        dRealMutablePtr J_ptr = J;
+        for (unsigned int i=0; i<m; J_ptr += 12, i++) {
+            dReal Ad_i = Ad[i];
+            if (Adrow != NULL) Adrow[i] = Ad_i;
+            for (unsigned int j=0; j<12; j++) {
+                J_ptr[j] *= Ad_i;
+            }
+            b[i] *= Ad_i;
+            // scale Ad by CFM. N.B. this should be done last since it is used above
+            Ad[i] = Ad_i * cfm[i];
+        }
+    }
+
+
+    // order to solve constraint rows in
+    IndexError *order = memarena->AllocateArray<IndexError> (m);
+
+#ifndef REORDER_CONSTRAINTS
+    if (roworder != NULL) {
+        // keep the body locality order. the rows of a joint are in their
+        // order, so contact normals still come before their friction rows
+        for (unsigned int i=0; i<m; i++) order[i].index = i;
+    }
+    else {
+        // make sure constraints with findex < 0 come first.
+        IndexError *orderhead = order, *ordertail = order + (m - 1);
+
+        // Fill the array from both ends
+        for (unsigned int i=0; i<m; i++) {
+            if (findex[i] == -1) {
+                orderhead->index = i; // Place them at the front
+                ++orderhead;
+            } else {
+                ordertail->index = i; // Place them at the end
+                --ordertail;
+            }
+        }
+        dIASSERT (orderhead-ordertail==1);
+    }
+#endif
+
+#ifdef dDOUBLE
+    if (qs->mixed_precision) {
+        // sweep over float copies of the row arrays. the constraint forces are
+        // then computed again in double from the resulting lambda
+        float *J_float = memarena->AllocateArray<float> ((size_t)m*12);
+        float *iMJ_float = memarena->AllocateArray<float> ((size_t)m*12);
+        for (size_t k=0; k<(size_t)m*12; k++) {
+            J_float[k] = (float)J[k];
+            iMJ_float[k] = (float)iMJ[k];
+        }
+        float *lambda_float = memarena->AllocateArray<float> (m);
+        float *b_float = memarena->AllocateArray<float> (m);
+        float *lo_float = memarena->AllocateArray<float> (m);
+        float *hi_float = memarena->AllocateArray<float> (m);
+        float *Ad_float = memarena->AllocateArray<float> (m);
+        for (unsigned int i=0; i<m; i++) {
+            lambda_float[i] = (float)lambda[i];
+            b_float[i] = (float)b[i];
+            lo_float[i] = (float)lo[i];
+            hi_float[i] = (float)hi[i];
+            Ad_float[i] = (float)Ad[i];
+        }
+        float *fc_float = memarena->AllocateArray<float> ((size_t)nb*6);
+        for (size_t k=0; k<(size_t)nb*6; k++) fc_float[k] = (float)fc[k];
+
+        {
+            dxFloatFlushToZeroScope flushtozero;
+            SOR_Iterate (memarena,m,num_iterations,order,roworder != NULL,J_float,iMJ_float,jb,lambda_float,fc_float,
+                b_float,lo_float,hi_float,Ad_float,findex,blocks,rowblock);
+        }
+
+        for (unsigned int i=0; i<m; i++) lambda[i] = lambda_float[i];
+        multiply_invM_JT (m,nb,iMJ,jb,lambda,fc);
+    }
+    else
+#endif
+    {
+        SOR_Iterate (memarena,m,num_iterations,order,roworder != NULL,J,iMJ,jb,lambda,fc,
+            b,lo,hi,Ad,findex,blocks,rowblock);
+    }
+
+    if (num_cg_iterations != 0) {
+        num_iterations += CG_RefineFreeRows (memarena,m,nb,J,iMJ,jb,lambda,fc,b,lo,hi,Adrow,Ad,findex,num_cg_iterations);
+    }
+
+    if (roworder != NULL) {
+        for (unsigned int k=0; k<m; k++) lambda_out[roworder[k]] = lambda[k];
+    }
+
+    return num_iterations;
+}
+
+// Row layout for FillJointInfo2ByType(): 12 element rows of J holding both
+// bodies' blocks side by side, plus saving of the rows of joints that have
+// feedback requested.
+struct dxQuickStepJacobianLayout
 {
-    dxJoint *joint;
-    dxJoint::Info1 info;
+    dxJoint::Info2 Jinfo;
+    dReal *J, *c, *cfm, *lo, *hi;
+    int *findex;
+    dReal *Jcopyrow;
+    unsigned int ofsi;
+
+    dxJoint::Info2 *begin(const dJointWithInfo1 *)
+    {
+        dReal *const Jrow = J + (size_t)ofsi * 12;
+        Jinfo.J1l = Jrow;
+        Jinfo.J1a = Jrow + 3;
+        Jinfo.J2l = Jrow + 6;
+        Jinfo.J2a = Jrow + 9;
+        Jinfo.c = c + ofsi;
+        Jinfo.cfm = cfm + ofsi;
+        Jinfo.lo = lo + ofsi;
+        Jinfo.hi = hi + ofsi;
+        Jinfo.findex = findex + ofsi;
+        return &Jinfo;
+    }
+
+    void end(const dJointWithInfo1 *jicurr)
+    {
+        const unsigned int infom = jicurr->info.m;
+
+        // we need a copy of Jacobian for joint feedbacks
+        // because it gets destroyed by SOR solver
+        // instead of saving all Jacobian, we can save just rows
+        // for joints, that requested feedback (which is normally much less)
+        if (jicurr->joint->feedback) {
+            const size_t rowels = (size_t)infom * 12;
+            memcpy(Jcopyrow, J + (size_t)ofsi * 12, (size_t)rowels * sizeof(dReal));
+            Jcopyrow += rowels;
+        }
+
+        // adjust returned findex values for global index numbering
+        int *findex_ofsi = findex + ofsi;
+        for (unsigned int j=0; j<infom; j++) {
+            int fival = findex_ofsi[j];
+            if (fival != -1) 
+                findex_ofsi[j] = fival + ofsi;
+        }
+
+        ofsi += infom;
+    }
 };
 
 void dxQuickStepper (dxWorldProcessMemArena *memarena, 
                      dxWorld *world, dxBody * const *body, unsigned int nb,
-                     dxJoint * const *_joint, unsigned int _nj, dReal stepsize)
+                     dxJoint * const *_joint, unsigned int _nj, dReal stepsize,
+                     dxStepStatsThreadSlot *statsslot)
 {
-    IFTIMING(dTimerStart("preprocessing"));
+    dxStepPhaseTimer phasetimer(statsslot);
+    phasetimer.Switch(dStepPhaseAssembly);
 
     const dReal stepsize1 = dRecip(stepsize);
 
@@ -667,7 +1112,7 @@ void dxQuickStepper (dxWorldProcessMemArena *memarena,
     // get joint information (m = total constraint dimension, nub = number of unbounded variables).
     // joints with m=0 are inactive and are removed from the joints array
     // entirely, so that the code that follows does not consider them.
-    dJointWithInfo1 *const jointiinfos = memarena->AllocateArray<dJointWithInfo1> (_nj);
+    dJointWithInfo1 *jointiinfos = memarena->AllocateArray<dJointWithInfo1> (_nj);
     size_t nj;
 
     {
@@ -687,6 +1132,9 @@ void dxQuickStepper (dxWorldProcessMemArena *memarena,
 
     memarena->ShrinkArray<dJointWithInfo1>(jointiinfos, _nj, nj);
 
+    // group the joints by type so that their rows can be fetched in batches
+    jointiinfos = SortJointInfosByType(memarena, jointiinfos, nj, false);
+
     unsigned int m;
     unsigned int mfb; // number of rows of Jacobian we will have to save for joint feedback
 
@@ -705,6 +1153,8 @@ void dxQuickStepper (dxWorldProcessMemArena *memarena,
         mfb = mfbcurr;
     }
 
+    phasetimer.AccumulateRows(m);
+
     // if there are constraints, compute the constraint force
     dReal *J = NULL;
     int *jb = NULL;
@@ -747,7 +1197,6 @@ void dxQuickStepper (dxWorldProcessMemArena *memarena,
             dSetZero (c, m);
 
             {
-                IFTIMING (dTimerNow ("create J"));
                 // get jacobian data from constraints. an m*12 matrix will be created
                 // to store the two jacobian blocks from each constraint. it has this
                 // format:
@@ -761,52 +1210,21 @@ void dxQuickStepper (dxWorldProcessMemArena *memarena,
                 //   (lll) = linear jacobian data
                 //   (aaa) = angular jacobian data
                 //
-                dxJoint::Info2 Jinfo;
-                Jinfo.rowskip = 12;
-                Jinfo.fps = stepsize1;
-                Jinfo.erp = world->global_erp;
-
-                dReal *Jcopyrow = Jcopy;
-                unsigned ofsi = 0;
-                const dJointWithInfo1 *jicurr = jointiinfos;
-                const dJointWithInfo1 *const jiend = jicurr + nj;
-                for (; jicurr != jiend; jicurr++) {
-                    dReal *const Jrow = J + (size_t)ofsi * 12;
-                    Jinfo.J1l = Jrow;
-                    Jinfo.J1a = Jrow + 3;
-                    Jinfo.J2l = Jrow + 6;
-                    Jinfo.J2a = Jrow + 9;
-                    Jinfo.c = c + ofsi;
-                    Jinfo.cfm = cfm + ofsi;
-                    Jinfo.lo = lo + ofsi;
-                    Jinfo.hi = hi + ofsi;
-                    Jinfo.findex = findex + ofsi;
-
-                    dxJoint *joint = jicurr->joint;
-                    joint->getInfo2 (&Jinfo);
-
-                    const unsigned int infom = jicurr->info.m;
-
-                    // we need a copy of Jacobian for joint feedbacks
-                    // because it gets destroyed by SOR solver
-                    // instead of saving all Jacobian, we can save just rows
-                    // for joints, that requested feedback (which is normally much less)
-                    if (joint->feedback) {
-                        const size_t rowels = (size_t)infom * 12;
-                        memcpy(Jcopyrow, Jrow, (size_t)rowels * sizeof(dReal));
-                        Jcopyrow += rowels;
-                    }
-
-                    // adjust returned findex values for global index numbering
-                    int *findex_ofsi = findex + ofsi;
-                    for (unsigned int j=0; j<infom; j++) {
-                        int fival = findex_ofsi[j];
-                        if (fival != -1) 
-                            findex_ofsi[j] = fival + ofsi;
-                    }
-
-                    ofsi += infom;
-                }
+                dxQuickStepJacobianLayout layout;
+                layout.Jinfo.rowskip = 12;
+                layout.Jinfo.fps = stepsize1;
+                layout.Jinfo.erp = world->global_erp;
+                layout.J = J;
+                layout.c = c;
+                layout.cfm = cfm;
+                layout.lo = lo;
+                layout.hi = hi;
+                layout.findex = findex;
+                layout.Jcopyrow = Jcopy;
+                layout.ofsi = 0;
+
+                FillJointInfo2ByType(layout, jointiinfos, nj);
+                dIASSERT (layout.ofsi == m);
             }
 
             {
@@ -830,7 +1248,6 @@ void dxQuickStepper (dxWorldProcessMemArena *memarena,
             }
 
             BEGIN_STATE_SAVE(memarena, tmp1state) {
-                IFTIMING (dTimerNow ("compute rhs"));
                 // compute the right hand side `rhs'
                 dReal *tmp1 = memarena->AllocateArray<dReal> ((size_t)nb*6);
                 // put v/h + invM*fe into tmp1
@@ -877,9 +1294,10 @@ void dxQuickStepper (dxWorldProcessMemArena *memarena,
         dReal *cforce = memarena->AllocateArray<dReal> ((size_t)nb*6);
 
         BEGIN_STATE_SAVE(memarena, lcpstate) {
-            IFTIMING (dTimerNow ("solving LCP problem"));
+            phasetimer.Switch(dStepPhaseSolve);
             // solve the LCP problem and get lambda and invM*constraint_force
-            SOR_LCP (memarena,m,nb,J,jb,body,invI,lambda,cforce,rhs,lo,hi,cfm,findex,&world->qs);
+            unsigned int iterations = SOR_LCP (memarena,m,nb,J,jb,body,invI,lambda,cforce,rhs,lo,hi,cfm,findex,&world->qs);
+            phasetimer.AccumulateIterations(iterations);
 
         } END_STATE_SAVE(memarena, lcpstate);
 
@@ -958,7 +1376,7 @@ void dxQuickStepper (dxWorldProcessMemArena *memarena,
     }
 
     {
-        IFTIMING (dTimerNow ("compute velocity update"));
+        phasetimer.Switch(dStepPhaseIntegration);
         // compute the velocity update:
         // add stepsize * invM * fe to the body velocity
         const dReal *invIrow = invI;
@@ -1001,7 +1419,6 @@ void dxQuickStepper (dxWorldProcessMemArena *memarena,
     {
         // update the position and orientation from the new linear/angular velocity
         // (over the given timestep)
-        IFTIMING (dTimerNow ("update position"));
         dxBody *const *const bodyend = body + nb;
         for (dxBody *const *bodycurr = body; bodycurr != bodyend; bodycurr++) {
             dxBody *b = *bodycurr;
@@ -1010,7 +1427,6 @@ void dxQuickStepper (dxWorldProcessMemArena *memarena,
     }
 
     {
-        IFTIMING (dTimerNow ("tidy up"));
         // zero all force accumulators
         dxBody *const *const bodyend = body + nb;
         for (dxBody *const *bodycurr = body; bodycurr != bodyend; bodycurr++) {
@@ -1020,27 +1436,61 @@ void dxQuickStepper (dxWorldProcessMemArena *memarena,
         }
     }
 
-    IFTIMING (dTimerEnd());
-    IFTIMING (if (m > 0) dTimerReport (stdout,1));
+    phasetimer.Stop();
 }
 
-#ifdef USE_CG_LCP
-static size_t EstimateGR_LCPMemoryRequirements(unsigned int m)
+static size_t EstimateCG_RefineMemoryRequirements(unsigned int m, unsigned int nb)
 {
-    size_t res = dEFFICIENT_SIZE(sizeof(dReal) * 12 * (size_t)m); // for iMJ
-    res += 5 * dEFFICIENT_SIZE(sizeof(dReal) * (size_t)m); // for r, z, p, q, Ad
+    size_t res = dEFFICIENT_SIZE(sizeof(unsigned int) * (size_t)m); // for freerows
+    res += 4 * dEFFICIENT_SIZE(sizeof(dReal) * (size_t)m); // for r, z, p, q
+    res += dEFFICIENT_SIZE(sizeof(dReal) * 6 * (size_t)nb); // for fp
+    return res;
+}
+
+static size_t EstimateBodyLocalRowOrderMemoryRequirements(unsigned int m, unsigned int nb)
+{
+    size_t res = dEFFICIENT_SIZE(sizeof(unsigned int) * (size_t)(nb + 1)); // for bodyrowstart
+    res += dEFFICIENT_SIZE(sizeof(unsigned int) * 2 * (size_t)m); // for bodyrows
+    res += 2 * dEFFICIENT_SIZE(sizeof(unsigned int) * (size_t)nb); // for bodyrowend, queue
+    res += dEFFICIENT_SIZE(sizeof(bool) * (size_t)nb); // for bodyseen
+    res += dEFFICIENT_SIZE(sizeof(bool) * (size_t)m); // for rowdone
     return res;
 }
-#endif
 
-static size_t EstimateSOR_LCPMemoryRequirements(unsigned int m)
+static size_t EstimateSOR_LCPMemoryRequirements(unsigned int m, unsigned int nb, const dxQuickStepParameters *qs)
 {
-    size_t res = dEFFICIENT_SIZE(sizeof(dReal) * 12 * (size_t)m); // for iMJ
+    size_t res = 0;
+    if (qs->row_order == dQuickStepRowsByBody) {
+        res += 2 * dEFFICIENT_SIZE(sizeof(unsigned int) * (size_t)m); // for roworder, rowpos
+        res += dEFFICIENT_SIZE(sizeof(dReal) * 12 * (size_t)m); // for J_local
+        res += dEFFICIENT_SIZE(sizeof(int) * 2 * (size_t)m); // for jb_local
+        res += 5 * dEFFICIENT_SIZE(sizeof(dReal) * (size_t)m); // for lambda_local, b_local, lo_local, hi_local, cfm_local
+        res += dEFFICIENT_SIZE(sizeof(int) * (size_t)m); // for findex_local
+        res += EstimateBodyLocalRowOrderMemoryRequirements(m, nb); // for ComputeBodyLocalRowOrder
+    }
+    res += dEFFICIENT_SIZE(sizeof(dReal) * 12 * (size_t)m); // for iMJ
     res += dEFFICIENT_SIZE(sizeof(dReal) * (size_t)m); // for Ad
+    if (qs->solver == dQuickStepBlockContacts) {
+        res += dEFFICIENT_SIZE(sizeof(dxContactRowBlock) * (size_t)(m/2)); // for blocks
+        res += dEFFICIENT_SIZE(sizeof(int) * (size_t)m); // for rowblock
+    }
+    if (qs->solver == dQuickStepPGSCG) {
+        res += dEFFICIENT_SIZE(sizeof(dReal) * (size_t)m); // for Adrow
+    }
     res += dEFFICIENT_SIZE(sizeof(IndexError) * (size_t)m); // for order
+#ifdef dDOUBLE
+    if (qs->mixed_precision) {
+        res += 2 * dEFFICIENT_SIZE(sizeof(float) * 12 * (size_t)m); // for J_float, iMJ_float
+        res += 5 * dEFFICIENT_SIZE(sizeof(float) * (size_t)m); // for lambda_float, b_float, lo_float, hi_float, Ad_float
+        res += dEFFICIENT_SIZE(sizeof(float) * 6 * (size_t)nb); // for fc_float
+    }
+#endif
 #ifdef REORDER_CONSTRAINTS
     res += dEFFICIENT_SIZE(sizeof(dReal) * (size_t)m); // for last_lambda
 #endif
+    if (qs->solver == dQuickStepPGSCG) {
+        res += EstimateCG_RefineMemoryRequirements(m, nb); // for CG_RefineFreeRows
+    }
     return res;
 }
 
@@ -1077,6 +1527,7 @@ size_t dxEstimateQuickStepMemoryRequirements (
         size_t sub1_res1 = dEFFICIENT_SIZE(sizeof(dJointWithInfo1) * (size_t)_nj); // for initial jointiinfos
 
         size_t sub1_res2 = dEFFICIENT_SIZE(sizeof(dJointWithInfo1) * (size_t)nj); // for shrunk jointiinfos
+        sub1_res2 += dEFFICIENT_SIZE(sizeof(dJointWithInfo1) * (size_t)nj); // for type sorted jointiinfos
         if (m > 0) {
             sub1_res2 += dEFFICIENT_SIZE(sizeof(dReal) * 12 * (size_t)m); // for J
             sub1_res2 += dEFFICIENT_SIZE(sizeof(int) * 12 * (size_t)m); // for jb
@@ -1096,7 +1547,7 @@ size_t dxEstimateQuickStepMemoryRequirements (
                 size_t sub2_res2 = dEFFICIENT_SIZE(sizeof(dReal) * (size_t)m); // for lambda
                 sub2_res2 += dEFFICIENT_SIZE(sizeof(dReal) * 6 * (size_t)nb); // for cforce
                 {
-                    size_t sub3_res1 = EstimateSOR_LCPMemoryRequirements(m); // for SOR_LCP
+                    size_t sub3_res1 = EstimateSOR_LCPMemoryRequirements(m, nb, &body[0]->world->qs); // for SOR_LCP
 
                     size_t sub3_res2 = 0;
 #ifdef CHECK_VELOCITY_OBEYS_CONSTRAINT
@@ -26,6 +26,7 @@
 #include <ode/common.h>
 
 class dxWorldProcessMemArena;
+struct dxStepStatsThreadSlot;
 
 
 size_t dxEstimateQuickStepMemoryRequirements (
@@ -34,7 +35,7 @@ size_t dxEstimateQuickStepMemoryRequirements (
 void dxQuickStepper (
     dxWorldProcessMemArena *memarena, dxWorld *world, 
     dxBody * const *body, unsigned int nb, dxJoint * const *_joint, unsigned int _nj, 
-    dReal stepsize);
+    dReal stepsize, dxStepStatsThreadSlot *statsslot);
 
 
 #endif
@@ -0,0 +1,1048 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001,2002 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+
+/*
+
+Sparse variant of the "big matrix" stepper.
+
+The system solved is the same as in step.cpp: (J*invM*J' + cfm/h) * lambda =
+rhs, with LCP conditions on the bounded rows. The rows are split into two sets:
+
+  b: bilateral rows (unbounded, no findex) of the non-contact joints;
+  u: all the other rows -- contacts, limits, motors.
+
+A_bb is factorized as L*D*L' with L stored as a block sparse matrix, one
+block row/column per joint (the blocks are up to 6x6). The joints are
+eliminated in reverse of the order the island was discovered in, i.e. from
+the leaves of the island's spanning tree towards its root, which produces no
+fill-in at all for tree-like articulations; the loops only add fill along
+their paths. A_bb is never assembled as a whole: the blocks of each column are
+computed from the bodies the joints share right before they are needed
+(up-looking factorization after T. A. Davis, "Algorithm 849: A concise sparse
+Cholesky factorization package").
+
+The u rows are eliminated with the Schur complement
+    S = A_uu - A_ub * inv(A_bb) * A_bu,
+which is a dense n_u x n_u matrix solved with the regular Dantzig LCP
+solver. Finally lambda_b is recovered from the factorization.
+
+The accuracy is that of dWorldStep(), while the cost for an articulation
+with few unilateral rows is near linear in the number of rows.
+
+*/
+
+#include <ode/common.h>
+#include <ode/rotation.h>
+#include <ode/error.h>
+#include <ode/matrix.h>
+#include <ode/memory.h>
+#include "config.h"
+#include "odemath.h"
+#include "objects.h"
+#include "joints/joint.h"
+#include "lcp.h"
+#include "util.h"
+#include "stepstats.h"
+#include "sparsestep.h"
+
+
+// Jacobian rows are stored as 16 dReal-s: the 8 elements of the first body
+// block followed by the 8 elements of the second one. As in step.cpp, the
+// 4th and 8th elements of each block are zero.
+#define SPARSE_JROW_SIZE 16
+
+// The largest joint block is 6x6
+#define SPARSE_MAX_BLOCK 6
+
+
+//****************************************************************************
+// helpers
+
+static inline dReal Dot_p8 (const dReal *a, const dReal *b)
+{
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[4]*b[4] + a[5]*b[5] + a[6]*b[6];
+}
+
+// Returns the element of J*invM*J' produced by the two rows given (the first
+// row is passed premultiplied with invM). Only the bodies the rows share
+// contribute to the value.
+static inline dReal RowCoupling (const dReal *JinvMrow, const int *bodies1, const dReal *Jrow, const int *bodies2)
+{
+    dReal sum = 0;
+    for (unsigned int s = 0; s != 2; ++s) {
+        int b = bodies1[s];
+        if (b != -1) {
+            if (bodies2[0] == b) sum += Dot_p8 (JinvMrow + 8*s, Jrow);
+            else if (bodies2[1] == b) sum += Dot_p8 (JinvMrow + 8*s, Jrow + 8);
+        }
+    }
+    return sum;
+}
+
+// Adds J'*lambda of the row to the body force vector
+static inline void AddRowForce (dReal *bodyforce, const dReal *Jrow, const int *bodies, dReal lambda)
+{
+    for (unsigned int s = 0; s != 2; ++s) {
+        int b = bodies[s];
+        if (b != -1) {
+            dReal *f = bodyforce + 8*(size_t)(unsigned)b;
+            const dReal *J = Jrow + 8*s;
+            f[0] += J[0] * lambda; f[1] += J[1] * lambda; f[2] += J[2] * lambda;
+            f[4] += J[4] * lambda; f[5] += J[5] * lambda; f[6] += J[6] * lambda;
+        }
+    }
+}
+
+// Returns J*invM*f of the row (premultiplied with invM) for a body force vector
+static inline dReal RowTimesForce (const dReal *JinvMrow, const int *bodies, const dReal *bodyforce)
+{
+    dReal sum = 0;
+    for (unsigned int s = 0; s != 2; ++s) {
+        int b = bodies[s];
+        if (b != -1) {
+            sum += Dot_p8 (JinvMrow + 8*s, bodyforce + 8*(size_t)(unsigned)b);
+        }
+    }
+    return sum;
+}
+
+
+//****************************************************************************
+// factorization structure
+
+// Collects the joints that may contribute bilateral rows to the factorization
+// in the order they are going to be eliminated, and tags them with their
+// positions. All the other joints of the island are tagged with -1.
+// Contact joints never contribute (the normal row is always bounded and the
+// friction rows would be coupled with it) and are left entirely to the LCP.
+
+static unsigned int CollectFactorJoints (dxJoint * const *_joint, unsigned int _nj, dxJoint **fjoint)
+{
+    unsigned int nf = 0;
+    dxJoint::SureMaxInfo info;
+
+    // Island joints are listed in the order of discovery by BuildIslands(),
+    // so iterating backwards visits the leaves before the joints closer to
+    // the root.
+    for (dxJoint * const *_jcurr = _joint + _nj; _jcurr != _joint; ) {
+        dxJoint *j = *(--_jcurr);
+        j->tag = -1;
+
+        if (j->type() != dJointTypeContact) {
+            j->getSureMaxInfo (&info);
+            if (info.max_m > 0) {
+                j->tag = nf;
+                fjoint[nf] = j;
+                ++nf;
+            }
+        }
+    }
+
+    return nf;
+}
+
+// Computes the elimination tree of the block factor and the number of
+// off-diagonal blocks in each of its columns. Returns the number of dReal-s
+// these blocks occupy for the block sizes given.
+
+static size_t AnalyseFactor (dxJoint * const *fjoint, unsigned int nf, const unsigned int *fsize,
+                             int *parent, int *flag, unsigned int *colcount)
+{
+    size_t lsize = 0;
+
+    for (unsigned int k = 0; k != nf; ++k) {
+        parent[k] = -1;
+        flag[k] = (int)k;
+        colcount[k] = 0;
+
+        dxJoint *joint = fjoint[k];
+        for (unsigned int side = 0; side != 2; ++side) {
+            dxBody *b = joint->node[side].body;
+            if (b) {
+                for (dxJointNode *n = b->firstjoint; n; n = n->next) {
+                    int i = n->joint->tag;
+                    if (i != -1 && (unsigned)i < k) {
+                        // follow the path from i to the root of the elimination tree
+                        // and stop at the first node already in row k
+                        for (; flag[i] != (int)k; i = parent[i]) {
+                            if (parent[i] == -1) parent[i] = (int)k;
+                            colcount[i] += 1;
+                            lsize += (size_t)fsize[i] * fsize[k];
+                            flag[i] = (int)k;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return lsize;
+}
+
+static inline bool IsFactorJoint (dxJoint *j, dxJoint::SureMaxInfo *info)
+{
+    if (j->type() == dJointTypeContact) return false;
+    j->getSureMaxInfo (info);
+    return info->max_m > 0;
+}
+
+// Bounds the number and the total size of the off-diagonal blocks of the
+// factor from the island's counts alone, leaving the joint tags to the
+// caller. A_bb couples the joints that share a body, d*(d-1)/2 blocks for d
+// factorized joints on a body, and the elimination order adds no fill for
+// tree-like articulations. Every loop of the body graph may add fill along
+// its path, counted as one block per column. The dense factor caps it all.
+
+static void BoundFactorBlocks (dxBody * const *body, unsigned int nb, dxJoint * const *_joint, unsigned int _nj,
+                               size_t *lnzbound, size_t *lsizebound)
+{
+    dxJoint::SureMaxInfo info;
+    size_t nf = 0, nlinks = 0;
+
+    dxJoint *const *const _jend = _joint + _nj;
+    for (dxJoint *const *_jcurr = _joint; _jcurr != _jend; ++_jcurr) {
+        dxJoint *j = *_jcurr;
+        if (IsFactorJoint (j, &info)) {
+            ++nf;
+            if (j->node[0].body != NULL && j->node[1].body != NULL) ++nlinks;
+        }
+    }
+
+    size_t lnz = 0;
+    dxBody *const *const bodyend = body + nb;
+    for (dxBody *const *bodycurr = body; bodycurr != bodyend; ++bodycurr) {
+        size_t d = 0;
+        for (dxJointNode *n = (*bodycurr)->firstjoint; n; n = n->next) {
+            if (IsFactorJoint (n->joint, &info)) ++d;
+        }
+        lnz += d * (d - 1) / 2;
+    }
+
+    // a spanning tree of the bodies takes nb-1 of the links
+    if (nlinks + 1 > nb) lnz += (nlinks + 1 - nb) * nf;
+
+    const size_t dense = nf * (nf - 1) / 2;
+    if (lnz > dense) lnz = dense;
+
+    *lnzbound = lnz;
+    *lsizebound = lnz * SPARSE_MAX_BLOCK * SPARSE_MAX_BLOCK;
+}
+
+
+//****************************************************************************
+// block sparse L*D*L' factor of A_bb
+
+struct dxSparseFactor
+{
+    unsigned int nf;            // number of block columns (one per joint)
+    const unsigned int *size;   // block sizes
+    const unsigned int *rowofs; // offsets of the blocks in the bilateral row numbering
+    unsigned int *lstart;       // first off-diagonal block of each column
+    unsigned int *lcount;       // number of off-diagonal blocks of each column
+    unsigned int *lrow;         // block row of each off-diagonal block
+    size_t *lofs;               // offset of each off-diagonal block in lx
+    dReal *lx;                  // the off-diagonal blocks, size[row] x size[col] each
+    size_t *dofs;               // offsets of the diagonal blocks in dx
+    dReal *dx;                  // factorized diagonal blocks, size x dPAD(size) each
+    dReal *dinv;                // inverted diagonals of the diagonal blocks
+
+    void solve (dReal *x) const;
+};
+
+// Solves A_bb*x = b in place
+void dxSparseFactor::solve (dReal *x) const
+{
+    // L*z = b
+    for (unsigned int i = 0; i != nf; ++i) {
+        const unsigned int mi = size[i];
+        if (mi != 0) {
+            const dReal *xi = x + rowofs[i];
+            const unsigned int lend = lstart[i] + lcount[i];
+            for (unsigned int p = lstart[i]; p != lend; ++p) {
+                const unsigned int r = lrow[p];
+                const unsigned int mr = size[r];
+                const dReal *Lri = lx + lofs[p];
+                dReal *xr = x + rowofs[r];
+                for (unsigned int a = 0; a != mr; Lri += mi, ++a) {
+                    dReal sum = 0;
+                    for (unsigned int c = 0; c != mi; ++c) sum += Lri[c] * xi[c];
+                    xr[a] -= sum;
+                }
+            }
+        }
+    }
+
+    // D*y = z
+    for (unsigned int i = 0; i != nf; ++i) {
+        const unsigned int mi = size[i];
+        if (mi != 0) {
+            dReal *xi = x + rowofs[i];
+            dSolveLDLT (dx + dofs[i], dinv + rowofs[i], xi, mi, dPAD(mi));
+        }
+    }
+
+    // L'*x = y
+    for (unsigned int i = nf; i != 0; ) {
+        --i;
+        const unsigned int mi = size[i];
+        if (mi != 0) {
+            dReal *xi = x + rowofs[i];
+            const unsigned int lend = lstart[i] + lcount[i];
+            for (unsigned int p = lstart[i]; p != lend; ++p) {
+                const unsigned int r = lrow[p];
+                const unsigned int mr = size[r];
+                const dReal *Lri = lx + lofs[p];
+                const dReal *xr = x + rowofs[r];
+                for (unsigned int a = 0; a != mr; Lri += mi, ++a) {
+                    const dReal xra = xr[a];
+                    for (unsigned int c = 0; c != mi; ++c) xi[c] -= Lri[c] * xra;
+                }
+            }
+        }
+    }
+}
+
+
+//****************************************************************************
+// the stepper
+
+struct dxSparseJointInfo
+{
+    dxJoint *joint;
+    dxJoint::Info1 info;
+    unsigned int ofs;           // index of the first row of the joint
+};
+
+void dxSparseStepper (dxWorldProcessMemArena *memarena,
+                      dxWorld *world, dxBody * const *body, unsigned int nb,
+                      dxJoint * const *_joint, unsigned int _nj, dReal stepsize,
+                      dxStepStatsThreadSlot *statsslot)
+{
+    dxStepPhaseTimer phasetimer(statsslot);
+    phasetimer.Switch(dStepPhaseAssembly);
+
+    const dReal stepsizeRecip = dRecip(stepsize);
+
+    {
+        // number all bodies in the body list - set their tag values
+        for (unsigned int i=0; i<nb; ++i) body[i]->tag = i;
+    }
+
+    // for all bodies, compute the inertia tensor and its inverse in the global
+    // frame, and compute the rotational force and add it to the torque
+    // accumulator. invI are vertically stacked 3x4 matrices, one per body.
+
+    dReal *invI = memarena->AllocateArray<dReal> (3*4*(size_t)nb);
+
+    { // Identical to step.cpp
+        dReal *invIrow = invI;
+        dxBody *const *const bodyend = body + nb;
+        for (dxBody *const *bodycurr = body; bodycurr != bodyend; invIrow += 12, ++bodycurr) {
+            dMatrix3 tmp;
+            dxBody *b = *bodycurr;
+
+            // compute inverse inertia tensor in global frame
+            dMultiply2_333 (tmp,b->invI,b->posr.R);
+            dMultiply0_333 (invIrow,b->posr.R,tmp);
+
+            if (b->flags & dxBodyGyroscopic) {
+                dMatrix3 I;
+                // compute inertia tensor in global frame
+                dMultiply2_333 (tmp,b->mass.I,b->posr.R);
+                dMultiply0_333 (I,b->posr.R,tmp);
+                // compute rotational force
+                dMultiply0_331 (tmp,I,b->avel);
+                dSubtractVectorCross3 (b->tacc,b->avel,tmp);
+            }
+        }
+    }
+
+    {
+        // add the gravity force to all bodies
+        dxBody *const *const bodyend = body + nb;
+        for (unsigned int axis = 0; axis != 3; ++axis) {
+            dReal gravity = world->gravity[axis];
+            if (gravity) {
+                for (dxBody *const *bodycurr = body; bodycurr != bodyend; ++bodycurr) {
+                    dxBody *b = *bodycurr;
+                    if ((b->flags & dxBodyNoGravity)==0) {
+                        b->facc[axis] += b->mass.mass * gravity;
+                    }
+                }
+            }
+        }
+    }
+
+    // Collect the factorized joints in elimination order followed by all the
+    // other active joints. The factorized joints are kept even if they are
+    // inactive (m=0) so that their index matches their tag.
+
+    dxJoint **fjoint = memarena->AllocateArray<dxJoint *> (_nj);
+    const unsigned int nf = CollectFactorJoints (_joint, _nj, fjoint);
+
+    dxSparseJointInfo *jointinfos = memarena->AllocateArray<dxSparseJointInfo> (_nj);
+    unsigned int nj = 0, m = 0;
+
+    {
+        dxSparseJointInfo *jicurr = jointinfos;
+        for (unsigned int k = 0; k != nf; ++jicurr, ++k) {
+            dxJoint *j = fjoint[k];
+            j->getInfo1 (&jicurr->info);
+            dIASSERT (jicurr->info.m >= 0 && jicurr->info.m <= SPARSE_MAX_BLOCK && jicurr->info.nub >= 0 && jicurr->info.nub <= jicurr->info.m);
+            jicurr->joint = j;
+            jicurr->ofs = m;
+            m += jicurr->info.m;
+        }
+
+        dxJoint *const *const _jend = _joint + _nj;
+        for (dxJoint *const *_jcurr = _joint; _jcurr != _jend; ++_jcurr) {
+            dxJoint *j = *_jcurr;
+            if (j->tag == -1) {
+                j->getInfo1 (&jicurr->info);
+                dIASSERT (jicurr->info.m >= 0 && jicurr->info.m <= SPARSE_MAX_BLOCK && jicurr->info.nub >= 0 && jicurr->info.nub <= jicurr->info.m);
+                if (jicurr->info.m > 0) {
+                    jicurr->joint = j;
+                    jicurr->ofs = m;
+                    m += jicurr->info.m;
+                    ++jicurr;
+                }
+            }
+        }
+
+        nj = (unsigned int)(jicurr - jointinfos);
+    }
+
+    phasetimer.AccumulateRows(m);
+
+    // this will be set to the force due to the constraints
+    dReal *cforce = memarena->AllocateArray<dReal> ((size_t)nb*8);
+    dSetZero (cforce,(size_t)nb*8);
+
+    // if there are constraints, compute cforce
+    if (m > 0) {
+        dReal *J = memarena->AllocateArray<dReal> (SPARSE_JROW_SIZE*(size_t)m);
+        dSetZero (J,SPARSE_JROW_SIZE*(size_t)m);
+
+        dReal *rhs = memarena->AllocateArray<dReal> (m);
+        dSetZero (rhs,m);
+
+        dReal *cfm = memarena->AllocateArray<dReal> (m);
+        dSetValue (cfm,m,world->global_cfm);
+
+        dReal *lo = memarena->AllocateArray<dReal> (m);
+        dSetValue (lo,m,-dInfinity);
+
+        dReal *hi = memarena->AllocateArray<dReal> (m);
+        dSetValue (hi,m, dInfinity);
+
+        int *findex = memarena->AllocateArray<int> (m);
+        for (unsigned int i=0; i<m; ++i) findex[i] = -1;
+
+        // indices of the bodies of every row (-1 for none)
+        int *rowbody = memarena->AllocateArray<int> (2*(size_t)m);
+
+        {
+            // get the jacobian data from the constraints, one row after another
+            dxJoint::Info2 Jinfo;
+            Jinfo.rowskip = SPARSE_JROW_SIZE;
+            Jinfo.fps = stepsizeRecip;
+            Jinfo.erp = world->global_erp;
+
+            const dxSparseJointInfo *jicurr = jointinfos;
+            const dxSparseJointInfo *const jiend = jicurr + nj;
+            for (; jicurr != jiend; ++jicurr) {
+                const unsigned int infom = jicurr->info.m;
+                const unsigned int ofsi = jicurr->ofs;
+                if (infom == 0) continue;
+
+                dReal *const Jrow = J + SPARSE_JROW_SIZE*(size_t)ofsi;
+                Jinfo.J1l = Jrow;
+                Jinfo.J1a = Jrow + 4;
+                Jinfo.J2l = Jrow + 8;
+                Jinfo.J2a = Jrow + 12;
+                Jinfo.c = rhs + ofsi;
+                Jinfo.cfm = cfm + ofsi;
+                Jinfo.lo = lo + ofsi;
+                Jinfo.hi = hi + ofsi;
+                Jinfo.findex = findex + ofsi;
+
+                dxJoint *joint = jicurr->joint;
+                joint->getInfo2 (&Jinfo);
+
+                int b0 = joint->node[0].body ? joint->node[0].body->tag : -1;
+                int b1 = joint->node[1].body ? joint->node[1].body->tag : -1;
+
+                // adjust returned findex values for global index numbering
+                int *findex_ofsi = findex + ofsi;
+                int *rowbody_ofsi = rowbody + 2*(size_t)ofsi;
+                for (unsigned int j=0; j<infom; rowbody_ofsi += 2, ++j) {
+                    int fival = findex_ofsi[j];
+                    if (fival != -1)
+                        findex_ofsi[j] = fival + ofsi;
+                    rowbody_ofsi[0] = b0;
+                    rowbody_ofsi[1] = b1;
+                }
+            }
+        }
+
+        // compute JinvM = J*invM. this has the same format as J.
+        dReal *JinvM = memarena->AllocateArray<dReal> (SPARSE_JROW_SIZE*(size_t)m);
+
+        {
+            dReal *Jdst = JinvM;
+            const dReal *Jsrc = J;
+            const int *rowbodycurr = rowbody;
+            for (unsigned int i = 0; i != m; rowbodycurr += 2, ++i) {
+                for (unsigned int s = 0; s != 2; Jsrc += 8, Jdst += 8, ++s) {
+                    int b = rowbodycurr[s];
+                    if (b != -1) {
+                        dReal body_invMass = body[b]->invMass;
+                        for (unsigned int k=0; k<3; ++k) Jdst[k] = Jsrc[k] * body_invMass;
+                        Jdst[3] = 0;
+                        dMultiply0_133 (Jdst+4,Jsrc+4,invI + 12*(size_t)(unsigned)b);
+                        Jdst[7] = 0;
+                    } else {
+                        dSetZero (Jdst,8);
+                    }
+                }
+            }
+        }
+
+        BEGIN_STATE_SAVE(memarena, tmp1state) {
+            // compute the right hand side `rhs' = c/h - J*(v/h + invM*fe)
+            dReal *tmp1 = memarena->AllocateArray<dReal> ((size_t)nb*8);
+
+            {
+                // put v/h + invM*fe into tmp1
+                dReal *tmp1curr = tmp1;
+                const dReal *invIrow = invI;
+                dxBody *const *const bodyend = body + nb;
+                for (dxBody *const *bodycurr = body; bodycurr != bodyend; tmp1curr+=8, invIrow+=12, ++bodycurr) {
+                    dxBody *b = *bodycurr;
+                    for (unsigned int j=0; j<3; ++j) tmp1curr[j] = b->facc[j]*b->invMass + b->lvel[j]*stepsizeRecip;
+                    tmp1curr[3] = 0;
+                    dMultiply0_331 (tmp1curr+4, invIrow, b->tacc);
+                    for (unsigned int k=0; k<3; ++k) tmp1curr[4+k] += b->avel[k]*stepsizeRecip;
+                    tmp1curr[7] = 0;
+                }
+            }
+
+            const dReal *Jrow = J;
+            const int *rowbodycurr = rowbody;
+            for (unsigned int i = 0; i != m; Jrow += SPARSE_JROW_SIZE, rowbodycurr += 2, ++i) {
+                dReal sum = 0;
+                for (unsigned int s = 0; s != 2; ++s) {
+                    int b = rowbodycurr[s];
+                    if (b != -1) sum += Dot_p8 (Jrow + 8*s, tmp1 + 8*(size_t)(unsigned)b);
+                }
+                rhs[i] = rhs[i]*stepsizeRecip - sum;
+            }
+        } END_STATE_SAVE(memarena, tmp1state);
+
+        // split the rows into the bilateral (factorized) and the unilateral (LCP) sets
+
+        unsigned int *brow = memarena->AllocateArray<unsigned int> (m);
+        unsigned int *urow = memarena->AllocateArray<unsigned int> (m);
+        int *rowmap = memarena->AllocateArray<int> (m);
+        unsigned int *fsize = memarena->AllocateArray<unsigned int> (nf);
+        unsigned int *rowofs = memarena->AllocateArray<unsigned int> (nf);
+        unsigned int nbr = 0, nur = 0;
+
+        {
+            const dxSparseJointInfo *jicurr = jointinfos;
+            const dxSparseJointInfo *const jiend = jicurr + nj;
+            for (unsigned int k = 0; jicurr != jiend; ++jicurr, ++k) {
+                const unsigned int infom = jicurr->info.m;
+                const unsigned int ofsi = jicurr->ofs;
+
+                // rows of a joint using findex all go to the LCP together
+                bool factorize = k < nf;
+                for (unsigned int j = 0; factorize && j != infom; ++j) {
+                    if (findex[ofsi + j] != -1) factorize = false;
+                }
+
+                if (k < nf) rowofs[k] = nbr;
+
+                for (unsigned int j = 0; j != infom; ++j) {
+                    const unsigned int i = ofsi + j;
+                    if (factorize && lo[i] == -dInfinity && hi[i] == dInfinity) {
+                        rowmap[i] = nbr;
+                        brow[nbr++] = i;
+                    } else {
+                        rowmap[i] = nur;
+                        urow[nur++] = i;
+                    }
+                }
+
+                if (k < nf) fsize[k] = nbr - rowofs[k];
+            }
+        }
+
+        phasetimer.Switch(dStepPhaseSolve);
+
+        dxSparseFactor factor;
+        factor.nf = nf;
+        factor.size = fsize;
+        factor.rowofs = rowofs;
+
+        // the off-diagonal blocks if they did not fit in the arena
+        void *lblock = NULL;
+        size_t lblocksize = 0;
+
+        if (nbr > 0) {
+            // symbolic analysis
+            int *parent = memarena->AllocateArray<int> (nf);
+            int *flag = memarena->AllocateArray<int> (nf);
+            unsigned int *colcount = memarena->AllocateArray<unsigned int> (nf);
+            const size_t lsize = AnalyseFactor (fjoint, nf, fsize, parent, flag, colcount);
+
+            factor.lstart = memarena->AllocateArray<unsigned int> (nf);
+            factor.lcount = memarena->AllocateArray<unsigned int> (nf);
+            factor.dofs = memarena->AllocateArray<size_t> (nf);
+
+            unsigned int lnz = 0;
+            size_t dsize = 0;
+            for (unsigned int k = 0; k != nf; ++k) {
+                factor.lstart[k] = lnz;
+                factor.lcount[k] = 0;
+                lnz += colcount[k];
+                factor.dofs[k] = dsize;
+                dsize += (size_t)fsize[k] * dPAD(fsize[k]);
+            }
+
+            // The arena holds as many off-diagonal blocks as the estimate's
+            // bound. A factor with more fill (which takes many loops) gets
+            // them from the arena's memory manager for this step.
+            size_t lnzbound, lsizebound;
+            BoundFactorBlocks (body, nb, _joint, _nj, &lnzbound, &lsizebound);
+            if (lnz <= lnzbound && lsize <= lsizebound) {
+                factor.lrow = memarena->AllocateArray<unsigned int> (lnz);
+                factor.lofs = memarena->AllocateArray<size_t> (lnz);
+                factor.lx = memarena->AllocateArray<dReal> (lsize);
+            } else {
+                const size_t lxsize = dEFFICIENT_SIZE(sizeof(dReal) * lsize);
+                const size_t lofssize = dEFFICIENT_SIZE(sizeof(size_t) * (size_t)lnz);
+                lblocksize = lxsize + lofssize + dEFFICIENT_SIZE(sizeof(unsigned int) * (size_t)lnz);
+                lblock = memarena->GetMemoryManager()->m_fnAlloc (lblocksize);
+                dIASSERT(lblock != NULL);
+                factor.lx = (dReal *)lblock;
+                factor.lofs = (size_t *)((char *)lblock + lxsize);
+                factor.lrow = (unsigned int *)((char *)lblock + lxsize + lofssize);
+            }
+            factor.dx = memarena->AllocateArray<dReal> (dsize);
+            factor.dinv = memarena->AllocateArray<dReal> (nbr);
+
+            for (unsigned int k = 0; k != nf; ++k) flag[k] = -1;
+
+            BEGIN_STATE_SAVE(memarena, numericstate) {
+                // numeric factorization, one block row at a time. Y holds the
+                // blocks of column k of A_bb above the diagonal, size[i] x size[k] each.
+                dReal *Y = memarena->AllocateArray<dReal> (SPARSE_MAX_BLOCK*(size_t)nbr);
+                dSetZero (Y,SPARSE_MAX_BLOCK*(size_t)nbr);
+                int *pattern = memarena->AllocateArray<int> (nf);
+
+                size_t lxnext = 0;
+
+                for (unsigned int k = 0; k != nf; ++k) {
+                    const unsigned int mk = fsize[k];
+                    const unsigned int dskip = dPAD(mk);
+                    const unsigned int *browk = brow + rowofs[k];
+                    dReal *Dk = factor.dx + factor.dofs[k];
+
+                    // the diagonal block of A
+                    for (unsigned int a = 0; a != mk; ++a) {
+                        const unsigned int ra = browk[a];
+                        const dReal *JinvMrow = JinvM + SPARSE_JROW_SIZE*(size_t)ra;
+                        for (unsigned int c = 0; c != mk; ++c) {
+                            const unsigned int rc = browk[c];
+                            Dk[a*dskip + c] = RowCoupling (JinvMrow, rowbody + 2*(size_t)ra, J + SPARSE_JROW_SIZE*(size_t)rc, rowbody + 2*(size_t)rc);
+                        }
+                        Dk[a*dskip + a] += cfm[ra] * stepsizeRecip;
+                    }
+
+                    // scatter the blocks of A above the diagonal into Y and find
+                    // the nonzero pattern of row k of L
+                    flag[k] = (int)k;
+                    unsigned int top = nf;
+
+                    dxJoint *joint = fjoint[k];
+                    dxBody *jb0 = joint->node[0].body;
+                    for (unsigned int side = 0; side != 2; ++side) {
+                        dxBody *b = joint->node[side].body;
+                        if (b) {
+                            for (dxJointNode *n = b->firstjoint; n; n = n->next) {
+                                int i = n->joint->tag;
+                                if (i != -1 && (unsigned)i < k) {
+                                    // the coupling through both shared bodies is added
+                                    // when the joint is met for the first time
+                                    if (side == 1 && jb0 != NULL && (n->joint->node[0].body == jb0 || n->joint->node[1].body == jb0)) {
+                                        continue;
+                                    }
+
+                                    const unsigned int mi = fsize[i];
+                                    if (mi != 0 && mk != 0) {
+                                        const unsigned int *browi = brow + rowofs[i];
+                                        dReal *Yi = Y + (size_t)rowofs[i]*mk;
+                                        for (unsigned int a = 0; a != mi; Yi += mk, ++a) {
+                                            const unsigned int ra = browi[a];
+                                            const dReal *JinvMrow = JinvM + SPARSE_JROW_SIZE*(size_t)ra;
+                                            for (unsigned int c = 0; c != mk; ++c) {
+                                                const unsigned int rc = browk[c];
+                                                Yi[c] += RowCoupling (JinvMrow, rowbody + 2*(size_t)ra, J + SPARSE_JROW_SIZE*(size_t)rc, rowbody + 2*(size_t)rc);
+                                            }
+                                        }
+                                    }
+
+                                    unsigned int len = 0;
+                                    for (; flag[i] != (int)k; i = parent[i]) {
+                                        pattern[len++] = i;
+                                        flag[i] = (int)k;
+                                    }
+                                    while (len > 0) pattern[--top] = pattern[--len];
+                                }
+                            }
+                        }
+                    }
+
+                    // compute the row k of L and the diagonal block D_k
+                    for (; top != nf; ++top) {
+                        const unsigned int i = (unsigned)pattern[top];
+                        const unsigned int mi = fsize[i];
+
+                        const unsigned int p = factor.lstart[i] + factor.lcount[i]++;
+                        factor.lrow[p] = k;
+                        factor.lofs[p] = lxnext;
+                        dReal *Lki = factor.lx + lxnext;
+                        lxnext += (size_t)mk * mi;
+
+                        if (mi == 0 || mk == 0) continue;
+
+                        dReal *Yi = Y + (size_t)rowofs[i]*mk;
+
+                        // Y_r -= L_ri*Y_i for all the blocks already computed in column i
+                        for (unsigned int q = factor.lstart[i]; q != p; ++q) {
+                            const unsigned int r = factor.lrow[q];
+                            const unsigned int mr = fsize[r];
+                            const dReal *Lri = factor.lx + factor.lofs[q];
+                            dReal *Yr = Y + (size_t)rowofs[r]*mk;
+                            for (unsigned int a = 0; a != mr; Lri += mi, Yr += mk, ++a) {
+                                for (unsigned int c = 0; c != mk; ++c) {
+                                    dReal sum = 0;
+                                    for (unsigned int e = 0; e != mi; ++e) sum += Lri[e] * Yi[e*mk + c];
+                                    Yr[c] -= sum;
+                                }
+                            }
+                        }
+
+                        // L_ki = (inv(D_i)*Y_i)'
+                        const dReal *Di = factor.dx + factor.dofs[i];
+                        const dReal *dinvi = factor.dinv + rowofs[i];
+                        for (unsigned int c = 0; c != mk; ++c) {
+                            dReal *Lkirow = Lki + c*mi;
+                            for (unsigned int a = 0; a != mi; ++a) Lkirow[a] = Yi[a*mk + c];
+                            dSolveLDLT (Di, dinvi, Lkirow, mi, dPAD(mi));
+                        }
+
+                        // D_k -= L_ki*Y_i
+                        for (unsigned int c = 0; c != mk; ++c) {
+                            const dReal *Lkirow = Lki + c*mi;
+                            for (unsigned int e = 0; e != mk; ++e) {
+                                dReal sum = 0;
+                                for (unsigned int a = 0; a != mi; ++a) sum += Lkirow[a] * Yi[a*mk + e];
+                                Dk[c*dskip + e] -= sum;
+                            }
+                        }
+
+                        dSetZero (Yi,(size_t)mi*mk);
+                    }
+
+                    if (mk != 0) {
+                        dFactorLDLT (Dk, factor.dinv + rowofs[k], mk, dskip);
+                    }
+                }
+
+                dIASSERT(lxnext == lsize);
+            } END_STATE_SAVE(memarena, numericstate);
+        }
+
+        dReal *lambda = memarena->AllocateArray<dReal> (m);
+
+        {
+            // yb = inv(A_bb)*rhs_b
+            dReal *yb = memarena->AllocateArray<dReal> (nbr);
+            for (unsigned int t = 0; t != nbr; ++t) yb[t] = rhs[brow[t]];
+            if (nbr > 0) factor.solve (yb);
+
+            if (nur > 0) {
+                BEGIN_STATE_SAVE(memarena, schurstate) {
+                    const unsigned int sskip = dPAD(nur);
+                    dReal *S = memarena->AllocateArray<dReal> ((size_t)nur*sskip);
+                    dReal *rhsu = memarena->AllocateArray<dReal> (nur);
+                    dReal *lambdau = memarena->AllocateArray<dReal> (nur);
+                    dReal *lou = memarena->AllocateArray<dReal> (nur);
+                    dReal *hiu = memarena->AllocateArray<dReal> (nur);
+                    int *findexu = memarena->AllocateArray<int> (nur);
+                    dReal *w = memarena->AllocateArray<dReal> (nbr);
+                    dReal *bodyforce = memarena->AllocateArray<dReal> ((size_t)nb*8);
+
+                    // rhs_u - A_ub*inv(A_bb)*rhs_b
+                    dSetZero (bodyforce,(size_t)nb*8);
+                    for (unsigned int t = 0; t != nbr; ++t) {
+                        const unsigned int rb = brow[t];
+                        AddRowForce (bodyforce, J + SPARSE_JROW_SIZE*(size_t)rb, rowbody + 2*(size_t)rb, yb[t]);
+                    }
+                    for (unsigned int s = 0; s != nur; ++s) {
+                        const unsigned int ru = urow[s];
+                        rhsu[s] = rhs[ru] - RowTimesForce (JinvM + SPARSE_JROW_SIZE*(size_t)ru, rowbody + 2*(size_t)ru, bodyforce);
+                        lou[s] = lo[ru];
+                        hiu[s] = hi[ru];
+                        int fival = findex[ru];
+                        findexu[s] = fival != -1 ? rowmap[fival] : -1;
+                    }
+
+                    // S = A_uu - A_ub*inv(A_bb)*A_bu, one column at a time:
+                    // column u is J_u*invM*(J_u'*e_u - J_b'*w), w = inv(A_bb)*J_b*invM*J_u'*e_u
+                    for (unsigned int u = 0; u != nur; ++u) {
+                        const unsigned int ru = urow[u];
+                        const dReal *JinvMu = JinvM + SPARSE_JROW_SIZE*(size_t)ru;
+                        const int *bodiesu = rowbody + 2*(size_t)ru;
+
+                        dSetZero (bodyforce,(size_t)nb*8);
+                        AddRowForce (bodyforce, J + SPARSE_JROW_SIZE*(size_t)ru, bodiesu, REAL(1.0));
+
+                        if (nbr > 0) {
+                            bool coupled = false;
+                            for (unsigned int t = 0; t != nbr; ++t) {
+                                const unsigned int rb = brow[t];
+                                w[t] = RowCoupling (JinvMu, bodiesu, J + SPARSE_JROW_SIZE*(size_t)rb, rowbody + 2*(size_t)rb);
+                                if (w[t] != 0) coupled = true;
+                            }
+
+                            if (coupled) {
+                                factor.solve (w);
+                                for (unsigned int t = 0; t != nbr; ++t) {
+                                    const unsigned int rb = brow[t];
+                                    AddRowForce (bodyforce, J + SPARSE_JROW_SIZE*(size_t)rb, rowbody + 2*(size_t)rb, -w[t]);
+                                }
+                            }
+                        }
+
+                        dReal *Scol = S + u;
+                        for (unsigned int s = 0; s != nur; Scol += sskip, ++s) {
+                            const unsigned int rs = urow[s];
+                            *Scol = RowTimesForce (JinvM + SPARSE_JROW_SIZE*(size_t)rs, rowbody + 2*(size_t)rs, bodyforce);
+                        }
+                        S[(size_t)u*sskip + u] += cfm[ru] * stepsizeRecip;
+                    }
+
+                    // solve the LCP problem for the unilateral rows.
+                    // this will destroy S but that's OK
+                    dSolveLCP (memarena, nur, S, lambdau, rhsu, NULL, 0, lou, hiu, findexu);
+
+                    for (unsigned int s = 0; s != nur; ++s) lambda[urow[s]] = lambdau[s];
+
+                    if (nbr > 0) {
+                        // lambda_b = yb - inv(A_bb)*A_bu*lambda_u
+                        dSetZero (bodyforce,(size_t)nb*8);
+                        for (unsigned int s = 0; s != nur; ++s) {
+                            const unsigned int ru = urow[s];
+                            AddRowForce (bodyforce, J + SPARSE_JROW_SIZE*(size_t)ru, rowbody + 2*(size_t)ru, lambdau[s]);
+                        }
+                        for (unsigned int t = 0; t != nbr; ++t) {
+                            const unsigned int rb = brow[t];
+                            w[t] = RowTimesForce (JinvM + SPARSE_JROW_SIZE*(size_t)rb, rowbody + 2*(size_t)rb, bodyforce);
+                        }
+                        factor.solve (w);
+                        for (unsigned int t = 0; t != nbr; ++t) yb[t] -= w[t];
+                    }
+                } END_STATE_SAVE(memarena, schurstate);
+            }
+
+            for (unsigned int t = 0; t != nbr; ++t) lambda[brow[t]] = yb[t];
+        }
+
+        if (lblock != NULL) {
+            memarena->GetMemoryManager()->m_fnFree (lblock, lblocksize);
+        }
+
+        {
+            // compute the constraint force `cforce'
+            // compute cforce = J'*lambda
+            const dxSparseJointInfo *jicurr = jointinfos;
+            const dxSparseJointInfo *const jiend = jicurr + nj;
+            for (; jicurr != jiend; ++jicurr) {
+                const unsigned int infom = jicurr->info.m;
+                dxJoint *joint = jicurr->joint;
+
+                const dReal *Jrow = J + SPARSE_JROW_SIZE*(size_t)jicurr->ofs;
+                const dReal *lambdarow = lambda + jicurr->ofs;
+
+                dReal data[2][8];
+                dSetZero (&data[0][0],2*8);
+                for (unsigned int j = 0; j != infom; Jrow += SPARSE_JROW_SIZE, ++j) {
+                    const dReal lambdaj = lambdarow[j];
+                    for (unsigned int k = 0; k != 8; ++k) data[0][k] += Jrow[k] * lambdaj;
+                    for (unsigned int k = 0; k != 8; ++k) data[1][k] += Jrow[8 + k] * lambdaj;
+                }
+
+                dxBody* b1 = joint->node[0].body;
+                dReal *cf1 = cforce + 8*(size_t)(unsigned)b1->tag;
+                for (unsigned int k = 0; k != 8; ++k) cf1[k] += data[0][k];
+
+                dxBody* b2 = joint->node[1].body;
+                if (b2) {
+                    dReal *cf2 = cforce + 8*(size_t)(unsigned)b2->tag;
+                    for (unsigned int k = 0; k != 8; ++k) cf2[k] += data[1][k];
+                }
+
+                dJointFeedback *fb = joint->feedback;
+                if (fb) {
+                    // the user has requested feedback on the amount of force that this
+                    // joint is applying to the bodies.
+                    fb->f1[0] = data[0][0]; fb->f1[1] = data[0][1]; fb->f1[2] = data[0][2];
+                    fb->t1[0] = data[0][4]; fb->t1[1] = data[0][5]; fb->t1[2] = data[0][6];
+                    if (b2) {
+                        fb->f2[0] = data[1][0]; fb->f2[1] = data[1][1]; fb->f2[2] = data[1][2];
+                        fb->t2[0] = data[1][4]; fb->t2[1] = data[1][5]; fb->t2[2] = data[1][6];
+                    }
+                }
+            }
+        }
+    } // if (m > 0)
+
+    {
+        // compute the velocity update
+        phasetimer.Switch(dStepPhaseIntegration);
+
+        // add fe to cforce and multiply cforce by stepsize
+        dReal data[4];
+        const dReal *invIrow = invI;
+        dReal *cforcecurr = cforce;
+        dxBody *const *const bodyend = body + nb;
+        for (dxBody *const *bodycurr = body; bodycurr != bodyend; invIrow+=12, cforcecurr+=8, ++bodycurr) {
+            dxBody *b = *bodycurr;
+
+            dReal body_invMass_mul_stepsize = stepsize * b->invMass;
+            for (unsigned int j=0; j<3; ++j) b->lvel[j] += (cforcecurr[j] + b->facc[j]) * body_invMass_mul_stepsize;
+
+            for (unsigned int k=0; k<3; ++k) data[k] = (cforcecurr[4+k] + b->tacc[k]) * stepsize;
+            dMultiplyAdd0_331 (b->avel, invIrow, data);
+        }
+    }
+
+    {
+        // update the position and orientation from the new linear/angular velocity
+        // (over the given timestep)
+        dxBody *const *const bodyend = body + nb;
+        for (dxBody *const *bodycurr = body; bodycurr != bodyend; ++bodycurr) {
+            dxBody *b = *bodycurr;
+            dxStepBody (b,stepsize);
+        }
+    }
+
+    {
+        // zero all force accumulators
+        dxBody *const *const bodyend = body + nb;
+        for (dxBody *const *bodycurr = body; bodycurr != bodyend; ++bodycurr) {
+            dxBody *b = *bodycurr;
+            dSetZero (b->facc,4);
+            dSetZero (b->tacc,4);
+        }
+    }
+
+    phasetimer.Stop();
+}
+
+
+//****************************************************************************
+
+size_t dxEstimateSparseStepMemoryRequirements (dxBody * const *body, unsigned int nb, dxJoint * const *_joint, unsigned int _nj)
+{
+    unsigned int m = 0, nu = 0, nf = 0;
+    size_t dsize = 0;
+
+    {
+        // Only the unilateral rows go to the LCP: all the rows of contacts and
+        // at most the rows after the first nub ones of other joints (limits
+        // and motors).
+        dxJoint::SureMaxInfo info;
+        dxJoint *const *const _jend = _joint + _nj;
+        for (dxJoint *const *_jcurr = _joint; _jcurr != _jend; ++_jcurr) {
+            dxJoint *j = *_jcurr;
+            j->getSureMaxInfo (&info);
+            m += info.max_m;
+
+            if (j->type() == dJointTypeContact) {
+                nu += info.max_m;
+            } else if (info.max_m > 0) {
+                nu += info.max_m - info.min_nub;
+                dsize += (size_t)info.max_m * dPAD(info.max_m);
+                ++nf;
+            }
+        }
+    }
+
+    size_t lnz, lsize;
+    BoundFactorBlocks (body, nb, _joint, _nj, &lnz, &lsize);
+
+    size_t res = 0;
+
+    res += dEFFICIENT_SIZE(sizeof(dReal) * 3 * 4 * (size_t)nb); // for invI
+    res += dEFFICIENT_SIZE(sizeof(dxJoint *) * (size_t)_nj); // for fjoint
+    res += dEFFICIENT_SIZE(sizeof(dxSparseJointInfo) * (size_t)_nj); // for jointinfos
+    res += dEFFICIENT_SIZE(sizeof(dReal) * 8 * (size_t)nb); // for cforce
+
+    if (m > 0) {
+        res += 2 * dEFFICIENT_SIZE(sizeof(dReal) * SPARSE_JROW_SIZE * (size_t)m); // for J, JinvM
+        res += 4 * dEFFICIENT_SIZE(sizeof(dReal) * (size_t)m); // for rhs, cfm, lo, hi
+        res += dEFFICIENT_SIZE(sizeof(int) * (size_t)m); // for findex
+        res += dEFFICIENT_SIZE(sizeof(int) * 2 * (size_t)m); // for rowbody
+        res += dEFFICIENT_SIZE(sizeof(dReal) * 8 * (size_t)nb); // for tmp1
+        res += 3 * dEFFICIENT_SIZE(sizeof(int) * (size_t)m); // for brow, urow, rowmap
+        res += 2 * dEFFICIENT_SIZE(sizeof(unsigned int) * (size_t)nf); // for fsize, rowofs
+
+        // factorization
+        res += 5 * dEFFICIENT_SIZE(sizeof(int) * (size_t)nf); // for parent, flag, colcount, lstart, lcount
+        res += dEFFICIENT_SIZE(sizeof(size_t) * (size_t)nf); // for dofs
+        res += dEFFICIENT_SIZE(sizeof(unsigned int) * (size_t)lnz); // for lrow
+        res += dEFFICIENT_SIZE(sizeof(size_t) * (size_t)lnz); // for lofs
+        res += dEFFICIENT_SIZE(sizeof(dReal) * lsize); // for lx
+        res += dEFFICIENT_SIZE(sizeof(dReal) * dsize); // for dx
+        res += dEFFICIENT_SIZE(sizeof(dReal) * (size_t)m); // for dinv
+        res += dEFFICIENT_SIZE(sizeof(dReal) * SPARSE_MAX_BLOCK * (size_t)m); // for Y
+        res += dEFFICIENT_SIZE(sizeof(int) * (size_t)nf); // for pattern
+
+        res += 2 * dEFFICIENT_SIZE(sizeof(dReal) * (size_t)m); // for lambda, yb
+
+        // Schur complement and LCP
+        if (nu > 0) {
+            res += dEFFICIENT_SIZE(sizeof(dReal) * (size_t)nu * dPAD(nu)); // for S
+            res += 4 * dEFFICIENT_SIZE(sizeof(dReal) * (size_t)nu); // for rhsu, lambdau, lou, hiu
+            res += dEFFICIENT_SIZE(sizeof(int) * (size_t)nu); // for findexu
+            res += dEFFICIENT_SIZE(sizeof(dReal) * (size_t)m); // for w
+            res += dEFFICIENT_SIZE(sizeof(dReal) * 8 * (size_t)nb); // for bodyforce
+            res += dEstimateSolveLCPMemoryReq(nu, false);
+        }
+    }
+
+    return res;
+}
@@ -22,27 +22,16 @@
 
 #include <ode/odeconfig.h>
 #include <ode/rotation.h>
-#include <ode/timer.h>
 #include <ode/error.h>
 #include <ode/matrix.h>
 #include "config.h"
 #include "odemath.h"
 #include "objects.h"
 #include "joints/joint.h"
+#include "jointbatch.h"
 #include "lcp.h"
 #include "util.h"
-
-//****************************************************************************
-// misc defines
-
-//#define TIMING
-
-
-#ifdef TIMING
-#define IFTIMING(x) x
-#else
-#define IFTIMING(x) ((void)0)
-#endif
+#include "stepstats.h"
 
 //****************************************************************************
 // special matrix multipliers
@@ -178,17 +167,55 @@ static void Multiply1_8q1 (dReal *A, const dReal *B, const dReal *C, unsigned in
 //****************************************************************************
 // an optimized version of dInternalStepIsland1()
 
-struct dJointWithInfo1
+// Row layout for FillJointInfo2ByType(): 8 element rows of J with the
+// body 1 block of a joint followed by its body 2 block.
+struct dxStepJacobianLayout
 {
-    dxJoint *joint;
-    dxJoint::Info1 info;
+    dxJoint::Info2 Jinfo;
+    dReal *J, *c, *cfm, *lo, *hi;
+    int *findex;
+    unsigned int ofsi;
+
+    dxJoint::Info2 *begin(const dJointWithInfo1 *jicurr)
+    {
+        const unsigned int infom = jicurr->info.m;
+        dReal *const J1row = J + 2*8*(size_t)ofsi;
+        Jinfo.J1l = J1row;
+        Jinfo.J1a = J1row + 4;
+        dReal *const J2row = J1row + 8*(size_t)infom;
+        Jinfo.J2l = J2row;
+        Jinfo.J2a = J2row + 4;
+        Jinfo.c = c + ofsi;
+        Jinfo.cfm = cfm + ofsi;
+        Jinfo.lo = lo + ofsi;
+        Jinfo.hi = hi + ofsi;
+        Jinfo.findex = findex + ofsi;
+        return &Jinfo;
+    }
+
+    void end(const dJointWithInfo1 *jicurr)
+    {
+        const unsigned int infom = jicurr->info.m;
+
+        // adjust returned findex values for global index numbering
+        int *findex_ofsi = findex + ofsi;
+        for (unsigned int j=0; j<infom; ++j) {
+            int fival = findex_ofsi[j];
+            if (fival != -1) 
+                findex_ofsi[j] = fival + ofsi;
+        }
+
+        ofsi += infom;
+    }
 };
 
 static void dInternalStepIsland_x2 (dxWorldProcessMemArena *memarena, 
                                     dxWorld *world, dxBody * const *body, unsigned int nb,
-                                    dxJoint * const *_joint, unsigned int _nj, dReal stepsize)
+                                    dxJoint * const *_joint, unsigned int _nj, dReal stepsize,
+                                    dxStepStatsThreadSlot *statsslot)
 {
-    IFTIMING(dTimerStart("preprocessing"));
+    dxStepPhaseTimer phasetimer(statsslot);
+    phasetimer.Switch(dStepPhaseAssembly);
 
     const dReal stepsizeRecip = dRecip(stepsize);
 
@@ -407,6 +434,10 @@ static void dInternalStepIsland_x2 (dxWorldProcessMemArena *memarena,
     unsigned int nj = (unsigned int)(ji_end - ji_start);
     dIASSERT((size_t)(ji_end - ji_start) <= (size_t)UINT_MAX);
 
+    // group the joints by type so that their rows can be fetched in batches,
+    // keeping the unbounded/mixed/LCP order built above
+    jointiinfos = SortJointInfosByType(memarena, jointiinfos, nj, true);
+
     unsigned int m = 0;
 
     {
@@ -422,6 +453,8 @@ static void dInternalStepIsland_x2 (dxWorldProcessMemArena *memarena,
         m = mcurr;
     }
 
+    phasetimer.AccumulateRows(m);
+
     // this will be set to the force due to the constraints
     dReal *cforce = memarena->AllocateArray<dReal> ((size_t)nb*8);
     dSetZero (cforce,(size_t)nb*8);
@@ -468,7 +501,6 @@ static void dInternalStepIsland_x2 (dxWorldProcessMemArena *memarena,
             dSetZero (JinvM,2*8*(size_t)m);
 
             {
-                IFTIMING(dTimerNow ("create J"));
                 // get jacobian data from constraints. a (2*m)x8 matrix will be created
                 // to store the two jacobian blocks from each constraint. it has this
                 // format:
@@ -487,45 +519,23 @@ static void dInternalStepIsland_x2 (dxWorldProcessMemArena *memarena,
                 //   (aaa) = angular jacobian data
                 //
 
-                dxJoint::Info2 Jinfo;
-                Jinfo.rowskip = 8;
-                Jinfo.fps = stepsizeRecip;
-                Jinfo.erp = world->global_erp;
-
-                unsigned ofsi = 0;
-                const dJointWithInfo1 *jicurr = jointiinfos;
-                const dJointWithInfo1 *const jiend = jicurr + nj;
-                for (; jicurr != jiend; ++jicurr) {
-                    const unsigned int infom = jicurr->info.m;
-                    dReal *const J1row = J + 2*8*(size_t)ofsi;
-                    Jinfo.J1l = J1row;
-                    Jinfo.J1a = J1row + 4;
-                    dReal *const J2row = J1row + 8*(size_t)infom;
-                    Jinfo.J2l = J2row;
-                    Jinfo.J2a = J2row + 4;
-                    Jinfo.c = c + ofsi;
-                    Jinfo.cfm = cfm + ofsi;
-                    Jinfo.lo = lo + ofsi;
-                    Jinfo.hi = hi + ofsi;
-                    Jinfo.findex = findex + ofsi;
-
-                    dxJoint *joint = jicurr->joint;
-                    joint->getInfo2 (&Jinfo);
-
-                    // adjust returned findex values for global index numbering
-                    int *findex_ofsi = findex + ofsi;
-                    for (unsigned int j=0; j<infom; ++j) {
-                        int fival = findex_ofsi[j];
-                        if (fival != -1) 
-                            findex_ofsi[j] = fival + ofsi;
-                    }
-
-                    ofsi += infom;
-                }
+                dxStepJacobianLayout layout;
+                layout.Jinfo.rowskip = 8;
+                layout.Jinfo.fps = stepsizeRecip;
+                layout.Jinfo.erp = world->global_erp;
+                layout.J = J;
+                layout.c = c;
+                layout.cfm = cfm;
+                layout.lo = lo;
+                layout.hi = hi;
+                layout.findex = findex;
+                layout.ofsi = 0;
+
+                FillJointInfo2ByType(layout, jointiinfos, nj);
+                dIASSERT (layout.ofsi == m);
             }
 
             {
-                IFTIMING(dTimerNow ("compute A"));
                 {
                     // compute A = J*invM*J'. first compute JinvM = J*invM. this has the same
                     // format as J so we just go through the constraints in J multiplying by
@@ -660,7 +670,6 @@ static void dInternalStepIsland_x2 (dxWorldProcessMemArena *memarena,
 
         BEGIN_STATE_SAVE(memarena, tmp1state) {
             // compute the right hand side `rhs'
-            IFTIMING(dTimerNow ("compute rhs"));
 
             dReal *tmp1 = memarena->AllocateArray<dReal> ((size_t)nb*8);
             //dSetZero (tmp1,nb*8);
@@ -709,7 +718,7 @@ static void dInternalStepIsland_x2 (dxWorldProcessMemArena *memarena,
         dReal *lambda = memarena->AllocateArray<dReal> (m);
 
         BEGIN_STATE_SAVE(memarena, lcpstate) {
-            IFTIMING(dTimerNow ("solving LCP problem"));
+            phasetimer.Switch(dStepPhaseSolve);
 
             // solve the LCP problem and get lambda.
             // this will destroy A but that's OK
@@ -718,8 +727,6 @@ static void dInternalStepIsland_x2 (dxWorldProcessMemArena *memarena,
         } END_STATE_SAVE(memarena, lcpstate);
 
         {
-            IFTIMING(dTimerNow ("compute constraint force"));
-
             // compute the constraint force `cforce'
             // compute cforce = J'*lambda
             unsigned ofsi = 0;
@@ -784,7 +791,7 @@ static void dInternalStepIsland_x2 (dxWorldProcessMemArena *memarena,
 
     {
         // compute the velocity update
-        IFTIMING(dTimerNow ("compute velocity update"));
+        phasetimer.Switch(dStepPhaseIntegration);
 
         // add fe to cforce and multiply cforce by stepsize
         dReal data[4];
@@ -805,7 +812,6 @@ static void dInternalStepIsland_x2 (dxWorldProcessMemArena *memarena,
     {
         // update the position and orientation from the new linear/angular velocity
         // (over the given timestep)
-        IFTIMING(dTimerNow ("update position"));
         dxBody *const *const bodyend = body + nb;
         for (dxBody *const *bodycurr = body; bodycurr != bodyend; ++bodycurr) {
             dxBody *b = *bodycurr;
@@ -814,8 +820,6 @@ static void dInternalStepIsland_x2 (dxWorldProcessMemArena *memarena,
     }
 
     {
-        IFTIMING(dTimerNow ("tidy up"));
-
         // zero all force accumulators
         dxBody *const *const bodyend = body + nb;
         for (dxBody *const *bodycurr = body; bodycurr != bodyend; ++bodycurr) {
@@ -831,18 +835,17 @@ static void dInternalStepIsland_x2 (dxWorldProcessMemArena *memarena,
         }
     }
 
-    IFTIMING(dTimerEnd());
-    if (m > 0) IFTIMING(dTimerReport (stdout,1));
-
+    phasetimer.Stop();
 }
 
 //****************************************************************************
 
 void dInternalStepIsland (dxWorldProcessMemArena *memarena, 
                           dxWorld *world, dxBody * const *body, unsigned int nb,
-                          dxJoint * const *joint, unsigned int nj, dReal stepsize)
+                          dxJoint * const *joint, unsigned int nj, dReal stepsize,
+                          dxStepStatsThreadSlot *statsslot)
 {
-    dInternalStepIsland_x2 (memarena,world,body,nb,joint,nj,stepsize);
+    dInternalStepIsland_x2 (memarena,world,body,nb,joint,nj,stepsize,statsslot);
 }
 
 size_t dxEstimateStepMemoryRequirements (dxBody * const *body, unsigned int nb, dxJoint * const *_joint, unsigned int _nj)
@@ -876,6 +879,7 @@ size_t dxEstimateStepMemoryRequirements (dxBody * const *body, unsigned int nb,
 
         // The array can't grow right more than by nj
         size_t sub1_res2 = dEFFICIENT_SIZE(sizeof(dJointWithInfo1) * ((size_t)_nj + (size_t)nj)); // for shrunk jointiinfos
+        sub1_res2 += dEFFICIENT_SIZE(sizeof(dJointWithInfo1) * (size_t)nj); // for type sorted jointiinfos
         sub1_res2 += dEFFICIENT_SIZE(sizeof(dReal) * 8 * (size_t)nb); // for cforce
         if (m > 0) {
             sub1_res2 += dEFFICIENT_SIZE(sizeof(dReal) * 2 * 8 * (size_t)m); // for J
@@ -26,6 +26,7 @@
 #include <ode/common.h>
 
 class dxWorldProcessMemArena;
+struct dxStepStatsThreadSlot;
 
 
 size_t dxEstimateStepMemoryRequirements (
@@ -34,7 +35,7 @@ size_t dxEstimateStepMemoryRequirements (
 void dInternalStepIsland (
     dxWorldProcessMemArena *memarena, dxWorld *world, 
     dxBody * const *body, unsigned int nb, dxJoint * const *joint, unsigned int nj,
-    dReal stepsize);
+    dReal stepsize, dxStepStatsThreadSlot *statsslot);
 
 
 
@@ -0,0 +1,198 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001,2002 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+
+/*
+
+Per-world step statistics implementation.
+
+*/
+
+#include <ode/common.h>
+#include <ode/memory.h>
+#include "config.h"
+#include "stepstats.h"
+#include "odeou.h"
+#include <string.h>
+
+
+//****************************************************************************
+// dxStepStatsThreadSlot
+
+void dxStepStatsThreadSlot::Reset()
+{
+    for (unsigned phase = 0; phase != dStepPhase__MAX; ++phase) {
+        m_phaseTime[phase] = 0;
+    }
+    m_busyTime = 0;
+    m_islandCount = 0;
+    m_constraintRows = 0;
+    m_solverIterations = 0;
+}
+
+
+//****************************************************************************
+// dxStepStats
+
+dxStepStats::dxStepStats():
+    m_lastValid(false),
+    m_stepStartTime(0),
+    m_islandsStartTime(0),
+    m_threadSlots(NULL),
+    m_threadSlotsCapacity(0),
+    m_threadSlotsCount(0),
+    m_threadSlotsObtained(0)
+{
+    memset(&m_current, 0, sizeof(m_current));
+    memset(&m_last, 0, sizeof(m_last));
+}
+
+dxStepStats::~dxStepStats()
+{
+    if (m_threadSlots != NULL) {
+        dFree(m_threadSlots, (size_t)m_threadSlotsCapacity * GetThreadSlotStride());
+    }
+}
+
+
+void dxStepStats::BeginStep()
+{
+    memset(&m_current, 0, sizeof(m_current));
+    m_current.struct_size = sizeof(m_current);
+
+    m_threadSlotsCount = 0;
+    m_threadSlotsObtained = 0;
+
+    m_stepStartTime = dxMonotonicTime();
+}
+
+void dxStepStats::EndStep(bool stepSucceeded)
+{
+    if (stepSucceeded) {
+        dWorldStepStats &current = m_current;
+        current.step_time = dxMonotonicTime() - m_stepStartTime;
+
+        const unsigned slotsCount = m_threadSlotsCount;
+        current.thread_count = slotsCount;
+
+        for (unsigned index = 0; index != slotsCount; ++index) {
+            const dxStepStatsThreadSlot *slot = GetThreadSlot(index);
+
+            for (unsigned phase = 0; phase != dStepPhase__MAX; ++phase) {
+                current.phase_time[phase] += slot->m_phaseTime[phase];
+            }
+            current.constraint_rows += slot->m_constraintRows;
+            current.solver_iterations += slot->m_solverIterations;
+
+            if (index < dWORLDSTEPSTATS_MAX_THREADS) {
+                dWorldStepThreadStats &threadStats = current.threads[index];
+                threadStats.busy_time = slot->m_busyTime;
+                threadStats.idle_time = current.islands_time > slot->m_busyTime ? current.islands_time - slot->m_busyTime : 0.0;
+                threadStats.island_count = slot->m_islandCount;
+            }
+        }
+
+        m_last = current;
+        m_lastValid = true;
+    }
+}
+
+
+void dxStepStats::AccumulateIsland(unsigned bodiesCount, unsigned jointsCount)
+{
+    dWorldStepStats &current = m_current;
+    current.island_count += 1;
+    current.body_count += bodiesCount;
+    current.joint_count += jointsCount;
+    if (bodiesCount > current.max_island_bodies) current.max_island_bodies = bodiesCount;
+    if (jointsCount > current.max_island_joints) current.max_island_joints = jointsCount;
+}
+
+
+bool dxStepStats::PrepareThreadSlots(unsigned threadsCount)
+{
+    bool result = false;
+
+    do {
+        if (threadsCount > m_threadSlotsCapacity) {
+            const size_t slotStride = GetThreadSlotStride();
+
+            void *newSlots = dAlloc((size_t)threadsCount * slotStride);
+            if (newSlots == NULL) {
+                break;
+            }
+
+            if (m_threadSlots != NULL) {
+                dFree(m_threadSlots, (size_t)m_threadSlotsCapacity * slotStride);
+            }
+
+            m_threadSlots = newSlots;
+            m_threadSlotsCapacity = threadsCount;
+        }
+
+        for (unsigned index = 0; index != threadsCount; ++index) {
+            GetThreadSlot(index)->Reset();
+        }
+
+        m_threadSlotsCount = threadsCount;
+        m_threadSlotsObtained = 0;
+
+        result = true;
+    }
+    while (false);
+
+    return result;
+}
+
+dxStepStatsThreadSlot *dxStepStats::ObtainThreadSlot()
+{
+    size_t slotIndex;
+
+    while (true)
+    {
+        slotIndex = m_threadSlotsObtained;
+        dIASSERT(slotIndex < m_threadSlotsCount);
+
+        if (AtomicCompareExchangePointer((volatile atomicptr *)&m_threadSlotsObtained, (atomicptr)slotIndex, (atomicptr)(slotIndex + 1)))
+        {
+            break;
+        }
+    }
+
+    return GetThreadSlot((unsigned)slotIndex);
+}
+
+
+bool dxStepStats::GetLastStats(dWorldStepStats *stats) const
+{
+    bool result = false;
+
+    if (m_lastValid) {
+        size_t copySize = stats->struct_size < sizeof(m_last) ? stats->struct_size : sizeof(m_last);
+        unsigned structSize = stats->struct_size;
+        memcpy(stats, &m_last, copySize);
+        stats->struct_size = structSize;
+
+        result = true;
+    }
+
+    return result;
+}
@@ -0,0 +1,139 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001,2002 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+
+/*
+
+Per-world step statistics.
+
+Unlike the global dTimer functions, the statistics are kept per world and
+are safe to be collected from several island stepping threads at once.
+Each island stepping job obtains its own thread slot and accumulates the
+per-island phase times and counters there without synchronization. The slots
+are summed into the public dWorldStepStats structure when the step ends.
+
+*/
+
+
+#ifndef _ODE_STEPSTATS_H_
+#define _ODE_STEPSTATS_H_
+
+#include <ode/common.h>
+#include <ode/objects.h>
+#include "objects.h"
+#include "util.h"
+
+
+struct dxStepStatsThreadSlot
+{
+    void Reset();
+
+    double m_phaseTime[dStepPhase__MAX];
+    double m_busyTime;
+    unsigned m_islandCount;
+    unsigned m_constraintRows;
+    unsigned m_solverIterations;
+};
+
+
+class dxStepStats:
+    public dBase
+{
+public:
+    dxStepStats();
+    ~dxStepStats();
+
+    void BeginStep();
+    void EndStep(bool stepSucceeded);
+
+    void AccumulatePhaseTime(unsigned phase, double time) { m_current.phase_time[phase] += time; }
+    void AccumulateIsland(unsigned bodiesCount, unsigned jointsCount);
+
+    bool PrepareThreadSlots(unsigned threadsCount);
+    dxStepStatsThreadSlot *ObtainThreadSlot();
+
+    void BeginIslandsProcessing() { m_islandsStartTime = dxMonotonicTime(); }
+    void EndIslandsProcessing() { m_current.islands_time = dxMonotonicTime() - m_islandsStartTime; }
+
+    bool GetLastStats(dWorldStepStats *stats) const;
+
+private:
+    dxStepStatsThreadSlot *GetThreadSlot(unsigned index) const
+    {
+        return (dxStepStatsThreadSlot *)((char *)m_threadSlots + (size_t)index * GetThreadSlotStride());
+    }
+
+    // Slots are padded to a cache line to avoid false sharing among threads
+    static size_t GetThreadSlotStride() { return (sizeof(dxStepStatsThreadSlot) + 63) & ~(size_t)63; }
+
+private:
+    dWorldStepStats         m_current;
+    dWorldStepStats         m_last;
+    bool                    m_lastValid;
+    double                  m_stepStartTime;
+    double                  m_islandsStartTime;
+    void                    *m_threadSlots;
+    unsigned                m_threadSlotsCapacity;
+    unsigned                m_threadSlotsCount;
+    volatile size_t         m_threadSlotsObtained;
+};
+
+
+// Replacement for dTimerNow() for per-island stepper phases.
+// All methods are no-ops if no statistics slot has been assigned.
+
+class dxStepPhaseTimer
+{
+public:
+    explicit dxStepPhaseTimer(dxStepStatsThreadSlot *slot): m_slot(slot), m_phase(dStepPhase__MAX), m_phaseStartTime(0) {}
+    ~dxStepPhaseTimer() { Stop(); }
+
+    void Switch(unsigned phase)
+    {
+        if (m_slot != NULL) {
+            double now = dxMonotonicTime();
+            if (m_phase != dStepPhase__MAX) {
+                m_slot->m_phaseTime[m_phase] += now - m_phaseStartTime;
+            }
+            m_phase = phase;
+            m_phaseStartTime = now;
+        }
+    }
+
+    void Stop()
+    {
+        if (m_slot != NULL && m_phase != dStepPhase__MAX) {
+            m_slot->m_phaseTime[m_phase] += dxMonotonicTime() - m_phaseStartTime;
+            m_phase = dStepPhase__MAX;
+        }
+    }
+
+    void AccumulateRows(unsigned rows) { if (m_slot != NULL) m_slot->m_constraintRows += rows; }
+    void AccumulateIterations(unsigned iterations) { if (m_slot != NULL) m_slot->m_solverIterations += iterations; }
+
+private:
+    dxStepStatsThreadSlot *m_slot;
+    unsigned m_phase;
+    double m_phaseStartTime;
+};
+
+
+#endif // #ifndef _ODE_STEPSTATS_H_
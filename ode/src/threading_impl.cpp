@@ -187,7 +187,7 @@ static const dxThreadingFunctionsInfo g_builtin_threading_functions =
     if (impl != NULL)
 #endif // #if !dBUILTIN_THREADING_IMPL_ENABLED
     {
-        ((dxIThreadingImplementation *)impl)->StickToJobsProcessing(readiness_callback, callback_context);
+        ((dxIThreadingImplementation *)impl)->StickToJobsProcessing(readiness_callback, callback_context, NULL);
     }
 }
 
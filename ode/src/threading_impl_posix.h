@@ -46,6 +46,7 @@
 #if dBUILTIN_THREADING_IMPL_ENABLED
 
 #include <pthread.h>
+#include <sched.h>
 #include <time.h>
 #include <errno.h>
 
@@ -81,6 +82,9 @@ public:
     void WakeupAllThreads();
 
     bool WaitWakeup(const dThreadedWaitTime *timeout_time_ptr);
+    bool PollWakeup();
+
+    static void YieldProcessing() { sched_yield(); }
 
 private:
     bool BlockAsAWaiter(const dThreadedWaitTime *timeout_time_ptr);
@@ -293,6 +297,20 @@ bool dxCondvarWakeup::WaitWakeup(const dThreadedWaitTime *timeout_time_ptr)
     return wait_result;
 }
 
+bool dxCondvarWakeup::PollWakeup()
+{
+    // Spinning threads are not registered as waiters, so a wakeup for them is 
+    // always left in the signaled state. The unlocked read only saves locking 
+    // the mutex while there is none.
+    if (!*(volatile bool *)&m_signaled_state)
+    {
+        return false;
+    }
+
+    const dThreadedWaitTime no_wait = { 0, 0 };
+    return WaitWakeup(&no_wait);
+}
+
 bool dxCondvarWakeup::BlockAsAWaiter(const dThreadedWaitTime *timeout_time_ptr)
 {
     bool wait_result = false;
@@ -38,11 +38,17 @@
 #include <ode/memory.h>
 
 #include <ode/threading.h>
+#include <ode/threading_impl.h>
 
 #include "objects.h"
+#include "util.h"
 
 #include <new>
 
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#endif
+
 
 #define dMAKE_JOBINSTANCE_RELEASEE(job_instance) ((dCallReleaseeID)(job_instance))
 #define dMAKE_RELEASEE_JOBINSTANCE(releasee) ((dxThreadedJobInfo *)(releasee))
@@ -291,6 +297,34 @@ private:
 typedef void (dxThreadReadyToServeCallback)(void *callback_context);
 
 
+/*
+ * Options of a thread serving a multi-threaded implementation. An idle thread
+ * polls for a wakeup m_spin_count times (or, if m_keep_hot is set, until there
+ * is one) before blocking. If m_stats is not NULL the thread accumulates its
+ * counters there.
+ */
+struct dxThreadServeOptions
+{
+    dxThreadServeOptions(): m_spin_count(0), m_keep_hot(false), m_stats(NULL) {}
+
+    unsigned                        m_spin_count;
+    bool                            m_keep_hot;
+    dThreadingThreadPoolThreadStats *m_stats;
+};
+
+// While keeping hot, the thread yields its processor every this many polls
+#define dxTHREAD_KEEP_HOT_YIELD_INTERVAL 1024U
+
+static inline void dxSpinPause()
+{
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+    __asm__ __volatile__("pause");
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+    _mm_pause();
+#endif
+}
+
+
 #if dBUILTIN_THREADING_IMPL_ENABLED
 
 template<class tThreadWakeup, class tJobListContainer>
@@ -327,13 +361,14 @@ public:
 
 public:
     inline unsigned RetrieveActiveThreadsCount();
-    inline void StickToJobsProcessing(dxThreadReadyToServeCallback *readiness_callback/*=NULL*/, void *callback_context/*=NULL*/);
+    inline void StickToJobsProcessing(dxThreadReadyToServeCallback *readiness_callback/*=NULL*/, void *callback_context/*=NULL*/, 
+        const dxThreadServeOptions *serve_options/*=NULL*/);
 
 private:
-    void PerformJobProcessingUntilShutdown();
-    void PerformJobProcessingSession();
+    void PerformJobProcessingUntilShutdown(const dxThreadServeOptions *serve_options);
+    void PerformJobProcessingSession(dThreadingThreadPoolThreadStats *stats);
 
-    void BlockAsIdleThread();
+    void BlockAsIdleThread(const dxThreadServeOptions *serve_options);
     void ActivateAnIdleThread();
 
 public:
@@ -387,7 +422,8 @@ public:
 
 public:
     inline unsigned RetrieveActiveThreadsCount();
-    inline void StickToJobsProcessing(dxThreadReadyToServeCallback *readiness_callback/*=NULL*/, void *callback_context/*=NULL*/);
+    inline void StickToJobsProcessing(dxThreadReadyToServeCallback *readiness_callback/*=NULL*/, void *callback_context/*=NULL*/, 
+        const dxThreadServeOptions *serve_options/*=NULL*/);
 
 private:
     void PerformJobProcessingUntilExhaustion();
@@ -434,7 +470,8 @@ public:
 
 public:
     virtual unsigned RetrieveActiveThreadsCount() = 0;
-    virtual void StickToJobsProcessing(dxThreadReadyToServeCallback *readiness_callback/*=NULL*/, void *callback_context/*=NULL*/) = 0;
+    virtual void StickToJobsProcessing(dxThreadReadyToServeCallback *readiness_callback/*=NULL*/, void *callback_context/*=NULL*/, 
+        const dxThreadServeOptions *serve_options/*=NULL*/) = 0;
     virtual void ShutdownProcessing() = 0;
     virtual void CleanupForRestart() = 0;
 };
@@ -495,7 +532,8 @@ protected:
 
 protected:
     virtual unsigned RetrieveActiveThreadsCount();
-    virtual void StickToJobsProcessing(dxThreadReadyToServeCallback *readiness_callback/*=NULL*/, void *callback_context/*=NULL*/);
+    virtual void StickToJobsProcessing(dxThreadReadyToServeCallback *readiness_callback/*=NULL*/, void *callback_context/*=NULL*/, 
+        const dxThreadServeOptions *serve_options/*=NULL*/);
     virtual void ShutdownProcessing();
     virtual void CleanupForRestart();
 
@@ -930,7 +968,8 @@ unsigned dxtemplateJobListThreadedHandler<tThreadWakeup, tJobListContainer>::Ret
 }
 
 template<class tThreadWakeup, class tJobListContainer>
-void dxtemplateJobListThreadedHandler<tThreadWakeup, tJobListContainer>::StickToJobsProcessing(dxThreadReadyToServeCallback *readiness_callback/*=NULL*/, void *callback_context/*=NULL*/)
+void dxtemplateJobListThreadedHandler<tThreadWakeup, tJobListContainer>::StickToJobsProcessing(dxThreadReadyToServeCallback *readiness_callback/*=NULL*/, void *callback_context/*=NULL*/, 
+    const dxThreadServeOptions *serve_options/*=NULL*/)
 {
     RegisterAsActiveThread();
 
@@ -939,15 +978,18 @@ void dxtemplateJobListThreadedHandler<tThreadWakeup, tJobListContainer>::StickTo
         (*readiness_callback)(callback_context);
     }
 
-    PerformJobProcessingUntilShutdown();
+    PerformJobProcessingUntilShutdown(serve_options);
 
     UnregisterAsActiveThread();
 }
 
 
 template<class tThreadWakeup, class tJobListContainer>
-void dxtemplateJobListThreadedHandler<tThreadWakeup, tJobListContainer>::PerformJobProcessingUntilShutdown()
+void dxtemplateJobListThreadedHandler<tThreadWakeup, tJobListContainer>::PerformJobProcessingUntilShutdown(const dxThreadServeOptions *serve_options)
 {
+    dThreadingThreadPoolThreadStats *stats = serve_options != NULL ? serve_options->m_stats : NULL;
+    double last_time = stats != NULL ? dxMonotonicTime() : 0.0;
+
     while (true)
     {
         // It is expected that new jobs will not be queued any longer after shutdown had been requested
@@ -956,7 +998,14 @@ void dxtemplateJobListThreadedHandler<tThreadWakeup, tJobListContainer>::Perform
             break;
         }
 
-        PerformJobProcessingSession();
+        PerformJobProcessingSession(stats);
+
+        if (stats != NULL)
+        {
+            double current_time = dxMonotonicTime();
+            stats->busy_time += current_time - last_time;
+            last_time = current_time;
+        }
 
         // It is expected that new jobs will not be queued any longer after shutdown had been requested
         if (IsShutdownRequested() && m_job_list_ptr->IsJobListReadyForShutdown())
@@ -964,12 +1013,19 @@ void dxtemplateJobListThreadedHandler<tThreadWakeup, tJobListContainer>::Perform
             break;
         }
 
-        BlockAsIdleThread();
+        BlockAsIdleThread(serve_options);
+
+        if (stats != NULL)
+        {
+            double current_time = dxMonotonicTime();
+            stats->idle_time += current_time - last_time;
+            last_time = current_time;
+        }
     }
 }
 
 template<class tThreadWakeup, class tJobListContainer>
-void dxtemplateJobListThreadedHandler<tThreadWakeup, tJobListContainer>::PerformJobProcessingSession()
+void dxtemplateJobListThreadedHandler<tThreadWakeup, tJobListContainer>::PerformJobProcessingSession(dThreadingThreadPoolThreadStats *stats)
 {
     dxThreadedJobInfo *current_job = NULL;
     bool job_result = false;
@@ -989,14 +1045,47 @@ void dxtemplateJobListThreadedHandler<tThreadWakeup, tJobListContainer>::Perform
             ActivateAnIdleThread();
         }
 
+        if (stats != NULL)
+        {
+            stats->job_count += 1;
+        }
+
         job_result = current_job->InvokeCallFunction();
     }
 }
 
 
 template<class tThreadWakeup, class tJobListContainer>
-void dxtemplateJobListThreadedHandler<tThreadWakeup, tJobListContainer>::BlockAsIdleThread()
+void dxtemplateJobListThreadedHandler<tThreadWakeup, tJobListContainer>::BlockAsIdleThread(const dxThreadServeOptions *serve_options)
 {
+    if (serve_options != NULL && (serve_options->m_keep_hot || serve_options->m_spin_count != 0))
+    {
+        const bool keep_hot = serve_options->m_keep_hot;
+        const unsigned spin_count = serve_options->m_spin_count;
+
+        for (unsigned spin_index = 0; keep_hot || spin_index != spin_count; ++spin_index)
+        {
+            if (m_processing_wakeup.PollWakeup())
+            {
+                return;
+            }
+
+            if (keep_hot && (spin_index + 1) % dxTHREAD_KEEP_HOT_YIELD_INTERVAL == 0)
+            {
+                tThreadWakeup::YieldProcessing();
+            }
+            else
+            {
+                dxSpinPause();
+            }
+        }
+    }
+
+    if (serve_options != NULL && serve_options->m_stats != NULL)
+    {
+        serve_options->m_stats->block_count += 1;
+    }
+
     m_processing_wakeup.WaitWakeup(NULL);
 }
 
@@ -1049,7 +1138,8 @@ unsigned dxtemplateJobListSelfHandler<tThreadWakeup, tJobListContainer>::Retriev
 }
 
 template<class tThreadWakeup, class tJobListContainer>
-void dxtemplateJobListSelfHandler<tThreadWakeup, tJobListContainer>::StickToJobsProcessing(dxThreadReadyToServeCallback *readiness_callback/*=NULL*/, void *callback_context/*=NULL*/)
+void dxtemplateJobListSelfHandler<tThreadWakeup, tJobListContainer>::StickToJobsProcessing(dxThreadReadyToServeCallback *readiness_callback/*=NULL*/, void *callback_context/*=NULL*/, 
+    const dxThreadServeOptions *serve_options/*=NULL*/)
 {
     dIASSERT(false); // This method is not expected to be called for Self-Handler
 }
@@ -1242,9 +1332,10 @@ unsigned dxtemplateThreadingImplementation<tJobListContainer, tJobListHandler>::
 }
 
 template<class tJobListContainer, class tJobListHandler>
-void dxtemplateThreadingImplementation<tJobListContainer, tJobListHandler>::StickToJobsProcessing(dxThreadReadyToServeCallback *readiness_callback/*=NULL*/, void *callback_context/*=NULL*/)
+void dxtemplateThreadingImplementation<tJobListContainer, tJobListHandler>::StickToJobsProcessing(dxThreadReadyToServeCallback *readiness_callback/*=NULL*/, void *callback_context/*=NULL*/, 
+    const dxThreadServeOptions *serve_options/*=NULL*/)
 {
-    m_list_handler.StickToJobsProcessing(readiness_callback, callback_context);
+    m_list_handler.StickToJobsProcessing(readiness_callback, callback_context, serve_options);
 }
 
 template<class tJobListContainer, class tJobListHandler>
@@ -78,6 +78,9 @@ public:
     void WakeupAllThreads();
 
     bool WaitWakeup(const dThreadedWaitTime *timeout_time_ptr);
+    bool PollWakeup() { const dThreadedWaitTime no_wait = { 0, 0 }; return WaitWakeup(&no_wait); }
+
+    static void YieldProcessing() { SwitchToThread(); }
 
 private:
     bool          m_state_is_permanent;
@@ -44,6 +44,7 @@
 
 #include <new>
 #include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <errno.h>
 
@@ -206,10 +207,14 @@ public:
     dxThreadPoolThreadInfo();
     ~dxThreadPoolThreadInfo();
 
-    bool Initialize(size_t stack_size, unsigned int ode_data_allocate_flags);
+    bool Initialize(size_t stack_size, unsigned int ode_data_allocate_flags, 
+        const dThreadingThreadPoolConfig *config, int cpu_id);
+
+    const dThreadingThreadPoolThreadStats &GetStats() const { return m_stats; }
+    void ResetStats() { m_stats = dThreadingThreadPoolThreadStats(); }
 
 private:
-    bool InitializeThreadAttributes(pthread_attr_t *thread_attr, size_t stack_size);
+    bool InitializeThreadAttributes(pthread_attr_t *thread_attr, size_t stack_size, int cpu_id);
     void FinalizeThreadAttributes(pthread_attr_t *thread_attr);
     bool WaitInitStatus();
 
@@ -257,6 +262,9 @@ private:
     dxEventObject m_command_event;
     dxEventObject m_acknowledgement_event;
     void        *m_command_param;
+
+    dxThreadServeOptions m_serve_options;
+    dThreadingThreadPoolThreadStats m_stats;
 };
 
 
@@ -267,7 +275,9 @@ m_ode_data_allocate_flags(0),
 m_command_code(dxTHREAD_COMMAND_EXIT),
 m_command_event(),
 m_acknowledgement_event(),
-m_command_param(NULL)
+m_command_param(NULL),
+m_serve_options(),
+m_stats()
 {
 }
 
@@ -277,7 +287,8 @@ dxThreadPoolThreadInfo::~dxThreadPoolThreadInfo()
 }
 
 
-bool dxThreadPoolThreadInfo::Initialize(size_t stack_size, unsigned int ode_data_allocate_flags)
+bool dxThreadPoolThreadInfo::Initialize(size_t stack_size, unsigned int ode_data_allocate_flags, 
+    const dThreadingThreadPoolConfig *config, int cpu_id)
 {
     bool result = false;
 
@@ -308,8 +319,15 @@ bool dxThreadPoolThreadInfo::Initialize(size_t stack_size, unsigned int ode_data
 
         m_ode_data_allocate_flags = ode_data_allocate_flags;
 
+        if (config != NULL)
+        {
+            m_serve_options.m_spin_count = config->spin_count;
+            m_serve_options.m_keep_hot = config->keep_hot != 0;
+        }
+        m_serve_options.m_stats = &m_stats;
+
         pthread_attr_t thread_attr;
-        if (!InitializeThreadAttributes(&thread_attr, stack_size))
+        if (!InitializeThreadAttributes(&thread_attr, stack_size, cpu_id))
         {
             break;
         }
@@ -352,7 +370,7 @@ bool dxThreadPoolThreadInfo::Initialize(size_t stack_size, unsigned int ode_data
     return result;
 }
 
-bool dxThreadPoolThreadInfo::InitializeThreadAttributes(pthread_attr_t *thread_attr, size_t stack_size)
+bool dxThreadPoolThreadInfo::InitializeThreadAttributes(pthread_attr_t *thread_attr, size_t stack_size, int cpu_id)
 {
     bool result = false;
 
@@ -381,6 +399,29 @@ bool dxThreadPoolThreadInfo::InitializeThreadAttributes(pthread_attr_t *thread_a
             break;
         }
 
+#if (HAVE_PTHREAD_ATTR_SETAFFINITY_NP)
+        if (cpu_id >= 0)
+        {
+            if (cpu_id >= CPU_SETSIZE)
+            {
+                errno = EINVAL;
+                break;
+            }
+
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            CPU_SET(cpu_id, &cpu_set);
+
+            if ((set_result = pthread_attr_setaffinity_np(thread_attr, sizeof(cpu_set), &cpu_set)) != EOK)
+            {
+                errno = set_result;
+                break;
+            }
+        }
+#else
+        (void)cpu_id; // -- the assignment is ignored where affinity is not supported
+#endif
+
         result = true;
     }
     while (false);
@@ -549,7 +590,7 @@ void dxThreadPoolThreadInfo::RunCommandHandlingLoop()
 
 void dxThreadPoolThreadInfo::ThreadedServeImplementation(dThreadingImplementationID impl, dxEventObject *ready_wait_event)
 {
-    ((dxIThreadingImplementation *)impl)->StickToJobsProcessing(&ProcessThreadServeReadiness_Callback, (void *)ready_wait_event);
+    ((dxIThreadingImplementation *)impl)->StickToJobsProcessing(&ProcessThreadServeReadiness_Callback, (void *)ready_wait_event, &m_serve_options);
 }
 
 void dxThreadPoolThreadInfo::ProcessThreadServeReadiness_Callback(void *context)
@@ -568,21 +609,27 @@ public:
     dxThreadingThreadPool();
     ~dxThreadingThreadPool();
 
-    bool InitializeThreads(size_t thread_count, size_t stack_size, unsigned int ode_data_allocate_flags);
+    bool InitializeThreads(size_t thread_count, size_t stack_size, unsigned int ode_data_allocate_flags, 
+        const dThreadingThreadPoolConfig *config);
 
 private:
     void FinalizeThreads();
 
-    bool InitializeIndividualThreadInfos(dxThreadPoolThreadInfo *thread_infos, size_t thread_count, size_t stack_size, unsigned int ode_data_allocate_flags);
+    bool InitializeIndividualThreadInfos(dxThreadPoolThreadInfo *thread_infos, size_t thread_count, size_t stack_size, unsigned int ode_data_allocate_flags, 
+        const dThreadingThreadPoolConfig *config);
     void FinalizeIndividualThreadInfos(dxThreadPoolThreadInfo *thread_infos, size_t thread_count);
 
-    bool InitializeSingleThreadInfo(dxThreadPoolThreadInfo *thread_info, size_t stack_size, unsigned int ode_data_allocate_flags);
+    bool InitializeSingleThreadInfo(dxThreadPoolThreadInfo *thread_info, size_t stack_size, unsigned int ode_data_allocate_flags, 
+        const dThreadingThreadPoolConfig *config, int cpu_id);
     void FinalizeSingleThreadInfo(dxThreadPoolThreadInfo *thread_info);
 
 public:
     void ServeThreadingImplementation(dThreadingImplementationID impl);
     void WaitIdleState();
 
+    bool GetThreadStats(size_t thread_index, dThreadingThreadPoolThreadStats *out_stats) const;
+    void ResetThreadStats();
+
 private:
     dxThreadPoolThreadInfo  *m_thread_infos;
     size_t                  m_thread_count;
@@ -603,7 +650,8 @@ dxThreadingThreadPool::~dxThreadingThreadPool()
 }
 
 
-bool dxThreadingThreadPool::InitializeThreads(size_t thread_count, size_t stack_size, unsigned int ode_data_allocate_flags)
+bool dxThreadingThreadPool::InitializeThreads(size_t thread_count, size_t stack_size, unsigned int ode_data_allocate_flags, 
+    const dThreadingThreadPoolConfig *config)
 {
     dIASSERT(m_thread_infos == NULL);
 
@@ -631,7 +679,7 @@ bool dxThreadingThreadPool::InitializeThreads(size_t thread_count, size_t stack_
 
         thread_infos_allocated = true;
 
-        if (!InitializeIndividualThreadInfos(thread_infos, thread_count, stack_size, ode_data_allocate_flags))
+        if (!InitializeIndividualThreadInfos(thread_infos, thread_count, stack_size, ode_data_allocate_flags, config))
         {
             break;
         }
@@ -673,14 +721,18 @@ void dxThreadingThreadPool::FinalizeThreads()
 }
 
 
-bool dxThreadingThreadPool::InitializeIndividualThreadInfos(dxThreadPoolThreadInfo *thread_infos, size_t thread_count, size_t stack_size, unsigned int ode_data_allocate_flags)
+bool dxThreadingThreadPool::InitializeIndividualThreadInfos(dxThreadPoolThreadInfo *thread_infos, size_t thread_count, size_t stack_size, unsigned int ode_data_allocate_flags, 
+    const dThreadingThreadPoolConfig *config)
 {
     bool any_fault = false;
 
     dxThreadPoolThreadInfo *const infos_end = thread_infos + thread_count;
     for (dxThreadPoolThreadInfo *current_info = thread_infos; current_info != infos_end; ++current_info)
     {
-        if (!InitializeSingleThreadInfo(current_info, stack_size, ode_data_allocate_flags))
+        const size_t thread_index = current_info - thread_infos;
+        const int cpu_id = config != NULL && config->cpu_count != 0 ? config->cpu_ids[thread_index % config->cpu_count] : -1;
+
+        if (!InitializeSingleThreadInfo(current_info, stack_size, ode_data_allocate_flags, config, cpu_id))
         {
             FinalizeIndividualThreadInfos(thread_infos, current_info - thread_infos);
 
@@ -703,13 +755,14 @@ void dxThreadingThreadPool::FinalizeIndividualThreadInfos(dxThreadPoolThreadInfo
 }
 
 
-bool dxThreadingThreadPool::InitializeSingleThreadInfo(dxThreadPoolThreadInfo *thread_info, size_t stack_size, unsigned int ode_data_allocate_flags)
+bool dxThreadingThreadPool::InitializeSingleThreadInfo(dxThreadPoolThreadInfo *thread_info, size_t stack_size, unsigned int ode_data_allocate_flags, 
+    const dThreadingThreadPoolConfig *config, int cpu_id)
 {
     bool result = false;
 
     new(thread_info) dxThreadPoolThreadInfo();
 
-    if (thread_info->Initialize(stack_size, ode_data_allocate_flags))
+    if (thread_info->Initialize(stack_size, ode_data_allocate_flags, config, cpu_id))
     {
         result = true;
     }
@@ -753,20 +806,50 @@ void dxThreadingThreadPool::WaitIdleState()
     }
 }
 
+bool dxThreadingThreadPool::GetThreadStats(size_t thread_index, dThreadingThreadPoolThreadStats *out_stats) const
+{
+    bool result = false;
+
+    if (thread_index < m_thread_count)
+    {
+        *out_stats = m_thread_infos[thread_index].GetStats();
+        result = true;
+    }
+
+    return result;
+}
+
+void dxThreadingThreadPool::ResetThreadStats()
+{
+    dxThreadPoolThreadInfo *const infos_end = m_thread_infos + m_thread_count;
+    for (dxThreadPoolThreadInfo *current_info = m_thread_infos; current_info != infos_end; ++current_info)
+    {
+        current_info->ResetStats();
+    }
+}
+
 
 #endif // #if dBUILTIN_THREADING_IMPL_ENABLED
 
 
 /*extern */dThreadingThreadPoolID dThreadingAllocateThreadPool(unsigned thread_count, 
                                                                size_t stack_size, unsigned int ode_data_allocate_flags, void *reserved/*=NULL*/)
+{
+    return dThreadingAllocateThreadPoolWithConfig(thread_count, stack_size, ode_data_allocate_flags, NULL);
+}
+
+/*extern */dThreadingThreadPoolID dThreadingAllocateThreadPoolWithConfig(unsigned thread_count, 
+                                                                         size_t stack_size, unsigned int ode_data_allocate_flags, const dThreadingThreadPoolConfig *config)
 {
     dAASSERT(thread_count != 0);
+    dUASSERT(config == NULL || config->struct_size >= sizeof(*config), "Bad thread pool config");
+    dUASSERT(config == NULL || config->cpu_count == 0 || config->cpu_ids != NULL, "CPU ids expected");
 
 #if dBUILTIN_THREADING_IMPL_ENABLED
     dxThreadingThreadPool *thread_pool = new dxThreadingThreadPool();
     if (thread_pool != NULL)
     {
-        if (thread_pool->InitializeThreads(thread_count, stack_size, ode_data_allocate_flags))
+        if (thread_pool->InitializeThreads(thread_count, stack_size, ode_data_allocate_flags, config))
         {
             // do nothing
         }
@@ -799,6 +882,27 @@ void dxThreadingThreadPool::WaitIdleState()
 #endif // #if dBUILTIN_THREADING_IMPL_ENABLED
 }
 
+/*extern */int dThreadingThreadPoolGetThreadStats(dThreadingThreadPoolID pool, unsigned thread_index, 
+                                                  dThreadingThreadPoolThreadStats *out_stats)
+{
+    dAASSERT(out_stats != NULL);
+
+#if dBUILTIN_THREADING_IMPL_ENABLED
+    dxThreadingThreadPool *thread_pool = (dxThreadingThreadPool *)pool;
+    return thread_pool != NULL && thread_pool->GetThreadStats(thread_index, out_stats);
+#else
+    return 0;
+#endif // #if dBUILTIN_THREADING_IMPL_ENABLED
+}
+
+/*extern */void dThreadingThreadPoolResetThreadStats(dThreadingThreadPoolID pool)
+{
+#if dBUILTIN_THREADING_IMPL_ENABLED
+    dxThreadingThreadPool *thread_pool = (dxThreadingThreadPool *)pool;
+    thread_pool->ResetThreadStats();
+#endif // #if dBUILTIN_THREADING_IMPL_ENABLED
+}
+
 /*extern */void dThreadingFreeThreadPool(dThreadingThreadPoolID pool)
 {
 #if dBUILTIN_THREADING_IMPL_ENABLED
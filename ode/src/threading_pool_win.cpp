@@ -126,7 +126,11 @@ public:
     dxThreadPoolThreadInfo();
     ~dxThreadPoolThreadInfo();
 
-    bool Initialize(size_t stack_size, unsigned int ode_data_allocate_flags);
+    bool Initialize(size_t stack_size, unsigned int ode_data_allocate_flags, 
+        const dThreadingThreadPoolConfig *config, int cpu_id);
+
+    const dThreadingThreadPoolThreadStats &GetStats() const { return m_stats; }
+    void ResetStats() { m_stats = dThreadingThreadPoolThreadStats(); }
 
 private:
     bool WaitInitStatus();
@@ -173,6 +177,9 @@ private:
     dxEventObject m_command_event;
     dxEventObject m_acknowledgement_event;
     void        *m_command_param;
+
+    dxThreadServeOptions m_serve_options;
+    dThreadingThreadPoolThreadStats m_stats;
 };
 
 
@@ -182,7 +189,9 @@ m_ode_data_allocate_flags(0),
 m_command_code(dxTHREAD_COMMAND_EXIT),
 m_command_event(),
 m_acknowledgement_event(),
-m_command_param(NULL)
+m_command_param(NULL),
+m_serve_options(),
+m_stats()
 {
 }
 
@@ -192,7 +201,8 @@ dxThreadPoolThreadInfo::~dxThreadPoolThreadInfo()
 }
 
 
-bool dxThreadPoolThreadInfo::Initialize(size_t stack_size, unsigned int ode_data_allocate_flags)
+bool dxThreadPoolThreadInfo::Initialize(size_t stack_size, unsigned int ode_data_allocate_flags, 
+    const dThreadingThreadPoolConfig *config, int cpu_id)
 {
     bool result = false;
 
@@ -202,7 +212,7 @@ bool dxThreadPoolThreadInfo::Initialize(size_t stack_size, unsigned int ode_data
 
     do 
     {
-        if (stack_size > THREAD_STACK_MAX)
+        if (stack_size > THREAD_STACK_MAX || cpu_id >= (int)(sizeof(DWORD_PTR) * 8))
         {
             SetLastError(ERROR_INVALID_PARAMETER);
             break;
@@ -224,6 +234,13 @@ bool dxThreadPoolThreadInfo::Initialize(size_t stack_size, unsigned int ode_data
 
         m_ode_data_allocate_flags = ode_data_allocate_flags;
 
+        if (config != NULL)
+        {
+            m_serve_options.m_spin_count = config->spin_count;
+            m_serve_options.m_keep_hot = config->keep_hot != 0;
+        }
+        m_serve_options.m_stats = &m_stats;
+
         thread_handle = (HANDLE)_beginthreadex(NULL, (unsigned)stack_size, &ThreadProcedure_Callback, (void *)this, 0, NULL);
         if (thread_handle == NULL) // Not a bug!!! _beginthreadex() returns NULL on failure
         {
@@ -242,6 +259,15 @@ bool dxThreadPoolThreadInfo::Initialize(size_t stack_size, unsigned int ode_data
             }
         }
 
+        // The same applies to the affinity
+        if (cpu_id >= 0)
+        {
+            if (!SetThreadAffinityMask(thread_handle, (DWORD_PTR)1 << cpu_id))
+            {
+                // -- The processor may be absent from the process affinity mask. The thread runs wherever the system places it then.
+            }
+        }
+
         bool thread_init_result = WaitInitStatus();
         if (!thread_init_result)
         {
@@ -408,7 +434,7 @@ void dxThreadPoolThreadInfo::RunCommandHandlingLoop()
 
 void dxThreadPoolThreadInfo::ThreadedServeImplementation(dThreadingImplementationID impl, dxEventObject *ready_wait_event)
 {
-    ((dxIThreadingImplementation *)impl)->StickToJobsProcessing(&ProcessThreadServeReadiness_Callback, (void *)ready_wait_event);
+    ((dxIThreadingImplementation *)impl)->StickToJobsProcessing(&ProcessThreadServeReadiness_Callback, (void *)ready_wait_event, &m_serve_options);
 }
 
 void dxThreadPoolThreadInfo::ProcessThreadServeReadiness_Callback(void *context)
@@ -427,21 +453,27 @@ public:
     dxThreadingThreadPool();
     ~dxThreadingThreadPool();
 
-    bool InitializeThreads(size_t thread_count, size_t stack_size, unsigned int ode_data_allocate_flags);
+    bool InitializeThreads(size_t thread_count, size_t stack_size, unsigned int ode_data_allocate_flags, 
+        const dThreadingThreadPoolConfig *config);
 
 private:
     void FinalizeThreads();
 
-    bool InitializeIndividualThreadInfos(dxThreadPoolThreadInfo *thread_infos, size_t thread_count, size_t stack_size, unsigned int ode_data_allocate_flags);
+    bool InitializeIndividualThreadInfos(dxThreadPoolThreadInfo *thread_infos, size_t thread_count, size_t stack_size, unsigned int ode_data_allocate_flags, 
+        const dThreadingThreadPoolConfig *config);
     void FinalizeIndividualThreadInfos(dxThreadPoolThreadInfo *thread_infos, size_t thread_count);
 
-    bool InitializeSingleThreadInfo(dxThreadPoolThreadInfo *thread_info, size_t stack_size, unsigned int ode_data_allocate_flags);
+    bool InitializeSingleThreadInfo(dxThreadPoolThreadInfo *thread_info, size_t stack_size, unsigned int ode_data_allocate_flags, 
+        const dThreadingThreadPoolConfig *config, int cpu_id);
     void FinalizeSingleThreadInfo(dxThreadPoolThreadInfo *thread_info);
 
 public:
     void ServeThreadingImplementation(dThreadingImplementationID impl);
     void WaitIdleState();
 
+    bool GetThreadStats(size_t thread_index, dThreadingThreadPoolThreadStats *out_stats) const;
+    void ResetThreadStats();
+
 private:
     dxThreadPoolThreadInfo  *m_thread_infos;
     size_t                  m_thread_count;
@@ -462,7 +494,8 @@ dxThreadingThreadPool::~dxThreadingThreadPool()
 }
 
 
-bool dxThreadingThreadPool::InitializeThreads(size_t thread_count, size_t stack_size, unsigned int ode_data_allocate_flags)
+bool dxThreadingThreadPool::InitializeThreads(size_t thread_count, size_t stack_size, unsigned int ode_data_allocate_flags, 
+    const dThreadingThreadPoolConfig *config)
 {
     dIASSERT(m_thread_infos == NULL);
 
@@ -490,7 +523,7 @@ bool dxThreadingThreadPool::InitializeThreads(size_t thread_count, size_t stack_
 
         thread_infos_allocated = true;
 
-        if (!InitializeIndividualThreadInfos(thread_infos, thread_count, stack_size, ode_data_allocate_flags))
+        if (!InitializeIndividualThreadInfos(thread_infos, thread_count, stack_size, ode_data_allocate_flags, config))
         {
             break;
         }
@@ -532,14 +565,18 @@ void dxThreadingThreadPool::FinalizeThreads()
 }
 
 
-bool dxThreadingThreadPool::InitializeIndividualThreadInfos(dxThreadPoolThreadInfo *thread_infos, size_t thread_count, size_t stack_size, unsigned int ode_data_allocate_flags)
+bool dxThreadingThreadPool::InitializeIndividualThreadInfos(dxThreadPoolThreadInfo *thread_infos, size_t thread_count, size_t stack_size, unsigned int ode_data_allocate_flags, 
+    const dThreadingThreadPoolConfig *config)
 {
     bool any_fault = false;
 
     dxThreadPoolThreadInfo *const infos_end = thread_infos + thread_count;
     for (dxThreadPoolThreadInfo *current_info = thread_infos; current_info != infos_end; ++current_info)
     {
-        if (!InitializeSingleThreadInfo(current_info, stack_size, ode_data_allocate_flags))
+        const size_t thread_index = current_info - thread_infos;
+        const int cpu_id = config != NULL && config->cpu_count != 0 ? config->cpu_ids[thread_index % config->cpu_count] : -1;
+
+        if (!InitializeSingleThreadInfo(current_info, stack_size, ode_data_allocate_flags, config, cpu_id))
         {
             FinalizeIndividualThreadInfos(thread_infos, current_info - thread_infos);
 
@@ -562,13 +599,14 @@ void dxThreadingThreadPool::FinalizeIndividualThreadInfos(dxThreadPoolThreadInfo
 }
 
 
-bool dxThreadingThreadPool::InitializeSingleThreadInfo(dxThreadPoolThreadInfo *thread_info, size_t stack_size, unsigned int ode_data_allocate_flags)
+bool dxThreadingThreadPool::InitializeSingleThreadInfo(dxThreadPoolThreadInfo *thread_info, size_t stack_size, unsigned int ode_data_allocate_flags, 
+    const dThreadingThreadPoolConfig *config, int cpu_id)
 {
     bool result = false;
 
     new(thread_info) dxThreadPoolThreadInfo();
 
-    if (thread_info->Initialize(stack_size, ode_data_allocate_flags))
+    if (thread_info->Initialize(stack_size, ode_data_allocate_flags, config, cpu_id))
     {
         result = true;
     }
@@ -612,20 +650,50 @@ void dxThreadingThreadPool::WaitIdleState()
     }
 }
 
+bool dxThreadingThreadPool::GetThreadStats(size_t thread_index, dThreadingThreadPoolThreadStats *out_stats) const
+{
+    bool result = false;
+
+    if (thread_index < m_thread_count)
+    {
+        *out_stats = m_thread_infos[thread_index].GetStats();
+        result = true;
+    }
+
+    return result;
+}
+
+void dxThreadingThreadPool::ResetThreadStats()
+{
+    dxThreadPoolThreadInfo *const infos_end = m_thread_infos + m_thread_count;
+    for (dxThreadPoolThreadInfo *current_info = m_thread_infos; current_info != infos_end; ++current_info)
+    {
+        current_info->ResetStats();
+    }
+}
+
 
 #endif // #if dBUILTIN_THREADING_IMPL_ENABLED
 
 
 /*extern */dThreadingThreadPoolID dThreadingAllocateThreadPool(unsigned thread_count, 
                                                                size_t stack_size, unsigned int ode_data_allocate_flags, void *reserved/*=NULL*/)
+{
+    return dThreadingAllocateThreadPoolWithConfig(thread_count, stack_size, ode_data_allocate_flags, NULL);
+}
+
+/*extern */dThreadingThreadPoolID dThreadingAllocateThreadPoolWithConfig(unsigned thread_count, 
+                                                                         size_t stack_size, unsigned int ode_data_allocate_flags, const dThreadingThreadPoolConfig *config)
 {
     dAASSERT(thread_count != 0);
+    dUASSERT(config == NULL || config->struct_size >= sizeof(*config), "Bad thread pool config");
+    dUASSERT(config == NULL || config->cpu_count == 0 || config->cpu_ids != NULL, "CPU ids expected");
 
 #if dBUILTIN_THREADING_IMPL_ENABLED
     dxThreadingThreadPool *thread_pool = new dxThreadingThreadPool();
     if (thread_pool != NULL)
     {
-        if (thread_pool->InitializeThreads(thread_count, stack_size, ode_data_allocate_flags))
+        if (thread_pool->InitializeThreads(thread_count, stack_size, ode_data_allocate_flags, config))
         {
             // do nothing
         }
@@ -658,6 +726,27 @@ void dxThreadingThreadPool::WaitIdleState()
 #endif // #if dBUILTIN_THREADING_IMPL_ENABLED
 }
 
+/*extern */int dThreadingThreadPoolGetThreadStats(dThreadingThreadPoolID pool, unsigned thread_index, 
+                                                  dThreadingThreadPoolThreadStats *out_stats)
+{
+    dAASSERT(out_stats != NULL);
+
+#if dBUILTIN_THREADING_IMPL_ENABLED
+    dxThreadingThreadPool *thread_pool = (dxThreadingThreadPool *)pool;
+    return thread_pool != NULL && thread_pool->GetThreadStats(thread_index, out_stats);
+#else
+    return 0;
+#endif // #if dBUILTIN_THREADING_IMPL_ENABLED
+}
+
+/*extern */void dThreadingThreadPoolResetThreadStats(dThreadingThreadPoolID pool)
+{
+#if dBUILTIN_THREADING_IMPL_ENABLED
+    dxThreadingThreadPool *thread_pool = (dxThreadingThreadPool *)pool;
+    thread_pool->ResetThreadStats();
+#endif // #if dBUILTIN_THREADING_IMPL_ENABLED
+}
+
 /*extern */void dThreadingFreeThreadPool(dThreadingThreadPoolID pool)
 {
 #if dBUILTIN_THREADING_IMPL_ENABLED
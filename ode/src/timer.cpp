@@ -275,6 +275,47 @@ double dStopwatchTime (dStopwatch *s)
     return s->time / dTimerTicksPerSecond();
 }
 
+//****************************************************************************
+// monotonic clock for internal statistics. unlike the functions above, it
+// keeps no global state and is safe to be called from any thread.
+
+#ifdef WIN32
+
+double dxMonotonicTime()
+{
+    static double secondsPerTick = 0.0;
+    if (secondsPerTick == 0.0) {
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency (&frequency);
+        secondsPerTick = 1.0 / (double)frequency.QuadPart;
+    }
+
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter (&counter);
+    return (double)counter.QuadPart * secondsPerTick;
+}
+
+#else // #ifndef WIN32
+
+#include <time.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+double dxMonotonicTime()
+{
+#if defined(_POSIX_TIMERS) && _POSIX_TIMERS > 0 && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1.0e-9;
+#else
+    struct timeval tv;
+    gettimeofday (&tv, 0);
+    return (double)tv.tv_sec + (double)tv.tv_usec * 1.0e-6;
+#endif
+}
+
+#endif // #ifndef WIN32
+
 //****************************************************************************
 // code timers
 
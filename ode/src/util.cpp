@@ -26,6 +26,7 @@
 #include "joints/joint.h"
 #include "util.h"
 #include "odeou.h"
+#include "stepstats.h"
 #include <new>
 
 
@@ -46,6 +47,7 @@ const char *const dxWorldProcessContext::m_aszContextMutexNames[dxPCM__MAX] =
 {
     "Stepper Arena Obtain Lock" , // dxPCM_STEPPER_ARENA_OBTAIN,
     "Stepper StepBody Serialize Lock" , // dxPCM_STEPPER_STEPBODY_SERIALIZE,
+    "Stepper Job Start Lock" , // dxPCM_STEPPER_JOB_START,
 };
 
 dxWorldProcessContext::dxWorldProcessContext():
@@ -206,70 +208,48 @@ dxWorldProcessMemArena *dxWorldProcessContext::ReallocateIslandsMemArena(size_t
 }
 
 bool dxWorldProcessContext::ReallocateStepperMemArenas(
-    dxWorld *world, unsigned nIslandThreadsCount, size_t nMemoryRequirement, 
+    dxWorld *world, unsigned nIslandThreadsCount, const size_t *pnMemoryRequirements, 
     const dxWorldProcessMemoryManager *pmmMemortManager, float fReserveFactor, unsigned uiReserveMinimum)
 {
     dxWorldProcessMemArena *pmaRebuiltArenasHead = NULL, *pmaRebuiltArenasTail = NULL;
-    dxWorldProcessMemArena *pmaExistingArenas = GetStepperArenasList();
-    unsigned nArenasToProcess = nIslandThreadsCount;
+    dxWorldProcessMemArena *pmaExistingArenas = SortArenasListBySize(GetStepperArenasList());
+    unsigned nArenaIndex = 0;
 
     // NOTE!
-    // The list is reallocated in a way to assure the largest arenas are at end 
-    // and if number of threads decreases they will be freed first of all.
-
-    while (true)
+    // The requirements decrease along the list, in the order the arenas are 
+    // obtained by island stepping jobs. Existing arenas are reused largest 
+    // first so that only the head one needs to be large, and if number of 
+    // threads decreases the arenas at the end are freed. The jobs return 
+    // the arenas in the order they complete, so the list has to be sorted 
+    // again or the large arena would drift back and others would grow to 
+    // its size too.
+
+    for (; nArenaIndex != nIslandThreadsCount; ++nArenaIndex)
     {
-        if (nArenasToProcess == 0)
-        {
-            FreeArenasList(pmaExistingArenas);
-            break;
-        }
-
         dxWorldProcessMemArena *pmaOldMemArena = pmaExistingArenas;
 
         if (pmaExistingArenas != NULL)
         {
             pmaExistingArenas = pmaExistingArenas->GetNextMemArena();
         }
-        else
+
+        // The old arena is freed on failure
+        dxWorldProcessMemArena *pmaNewMemArena = dxWorldProcessMemArena::ReallocateMemArena(pmaOldMemArena, pnMemoryRequirements[nArenaIndex], pmmMemortManager, fReserveFactor, uiReserveMinimum);
+        if (pmaNewMemArena == NULL)
         {
-            // If existing arenas ended, terminate and erase tail so that new arenas 
-            // would be appended to list head.
-            if (pmaRebuiltArenasTail != NULL)
-            {
-                pmaRebuiltArenasTail->SetNextMemArena(NULL);
-                pmaRebuiltArenasTail = NULL;
-            }
+            break;
         }
 
-        dxWorldProcessMemArena *pmaNewMemArena = dxWorldProcessMemArena::ReallocateMemArena(pmaOldMemArena, nMemoryRequirement, pmmMemortManager, fReserveFactor, uiReserveMinimum);
-
-        if (pmaNewMemArena != NULL)
+        if (pmaRebuiltArenasTail != NULL)
         {
-            // Append reallocated arenas to list tail while old arenas still exist...
-            if (pmaRebuiltArenasTail != NULL)
-            {
-                pmaRebuiltArenasTail->SetNextMemArena(pmaNewMemArena);
-                pmaRebuiltArenasTail = pmaNewMemArena;
-            }
-            else if (pmaRebuiltArenasHead == NULL)
-            {
-                pmaRebuiltArenasHead = pmaNewMemArena;
-                pmaRebuiltArenasTail = pmaNewMemArena;
-            }
-            // ...and append them to list head if those are additional arenas created
-            else
-            {
-                pmaNewMemArena->SetNextMemArena(pmaRebuiltArenasHead);
-                pmaRebuiltArenasHead = pmaNewMemArena;
-            }
-
-            --nArenasToProcess;
+            pmaRebuiltArenasTail->SetNextMemArena(pmaNewMemArena);
         }
-        else if (pmaOldMemArena == NULL)
+        else
         {
-            break;
+            pmaRebuiltArenasHead = pmaNewMemArena;
         }
+
+        pmaRebuiltArenasTail = pmaNewMemArena;
     }
 
     if (pmaRebuiltArenasTail != NULL)
@@ -277,12 +257,47 @@ bool dxWorldProcessContext::ReallocateStepperMemArenas(
         pmaRebuiltArenasTail->SetNextMemArena(NULL);
     }
 
+    FreeArenasList(pmaExistingArenas);
+
     SetStepperArenasList(pmaRebuiltArenasHead);
 
-    bool bResult = nArenasToProcess == 0;
+    bool bResult = nArenaIndex == nIslandThreadsCount;
     return bResult;
 }
 
+dxWorldProcessMemArena *dxWorldProcessContext::SortArenasListBySize(dxWorldProcessMemArena *pmaExistingArenas)
+{
+    // Insertion sort, the list has an arena per island thread only
+    dxWorldProcessMemArena *pmaSortedArenasHead = NULL;
+
+    while (pmaExistingArenas != NULL)
+    {
+        dxWorldProcessMemArena *pmaCurrentMemArena = pmaExistingArenas;
+        pmaExistingArenas = pmaExistingArenas->GetNextMemArena();
+
+        size_t nCurrentSize = pmaCurrentMemArena->GetMemorySize();
+        dxWorldProcessMemArena *pmaPreviousMemArena = NULL, *pmaNextMemArena = pmaSortedArenasHead;
+        while (pmaNextMemArena != NULL && pmaNextMemArena->GetMemorySize() >= nCurrentSize)
+        {
+            pmaPreviousMemArena = pmaNextMemArena;
+            pmaNextMemArena = pmaNextMemArena->GetNextMemArena();
+        }
+
+        pmaCurrentMemArena->SetNextMemArena(pmaNextMemArena);
+
+        if (pmaPreviousMemArena != NULL)
+        {
+            pmaPreviousMemArena->SetNextMemArena(pmaCurrentMemArena);
+        }
+        else
+        {
+            pmaSortedArenasHead = pmaCurrentMemArena;
+        }
+    }
+
+    return pmaSortedArenasHead;
+}
+
 void dxWorldProcessContext::FreeArenasList(dxWorldProcessMemArena *pmaExistingArenas)
 {
     while (pmaExistingArenas != NULL)
@@ -321,6 +336,16 @@ void dxWorldProcessContext::UnlockForStepbodySerialization()
     m_pswObjectsAllocWorld->UnlockMutexGroupMutex(m_pmgStepperMutexGroup, dxPCM_STEPPER_STEPBODY_SERIALIZE);
 }
 
+void dxWorldProcessContext::LockForStepperJobStart()
+{
+    m_pswObjectsAllocWorld->LockMutexGroupMutex(m_pmgStepperMutexGroup, dxPCM_STEPPER_JOB_START);
+}
+
+void dxWorldProcessContext::UnlockForStepperJobStart()
+{
+    m_pswObjectsAllocWorld->UnlockMutexGroupMutex(m_pmgStepperMutexGroup, dxPCM_STEPPER_JOB_START);
+}
+
 
 //****************************************************************************
 // Threading call contexts
@@ -330,7 +355,7 @@ struct dxStepperCallContext;
 struct dxIslandsProcessingCallContext
 {
     dxIslandsProcessingCallContext(dxWorld *world, const dxWorldProcessIslandsInfo &islandsInfo, dReal stepSize, dstepper_fn_t stepper):
-        m_world(world), m_islandsInfo(islandsInfo), m_stepSize(stepSize), m_stepper(stepper),
+        m_world(world), m_islandsInfo(islandsInfo), m_stepSize(stepSize), m_stepper(stepper), m_stepStats(world->stepstats),
         m_groupReleasee(NULL), m_islandToProcessStorage(0)
     {
     }
@@ -345,6 +370,7 @@ struct dxIslandsProcessingCallContext
 
     static int ThreadedProcessIslandSearch_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee);
     void ThreadedProcessIslandSearch(dxStepperCallContext *stepperCallContext);
+    void ProcessIslandSelection(dxStepperCallContext *stepperCallContext, size_t islandToProcess);
 
     static int ThreadedProcessIslandStepper_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee);
     void ThreadedProcessIslandStepper(dxStepperCallContext *stepperCallContext);
@@ -355,6 +381,7 @@ struct dxIslandsProcessingCallContext
     const dxWorldProcessIslandsInfo &m_islandsInfo;
     dReal const m_stepSize;
     dstepper_fn_t const m_stepper;
+    dxStepStats *const m_stepStats;
     dCallReleaseeID m_groupReleasee;
     volatile size_t m_islandToProcessStorage;
 };
@@ -362,33 +389,30 @@ struct dxIslandsProcessingCallContext
 struct dxStepperCallContext
 {
     dxStepperCallContext(dxIslandsProcessingCallContext *islandsProcessingContext, dxWorldProcessMemArena *stepperArena, 
-        size_t islandIndex, dxBody *const *islandBodiesStart, dxJoint *const *islandJointsStart):
-        m_islandsProcessingContext(islandsProcessingContext), m_stepperArena(stepperArena),
-        m_islandIndex(islandIndex), m_islandBodiesStart(islandBodiesStart), m_islandJointsStart(islandJointsStart),
-        m_islandBodiesCount(0), m_islandJointsCount(0)
+        dxStepStatsThreadSlot *statsSlot):
+        m_islandsProcessingContext(islandsProcessingContext), m_stepperArena(stepperArena), m_statsSlot(statsSlot),
+        m_islandBodiesStart(NULL), m_islandJointsStart(NULL),
+        m_islandBodiesCount(0), m_islandJointsCount(0), m_islandsBatched(0)
     {
     }
 
-    void AssignIslandSearchProgress(size_t islandIndex)
-    {
-        m_islandIndex = islandIndex; 
-    }
-
-    void AssignIslandSelection(dxBody *const *islandBodiesStart, dxJoint *const *islandJointsStart, unsigned islandBodiesCount, unsigned islandJointsCount)
+    void AssignIslandSelection(dxBody *const *islandBodiesStart, dxJoint *const *islandJointsStart, unsigned islandBodiesCount, unsigned islandJointsCount, unsigned islandsBatched)
     {
         m_islandBodiesStart = islandBodiesStart;
         m_islandJointsStart = islandJointsStart;
         m_islandBodiesCount = islandBodiesCount;
         m_islandJointsCount = islandJointsCount;
+        m_islandsBatched = islandsBatched;
     }
 
     dxIslandsProcessingCallContext  *m_islandsProcessingContext;
     dxWorldProcessMemArena          *m_stepperArena;
-    size_t                          m_islandIndex;
+    dxStepStatsThreadSlot           *m_statsSlot;
     dxBody *const                   *m_islandBodiesStart;
     dxJoint *const                  *m_islandJointsStart;
     unsigned                        m_islandBodiesCount;
     unsigned                        m_islandJointsCount;
+    unsigned                        m_islandsBatched;
 };
 
 
@@ -396,11 +420,56 @@ struct dxStepperCallContext
 //****************************************************************************
 // Auto disabling
 
+// With islands disabled as a whole, only the idle countdowns of the bodies are
+// maintained, from the instantaneous velocities. The islands are put to sleep
+// when they are built.
+static void HandleIslandAutoDisabling (dxWorld *world, dReal stepsize)
+{
+    for ( int i=0; i != world->active_bodies.size(); ++i )
+    {
+        dxBody *bb = world->active_bodies[i];
+        if ( !(bb->flags & dxBodyAutoDisable) ) continue;
+
+        if ( dCalcVectorLengthSquare3( bb->lvel ) <= bb->adis.linear_average_threshold
+            && dCalcVectorLengthSquare3( bb->avel ) <= bb->adis.angular_average_threshold )
+        {
+            // stop at zero for the countdowns not to overflow in islands that stay awake
+            if ( bb->adis_stepsleft > 0 ) bb->adis_stepsleft--;
+            if ( bb->adis_timeleft > 0 ) bb->adis_timeleft -= stepsize;
+        }
+        else
+        {
+            bb->adis_stepsleft = bb->adis.idle_steps;
+            bb->adis_timeleft = bb->adis.idle_time;
+        }
+    }
+}
+
+static bool IsIslandIdle (dxBody *const *bodies, unsigned int bcount)
+{
+    for ( unsigned int i = 0; i != bcount; ++i )
+    {
+        const dxBody *b = bodies[i];
+        if ( (b->flags & dxBodyAutoDisable) == 0 || b->adis.average_samples == 0
+            || b->adis_stepsleft > 0 || b->adis_timeleft > 0 ) return false;
+    }
+    return true;
+}
+
 void dInternalHandleAutoDisabling (dxWorld *world, dReal stepsize)
 {
-    dxBody *bb;
-    for ( bb=world->firstbody; bb; bb=(dxBody*)bb->next )
+    if ( world->adis_mode == dAutoDisableIslands )
     {
+        HandleIslandAutoDisabling (world, stepsize);
+        return;
+    }
+
+    // only the active bodies can be disabled. walk the set backwards, as
+    // disabling a body moves the last one in its place.
+    for ( int i=world->active_bodies.size(); i-- != 0; )
+    {
+        dxBody *bb = world->active_bodies[i];
+
         // don't freeze objects mid-air (patch 1586738)
         if ( bb->firstjoint == NULL ) continue;
 
@@ -518,7 +587,7 @@ void dInternalHandleAutoDisabling (dxWorld *world, dReal stepsize)
         // disable the body if it's idle for a long enough time
         if ( bb->adis_stepsleft <= 0 && bb->adis_timeleft <= 0 )
         {
-            bb->flags |= dxBodyDisabled; // set the disable flag
+            world->disableBody(bb); // set the disable flag
 
             // disabling bodies should also include resetting the velocity
             // should prevent jittering in big "islands"
@@ -630,6 +699,7 @@ void dxStepBody (dxBody *b, dReal h)
     // normalize the quaternion and convert it to a rotation matrix
     dNormalize4 (b->q);
     dQtoR (b->q,b->posr.R);
+    b->flags |= dxBodyStateChanged;
 
     // notify all attached geoms that this body has moved
     dxWorldProcessContext *world_process_context = b->world->UnsafeGetWorldProcessingContext(); 
@@ -667,20 +737,88 @@ void dxStepBody (dxBody *b, dReal h)
 //****************************************************************************
 // island processing
 
+// An islandsizes entry describes a unit of work for the stepper: an island,
+// or a run of tiny islands that follow each other in the body and joint
+// arrays and are stepped together.
 enum dxISLANDSIZESELEMENT
 {
     dxISE_BODIES_COUNT,
     dxISE_JOINTS_COUNT,
+    dxISE_BODIES_START,     // offset in the island bodies array
+    dxISE_JOINTS_START,     // offset in the island joints array
+    dxISE_ROWS_COUNT,       // maximal constraint rows, from getSureMaxInfo()
+    dxISE_ISLANDS_COUNT,    // number of islands batched in the entry
 
     dxISE__MAX,
 };
 
+// Islands that cost no more than this are batched with their neighbours,
+// as long as the batch stays within the body and row limits. The limits
+// keep the dense LCP of dWorldStep() on a batch small.
+#define dxISLAND_TINY_COST          8
+#define dxISLAND_BATCH_MAX_BODIES   32
+#define dxISLAND_BATCH_MAX_ROWS     48
+
+// The estimated stepping cost of an island, rows x bodies
+static inline size_t EstimateIslandCost(const unsigned int *islandsize)
+{
+    return ((size_t)islandsize[dxISE_ROWS_COUNT] + 1) * islandsize[dxISE_BODIES_COUNT];
+}
+
+static int CompareIslandCosts(const void *a, const void *b)
+{
+    const unsigned int *islanda = (const unsigned int *)a, *islandb = (const unsigned int *)b;
+    size_t costa = EstimateIslandCost(islanda), costb = EstimateIslandCost(islandb);
+    if (costa != costb) return costa > costb ? -1 : 1;
+    // keep the discovery order among equals for the results to be reproducible
+    return islanda[dxISE_BODIES_START] < islandb[dxISE_BODIES_START] ? -1 : 1;
+}
+
+// Merges runs of tiny islands into batches (the steppers do not require the
+// bodies to be connected) and orders the work from the most expensive to the
+// cheapest, so that a big island discovered late does not keep one thread
+// busy after all the others ran out of work. Returns the number of entries.
+static size_t BatchAndSortIslands(unsigned int *islandsizes, size_t islandcount)
+{
+    size_t entrycount = 0;
+    unsigned int *batch = NULL;
+
+    for (size_t i = 0; i != islandcount; ++i) {
+        unsigned int island[dxISE__MAX];
+        memcpy(island, islandsizes + i * dxISE__MAX, sizeof(island));
+        const bool tiny = EstimateIslandCost(island) <= dxISLAND_TINY_COST;
+
+        if (tiny && batch != NULL
+            && batch[dxISE_BODIES_COUNT] + island[dxISE_BODIES_COUNT] <= dxISLAND_BATCH_MAX_BODIES
+            && batch[dxISE_ROWS_COUNT] + island[dxISE_ROWS_COUNT] <= dxISLAND_BATCH_MAX_ROWS) {
+            // the island directly follows the batch in the arrays
+            dIASSERT(batch[dxISE_BODIES_START] + batch[dxISE_BODIES_COUNT] == island[dxISE_BODIES_START]);
+            batch[dxISE_BODIES_COUNT] += island[dxISE_BODIES_COUNT];
+            batch[dxISE_JOINTS_COUNT] += island[dxISE_JOINTS_COUNT];
+            batch[dxISE_ROWS_COUNT] += island[dxISE_ROWS_COUNT];
+            batch[dxISE_ISLANDS_COUNT] += 1;
+            continue;
+        }
+
+        unsigned int *entry = islandsizes + entrycount * dxISE__MAX;
+        memcpy(entry, island, sizeof(island));
+        batch = tiny ? entry : NULL;
+        ++entrycount;
+    }
+
+    qsort(islandsizes, entrycount, dxISE__MAX * sizeof(unsigned int), &CompareIslandCosts);
+    return entrycount;
+}
+
 // This estimates dynamic memory requirements for dxProcessIslands
-static size_t EstimateIslandProcessingMemoryRequirements(dxWorld *world)
+static size_t EstimateIslandProcessingMemoryRequirements(dxWorld *world, unsigned islandthreadscount)
 {
     size_t res = 0;
 
-    size_t islandcounts = dEFFICIENT_SIZE((size_t)(unsigned)world->nb * 2 * sizeof(int));
+    size_t arenareqs = dEFFICIENT_SIZE((size_t)islandthreadscount * sizeof(size_t));
+    res += arenareqs;
+
+    size_t islandcounts = dEFFICIENT_SIZE((size_t)(unsigned)world->nb * dxISE__MAX * sizeof(int));
     res += islandcounts;
 
     size_t bodiessize = dEFFICIENT_SIZE((size_t)(unsigned)world->nb * sizeof(dxBody*));
@@ -693,24 +831,36 @@ static size_t EstimateIslandProcessingMemoryRequirements(dxWorld *world)
     return res;
 }
 
-static size_t BuildIslandsAndEstimateStepperMemoryRequirements(
+// The stepper memory requirements are returned in arenareqs, for each of
+// the arenacount arenas in the order the island stepping jobs obtain them.
+static void BuildIslandsAndEstimateStepperMemoryRequirements(
     dxWorldProcessIslandsInfo &islandsinfo, dxWorldProcessMemArena *memarena, 
-    dxWorld *world, dReal stepsize, dmemestimate_fn_t stepperestimate)
+    dxWorld *world, dReal stepsize, dmemestimate_fn_t stepperestimate,
+    size_t *arenareqs, unsigned arenacount)
 {
-    size_t maxreq = 0;
+    dxStepStats *stepstats = world->stepstats;
+    double autodisablestart = stepstats != NULL ? dxMonotonicTime() : 0.0;
 
     // handle auto-disabling of bodies
     dInternalHandleAutoDisabling (world,stepsize);
 
+    double islandbuildstart = 0.0;
+    if (stepstats != NULL) {
+        islandbuildstart = dxMonotonicTime();
+        stepstats->AccumulatePhaseTime(dStepPhaseAutoDisable, islandbuildstart - autodisablestart);
+    }
+
     unsigned int nb = world->nb, nj = world->nj;
     // Make array for island body/joint counts
-    unsigned int *islandsizes = memarena->AllocateArray<unsigned int>(2 * (size_t)nb);
+    unsigned int *islandsizes = memarena->AllocateArray<unsigned int>(dxISE__MAX * (size_t)nb);
     unsigned int *sizescurr;
 
     // make arrays for body and joint lists (for a single island) to go into
     dxBody **body = memarena->AllocateArray<dxBody *>(nb);
     dxJoint **joint = memarena->AllocateArray<dxJoint *>(nj);
 
+    unsigned int sleepingbodies = 0;
+
     BEGIN_STATE_SAVE(memarena, stackstate) {
         // allocate a stack of unvisited bodies in the island. the maximum size of
         // the stack can be the lesser of the number of bodies or joints, because
@@ -719,16 +869,42 @@ static size_t BuildIslandsAndEstimateStepperMemoryRequirements(
         unsigned int stackalloc = (nj < nb) ? nj : nb;
         dxBody **stack = memarena->AllocateArray<dxBody *>(stackalloc);
 
+        dArray<dxBody *> &active = world->active_bodies;
+
         {
-            // set all body/joint tags to 0
-            for (dxBody *b=world->firstbody; b; b=(dxBody*)b->next) b->tag = 0;
-            for (dxJoint *j=world->firstjoint; j; j=(dxJoint*)j->next) j->tag = 0;
+            // enable the disabled bodies attached to active ones by enabled
+            // joints. This is how auto-enable works. The bodies enabled are
+            // appended to the set, so their neighbours are visited as well.
+            for (int i = 0; i != active.size(); ++i) {
+                for (dxJointNode *n=active[i]->firstjoint; n; n=n->next) {
+                    dxBody *nbody = n->body;
+                    if (nbody && (nbody->flags & dxBodyDisabled) && n->joint->isEnabled()) {
+                        world->enableBody(nbody);
+                    }
+                }
+            }
+        }
+
+        {
+            // set the tags of the active bodies, their joints and their
+            // neighbours to 0. Nothing else is visited below.
+            for (int i = 0; i != active.size(); ++i) {
+                dxBody *b = active[i];
+                b->tag = 0;
+                for (dxJointNode *n=b->firstjoint; n; n=n->next) {
+                    n->joint->tag = 0;
+                    if (n->body) n->body->tag = 0;
+                }
+            }
         }
 
         sizescurr = islandsizes;
         dxBody **bodystart = body;
         dxJoint **jointstart = joint;
-        for (dxBody *bb=world->firstbody; bb; bb=(dxBody*)bb->next) {
+        // the most recently enabled bodies are visited first, like the world
+        // body list does with the most recently created ones
+        for (int i = active.size(); i-- != 0; ) {
+            dxBody *bb = active[i];
             // get bb = the next enabled, untagged body, and tag it
             if (!bb->tag) {
                 if (!(bb->flags & dxBodyDisabled)) {
@@ -736,6 +912,7 @@ static size_t BuildIslandsAndEstimateStepperMemoryRequirements(
 
                     dxBody **bodycurr = bodystart;
                     dxJoint **jointcurr = jointstart;
+                    unsigned int rcount = 0;
 
                     // tag all bodies and joints starting from bb.
                     *bodycurr++ = bb;
@@ -753,12 +930,15 @@ static size_t BuildIslandsAndEstimateStepperMemoryRequirements(
                                     njoint->tag = 1;
                                     *jointcurr++ = njoint;
 
+                                    dxJoint::SureMaxInfo jinfo;
+                                    njoint->getSureMaxInfo(&jinfo);
+                                    rcount += jinfo.max_m;
+
                                     dxBody *nbody = n->body;
-                                    // Body disabled flag is not checked here. This is how auto-enable works.
                                     if (nbody && nbody->tag <= 0) {
                                         nbody->tag = 1;
-                                        // Make sure all bodies are in the enabled state.
-                                        nbody->flags &= ~dxBodyDisabled;
+                                        // Bodies attached by enabled joints have been enabled above.
+                                        dIASSERT(!(nbody->flags & dxBodyDisabled));
                                         stack[stacksize++] = nbody;
                                     }
                                 } else {
@@ -782,12 +962,29 @@ static size_t BuildIslandsAndEstimateStepperMemoryRequirements(
                     dIASSERT((size_t)(bodycurr - bodystart) <= (size_t)UINT_MAX);
                     dIASSERT((size_t)(jointcurr - jointstart) <= (size_t)UINT_MAX);
 
+                    // don't freeze objects mid-air (patch 1586738)
+                    if (world->adis_mode == dAutoDisableIslands && jcount != 0 && IsIslandIdle(bodystart, bcount)) {
+                        // Link the bodies into a ring to be woken up together,
+                        // and drop the island. The bodies are disabled below,
+                        // once the active set is not being walked.
+                        for (unsigned int k = 0; k != bcount; ++k) {
+                            bodystart[k]->sleep_next = bodystart[k + 1 != bcount ? k + 1 : 0];
+                        }
+                        sleepingbodies += bcount;
+                        continue;
+                    }
+
                     sizescurr[dxISE_BODIES_COUNT] = bcount;
                     sizescurr[dxISE_JOINTS_COUNT] = jcount;
+                    sizescurr[dxISE_BODIES_START] = (unsigned int)(bodystart - body);
+                    sizescurr[dxISE_JOINTS_START] = (unsigned int)(jointstart - joint);
+                    sizescurr[dxISE_ROWS_COUNT] = rcount;
+                    sizescurr[dxISE_ISLANDS_COUNT] = 1;
                     sizescurr += dxISE__MAX;
 
-                    size_t islandreq = stepperestimate(bodystart, bcount, jointstart, jcount);
-                    maxreq = (maxreq > islandreq) ? maxreq : islandreq;
+                    if (stepstats != NULL) {
+                        stepstats->AccumulateIsland(bcount, jcount);
+                    }
 
                     bodystart = bodycurr;
                     jointstart = jointcurr;
@@ -799,36 +996,68 @@ static size_t BuildIslandsAndEstimateStepperMemoryRequirements(
     } END_STATE_SAVE(memarena, stackstate);
 
 # ifndef dNODEBUG
-    // if debugging, check that all objects (except for disabled bodies,
-    // unconnected joints, and joints that are connected to disabled bodies)
-    // were tagged.
+    // if debugging, check that all active bodies and their enabled joints
+    // were tagged, and that their disabled joints and neighbours were not.
+    // Objects away from the active bodies are not looked at.
     {
-        for (dxBody *b=world->firstbody; b; b=(dxBody*)b->next) {
-            if (b->flags & dxBodyDisabled) {
-                if (b->tag > 0) dDebug (0,"disabled body tagged");
-            }
-            else {
-                if (b->tag <= 0) dDebug (0,"enabled body not tagged");
+        for (int i = 0; i != world->active_bodies.size(); ++i) {
+            dxBody *b = world->active_bodies[i];
+            if (b->tag <= 0) dDebug (0,"enabled body not tagged");
+            for (dxJointNode *n=b->firstjoint; n; n=n->next) {
+                if (n->joint->isEnabled()) {
+                    if (n->joint->tag <= 0) dDebug (0,"attached enabled joint not tagged");
+                }
+                else {
+                    if (n->joint->tag > 0) dDebug (0,"unattached or disabled joint tagged");
+                }
+                if (n->body && (n->body->flags & dxBodyDisabled) && n->body->tag > 0) {
+                    dDebug (0,"disabled body tagged");
+                }
             }
         }
-        for (dxJoint *j=world->firstjoint; j; j=(dxJoint*)j->next) {
-            if ( (( j->node[0].body && (j->node[0].body->flags & dxBodyDisabled)==0 ) ||
-                (j->node[1].body && (j->node[1].body->flags & dxBodyDisabled)==0) )
-                && 
-                j->isEnabled() ) {
-                    if (j->tag <= 0) dDebug (0,"attached enabled joint not tagged");
-            }
-            else {
-                if (j->tag > 0) dDebug (0,"unattached or disabled joint tagged");
+    }
+# endif
+
+    if (sleepingbodies != 0) {
+        // disable the bodies of the islands that fell asleep. Walk the set
+        // backwards, as disabling a body moves the last one in its place.
+        dArray<dxBody *> &active = world->active_bodies;
+        for (int i = active.size(); i-- != 0 && sleepingbodies != 0; ) {
+            dxBody *b = active[i];
+            if (b->sleep_next != NULL) {
+                --sleepingbodies;
+                world->disableBody(b);
+                dSetZero(b->lvel, 3);
+                dSetZero(b->avel, 3);
             }
         }
     }
-# endif
 
     size_t islandcount = ((size_t)(sizescurr - islandsizes) / dxISE__MAX);
-    islandsinfo.AssignInfo(islandcount, islandsizes, body, joint);
+    size_t entrycount = BatchAndSortIslands(islandsizes, islandcount);
+
+    // Each job takes its first entry together with its arena, and the entries
+    // are handed out in order, so the n-th arena never gets an entry before
+    // the n-th one. It only needs to fit the entries from there on.
+    size_t maxreq = 0;
+    for (size_t i = entrycount; i-- != 0; ) {
+        const unsigned int *entry = islandsizes + i * dxISE__MAX;
+        size_t islandreq = stepperestimate(body + entry[dxISE_BODIES_START], entry[dxISE_BODIES_COUNT], 
+            joint + entry[dxISE_JOINTS_START], entry[dxISE_JOINTS_COUNT]);
+        maxreq = (maxreq > islandreq) ? maxreq : islandreq;
+        if (i < arenacount) {
+            arenareqs[i] = maxreq;
+        }
+    }
+    for (size_t i = entrycount; i < arenacount; ++i) {
+        arenareqs[i] = 0;
+    }
 
-    return maxreq;
+    islandsinfo.AssignInfo(entrycount, islandsizes, body, joint);
+
+    if (stepstats != NULL) {
+        stepstats->AccumulatePhaseTime(dStepPhaseIslandBuild, dxMonotonicTime() - islandbuildstart);
+    }
 }
 
 static unsigned EstimateIslandProcessingSimultaneousCallsMaximumCount(unsigned allowedThreadCount, unsigned activeThreadCount)
@@ -877,6 +1106,15 @@ bool dxProcessIslands (dxWorld *world, const dxWorldProcessIslandsInfo &islandsI
             break;
         }
 
+        dxStepStats *stepStats = callContext.m_stepStats;
+        if (stepStats != NULL) {
+            if (!stepStats->PrepareThreadSlots(allowedThreadCount)) {
+                break;
+            }
+
+            stepStats->BeginIslandsProcessing();
+        }
+
         dCallReleaseeID groupReleasee;
         // First post a group call with dependency count set to number of expected threads
         world->PostThreadedCall(&summaryFault, &groupReleasee, allowedThreadCount, NULL, pcwGroupCallWait, 
@@ -891,6 +1129,10 @@ bool dxProcessIslands (dxWorld *world, const dxWorldProcessIslandsInfo &islandsI
         // Wait until group completes (since jobs were the dependencies of the group the group is going to complete only after all the jobs end)
         world->WaitThreadedCallExclusively(NULL, pcwGroupCallWait, NULL, "World Islands Stepping Wait");
 
+        if (stepStats != NULL) {
+            stepStats->EndIslandsProcessing();
+        }
+
         if (summaryFault != 0) {
             break;
         }
@@ -924,21 +1166,22 @@ void dxIslandsProcessingCallContext::ThreadedProcessJobStart()
 {
     dxWorldProcessContext *context = m_world->UnsafeGetWorldProcessingContext(); 
 
+    // The arenas are sized for the islands in the order they are handed out
+    // (see BuildIslandsAndEstimateStepperMemoryRequirements), which requires 
+    // the first island to be taken together with the arena.
+    context->LockForStepperJobStart();
     dxWorldProcessMemArena *stepperArena = context->ObtainStepperMemArena();
-    dIASSERT(stepperArena != NULL && stepperArena->IsStructureValid());
+    size_t islandToProcess = ObtainNextIslandToBeProcessed(m_islandsInfo.GetIslandsCount());
+    context->UnlockForStepperJobStart();
 
-    const dxWorldProcessIslandsInfo &islandsInfo = m_islandsInfo;
-    dxBody *const *islandBodiesStart = islandsInfo.GetBodiesArray();
-    dxJoint *const *islandJointsStart = islandsInfo.GetJointsArray();
+    dIASSERT(stepperArena != NULL && stepperArena->IsStructureValid());
 
-    size_t islandIndex = 0;
+    dxStepStatsThreadSlot *statsSlot = m_stepStats != NULL ? m_stepStats->ObtainThreadSlot() : NULL;
 
     dxStepperCallContext *stepperCallContext = (dxStepperCallContext *)stepperArena->AllocateBlock(sizeof(dxStepperCallContext));
-    new(stepperCallContext) dxStepperCallContext(this, stepperArena, islandIndex, islandBodiesStart, islandJointsStart);
+    new(stepperCallContext) dxStepperCallContext(this, stepperArena, statsSlot);
 
-    // Summary fault flag may be omitted as any failures will automatically propagate to dependent releasee (i.e. to m_groupReleasee)
-    m_world->PostThreadedCallForUnawareReleasee(NULL, NULL, 0, m_groupReleasee, NULL, 
-        &dxIslandsProcessingCallContext::ThreadedProcessIslandSearch_Callback, (void *)stepperCallContext, 0, "World Islands Stepping Selection");
+    ProcessIslandSelection(stepperCallContext, islandToProcess);
 }
 
 int dxIslandsProcessingCallContext::ThreadedProcessIslandSearch_Callback(void *callContext, dcallindex_t callInstanceIndex, dCallReleaseeID callThisReleasee)
@@ -949,6 +1192,12 @@ int dxIslandsProcessingCallContext::ThreadedProcessIslandSearch_Callback(void *c
 }
 
 void dxIslandsProcessingCallContext::ThreadedProcessIslandSearch(dxStepperCallContext *stepperCallContext)
+{
+    size_t islandToProcess = ObtainNextIslandToBeProcessed(m_islandsInfo.GetIslandsCount());
+    ProcessIslandSelection(stepperCallContext, islandToProcess);
+}
+
+void dxIslandsProcessingCallContext::ProcessIslandSelection(dxStepperCallContext *stepperCallContext, size_t islandToProcess)
 {
     bool finalizeJob = false;
 
@@ -956,41 +1205,22 @@ void dxIslandsProcessingCallContext::ThreadedProcessIslandSearch(dxStepperCallCo
     unsigned int const *islandSizes = islandsInfo.GetIslandSizes();
 
     const size_t islandsCount = islandsInfo.GetIslandsCount();
-    size_t islandToProcess = ObtainNextIslandToBeProcessed(islandsCount);
 
     if (islandToProcess != islandsCount) {
-        // First time, the counts are zeros and on next passes, adding counts will skip island that has just been processed by stepper
-        dxBody *const *islandBodiesStart = stepperCallContext->m_islandBodiesStart + stepperCallContext->m_islandBodiesCount;
-        dxJoint *const *islandJointsStart = stepperCallContext->m_islandJointsStart + stepperCallContext->m_islandJointsCount;
-        size_t islandIndex = stepperCallContext->m_islandIndex;
-
-        for (; ; ++islandIndex) {
-            unsigned int bcount = islandSizes[islandIndex * dxISE__MAX + dxISE_BODIES_COUNT];
-            unsigned int jcount = islandSizes[islandIndex * dxISE__MAX + dxISE_JOINTS_COUNT];
+        // Store selected island details
+        const unsigned int *islandSize = islandSizes + islandToProcess * dxISE__MAX;
+        stepperCallContext->AssignIslandSelection(
+            islandsInfo.GetBodiesArray() + islandSize[dxISE_BODIES_START], islandsInfo.GetJointsArray() + islandSize[dxISE_JOINTS_START], 
+            islandSize[dxISE_BODIES_COUNT], islandSize[dxISE_JOINTS_COUNT], islandSize[dxISE_ISLANDS_COUNT]);
 
-            if (islandIndex == islandToProcess) {
-                // Store selected island details
-                stepperCallContext->AssignIslandSelection(islandBodiesStart, islandJointsStart, bcount, jcount);
+        dCallReleaseeID nextSearchReleasee;
 
-                // Store next island index to continue search from
-                ++islandIndex;
-                stepperCallContext->AssignIslandSearchProgress(islandIndex);
+        // Summary fault flag may be omitted as any failures will automatically propagate to dependent releasee (i.e. to m_groupReleasee)
+        m_world->PostThreadedCallForUnawareReleasee(NULL, &nextSearchReleasee, 1, m_groupReleasee, NULL, 
+            &dxIslandsProcessingCallContext::ThreadedProcessIslandSearch_Callback, (void *)stepperCallContext, 0, "World Islands Stepping Selection");
 
-                dCallReleaseeID nextSearchReleasee;
-
-                // Summary fault flag may be omitted as any failures will automatically propagate to dependent releasee (i.e. to m_groupReleasee)
-                m_world->PostThreadedCallForUnawareReleasee(NULL, &nextSearchReleasee, 1, m_groupReleasee, NULL, 
-                    &dxIslandsProcessingCallContext::ThreadedProcessIslandSearch_Callback, (void *)stepperCallContext, 0, "World Islands Stepping Selection");
-
-                m_world->PostThreadedCall(NULL, NULL, 0, nextSearchReleasee, NULL, 
-                    &dxIslandsProcessingCallContext::ThreadedProcessIslandStepper_Callback, (void *)stepperCallContext, 0, "Island Stepping Job Start");
-
-                break;
-            }
-
-            islandBodiesStart += bcount;
-            islandJointsStart += jcount;
-        }
+        m_world->PostThreadedCall(NULL, NULL, 0, nextSearchReleasee, NULL, 
+            &dxIslandsProcessingCallContext::ThreadedProcessIslandStepper_Callback, (void *)stepperCallContext, 0, "Island Stepping Job Start");
     }
     else {
         finalizeJob = true;
@@ -1019,10 +1249,18 @@ void dxIslandsProcessingCallContext::ThreadedProcessIslandStepper(dxStepperCallC
     unsigned islandBodiesCount = stepperCallContext->m_islandBodiesCount;
     unsigned islandJointsCount = stepperCallContext->m_islandJointsCount;
 
+    dxStepStatsThreadSlot *statsSlot = stepperCallContext->m_statsSlot;
+    double stepperStartTime = statsSlot != NULL ? dxMonotonicTime() : 0.0;
+
     dxWorldProcessMemArena *stepperArena = stepperCallContext->m_stepperArena;
     BEGIN_STATE_SAVE(stepperArena, stepperState) {
-        m_stepper(stepperArena, m_world, islandBodiesStart, islandBodiesCount, islandJointsStart, islandJointsCount, m_stepSize);
+        m_stepper(stepperArena, m_world, islandBodiesStart, islandBodiesCount, islandJointsStart, islandJointsCount, m_stepSize, statsSlot);
     } END_STATE_SAVE(stepperArena, stepperState);
+
+    if (statsSlot != NULL) {
+        statsSlot->m_busyTime += dxMonotonicTime() - stepperStartTime;
+        statsSlot->m_islandCount += stepperCallContext->m_islandsBatched;
+    }
 }
 
 size_t dxIslandsProcessingCallContext::ObtainNextIslandToBeProcessed(size_t islandsCount)
@@ -1162,7 +1400,9 @@ bool dxReallocateWorldProcessContext (dxWorld *world, dxWorldProcessIslandsInfo
         const dxWorldProcessMemoryReserveInfo *reserveInfo = wmem->SureGetMemoryReserveInfo();
         const dxWorldProcessMemoryManager *memmgr = wmem->SureGetMemoryManager();
 
-        size_t islandsReq = EstimateIslandProcessingMemoryRequirements(world);
+        unsigned islandThreadsCount = world->GetThreadingIslandsMaxThreadsCount();
+
+        size_t islandsReq = EstimateIslandProcessingMemoryRequirements(world, islandThreadsCount);
         dIASSERT(islandsReq == dEFFICIENT_SIZE(islandsReq));
 
         dxWorldProcessMemArena *islandsArena = context->ReallocateIslandsMemArena(islandsReq, memmgr, 1.0f, reserveInfo->m_uiReserveMinimum);
@@ -1172,13 +1412,16 @@ bool dxReallocateWorldProcessContext (dxWorld *world, dxWorldProcessIslandsInfo
         }
         dIASSERT(islandsArena->IsStructureValid());
 
-        size_t stepperReq = BuildIslandsAndEstimateStepperMemoryRequirements(islandsInfo, islandsArena, world, stepSize, stepperEstimate);
-        dIASSERT(stepperReq == dEFFICIENT_SIZE(stepperReq));
+        size_t *stepperReqs = islandsArena->AllocateArray<size_t>(islandThreadsCount);
+        BuildIslandsAndEstimateStepperMemoryRequirements(islandsInfo, islandsArena, world, stepSize, stepperEstimate, 
+            stepperReqs, islandThreadsCount);
 
-        size_t stepperReqWithCallContext = stepperReq + dEFFICIENT_SIZE(sizeof(dxStepperCallContext));
+        for (unsigned i = 0; i != islandThreadsCount; ++i) {
+            dIASSERT(stepperReqs[i] == dEFFICIENT_SIZE(stepperReqs[i]));
+            stepperReqs[i] += dEFFICIENT_SIZE(sizeof(dxStepperCallContext));
+        }
 
-        unsigned islandThreadsCount = world->GetThreadingIslandsMaxThreadsCount();
-        if (!context->ReallocateStepperMemArenas(world, islandThreadsCount, stepperReqWithCallContext, 
+        if (!context->ReallocateStepperMemArenas(world, islandThreadsCount, stepperReqs, 
             memmgr, reserveInfo->m_fReserveFactor, reserveInfo->m_uiReserveMinimum))
         {
             break;
@@ -63,6 +63,9 @@
 void dInternalHandleAutoDisabling (dxWorld *world, dReal stepsize);
 void dxStepBody (dxBody *b, dReal h);
 
+// monotonic time in seconds, for internal statistics (implemented in timer.cpp)
+double dxMonotonicTime();
+
 
 struct dxWorldProcessMemoryManager:
     public dBase
@@ -192,6 +195,8 @@ public:
         const dxWorldProcessMemoryManager *memmgr, float rsrvfactor, unsigned rsrvminimum);
     static void FreeMemArena (dxWorldProcessMemArena *arena);
 
+    const dxWorldProcessMemoryManager *GetMemoryManager() const { return m_pArenaMemMgr; }
+
     dxWorldProcessMemArena *GetNextMemArena() const { return (dxWorldProcessMemArena *)m_pAllocCurrentOrNextArena; }
     void SetNextMemArena(dxWorldProcessMemArena *pArenaInstance) { m_pAllocCurrentOrNextArena = pArenaInstance; }
 
@@ -226,11 +231,12 @@ public:
 
     dxWorldProcessMemArena *ReallocateIslandsMemArena(size_t nMemoryRequirement, 
         const dxWorldProcessMemoryManager *pmmMemortManager, float fReserveFactor, unsigned uiReserveMinimum);
-    bool ReallocateStepperMemArenas(dxWorld *world, unsigned nIslandThreadsCount, size_t nMemoryRequirement, 
+    bool ReallocateStepperMemArenas(dxWorld *world, unsigned nIslandThreadsCount, const size_t *pnMemoryRequirements, 
         const dxWorldProcessMemoryManager *pmmMemortManager, float fReserveFactor, unsigned uiReserveMinimum);
 
 private:
     static void FreeArenasList(dxWorldProcessMemArena *pmaExistingArenas);
+    static dxWorldProcessMemArena *SortArenasListBySize(dxWorldProcessMemArena *pmaExistingArenas);
 
 private:
     void SetIslandsMemArena(dxWorldProcessMemArena *pmaInstance) { m_pmaIslandsArena = pmaInstance; }
@@ -247,11 +253,15 @@ public:
     void LockForStepbodySerialization();
     void UnlockForStepbodySerialization();
 
+    void LockForStepperJobStart();
+    void UnlockForStepperJobStart();
+
 private:
     enum dxProcessContextMutex
     {
         dxPCM_STEPPER_ARENA_OBTAIN,
         dxPCM_STEPPER_STEPBODY_SERIALIZE,
+        dxPCM_STEPPER_JOB_START,
 
         dxPCM__MAX,
     };
@@ -292,9 +302,13 @@ private:
 #define BEGIN_STATE_SAVE(memarena, state) void *state = memarena->SaveState();
 #define END_STATE_SAVE(memarena, state) memarena->RestoreState(state)
 
+struct dxStepStatsThreadSlot;
+
+// statsslot is NULL if step statistics are not collected for the world
 typedef void (*dstepper_fn_t) (dxWorldProcessMemArena *memarena, 
                                dxWorld *world, dxBody * const *body, unsigned int nb,
-                               dxJoint * const *_joint, unsigned int _nj, dReal stepsize);
+                               dxJoint * const *_joint, unsigned int _nj, dReal stepsize,
+                               dxStepStatsThreadSlot *statsslot);
 
 bool dxProcessIslands (dxWorld *world, const dxWorldProcessIslandsInfo &islandsInfo, dReal stepSize, dstepper_fn_t stepper);
 
@@ -0,0 +1,383 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001,2002 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+
+
+/*
+
+World state snapshots and bulk body state access.
+
+A snapshot is a flat buffer: a header, then one record per body in world
+list order, each followed by the body's auto-disable velocity samples,
+then the constraint forces of every joint in world list order. Restoring
+needs the same bodies and joints in the world, and only copies values back.
+
+The bulk body state functions copy selected fields of many bodies to or
+from caller arrays of fixed size records in one call.
+
+*/
+
+#include <ode/common.h>
+#include <ode/objects.h>
+#include <ode/collision.h>
+#include <ode/misc.h>
+#include <ode/odemath.h>
+#include "config.h"
+#include "objects.h"
+#include "joints/joint.h"
+#include <string.h>
+
+
+struct dxWorldStateHeader {
+    size_t size;                // total snapshot size in bytes
+    unsigned body_count;
+    unsigned joint_count;
+    unsigned active_count;      // size of the active body set
+    unsigned long rand_seed;    // quickstep randomizes the row order
+};
+
+struct dxBodyState {
+    dxPosR posr;
+    dQuaternion q;
+    dVector3 lvel, avel;
+    dVector3 facc, tacc;
+    dReal adis_timeleft;
+    int adis_stepsleft;
+    unsigned int average_counter;
+    int average_ready;
+    unsigned average_samples;   // number of samples following the record
+    int active_index;           // position in the active body set, -1 if disabled
+    int sleep_next;             // index of the next body in the sleeping island, -1 if none
+};
+
+struct dxJointState {
+    dReal lambda[6];
+};
+
+
+static inline size_t bodyAverageSamples (const dxBody *b)
+{
+    return b->average_lvel_buffer != NULL ? b->adis.average_samples : 0;
+}
+
+static inline size_t bodyStateSize (size_t average_samples)
+{
+    return sizeof(dxBodyState) + 2 * average_samples * sizeof(dVector3);
+}
+
+
+size_t dWorldGetStateSize (dWorldID w)
+{
+    dAASSERT (w);
+
+    size_t size = sizeof(dxWorldStateHeader);
+    for (dxBody *b = w->firstbody; b; b = (dxBody *)b->next) {
+        size += bodyStateSize (bodyAverageSamples (b));
+    }
+    size += (size_t)w->nj * sizeof(dxJointState);
+    return size;
+}
+
+
+size_t dWorldSaveState (dWorldID w, void *buffer, size_t buffer_size)
+{
+    dAASSERT (w);
+
+    size_t size = dWorldGetStateSize (w);
+    if (buffer == NULL || buffer_size < size) return 0;
+
+    char *ptr = (char *)buffer;
+
+    dxWorldStateHeader *header = (dxWorldStateHeader *)ptr;
+    header->size = size;
+    header->body_count = (unsigned)w->nb;
+    header->joint_count = (unsigned)w->nj;
+    header->active_count = (unsigned)w->active_bodies.size();
+    header->rand_seed = dRandGetSeed ();
+    ptr += sizeof(dxWorldStateHeader);
+
+    // number the bodies for the sleeping island rings to refer to
+    int index = 0;
+    for (dxBody *b = w->firstbody; b; b = (dxBody *)b->next) b->tag = index++;
+
+    for (dxBody *b = w->firstbody; b; b = (dxBody *)b->next) {
+        dxBodyState *state = (dxBodyState *)ptr;
+        state->posr = b->posr;
+        dCopyVector4 (state->q, b->q);
+        dCopyVector4 (state->lvel, b->lvel);
+        dCopyVector4 (state->avel, b->avel);
+        dCopyVector4 (state->facc, b->facc);
+        dCopyVector4 (state->tacc, b->tacc);
+        state->adis_timeleft = b->adis_timeleft;
+        state->adis_stepsleft = b->adis_stepsleft;
+        state->average_counter = b->average_counter;
+        state->average_ready = b->average_ready;
+        size_t samples = bodyAverageSamples (b);
+        state->average_samples = (unsigned)samples;
+        state->active_index = b->active_index;
+        state->sleep_next = b->sleep_next != NULL ? b->sleep_next->tag : -1;
+        ptr += sizeof(dxBodyState);
+
+        if (samples != 0) {
+            memcpy (ptr, b->average_lvel_buffer, samples * sizeof(dVector3));
+            ptr += samples * sizeof(dVector3);
+            memcpy (ptr, b->average_avel_buffer, samples * sizeof(dVector3));
+            ptr += samples * sizeof(dVector3);
+        }
+    }
+
+    for (dxJoint *j = w->firstjoint; j; j = (dxJoint *)j->next) {
+        dxJointState *state = (dxJointState *)ptr;
+        memcpy (state->lambda, j->lambda, sizeof(state->lambda));
+        ptr += sizeof(dxJointState);
+    }
+
+    dIASSERT ((size_t)(ptr - (char *)buffer) == size);
+    return size;
+}
+
+
+int dWorldRestoreState (dWorldID w, const void *buffer, size_t buffer_size)
+{
+    dAASSERT (w);
+
+    const dxWorldStateHeader *header = (const dxWorldStateHeader *)buffer;
+    if (buffer == NULL || buffer_size < sizeof(dxWorldStateHeader)
+        || header->size > buffer_size
+        || header->body_count != (unsigned)w->nb
+        || header->joint_count != (unsigned)w->nj
+        || header->size != dWorldGetStateSize (w)) {
+        return 0;
+    }
+
+    // check the auto-disable sample counts and the active set before
+    // anything is changed
+    const char *ptr = (const char *)buffer + sizeof(dxWorldStateHeader);
+    unsigned active_count = 0;
+    dArray<dxBody *> bodies;
+    for (dxBody *b = w->firstbody; b; b = (dxBody *)b->next) {
+        const dxBodyState *state = (const dxBodyState *)ptr;
+        if (state->average_samples != bodyAverageSamples (b)) return 0;
+        if (state->active_index >= (int)header->active_count) return 0;
+        if (state->sleep_next >= w->nb) return 0;
+        if (state->active_index >= 0) active_count++;
+        bodies.push (b);
+        ptr += bodyStateSize (state->average_samples);
+    }
+    if (active_count != header->active_count) return 0;
+
+    w->active_bodies.setSize ((int)active_count);
+
+    ptr = (const char *)buffer + sizeof(dxWorldStateHeader);
+    for (dxBody *b = w->firstbody; b; b = (dxBody *)b->next) {
+        const dxBodyState *state = (const dxBodyState *)ptr;
+        b->posr = state->posr;
+        dCopyVector4 (b->q, state->q);
+        dCopyVector4 (b->lvel, state->lvel);
+        dCopyVector4 (b->avel, state->avel);
+        dCopyVector4 (b->facc, state->facc);
+        dCopyVector4 (b->tacc, state->tacc);
+        b->adis_timeleft = state->adis_timeleft;
+        b->adis_stepsleft = state->adis_stepsleft;
+        b->average_counter = state->average_counter;
+        b->average_ready = state->average_ready;
+        // the active set is restored in its saved order, as the islands
+        // are stepped in that order
+        b->active_index = state->active_index;
+        if (b->active_index >= 0) {
+            w->active_bodies[b->active_index] = b;
+            b->flags = (b->flags & ~dxBodyDisabled) | dxBodyStateChanged;
+        }
+        else {
+            b->flags |= dxBodyDisabled | dxBodyStateChanged;
+        }
+        b->sleep_next = state->sleep_next >= 0 ? bodies[state->sleep_next] : NULL;
+        ptr += sizeof(dxBodyState);
+
+        size_t samples = state->average_samples;
+        if (samples != 0) {
+            memcpy (b->average_lvel_buffer, ptr, samples * sizeof(dVector3));
+            ptr += samples * sizeof(dVector3);
+            memcpy (b->average_avel_buffer, ptr, samples * sizeof(dVector3));
+            ptr += samples * sizeof(dVector3);
+        }
+
+        for (dxGeom *geom = b->geom; geom; geom = dGeomGetBodyNext (geom))
+            dGeomMoved (geom);
+    }
+
+    for (dxJoint *j = w->firstjoint; j; j = (dxJoint *)j->next) {
+        const dxJointState *state = (const dxJointState *)ptr;
+        memcpy (j->lambda, state->lambda, sizeof(j->lambda));
+        ptr += sizeof(dxJointState);
+    }
+
+    dRandSetSeed (header->rand_seed);
+    return 1;
+}
+
+
+//****************************************************************************
+// bulk body state access
+
+#define BODY_STATE_FIELDS (dBodyStatePosition | dBodyStateQuaternion | dBodyStateRotation \
+    | dBodyStateLinearVel | dBodyStateAngularVel)
+
+
+int dBodyStateRecordSize (unsigned fields)
+{
+    int size = 0;
+    if (fields & dBodyStatePosition) size += 3;
+    if (fields & dBodyStateQuaternion) size += 4;
+    if (fields & dBodyStateRotation) size += 12;
+    if (fields & dBodyStateLinearVel) size += 3;
+    if (fields & dBodyStateAngularVel) size += 3;
+    return size;
+}
+
+
+static void getBodyState (const dxBody *b, unsigned fields, dReal *record)
+{
+    if (fields & dBodyStatePosition) {
+        record[0] = b->posr.pos[0];
+        record[1] = b->posr.pos[1];
+        record[2] = b->posr.pos[2];
+        record += 3;
+    }
+    if (fields & dBodyStateQuaternion) {
+        dCopyVector4 (record, b->q);
+        record += 4;
+    }
+    if (fields & dBodyStateRotation) {
+        memcpy (record, b->posr.R, sizeof(dMatrix3));
+        record += 12;
+    }
+    if (fields & dBodyStateLinearVel) {
+        record[0] = b->lvel[0];
+        record[1] = b->lvel[1];
+        record[2] = b->lvel[2];
+        record += 3;
+    }
+    if (fields & dBodyStateAngularVel) {
+        record[0] = b->avel[0];
+        record[1] = b->avel[1];
+        record[2] = b->avel[2];
+    }
+}
+
+
+int dWorldGetBodyStates (dWorldID w, const dBodyID *bodies, int count, unsigned fields,
+                         dReal *states, int stride, int *indices)
+{
+    dAASSERT (w);
+    dUASSERT (count >= 0, "bad body count");
+    dUASSERT (states || count == 0, "bad states argument");
+    dUASSERT (stride >= dBodyStateRecordSize (fields), "stride is smaller than the record size");
+
+    const bool changed_only = (fields & dBodyStateChangedOnly) != 0;
+    fields &= BODY_STATE_FIELDS;
+
+    int written = 0;
+    dReal *record = states;
+
+    if (bodies != NULL) {
+        for (int i = 0; i != count; ++i) {
+            dxBody *b = bodies[i];
+            dUASSERT (b && b->world == w, "body does not belong to the world");
+            if (changed_only) {
+                if (!(b->flags & dxBodyStateChanged)) continue;
+                b->flags &= ~dxBodyStateChanged;
+            }
+            getBodyState (b, fields, record);
+            if (indices) indices[written] = i;
+            record += stride;
+            ++written;
+        }
+    }
+    else {
+        int index = 0;
+        for (dxBody *b = w->firstbody; b && written != count; b = (dxBody *)b->next, ++index) {
+            if (changed_only) {
+                if (!(b->flags & dxBodyStateChanged)) continue;
+                b->flags &= ~dxBodyStateChanged;
+            }
+            getBodyState (b, fields, record);
+            if (indices) indices[written] = index;
+            record += stride;
+            ++written;
+        }
+    }
+
+    return written;
+}
+
+
+static void setBodyState (dxBody *b, unsigned fields, const dReal *record)
+{
+    if (fields & dBodyStatePosition) {
+        dBodySetPosition (b, record[0], record[1], record[2]);
+        record += 3;
+    }
+    if (fields & dBodyStateQuaternion) {
+        dBodySetQuaternion (b, record);
+        record += 4;
+    }
+    if (fields & dBodyStateRotation) {
+        dBodySetRotation (b, record);
+        record += 12;
+    }
+    if (fields & dBodyStateLinearVel) {
+        dBodySetLinearVel (b, record[0], record[1], record[2]);
+        record += 3;
+    }
+    if (fields & dBodyStateAngularVel) {
+        dBodySetAngularVel (b, record[0], record[1], record[2]);
+    }
+}
+
+
+void dWorldSetBodyStates (dWorldID w, const dBodyID *bodies, int count, unsigned fields,
+                          const dReal *states, int stride)
+{
+    dAASSERT (w);
+    dUASSERT (count >= 0, "bad body count");
+    dUASSERT (states || count == 0, "bad states argument");
+    dUASSERT (stride >= dBodyStateRecordSize (fields), "stride is smaller than the record size");
+
+    fields &= BODY_STATE_FIELDS;
+    const dReal *record = states;
+
+    if (bodies != NULL) {
+        for (int i = 0; i != count; ++i) {
+            dxBody *b = bodies[i];
+            dUASSERT (b && b->world == w, "body does not belong to the world");
+            setBodyState (b, fields, record);
+            record += stride;
+        }
+    }
+    else {
+        int index = 0;
+        for (dxBody *b = w->firstbody; b && index != count; b = (dxBody *)b->next, ++index) {
+            setBodyState (b, fields, record);
+            record += stride;
+        }
+    }
+}
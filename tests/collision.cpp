@@ -1,5 +1,7 @@
 #include <UnitTest++.h>
 #include <ode/ode.h>
+#include <algorithm>
+#include <vector>
 
 TEST(test_collision_trimesh_sphere_exact)
 {
@@ -125,3 +127,659 @@ TEST(test_collision_heightfield_ray_fail)
     }
 }
 
+
+
+static void collision_stats_near_callback(void *data, dGeomID o1, dGeomID o2)
+{
+    dContactGeom contacts[4];
+    dCollide(o1, o2, 4, contacts, sizeof(dContactGeom));
+}
+
+TEST(test_collision_space_and_collider_stats)
+{
+    dSpaceID space = dSimpleSpaceCreate(0);
+
+    dGeomID s1 = dCreateSphere(space, 1);
+    dGeomSetPosition(s1, 0, 0, 0);
+    dGeomID s2 = dCreateSphere(space, 1);
+    dGeomSetPosition(s2, 1, 0, 0);
+    dGeomID s3 = dCreateSphere(space, 1);
+    dGeomSetPosition(s3, 10, 0, 0);
+    dGeomID b = dCreateBox(space, 1, 1, 1);
+    dGeomSetPosition(b, 0, REAL(1.2), 0);
+    // a geom that is filtered out by its bits
+    dGeomID s4 = dCreateSphere(space, 1);
+    dGeomSetCategoryBits(s4, 0);
+    dGeomSetCollideBits(s4, 0);
+
+    static dCollisionPairStats table[dGeomNumClasses][dGeomNumClasses];
+    CHECK_EQUAL(0, dSpaceGetStatsEnabled(space));
+    CHECK_EQUAL(0, dSpaceGetStats(space, table));
+    CHECK_EQUAL(1, dSpaceSetStatsEnabled(space, 1));
+    CHECK_EQUAL(1, dSpaceGetStatsEnabled(space));
+    dSetColliderStatsEnabled(1);
+
+    dSpaceCollide(space, 0, &collision_stats_near_callback);
+
+    CHECK_EQUAL(1, dSpaceGetStats(space, table));
+    const dCollisionPairStats &ss = table[dSphereClass][dSphereClass];
+    CHECK_EQUAL(6ul, ss.candidate_pairs);
+    CHECK_EQUAL(3ul, ss.filtered_pairs);
+    CHECK_EQUAL(2ul, ss.aabb_rejected_pairs);
+    const dCollisionPairStats &sb = table[dSphereClass][dBoxClass];
+    CHECK_EQUAL(4ul, sb.candidate_pairs);
+    CHECK_EQUAL(1ul, sb.filtered_pairs);
+    CHECK_EQUAL(1ul, sb.aabb_rejected_pairs);
+    CHECK_EQUAL(0ul, table[dBoxClass][dSphereClass].candidate_pairs);
+
+    CHECK_EQUAL(1, dGetColliderStats(table));
+    CHECK_EQUAL(1ul, table[dSphereClass][dSphereClass].narrowphase_calls);
+    CHECK_EQUAL(1ul, table[dSphereClass][dSphereClass].contacts);
+    CHECK_EQUAL(2ul, table[dSphereClass][dBoxClass].narrowphase_calls);
+    CHECK_EQUAL(2ul, table[dSphereClass][dBoxClass].contacts);
+    CHECK(table[dSphereClass][dBoxClass].narrowphase_time >= 0);
+    CHECK_EQUAL(0ul, table[dSphereClass][dBoxClass].candidate_pairs);
+
+    dSpaceResetStats(space);
+    dResetColliderStats();
+    CHECK_EQUAL(1, dSpaceGetStats(space, table));
+    CHECK_EQUAL(0ul, table[dSphereClass][dSphereClass].candidate_pairs);
+    CHECK_EQUAL(1, dGetColliderStats(table));
+    CHECK_EQUAL(0ul, table[dSphereClass][dBoxClass].narrowphase_calls);
+
+    dSetColliderStatsEnabled(0);
+    CHECK_EQUAL(0, dGetColliderStatsEnabled());
+    CHECK_EQUAL(0, dGetColliderStats(table));
+    CHECK_EQUAL(1, dSpaceSetStatsEnabled(space, 0));
+    CHECK_EQUAL(0, dSpaceGetStats(space, table));
+
+    dSpaceDestroy(space);
+}
+
+
+
+struct collide2_query_data
+{
+    dGeomID query;
+    std::vector<int> found;
+};
+
+static void collide2_query_near_callback(void *data, dGeomID o1, dGeomID o2)
+{
+    collide2_query_data *q = (collide2_query_data *)data;
+    dGeomID other = o1 == q->query ? o2 : o1;
+    q->found.push_back((int)(size_t)dGeomGetData(other));
+}
+
+static std::vector<int> collide2_query(dGeomID query, dSpaceID space)
+{
+    collide2_query_data q;
+    q.query = query;
+    dSpaceCollide2(query, (dGeomID)space, &q, &collide2_query_near_callback);
+    std::sort(q.found.begin(), q.found.end());
+    return q.found;
+}
+
+TEST(test_collision_space_collide2_matches_simple_space)
+{
+    // the simple space tests every geom, the hash and SAP spaces must find
+    // the same candidates through their query indices
+    dSpaceID spaces[3] = {
+        dSimpleSpaceCreate(0), dHashSpaceCreate(0), dSweepAndPruneSpaceCreate(0, dSAP_AXES_XZY)
+    };
+    const int numSpaces = 3;
+    const int numBoxes = 400;
+    dGeomID boxes[3][numBoxes];
+
+    dRandSetSeed(31);
+    for (int i = 0; i < numBoxes; ++i) {
+        // mostly small boxes, a few large ones
+        dReal scale = (i % 50 == 0) ? REAL(40.0) : REAL(1.0);
+        dReal lx = (dRandReal() + REAL(0.05)) * scale;
+        dReal ly = (dRandReal() + REAL(0.05)) * scale;
+        dReal lz = (dRandReal() + REAL(0.05)) * scale;
+        dReal px = (dRandReal() - REAL(0.5)) * 100;
+        dReal py = (dRandReal() - REAL(0.5)) * 100;
+        dReal pz = (dRandReal() - REAL(0.5)) * 100;
+        for (int s = 0; s < numSpaces; ++s) {
+            boxes[s][i] = dCreateBox(spaces[s], lx, ly, lz);
+            dGeomSetPosition(boxes[s][i], px, py, pz);
+            dGeomSetData(boxes[s][i], (void *)(size_t)i);
+        }
+    }
+    for (int s = 0; s < numSpaces; ++s) {
+        dGeomID plane = dCreatePlane(spaces[s], 0, 0, 1, -60);
+        dGeomSetData(plane, (void *)(size_t)numBoxes);
+    }
+
+    dGeomID sphere = dCreateSphere(0, 3);
+    dGeomID ray = dCreateRay(0, 150);
+    dGeomID slab = dCreateBox(0, 90, 2, 2);
+    dGeomRaySet(ray, -50, -50, -50, 1, 1, 1);
+
+    for (int round = 0; round < 4; ++round) {
+        for (int q = 0; q < 40; ++q) {
+            dReal px = (dRandReal() - REAL(0.5)) * 110;
+            dReal py = (dRandReal() - REAL(0.5)) * 110;
+            dReal pz = (dRandReal() - REAL(0.5)) * 110;
+            dGeomSetPosition(sphere, px, py, pz);
+            dGeomSetPosition(slab, px, py, pz);
+
+            std::vector<int> expected = collide2_query(sphere, spaces[0]);
+            std::vector<int> expectedSlab = collide2_query(slab, spaces[0]);
+            std::vector<int> expectedRay = collide2_query(ray, spaces[0]);
+            for (int s = 1; s < numSpaces; ++s) {
+                CHECK(expected == collide2_query(sphere, spaces[s]));
+                CHECK(expectedSlab == collide2_query(slab, spaces[s]));
+                CHECK(expectedRay == collide2_query(ray, spaces[s]));
+            }
+        }
+
+        // change the spaces between the rounds: move, disable and remove geoms
+        for (int i = round; i < numBoxes; i += 7) {
+            dReal px = (dRandReal() - REAL(0.5)) * 100;
+            dReal py = (dRandReal() - REAL(0.5)) * 100;
+            dReal pz = (dRandReal() - REAL(0.5)) * 100;
+            for (int s = 0; s < numSpaces; ++s) {
+                if (boxes[s][i] == 0) continue;
+                dGeomSetPosition(boxes[s][i], px, py, pz);
+            }
+        }
+        for (int s = 0; s < numSpaces; ++s) {
+            dGeomDisable(boxes[s][round * 11]);
+            dGeomDestroy(boxes[s][round * 13 + 1]);
+            boxes[s][round * 13 + 1] = 0;
+        }
+    }
+
+    dGeomDestroy(slab);
+    dGeomDestroy(ray);
+    dGeomDestroy(sphere);
+    for (int s = 0; s < numSpaces; ++s) {
+        dSpaceDestroy(spaces[s]);
+    }
+}
+
+
+
+static void collide_pairs_near_callback(void *data, dGeomID o1, dGeomID o2)
+{
+    std::vector<std::pair<int, int> > *pairs = (std::vector<std::pair<int, int> > *)data;
+    int i1 = (int)(size_t)dGeomGetData(o1), i2 = (int)(size_t)dGeomGetData(o2);
+    pairs->push_back(i1 < i2 ? std::make_pair(i1, i2) : std::make_pair(i2, i1));
+}
+
+static std::vector<std::pair<int, int> > collide_pairs(dSpaceID space)
+{
+    std::vector<std::pair<int, int> > pairs;
+    dSpaceCollide(space, &pairs, &collide_pairs_near_callback);
+    std::sort(pairs.begin(), pairs.end());
+    return pairs;
+}
+
+TEST(test_collision_hash_space_persistent_table)
+{
+    // the hash space keeps its table between the calls, it must report the
+    // same pairs as the simple space, exactly once, after any changes
+    dSpaceID simple = dSimpleSpaceCreate(0);
+    dSpaceID hash = dHashSpaceCreate(0);
+    const int numBoxes = 300;
+    dGeomID boxes[2][numBoxes];
+
+    dRandSetSeed(32);
+    for (int i = 0; i < numBoxes; ++i) {
+        dReal scale = (i % 40 == 0) ? REAL(30.0) : REAL(2.0);
+        dReal l = (dRandReal() + REAL(0.05)) * scale;
+        dReal px = (dRandReal() - REAL(0.5)) * 60;
+        dReal py = (dRandReal() - REAL(0.5)) * 60;
+        dReal pz = (dRandReal() - REAL(0.5)) * 60;
+        boxes[0][i] = dCreateBox(simple, l, l, l);
+        boxes[1][i] = dCreateBox(hash, l, l, l);
+        for (int s = 0; s < 2; ++s) {
+            dGeomSetPosition(boxes[s][i], px, py, pz);
+            dGeomSetData(boxes[s][i], (void *)(size_t)i);
+        }
+    }
+    dGeomSetData(dCreatePlane(simple, 0, 0, 1, 0), (void *)(size_t)numBoxes);
+    dGeomSetData(dCreatePlane(hash, 0, 0, 1, 0), (void *)(size_t)numBoxes);
+
+    for (int round = 0; round < 6; ++round) {
+        std::vector<std::pair<int, int> > expected = collide_pairs(simple);
+        std::vector<std::pair<int, int> > actual = collide_pairs(hash);
+        CHECK(!expected.empty());
+        CHECK(expected == actual);
+
+        // move a few boxes a little and a few far away
+        for (int i = round; i < numBoxes; i += 5) {
+            if (boxes[0][i] == 0) continue;
+            const dReal *pos = dGeomGetPosition(boxes[0][i]);
+            dReal step = (i % 3 == 0) ? REAL(20.0) : REAL(0.3);
+            dReal px = pos[0] + (dRandReal() - REAL(0.5)) * step;
+            dReal py = pos[1] + (dRandReal() - REAL(0.5)) * step;
+            dReal pz = pos[2] + (dRandReal() - REAL(0.5)) * step;
+            dGeomSetPosition(boxes[0][i], px, py, pz);
+            dGeomSetPosition(boxes[1][i], px, py, pz);
+        }
+
+        // remove, disable and add geoms, and change the levels
+        for (int s = 0; s < 2; ++s) {
+            dGeomDestroy(boxes[s][round * 17 + 3]);
+            boxes[s][round * 17 + 3] = 0;
+            dGeomEnable(boxes[s][(round + 5) * 7]);
+            dGeomDisable(boxes[s][round * 7]);
+        }
+        if (round == 2) {
+            dHashSpaceSetLevels(hash, -1, 3);
+        }
+        dGeomID sphere[2] = { dCreateSphere(simple, 2), dCreateSphere(hash, 2) };
+        for (int s = 0; s < 2; ++s) {
+            dGeomSetPosition(sphere[s], round * 5, 0, 0);
+            dGeomSetData(sphere[s], (void *)(size_t)(numBoxes + 1 + round));
+        }
+    }
+
+    dSpaceDestroy(hash);
+    dSpaceDestroy(simple);
+}
+
+TEST(test_collision_octree_space_matches_simple_space)
+{
+    // the octree grows and shrinks as the geoms move, the pairs and the
+    // collide2 results must stay the same as in the simple space
+    dSpaceID simple = dSimpleSpaceCreate(0);
+    dVector3 center = { 0, 0, 0 }, extents = { 20, 20, 20 };
+    dSpaceID octree = dOctreeSpaceCreate(0, center, extents, 5);
+    CHECK_EQUAL((int)dOctreeSpaceClass, dSpaceGetClass(octree));
+    const int numBoxes = 300;
+    dGeomID boxes[2][numBoxes];
+
+    dRandSetSeed(33);
+    for (int i = 0; i < numBoxes; ++i) {
+        dReal scale = (i % 40 == 0) ? REAL(30.0) : REAL(2.0);
+        dReal l = (dRandReal() + REAL(0.05)) * scale;
+        dReal px = (dRandReal() - REAL(0.5)) * 60;
+        dReal py = (dRandReal() - REAL(0.5)) * 60;
+        dReal pz = (dRandReal() - REAL(0.5)) * 60;
+        boxes[0][i] = dCreateBox(simple, l, l, l);
+        boxes[1][i] = dCreateBox(octree, l, l, l);
+        for (int s = 0; s < 2; ++s) {
+            dGeomSetPosition(boxes[s][i], px, py, pz);
+            dGeomSetData(boxes[s][i], (void *)(size_t)i);
+        }
+    }
+    dGeomSetData(dCreatePlane(simple, 0, 0, 1, 0), (void *)(size_t)numBoxes);
+    dGeomSetData(dCreatePlane(octree, 0, 0, 1, 0), (void *)(size_t)numBoxes);
+
+    dGeomID sphere = dCreateSphere(0, 4);
+
+    for (int round = 0; round < 6; ++round) {
+        std::vector<std::pair<int, int> > expected = collide_pairs(simple);
+        std::vector<std::pair<int, int> > actual = collide_pairs(octree);
+        CHECK(!expected.empty());
+        CHECK(expected == actual);
+
+        for (int q = 0; q < 20; ++q) {
+            dGeomSetPosition(sphere, (dRandReal() - REAL(0.5)) * 200,
+                (dRandReal() - REAL(0.5)) * 70, (dRandReal() - REAL(0.5)) * 70);
+            CHECK(collide2_query(sphere, simple) == collide2_query(sphere, octree));
+        }
+
+        // every geom is enumerated exactly once
+        int count = dSpaceGetNumGeoms(octree);
+        CHECK_EQUAL(dSpaceGetNumGeoms(simple), count);
+        std::vector<dGeomID> enumerated;
+        for (int i = 0; i < count; ++i) {
+            enumerated.push_back(dSpaceGetGeom(octree, i));
+        }
+        std::sort(enumerated.begin(), enumerated.end());
+        CHECK(std::unique(enumerated.begin(), enumerated.end()) == enumerated.end());
+
+        // move a few boxes a little and a few far outside the initial cell
+        for (int i = round; i < numBoxes; i += 5) {
+            if (boxes[0][i] == 0) continue;
+            const dReal *pos = dGeomGetPosition(boxes[0][i]);
+            dReal step = (i % 3 == 0) ? REAL(20.0) : REAL(0.3);
+            dReal px = pos[0] + (dRandReal() - REAL(0.5)) * step;
+            dReal py = pos[1] + (dRandReal() - REAL(0.5)) * step;
+            dReal pz = pos[2] + (dRandReal() - REAL(0.5)) * step;
+            if (i % 11 == 0) {
+                px += (round & 1) ? 150 : -150;
+            }
+            dGeomSetPosition(boxes[0][i], px, py, pz);
+            dGeomSetPosition(boxes[1][i], px, py, pz);
+        }
+
+        for (int s = 0; s < 2; ++s) {
+            dGeomDestroy(boxes[s][round * 17 + 3]);
+            boxes[s][round * 17 + 3] = 0;
+            dGeomEnable(boxes[s][(round + 5) * 7]);
+            dGeomDisable(boxes[s][round * 7]);
+        }
+    }
+
+    dGeomDestroy(sphere);
+    dSpaceDestroy(octree);
+    dSpaceDestroy(simple);
+}
+
+static void collide_order_near_callback(void *data, dGeomID o1, dGeomID o2)
+{
+    std::vector<std::pair<int, int> > *pairs = (std::vector<std::pair<int, int> > *)data;
+    pairs->push_back(std::make_pair((int)(size_t)dGeomGetData(o1), (int)(size_t)dGeomGetData(o2)));
+}
+
+TEST(test_collision_octree_space_order_does_not_depend_on_addresses)
+{
+    // the same geoms added in the same order are reported in the same order,
+    // whatever order they were allocated in
+    dVector3 center = { 0, 0, 0 }, extents = { 10, 10, 10 };
+    dSpaceID octree[2] = { dOctreeSpaceCreate(0, center, extents, 4), dOctreeSpaceCreate(0, center, extents, 4) };
+    const int numBoxes = 200;
+    dGeomID boxes[2][numBoxes];
+
+    for (int s = 0; s < 2; ++s) {
+        for (int n = 0; n < numBoxes; ++n) {
+            int i = s == 0 ? n : numBoxes - 1 - n;
+            boxes[s][i] = dCreateBox(0, 1, 1, 1);
+        }
+    }
+
+    dRandSetSeed(34);
+    for (int i = 0; i < numBoxes; ++i) {
+        dReal l = dRandReal() * 3 + REAL(0.1);
+        dReal px = (dRandReal() - REAL(0.5)) * 30;
+        dReal py = (dRandReal() - REAL(0.5)) * 30;
+        dReal pz = (dRandReal() - REAL(0.5)) * 30;
+        for (int s = 0; s < 2; ++s) {
+            dGeomBoxSetLengths(boxes[s][i], l, l, l);
+            dGeomSetPosition(boxes[s][i], px, py, pz);
+            dGeomSetData(boxes[s][i], (void *)(size_t)i);
+            dSpaceAdd(octree[s], boxes[s][i]);
+        }
+    }
+
+    std::vector<std::pair<int, int> > pairs[2];
+    for (int s = 0; s < 2; ++s) {
+        dSpaceCollide(octree[s], &pairs[s], &collide_order_near_callback);
+    }
+    CHECK(!pairs[0].empty());
+    CHECK(pairs[0] == pairs[1]);
+
+    for (int s = 0; s < 2; ++s) {
+        dSpaceDestroy(octree[s]);
+    }
+}
+
+TEST(test_collision_space_threaded_clean)
+{
+    // the AABBs computed by the threads must be the same as the serial ones,
+    // also for geoms with offsets from their bodies and in child spaces
+    dThreadingImplementationID threading = dThreadingAllocateMultiThreadedImplementation();
+    dThreadingThreadPoolID pool = dThreadingAllocateThreadPool(4, 0, dAllocateFlagBasicData, NULL);
+    dThreadingThreadPoolServeMultiThreadedImplementation(pool, threading);
+
+    dWorldID world = dWorldCreate();
+    dVector3 center = { 0, 0, 0 }, extents = { 50, 50, 50 };
+    const int numSpaces = 4;
+    dSpaceID spaces[numSpaces] = {
+        dSimpleSpaceCreate(0), dHashSpaceCreate(0),
+        dSweepAndPruneSpaceCreate(0, dSAP_AXES_XYZ), dOctreeSpaceCreate(0, center, extents, 6)
+    };
+    dSpaceID reference = dHashSpaceCreate(0);
+    dSpaceID child = dSimpleSpaceCreate(spaces[1]);
+    for (int s = 0; s < numSpaces; ++s) {
+        dSpaceSetThreadingImplementation(spaces[s], dThreadingImplementationGetFunctions(threading), threading);
+    }
+    dSpaceSetThreadingImplementation(child, dThreadingImplementationGetFunctions(threading), threading);
+
+    const int numBodies = 1500;
+    dBodyID bodies[numBodies];
+    std::vector<dGeomID> geoms[numSpaces + 1];
+    dRandSetSeed(34);
+    for (int i = 0; i < numBodies; ++i) {
+        bodies[i] = dBodyCreate(world);
+        dReal l = dRandReal() + REAL(0.1);
+        for (int s = 0; s <= numSpaces; ++s) {
+            dSpaceID space = s == numSpaces ? reference : (s == 1 && i % 10 == 0) ? child : spaces[s];
+            dGeomID g = dCreateBox(space, l, l, l);
+            dGeomSetBody(g, bodies[i]);
+            dGeomSetOffsetPosition(g, 0, l, 0);
+            dGeomSetData(g, (void *)(size_t)i);
+            geoms[s].push_back(g);
+        }
+    }
+
+    for (int round = 0; round < 3; ++round) {
+        for (int i = 0; i < numBodies; ++i) {
+            dBodySetPosition(bodies[i], (dRandReal() - REAL(0.5)) * 60,
+                (dRandReal() - REAL(0.5)) * 60, (dRandReal() - REAL(0.5)) * 60);
+            dMatrix3 R;
+            dRFromAxisAndAngle(R, dRandReal(), dRandReal(), 1, dRandReal() * 6);
+            dBodySetRotation(bodies[i], R);
+        }
+
+        std::vector<std::pair<int, int> > expected = collide_pairs(reference);
+        CHECK(!expected.empty());
+        for (int s = 0; s < numSpaces; ++s) {
+            if (s != 1) {
+                CHECK(expected == collide_pairs(spaces[s]));
+            }
+            dSpaceClean(spaces[s]);
+            for (int i = 0; i < numBodies; ++i) {
+                dReal aabb[6], expectedAABB[6];
+                dGeomGetAABB(geoms[s][i], aabb);
+                dGeomGetAABB(geoms[numSpaces][i], expectedAABB);
+                CHECK_ARRAY_EQUAL(expectedAABB, aabb, 6);
+            }
+        }
+    }
+
+    for (int s = 0; s < numSpaces; ++s) {
+        dSpaceDestroy(spaces[s]);
+    }
+    dSpaceDestroy(reference);
+    dWorldDestroy(world);
+
+    dThreadingImplementationShutdownProcessing(threading);
+    dThreadingFreeThreadPool(pool);
+    dThreadingFreeImplementation(threading);
+}
+
+TEST(test_collision_trimesh_tc_cache)
+{
+    // a terrain grid colliding with spheres and boxes must give the same
+    // contacts with temporal coherence as without, while geoms come and go
+    // and the cache drops the entries of the ones that left
+    const int N = 16;
+    std::vector<float> vertices;
+    std::vector<dTriIndex> indices;
+    for (int y = 0; y <= N; ++y) {
+        for (int x = 0; x <= N; ++x) {
+            vertices.push_back((float)x);
+            vertices.push_back((float)y);
+            vertices.push_back((float)((x * 7 + y * 3) % 5) * 0.1f);
+        }
+    }
+    for (int y = 0; y < N; ++y) {
+        for (int x = 0; x < N; ++x) {
+            dTriIndex i0 = y * (N + 1) + x;
+            dTriIndex triangles[6] = { i0, i0 + 1, i0 + N + 2, i0, i0 + N + 2, i0 + N + 1 };
+            indices.insert(indices.end(), triangles, triangles + 6);
+        }
+    }
+
+    dTriMeshDataID data = dGeomTriMeshDataCreate();
+    dGeomTriMeshDataBuildSingle(data, &vertices[0], 3 * sizeof(float), (int)vertices.size() / 3,
+        &indices[0], (int)indices.size(), 3 * sizeof(dTriIndex));
+    dGeomID plain = dCreateTriMesh(0, data, 0, 0, 0);
+    dGeomID coherent = dCreateTriMesh(0, data, 0, 0, 0);
+    dGeomTriMeshEnableTC(coherent, dSphereClass, 1);
+    dGeomTriMeshEnableTC(coherent, dBoxClass, 1);
+    dGeomTriMeshSetTCCacheMaxAge(coherent, 2);
+#ifndef dTRIMESH_GIMPACT
+    CHECK_EQUAL(2, dGeomTriMeshGetTCCacheMaxAge(coherent));
+#endif
+
+    const int numGeoms = 100;
+    dGeomID geoms[numGeoms];
+    for (int i = 0; i < numGeoms; ++i) {
+        geoms[i] = (i & 1) ? dCreateBox(0, REAL(0.6), REAL(0.4), REAL(0.5)) : dCreateSphere(0, REAL(0.4));
+    }
+
+    dRandSetSeed(35);
+    for (int frame = 0; frame < 30; ++frame) {
+        // a changing subset of the geoms touches the terrain
+        int active = (frame / 5 % 2 == 0) ? numGeoms : numGeoms / 4;
+        for (int i = 0; i < active; ++i) {
+            dGeomSetPosition(geoms[i], dRandReal() * N, dRandReal() * N, REAL(0.3) + dRandReal() * REAL(0.3));
+
+            dContactGeom expected[8], actual[8];
+            int expectedCount = dCollide(plain, geoms[i], 8, expected, sizeof(dContactGeom));
+            int actualCount = dCollide(coherent, geoms[i], 8, actual, sizeof(dContactGeom));
+            CHECK_EQUAL(expectedCount, actualCount);
+        }
+
+        // the entries of destroyed geoms stay until they age, a new geom
+        // allocated at the same address must still get the right contacts
+        if (frame % 10 == 9) {
+            for (int i = 0; i < numGeoms; i += 3) {
+                bool box = (i & 1) != 0;
+                dGeomDestroy(geoms[i]);
+                geoms[i] = box ? dCreateBox(0, REAL(0.6), REAL(0.4), REAL(0.5)) : dCreateSphere(0, REAL(0.4));
+            }
+        }
+    }
+
+    dGeomTriMeshClearTCCache(coherent);
+    for (int i = 0; i < numGeoms; ++i) {
+        dGeomDestroy(geoms[i]);
+    }
+    dGeomDestroy(coherent);
+    dGeomDestroy(plain);
+    dGeomTriMeshDataDestroy(data);
+}
+
+static dRaycastHit raycast_reference(const std::vector<dGeomID> &geoms, const dReal *origin,
+    const dReal *dir, dReal length, unsigned long collide_bits)
+{
+    dRaycastHit hit = { 0, { 0, 0, 0, 0 }, { 0, 0, 0, 0 }, length, -1 };
+    dGeomID ray = dCreateRay(0, length);
+    dGeomRaySet(ray, origin[0], origin[1], origin[2], dir[0], dir[1], dir[2]);
+    dGeomRaySetClosestHit(ray, 1);
+    for (size_t j = 0; j < geoms.size(); ++j) {
+        if ((dGeomGetCategoryBits(geoms[j]) & collide_bits) == 0) continue;
+        dContactGeom c;
+        if (dCollide(ray, geoms[j], 1, &c, sizeof(c)) && (!hit.geom || c.depth < hit.distance)) {
+            hit.geom = geoms[j];
+            hit.distance = c.depth;
+            hit.triangle = dGeomGetClass(geoms[j]) == dTriMeshClass ? c.side1 : -1;
+        }
+    }
+    dGeomDestroy(ray);
+    return hit;
+}
+
+TEST(test_collision_space_raycast_batch)
+{
+    // the batch must find the same closest hits as single rays collided
+    // with every geom, with and without threads, through child spaces
+    const int N = 8;
+    std::vector<float> vertices;
+    std::vector<dTriIndex> indices;
+    for (int y = 0; y <= N; ++y) {
+        for (int x = 0; x <= N; ++x) {
+            vertices.push_back((float)x * 4 - 16);
+            vertices.push_back((float)y * 4 - 16);
+            vertices.push_back((float)((x * 7 + y * 3) % 5) * 0.2f);
+        }
+    }
+    for (int y = 0; y < N; ++y) {
+        for (int x = 0; x < N; ++x) {
+            dTriIndex i0 = y * (N + 1) + x;
+            dTriIndex triangles[6] = { i0, i0 + 1, i0 + N + 2, i0, i0 + N + 2, i0 + N + 1 };
+            indices.insert(indices.end(), triangles, triangles + 6);
+        }
+    }
+    dTriMeshDataID data = dGeomTriMeshDataCreate();
+    dGeomTriMeshDataBuildSingle(data, &vertices[0], 3 * sizeof(float), (int)vertices.size() / 3,
+        &indices[0], (int)indices.size(), 3 * sizeof(dTriIndex));
+
+    dSpaceID space = dHashSpaceCreate(0);
+    dSpaceID child = dSimpleSpaceCreate(space);
+    std::vector<dGeomID> geoms;
+    geoms.push_back(dCreateTriMesh(child, data, 0, 0, 0));
+    dRandSetSeed(36);
+    for (int i = 0; i < 300; ++i) {
+        dSpaceID parent = (i % 5 == 0) ? child : space;
+        dGeomID g = (i % 3 == 0) ? dCreateBox(parent, 1, REAL(0.5), REAL(0.7))
+            : (i % 3 == 1) ? dCreateSphere(parent, REAL(0.4)) : dCreateCapsule(parent, REAL(0.3), 1);
+        dGeomSetPosition(g, (dRandReal() - REAL(0.5)) * 30, (dRandReal() - REAL(0.5)) * 30, 2 + dRandReal() * 6);
+        dMatrix3 R;
+        dRFromAxisAndAngle(R, dRandReal(), dRandReal(), 1, dRandReal() * 6);
+        dGeomSetRotation(g, R);
+        // some geoms the rays must ignore
+        if (i % 7 == 0) dGeomSetCategoryBits(g, 2);
+        geoms.push_back(g);
+    }
+
+    // fans of rays from a few sensors, plus a degenerate one
+    const int count = 1000;
+    std::vector<dReal> origins(count * 3), dirs(count * 3), lengths(count);
+    for (int i = 0; i < count; ++i) {
+        if (i % 100 == 0) {
+            origins[i * 3 + 0] = (dRandReal() - REAL(0.5)) * 20;
+            origins[i * 3 + 1] = (dRandReal() - REAL(0.5)) * 20;
+            origins[i * 3 + 2] = 5;
+        }
+        else {
+            origins[i * 3 + 0] = origins[(i - 1) * 3 + 0];
+            origins[i * 3 + 1] = origins[(i - 1) * 3 + 1];
+            origins[i * 3 + 2] = origins[(i - 1) * 3 + 2];
+        }
+        dReal angle = (dReal)(i % 100) * REAL(0.0628);
+        dirs[i * 3 + 0] = dCos(angle);
+        dirs[i * 3 + 1] = dSin(angle);
+        dirs[i * 3 + 2] = -REAL(0.2) - dRandReal();
+        lengths[i] = 5 + dRandReal() * 20;
+    }
+    dirs[3 * 3 + 0] = dirs[3 * 3 + 1] = dirs[3 * 3 + 2] = 0;
+
+    std::vector<dRaycastHit> expected(count);
+    int expectedHits = 0;
+    for (int i = 0; i < count; ++i) {
+        if (i == 3) {
+            dRaycastHit miss = { 0, { 0, 0, 0, 0 }, { 0, 0, 0, 0 }, lengths[i], -1 };
+            expected[i] = miss;
+            continue;
+        }
+        expected[i] = raycast_reference(geoms, &origins[i * 3], &dirs[i * 3], lengths[i], 1);
+        if (expected[i].geom) expectedHits++;
+    }
+    CHECK(expectedHits > count / 4);
+
+    dThreadingImplementationID threading = dThreadingAllocateMultiThreadedImplementation();
+    dThreadingThreadPoolID pool = dThreadingAllocateThreadPool(4, 0, dAllocateFlagCollisionData, NULL);
+    dThreadingThreadPoolServeMultiThreadedImplementation(pool, threading);
+
+    for (int threaded = 0; threaded < 2; ++threaded) {
+        if (threaded) {
+            dSpaceSetThreadingImplementation(space, dThreadingImplementationGetFunctions(threading), threading);
+        }
+
+        std::vector<dRaycastHit> hits(count);
+        CHECK_EQUAL(expectedHits, dSpaceRaycastBatch(space, count, &origins[0], &dirs[0], &lengths[0], 1, &hits[0]));
+        for (int i = 0; i < count; ++i) {
+            CHECK_EQUAL(expected[i].geom, hits[i].geom);
+            CHECK_CLOSE(expected[i].distance, hits[i].distance, REAL(1e-4));
+            CHECK_EQUAL(expected[i].triangle, hits[i].triangle);
+        }
+    }
+
+    dSpaceSetThreadingImplementation(space, NULL, NULL);
+    dSpaceDestroy(space);
+    dGeomTriMeshDataDestroy(data);
+
+    dThreadingImplementationShutdownProcessing(threading);
+    dThreadingFreeThreadPool(pool);
+    dThreadingFreeImplementation(threading);
+}
@@ -0,0 +1,180 @@
+/*************************************************************************
+ *                                                                       *
+ * Open Dynamics Engine, Copyright (C) 2001,2002 Russell L. Smith.       *
+ * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+ *                                                                       *
+ * This library is free software; you can redistribute it and/or         *
+ * modify it under the terms of EITHER:                                  *
+ *   (1) The GNU Lesser General Public License as published by the Free  *
+ *       Software Foundation; either version 2.1 of the License, or (at  *
+ *       your option) any later version. The text of the GNU Lesser      *
+ *       General Public License is included with this library in the     *
+ *       file LICENSE.TXT.                                               *
+ *   (2) The BSD-style license that is included with this library in     *
+ *       the file LICENSE-BSD.TXT.                                       *
+ *                                                                       *
+ * This library is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+ * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+ *                                                                       *
+ *************************************************************************/
+//234567890123456789012345678901234567890123456789012345678901234567890123456789
+//        1         2         3         4         5         6         7
+
+#include <UnitTest++.h>
+#include <ode/ode.h>
+#include "../ode/src/lcp.h"
+#include "../ode/src/util.h"
+#include <string.h>
+#include <vector>
+
+
+SUITE (TestMatrixKernels)
+{
+    // Builds a random symmetric positive definite n x n matrix
+    static void MakeRandomSPD(dReal *A, int n, int nskip)
+    {
+        std::vector<dReal> B(n * nskip);
+        dMakeRandomMatrix(&B[0], n, nskip, REAL(1.0));
+        dMultiply2(A, &B[0], &B[0], n, nskip, n);
+        for (int i = 0; i < n; ++i)
+            A[i * nskip + i] += (dReal)n;
+    }
+
+    struct Fixture
+    {
+        Fixture() : originalLevel(dGetMatrixKernelsLevel()) {}
+        ~Fixture() { dSetMatrixKernelsLevel(originalLevel); }
+
+        int originalLevel;
+    };
+
+    TEST(test_set_level_clamps)
+    {
+        Fixture fixture;
+
+        CHECK_EQUAL(int(dMatrixKernelsScalar), dSetMatrixKernelsLevel(dMatrixKernelsScalar));
+        CHECK_EQUAL(int(dMatrixKernelsScalar), dGetMatrixKernelsLevel());
+        CHECK_EQUAL(int(dMatrixKernelsScalar), dSetMatrixKernelsLevel(-1));
+
+        int best = dSetMatrixKernelsLevel(dMatrixKernelsAVX + 1);
+        CHECK(best >= dMatrixKernelsScalar && best <= dMatrixKernelsAVX);
+        CHECK_EQUAL(best, dGetMatrixKernelsLevel());
+    }
+
+    TEST(test_kernels_match_scalar)
+    {
+        Fixture fixture;
+
+        const dReal tol = REAL(1e-4);
+        const int sizes[] = { 1, 2, 3, 4, 5, 7, 8, 9, 13, 16, 31, 64 };
+
+        for (unsigned s = 0; s != sizeof(sizes) / sizeof(sizes[0]); ++s) {
+            const int n = sizes[s];
+            const int nskip = dPAD(n);
+
+            dRandSetSeed(n);
+            std::vector<dReal> A(n * nskip), b(nskip), c(nskip);
+            MakeRandomSPD(&A[0], n, nskip);
+            dMakeRandomMatrix(&b[0], 1, n, REAL(1.0));
+            dMakeRandomMatrix(&c[0], 1, n, REAL(1.0));
+
+            dSetMatrixKernelsLevel(dMatrixKernelsScalar);
+            std::vector<dReal> Lref(A), dref(nskip), xref(b), l1ref(b);
+            dFactorLDLT(&Lref[0], &dref[0], n, nskip);
+            dSolveLDLT(&Lref[0], &dref[0], &xref[0], n, nskip);
+            dSolveL1(&Lref[0], &l1ref[0], n, nskip);
+            dReal dotref = dDot(&b[0], &c[0], n);
+
+            for (int level = dMatrixKernelsScalar + 1; level <= dMatrixKernelsAVX; ++level) {
+                if (dSetMatrixKernelsLevel(level) != level)
+                    break;
+
+                std::vector<dReal> L(A), d(nskip), x(b), l1(b);
+                dFactorLDLT(&L[0], &d[0], n, nskip);
+                CHECK(dMaxDifferenceLowerTriangle(&L[0], &Lref[0], n) < tol);
+                CHECK(dMaxDifference(&d[0], &dref[0], 1, n) < tol);
+
+                dSolveLDLT(&L[0], &d[0], &x[0], n, nskip);
+                CHECK(dMaxDifference(&x[0], &xref[0], 1, n) < tol);
+
+                dSolveL1(&Lref[0], &l1[0], n, nskip);
+                CHECK(dMaxDifference(&l1[0], &l1ref[0], 1, n) < tol);
+
+                CHECK_CLOSE(dotref, dDot(&b[0], &c[0], n), tol * n);
+            }
+        }
+    }
+
+    // Solves a random box LCP the way dTestSolveLCP() makes them, with the
+    // first nub rows unbounded, at the current kernels level
+    static void SolveRandomLCP(dxWorldProcessMemArena *arena, const dReal *A, const dReal *b,
+                               const dReal *lo, const dReal *hi, int n, int nub, dReal *x, dReal *w)
+    {
+        const int nskip = dPAD(n);
+        std::vector<dReal> A2(A, A + n * nskip), b2(b, b + n), lo2(lo, lo + n), hi2(hi, hi + n);
+        dClearUpperTriangle(&A2[0], n);
+        dSetZero(x, n);
+        dSetZero(w, n);
+
+        arena->ResetState();
+        dSolveLCP(arena, n, &A2[0], x, &b2[0], w, nub, &lo2[0], &hi2[0], NULL);
+    }
+
+    TEST(test_lcp_solutions_match_scalar)
+    {
+        Fixture fixture;
+
+#ifdef dDOUBLE
+        const dReal tol = REAL(1e-9);
+#else
+        const dReal tol = REAL(1e-4);
+#endif
+        const int sizes[] = { 7, 16, 50, 100 };
+        const int maxn = 100;
+
+        dxWorldProcessMemArena *arena = dxAllocateTemporaryWorldProcessMemArena(dEstimateSolveLCPMemoryReq(maxn, true), NULL, NULL);
+        CHECK(arena != NULL);
+        if (arena == NULL)
+            return;
+
+        for (unsigned s = 0; s != sizeof(sizes) / sizeof(sizes[0]); ++s) {
+            const int n = sizes[s];
+            const int nskip = dPAD(n);
+            const int nub = n / 2;
+
+            // a random positive definite problem with random box limits
+            dRandSetSeed(n);
+            std::vector<dReal> B(n * nskip), A(n * nskip), x0(n), b(n), lo(n), hi(n);
+            dMakeRandomMatrix(&B[0], n, n, REAL(1.0));
+            dMultiply2(&A[0], &B[0], &B[0], n, n, n);
+            dMakeRandomMatrix(&x0[0], n, 1, REAL(1.0));
+            dMultiply0(&b[0], &A[0], &x0[0], n, n, 1);
+            for (int i = 0; i < n; ++i) {
+                b[i] += dRandReal() * REAL(0.2) - REAL(0.1);
+                lo[i] = i < nub ? -dInfinity : -dRandReal() - REAL(0.01);
+                hi[i] = i < nub ? dInfinity : dRandReal() + REAL(0.01);
+            }
+
+            dSetMatrixKernelsLevel(dMatrixKernelsScalar);
+            std::vector<dReal> xref(n), wref(n);
+            SolveRandomLCP(arena, &A[0], &b[0], &lo[0], &hi[0], n, nub, &xref[0], &wref[0]);
+
+            dReal scale = 1;
+            for (int i = 0; i < n; ++i)
+                if (dFabs(xref[i]) > scale) scale = dFabs(xref[i]);
+
+            for (int level = dMatrixKernelsScalar + 1; level <= dMatrixKernelsAVX; ++level) {
+                if (dSetMatrixKernelsLevel(level) != level)
+                    break;
+
+                std::vector<dReal> x(n), w(n);
+                SolveRandomLCP(arena, &A[0], &b[0], &lo[0], &hi[0], n, nub, &x[0], &w[0]);
+                CHECK(dMaxDifference(&x[0], &xref[0], 1, n) < tol * scale);
+            }
+        }
+
+        dxFreeTemporaryWorldProcessMemArena(arena);
+    }
+}
@@ -0,0 +1,1810 @@
+/*************************************************************************
+  *                                                                       *
+  * Open Dynamics Engine, Copyright (C) 2001,2002 Russell L. Smith.       *
+  * All rights reserved.  Email: russ@q12.org   Web: www.q12.org          *
+  *                                                                       *
+  * This library is free software; you can redistribute it and/or         *
+  * modify it under the terms of EITHER:                                  *
+  *   (1) The GNU Lesser General Public License as published by the Free  *
+  *       Software Foundation; either version 2.1 of the License, or (at  *
+  *       your option) any later version. The text of the GNU Lesser      *
+  *       General Public License is included with this library in the     *
+  *       file LICENSE.TXT.                                               *
+  *   (2) The BSD-style license that is included with this library in     *
+  *       the file LICENSE-BSD.TXT.                                       *
+  *                                                                       *
+  * This library is distributed in the hope that it will be useful,       *
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the files    *
+  * LICENSE.TXT and LICENSE-BSD.TXT for more details.                     *
+  *                                                                       *
+  *************************************************************************/
+
+////////////////////////////////////////////////////////////////////////////////
+// This file create unit test for some of the world functions found in:
+// ode/src/ode.cpp
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+#include <UnitTest++.h>
+#include <ode/ode.h>
+#include "../ode/src/util.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+
+// Step memory manager that counts the memory it hands out and the most
+// that was in use at once. It shrinks blocks with realloc(), as ODE's
+// default manager does.
+static size_t g_stepMemoryInUse = 0;
+static size_t g_stepMemoryPeak = 0;
+
+static void *countingStepAlloc(size_t size)
+{
+    g_stepMemoryInUse += size;
+    if (g_stepMemoryInUse > g_stepMemoryPeak) g_stepMemoryPeak = g_stepMemoryInUse;
+    return malloc(size);
+}
+
+static void *countingStepShrink(void *block, size_t size, size_t smallerSize)
+{
+    g_stepMemoryInUse -= size - smallerSize;
+    return realloc(block, smallerSize);
+}
+
+static void countingStepFree(void *block, size_t size)
+{
+    g_stepMemoryInUse -= size;
+    free(block);
+}
+
+static size_t stepMemoryInUse() { return g_stepMemoryInUse; }
+static size_t stepMemoryPeak() { return g_stepMemoryPeak; }
+static void resetStepMemoryPeak() { g_stepMemoryPeak = g_stepMemoryInUse; }
+
+static void setCountingStepMemoryManager(dWorldID w)
+{
+    dWorldStepMemoryFunctionsInfo memfuncs;
+    memfuncs.struct_size = sizeof(memfuncs);
+    memfuncs.alloc_block = &countingStepAlloc;
+    memfuncs.shrink_block = &countingStepShrink;
+    memfuncs.free_block = &countingStepFree;
+    dWorldSetStepMemoryManager(w, &memfuncs);
+}
+
+
+SUITE (TestWorldObjectMemory)
+{
+    static size_t allocated_blocks = 0;
+    static size_t allocated_bytes = 0;
+
+    static void *countingAlloc(size_t block_size)
+    {
+        ++allocated_blocks;
+        allocated_bytes += block_size;
+        return malloc(block_size);
+    }
+
+    static void countingFree(void *block_pointer, size_t block_size)
+    {
+        --allocated_blocks;
+        allocated_bytes -= block_size;
+        free(block_pointer);
+    }
+
+    TEST(test_custom_object_memory_manager)
+    {
+        dWorldID w = dWorldCreate();
+
+        dWorldObjectMemoryFunctionsInfo memfuncs;
+        memfuncs.struct_size = sizeof(memfuncs);
+        memfuncs.alloc_block = &countingAlloc;
+        memfuncs.free_block = &countingFree;
+        CHECK_EQUAL(1, dWorldSetObjectMemoryManager(w, &memfuncs));
+
+        dBodyID b1 = dBodyCreate(w);
+        dBodyID b2 = dBodyCreate(w);
+        dJointID j = dJointCreateHinge(w, 0);
+        dJointAttach(j, b1, b2);
+        CHECK_EQUAL(3u, allocated_blocks);
+
+        // grouped joints stay in the group storage
+        dJointGroupID group = dJointGroupCreate(0);
+        dJointCreateBall(w, group);
+        CHECK_EQUAL(3u, allocated_blocks);
+        dJointGroupDestroy(group);
+
+        dJointDestroy(j);
+        dBodyDestroy(b1);
+        CHECK_EQUAL(1u, allocated_blocks);
+
+        dWorldDestroy(w);
+        CHECK_EQUAL(0u, allocated_blocks);
+        CHECK_EQUAL(0u, allocated_bytes);
+    }
+
+    TEST(test_pooled_objects_churn)
+    {
+        dWorldID w = dWorldCreate();
+        dSpaceID s = dSimpleSpaceCreate(0);
+
+        dBodyID bodies[64];
+        dGeomID geoms[64];
+        for (int round = 0; round != 8; ++round) {
+            for (int i = 0; i != 64; ++i) {
+                bodies[i] = dBodyCreate(w);
+                dBodySetPosition(bodies[i], (dReal)i, (dReal)round, 0);
+                geoms[i] = dCreateSphere(s, 1);
+                dGeomSetBody(geoms[i], bodies[i]);
+                dGeomSetOffsetPosition(geoms[i], 0, 0, 1);
+            }
+            for (int i = 0; i != 64; ++i) {
+                const dReal *pos = dGeomGetPosition(geoms[i]);
+                CHECK_EQUAL((dReal)i, pos[0]);
+                CHECK_EQUAL((dReal)round, pos[1]);
+                CHECK_EQUAL(1, pos[2]);
+            }
+            for (int i = 0; i != 64; i += 2) {
+                dGeomDestroy(geoms[i]);
+                dBodyDestroy(bodies[i]);
+            }
+            for (int i = 1; i < 64; i += 2) {
+                dGeomDestroy(geoms[i]);
+                dBodyDestroy(bodies[i]);
+            }
+        }
+
+        dSpaceDestroy(s);
+        dWorldDestroy(w);
+    }
+}
+
+
+SUITE (TestWorldStepStats)
+{
+    // Builds three chains of two hinged bodies plus one free body
+    static void populateWorld(dWorldID w)
+    {
+        for (int chain = 0; chain != 3; ++chain) {
+            dBodyID b1 = dBodyCreate(w);
+            dBodyID b2 = dBodyCreate(w);
+            dBodySetPosition(b1, (dReal)(chain * 10), 0, 0);
+            dBodySetPosition(b2, (dReal)(chain * 10), 1, 0);
+            dJointID j = dJointCreateHinge(w, 0);
+            dJointAttach(j, b1, b2);
+            dJointSetHingeAnchor(j, (dReal)(chain * 10), REAL(0.5), 0);
+            dJointSetHingeAxis(j, 0, 0, 1);
+        }
+        dBodyCreate(w);
+    }
+
+    TEST(test_step_stats_disabled_by_default)
+    {
+        dWorldID w = dWorldCreate();
+        populateWorld(w);
+
+        CHECK_EQUAL(0, dWorldGetStepStatsEnabled(w));
+        dWorldStep(w, REAL(0.01));
+
+        dWorldStepStats stats;
+        stats.struct_size = sizeof(stats);
+        CHECK_EQUAL(0, dWorldGetStepStats(w, &stats));
+
+        dWorldDestroy(w);
+    }
+
+    TEST(test_step_stats_counters)
+    {
+        dWorldID w = dWorldCreate();
+        populateWorld(w);
+
+        CHECK_EQUAL(1, dWorldSetStepStatsEnabled(w, 1));
+        CHECK_EQUAL(1, dWorldGetStepStatsEnabled(w));
+
+        dWorldStepStats stats;
+        stats.struct_size = sizeof(stats);
+        CHECK_EQUAL(0, dWorldGetStepStats(w, &stats));
+
+        dWorldQuickStep(w, REAL(0.01));
+        CHECK_EQUAL(1, dWorldGetStepStats(w, &stats));
+        CHECK_EQUAL(sizeof(stats), (size_t)stats.struct_size);
+        CHECK_EQUAL(4u, stats.island_count);
+        CHECK_EQUAL(7u, stats.body_count);
+        CHECK_EQUAL(3u, stats.joint_count);
+        CHECK_EQUAL(2u, stats.max_island_bodies);
+        CHECK_EQUAL(1u, stats.max_island_joints);
+        CHECK_EQUAL(15u, stats.constraint_rows); // 5 rows per hinge
+        CHECK_EQUAL(3u * (unsigned)dWorldGetQuickStepNumIterations(w), stats.solver_iterations);
+        CHECK(stats.thread_count >= 1);
+
+        unsigned islands = 0;
+        double busy = 0;
+        for (unsigned i = 0; i != stats.thread_count && i != dWORLDSTEPSTATS_MAX_THREADS; ++i) {
+            islands += stats.threads[i].island_count;
+            busy += stats.threads[i].busy_time;
+            CHECK(stats.threads[i].busy_time <= stats.islands_time);
+        }
+        CHECK_EQUAL(4u, islands);
+
+        double phases = 0;
+        for (int phase = dStepPhaseAssembly; phase != dStepPhase__MAX; ++phase) {
+            CHECK(stats.phase_time[phase] >= 0);
+            phases += stats.phase_time[phase];
+        }
+        CHECK(phases <= busy);
+        CHECK(stats.islands_time <= stats.step_time);
+
+        dWorldStep(w, REAL(0.01));
+        CHECK_EQUAL(1, dWorldGetStepStats(w, &stats));
+        CHECK_EQUAL(15u, stats.constraint_rows);
+        CHECK_EQUAL(0u, stats.solver_iterations);
+
+        // a shorter structure is filled partially
+        dWorldStepStats partial;
+        memset(&partial, 0, sizeof(partial));
+        partial.struct_size = (unsigned)((char *)&partial.island_count - (char *)&partial);
+        CHECK_EQUAL(1, dWorldGetStepStats(w, &partial));
+        CHECK_EQUAL(0u, partial.island_count);
+        CHECK_EQUAL(stats.step_time, partial.step_time);
+
+        CHECK_EQUAL(1, dWorldSetStepStatsEnabled(w, 0));
+        CHECK_EQUAL(0, dWorldGetStepStats(w, &stats));
+
+        dWorldDestroy(w);
+    }
+}
+
+
+SUITE (TestWorldSparseStep)
+{
+    const int chainLength = 12;
+
+    // A hinge chain hanging from the static environment with a loop closed by
+    // a ball joint, an active hinge limit and a motor, and a ground contact
+    // created every step.
+    static void buildChain(dWorldID w, dBodyID *bodies, dJointFeedback *feedback)
+    {
+        dWorldSetGravity(w, 0, 0, REAL(-9.81));
+
+        for (int i = 0; i != chainLength; ++i) {
+            dBodyID b = dBodyCreate(w);
+            dMass mass;
+            dMassSetBox(&mass, 1, REAL(0.9), REAL(0.2), REAL(0.2));
+            dBodySetMass(b, &mass);
+            dBodySetPosition(b, REAL(0.5) + i, 0, REAL(0.5) + REAL(0.01) * i);
+            dBodySetAngularVel(b, 0, REAL(0.1) * (i % 3), 0);
+            bodies[i] = b;
+        }
+
+        for (int i = 0; i != chainLength; ++i) {
+            dJointID j = dJointCreateHinge(w, 0);
+            dJointAttach(j, bodies[i], i != 0 ? bodies[i - 1] : 0);
+            dJointSetHingeAnchor(j, (dReal)i, 0, REAL(0.5) + REAL(0.01) * i);
+            dJointSetHingeAxis(j, 0, 1, (i & 1) ? REAL(0.2) : 0);
+            if (i == 3) {
+                dJointSetHingeParam(j, dParamLoStop, REAL(-0.01));
+                dJointSetHingeParam(j, dParamHiStop, REAL(0.01));
+            }
+            if (i == 5) {
+                dJointSetHingeParam(j, dParamVel, 1);
+                dJointSetHingeParam(j, dParamFMax, 5);
+            }
+            if (i == chainLength - 1) {
+                dJointSetFeedback(j, feedback);
+            }
+        }
+
+        dJointID loop = dJointCreateBall(w, 0);
+        dJointAttach(loop, bodies[2], bodies[8]);
+        dJointSetBallAnchor(loop, REAL(5.0), 0, REAL(0.5));
+    }
+
+    static void addGroundContact(dWorldID w, dJointGroupID contacts, dBodyID b)
+    {
+        dContact contact;
+        memset(&contact, 0, sizeof(contact));
+        contact.surface.mode = dContactApprox1;
+        contact.surface.mu = 1;
+        const dReal *pos = dBodyGetPosition(b);
+        contact.geom.pos[0] = pos[0];
+        contact.geom.pos[1] = pos[1];
+        contact.geom.pos[2] = pos[2] - REAL(0.1);
+        contact.geom.normal[2] = 1;
+        contact.geom.depth = REAL(0.001);
+        dJointID j = dJointCreateContact(w, contacts, &contact);
+        dJointAttach(j, b, 0);
+    }
+
+    TEST(test_sparse_step_matches_step)
+    {
+        dWorldID worlds[2];
+        dBodyID bodies[2][chainLength];
+        dJointFeedback feedback[2];
+        dJointGroupID contacts = dJointGroupCreate(0);
+
+        for (int n = 0; n != 2; ++n) {
+            worlds[n] = dWorldCreate();
+            buildChain(worlds[n], bodies[n], &feedback[n]);
+        }
+
+        for (int step = 0; step != 20; ++step) {
+            for (int n = 0; n != 2; ++n) {
+                addGroundContact(worlds[n], contacts, bodies[n][chainLength - 1]);
+                CHECK_EQUAL(1, n == 0 ? dWorldStep(worlds[n], REAL(0.01)) : dWorldSparseStep(worlds[n], REAL(0.01)));
+                dJointGroupEmpty(contacts);
+            }
+        }
+
+        const dReal tolerance = REAL(1e-4);
+        for (int i = 0; i != chainLength; ++i) {
+            CHECK_ARRAY_CLOSE(dBodyGetPosition(bodies[0][i]), dBodyGetPosition(bodies[1][i]), 3, tolerance);
+            CHECK_ARRAY_CLOSE(dBodyGetQuaternion(bodies[0][i]), dBodyGetQuaternion(bodies[1][i]), 4, tolerance);
+            CHECK_ARRAY_CLOSE(dBodyGetLinearVel(bodies[0][i]), dBodyGetLinearVel(bodies[1][i]), 3, tolerance);
+            CHECK_ARRAY_CLOSE(dBodyGetAngularVel(bodies[0][i]), dBodyGetAngularVel(bodies[1][i]), 3, tolerance);
+        }
+        CHECK_ARRAY_CLOSE(feedback[0].f1, feedback[1].f1, 3, REAL(1e-2));
+        CHECK_ARRAY_CLOSE(feedback[0].t1, feedback[1].t1, 3, REAL(1e-2));
+
+        dJointGroupDestroy(contacts);
+        dWorldDestroy(worlds[0]);
+        dWorldDestroy(worlds[1]);
+    }
+
+    TEST(test_sparse_step_stats)
+    {
+        dWorldID w = dWorldCreate();
+        dBodyID bodies[chainLength];
+        dJointFeedback feedback;
+        buildChain(w, bodies, &feedback);
+
+        dWorldSetStepStatsEnabled(w, 1);
+        CHECK_EQUAL(1, dWorldSparseStep(w, REAL(0.01)));
+
+        dWorldStepStats stats;
+        stats.struct_size = sizeof(stats);
+        CHECK_EQUAL(1, dWorldGetStepStats(w, &stats));
+        CHECK_EQUAL(1u, stats.island_count);
+        CHECK_EQUAL((unsigned)chainLength, stats.body_count);
+        CHECK_EQUAL((unsigned)chainLength + 1, stats.joint_count);
+        CHECK(stats.constraint_rows >= 5u * chainLength + 3u);
+        CHECK_EQUAL(0u, stats.solver_iterations);
+
+        dWorldDestroy(w);
+    }
+
+    // Memory reserved by a sparse step of a free hinge chain with one limit,
+    // zero if the step fails
+    static size_t chainStepMemory(int length)
+    {
+        dWorldID w = dWorldCreate();
+        setCountingStepMemoryManager(w);
+        dWorldSetStepMemoryReservationPolicy(w, NULL);
+
+        dBodyID prev = 0;
+        for (int i = 0; i != length; ++i) {
+            dBodyID b = dBodyCreate(w);
+            dBodySetPosition(b, REAL(0.5) + i, 0, 0);
+            dJointID j = dJointCreateHinge(w, 0);
+            dJointAttach(j, b, prev);
+            dJointSetHingeAnchor(j, (dReal)i, 0, 0);
+            dJointSetHingeAxis(j, 0, 1, 0);
+            if (i == 0) {
+                dJointSetHingeParam(j, dParamLoStop, 0);
+                dJointSetHingeParam(j, dParamHiStop, 0);
+            }
+            prev = b;
+        }
+
+        size_t memory = dWorldSparseStep(w, REAL(0.01)) ? stepMemoryInUse() : 0;
+
+        dWorldDestroy(w);
+        return memory;
+    }
+
+    TEST(test_sparse_step_memory_follows_unilateral_rows)
+    {
+        // the LCP only gets the limit row, the memory grows linearly
+        size_t shortChain = chainStepMemory(100);
+        size_t longChain = chainStepMemory(400);
+        CHECK(shortChain != 0 && longChain != 0);
+        CHECK(longChain < shortChain * 6);
+        CHECK_EQUAL(0u, stepMemoryInUse());
+    }
+}
+
+
+SUITE (TestWorldJointTypeBatches)
+{
+    const dReal gravity = REAL(9.81);
+
+    // A column of four unit masses hanging from the static environment by a
+    // fixed joint, a ball, a hinge and a slider, plus a body resting on a
+    // ground contact. The joints are created with their types interleaved so
+    // that the steppers have to regroup them.
+    struct Scene
+    {
+        dWorldID world;
+        dBodyID column[4];
+        dBodyID resting;
+        dJointID joints[4];
+        dJointFeedback feedback[5];
+        dJointGroupID contacts;
+
+        Scene()
+        {
+            world = dWorldCreate();
+            dWorldSetGravity(world, 0, 0, -gravity);
+            dWorldSetQuickStepNumIterations(world, 100);
+            contacts = dJointGroupCreate(0);
+
+            for (int i = 0; i != 4; ++i) {
+                column[i] = createBody(0, REAL(10.0) - i);
+            }
+            resting = createBody(REAL(5.0), REAL(0.5));
+
+            joints[2] = dJointCreateHinge(world, 0);
+            dJointAttach(joints[2], column[2], column[1]);
+            dJointSetHingeAnchor(joints[2], 0, 0, REAL(8.5));
+            dJointSetHingeAxis(joints[2], 1, 0, 0);
+
+            joints[0] = dJointCreateFixed(world, 0);
+            dJointAttach(joints[0], column[0], 0);
+            dJointSetFixed(joints[0]);
+
+            joints[3] = dJointCreateSlider(world, 0);
+            dJointAttach(joints[3], column[3], column[2]);
+            dJointSetSliderAxis(joints[3], 1, 0, 0);
+
+            joints[1] = dJointCreateBall(world, 0);
+            dJointAttach(joints[1], column[1], column[0]);
+            dJointSetBallAnchor(joints[1], 0, 0, REAL(9.5));
+
+            for (int i = 0; i != 4; ++i) {
+                dJointSetFeedback(joints[i], &feedback[i]);
+            }
+        }
+
+        ~Scene()
+        {
+            dJointGroupDestroy(contacts);
+            dWorldDestroy(world);
+        }
+
+        dBodyID createBody(dReal x, dReal z)
+        {
+            dBodyID b = dBodyCreate(world);
+            dMass mass;
+            dMassSetSphereTotal(&mass, 1, REAL(0.25));
+            dBodySetMass(b, &mass);
+            dBodySetPosition(b, x, 0, z);
+            return b;
+        }
+
+        void addGroundContact()
+        {
+            dContact contact;
+            memset(&contact, 0, sizeof(contact));
+            contact.surface.mode = dContactApprox1;
+            contact.surface.mu = 1;
+            const dReal *pos = dBodyGetPosition(resting);
+            contact.geom.pos[0] = pos[0];
+            contact.geom.pos[1] = pos[1];
+            contact.geom.pos[2] = pos[2] - REAL(0.25);
+            contact.geom.normal[2] = 1;
+            dJointID j = dJointCreateContact(world, contacts, &contact);
+            dJointAttach(j, resting, 0);
+            dJointSetFeedback(j, &feedback[4]);
+        }
+
+        int run(bool quick)
+        {
+            int result = 1;
+            for (int step = 0; step != 10; ++step) {
+                addGroundContact();
+                result &= quick ? dWorldQuickStep(world, REAL(0.01)) : dWorldStep(world, REAL(0.01));
+                dJointGroupEmpty(contacts);
+            }
+            return result;
+        }
+    };
+
+    TEST(test_mixed_joint_types_hold_equilibrium)
+    {
+        for (int quick = 0; quick != 2; ++quick) {
+            Scene scene;
+            CHECK_EQUAL(1, scene.run(quick != 0));
+
+            const dReal tolerance = quick ? REAL(5e-2) : REAL(2e-2);
+
+            // every joint carries the bodies hanging below it
+            for (int i = 0; i != 4; ++i) {
+                const dReal expected[3] = { 0, 0, gravity * (4 - i) };
+                CHECK_ARRAY_CLOSE(expected, scene.feedback[i].f1, 3, tolerance);
+                CHECK_CLOSE(REAL(10.0) - i, dBodyGetPosition(scene.column[i])[2], REAL(1e-3));
+            }
+
+            const dReal expected[3] = { 0, 0, gravity };
+            CHECK_ARRAY_CLOSE(expected, scene.feedback[4].f1, 3, tolerance);
+            CHECK_CLOSE(REAL(0.5), dBodyGetPosition(scene.resting)[2], REAL(1e-3));
+        }
+    }
+}
+
+
+// Builds a chain of boxes of unit mass and 0.1 side from 'origin' along
+// the unit axis 'dir', hanging from the static environment at 'origin'.
+// The links are ball joints, or ball and hinge joints in turn if 'hinges'
+// is set; the hinges turn about the x axis.
+static void buildBoxChain(dWorldID w, const dReal *origin, const dReal *dir, int length, int hinges,
+                          dBodyID *bodies, dJointID *joints)
+{
+    for (int i = 0; i != length; ++i) {
+        dBodyID b = dBodyCreate(w);
+        dMass mass;
+        dMassSetBox(&mass, 1, REAL(0.1), REAL(0.1), REAL(0.1));
+        dMassAdjust(&mass, 1);
+        dBodySetMass(b, &mass);
+        dReal offset = REAL(0.1) * (i + 1);
+        dBodySetPosition(b, origin[0] + dir[0] * offset, origin[1] + dir[1] * offset, origin[2] + dir[2] * offset);
+        bodies[i] = b;
+
+        dReal anchor = REAL(0.1) * i + REAL(0.05);
+        dJointID j;
+        if (!hinges || i % 2 == 0) {
+            j = dJointCreateBall(w, 0);
+            dJointAttach(j, b, i != 0 ? bodies[i - 1] : 0);
+            dJointSetBallAnchor(j, origin[0] + dir[0] * anchor, origin[1] + dir[1] * anchor, origin[2] + dir[2] * anchor);
+        } else {
+            j = dJointCreateHinge(w, 0);
+            dJointAttach(j, b, bodies[i - 1]);
+            dJointSetHingeAnchor(j, origin[0] + dir[0] * anchor, origin[1] + dir[1] * anchor, origin[2] + dir[2] * anchor);
+            dJointSetHingeAxis(j, 1, 0, 0);
+        }
+        if (joints) joints[i] = j;
+    }
+}
+
+// Builds a stack of unit boxes of unit mass standing on the ground plane
+// at the origin.
+static void buildBoxStack(dWorldID w, int height, dGeomID *boxes)
+{
+    for (int i = 0; i != height; ++i) {
+        dBodyID b = dBodyCreate(w);
+        dMass mass;
+        dMassSetBox(&mass, 1, 1, 1, 1);
+        dBodySetMass(b, &mass);
+        dBodySetPosition(b, 0, 0, REAL(0.5) + i);
+        boxes[i] = dCreateBox(0, 1, 1, 1);
+        dGeomSetBody(boxes[i], b);
+    }
+}
+
+// QuickSteps the world, colliding each box of a stack with the one below
+// it (the first one with the ground) before every step, with friction
+// strong enough to hold the boxes in place.
+static void quickStepBoxStack(dWorldID w, dGeomID *boxes, int height, dGeomID ground, int steps)
+{
+    dJointGroupID contacts = dJointGroupCreate(0);
+    for (int step = 0; step != steps; ++step) {
+        for (int i = 0; i != height; ++i) {
+            dGeomID below = i != 0 ? boxes[i - 1] : ground;
+            dContact contact[8];
+            int n = dCollide(boxes[i], below, 8, &contact[0].geom, sizeof(dContact));
+            for (int k = 0; k != n; ++k) {
+                contact[k].surface.mode = dContactApprox1;
+                contact[k].surface.mu = REAL(0.8);
+                dJointID j = dJointCreateContact(w, contacts, contact + k);
+                dJointAttach(j, dGeomGetBody(boxes[i]), dGeomGetBody(below));
+            }
+        }
+        dWorldQuickStep(w, REAL(0.01));
+        dJointGroupEmpty(contacts);
+    }
+    dJointGroupDestroy(contacts);
+}
+
+
+SUITE (TestWorldQuickStepSolver)
+{
+    // Steps a unit box resting on the ground under gravity tilted by the
+    // given side pull, with friction strong enough to hold it in place,
+    // and returns how far the box has crept along the ground.
+    static dReal stepBoxOnSlope(int solver, int iterations, dReal pull)
+    {
+        dRandSetSeed(1);
+
+        dWorldID w = dWorldCreate();
+        dWorldSetGravity(w, pull, 0, REAL(-9.81));
+        dWorldSetQuickStepNumIterations(w, iterations);
+        dWorldSetQuickStepSolver(w, solver);
+
+        dGeomID box;
+        buildBoxStack(w, 1, &box);
+        dGeomID ground = dCreatePlane(0, 0, 0, 1, 0);
+        quickStepBoxStack(w, &box, 1, ground, 100);
+
+        dReal creep = dFabs(dBodyGetPosition(dGeomGetBody(box))[0]);
+
+        dGeomDestroy(ground);
+        dGeomDestroy(box);
+        dWorldDestroy(w);
+        return creep;
+    }
+
+    // Hangs a chain of ball-jointed boxes straight down from the static
+    // environment, takes one step from rest and returns the fastest body's
+    // speed, which would be (nearly, with the tiny CFM) zero with an exact
+    // solution.
+    static dReal stepHangingChain(int solver, int iterations, unsigned *usedIterations)
+    {
+        const int chainLength = 20;
+        const dReal origin[3] = { 0, 0, 0 }, down[3] = { 0, 0, -1 };
+
+        dWorldID w = dWorldCreate();
+        dWorldSetGravity(w, 0, 0, REAL(-9.81));
+        dWorldSetERP(w, 0);
+        dWorldSetCFM(w, REAL(1e-9));
+        dWorldSetQuickStepNumIterations(w, iterations);
+        dWorldSetQuickStepSolver(w, solver);
+        dWorldSetStepStatsEnabled(w, 1);
+
+        dBodyID bodies[chainLength];
+        buildBoxChain(w, origin, down, chainLength, 0, bodies, 0);
+
+        dWorldQuickStep(w, REAL(0.01));
+
+        dWorldStepStats stats;
+        stats.struct_size = sizeof(stats);
+        dWorldGetStepStats(w, &stats);
+        *usedIterations = stats.solver_iterations;
+
+        dReal speed = 0;
+        for (int i = 0; i != chainLength; ++i) {
+            dReal s = dCalcVectorLength3(dBodyGetLinearVel(bodies[i]));
+            if (s > speed) speed = s;
+        }
+
+        dWorldDestroy(w);
+        return speed;
+    }
+
+    TEST(test_quickstep_solver_setting)
+    {
+        dWorldID w = dWorldCreate();
+        CHECK_EQUAL(dQuickStepSOR, dWorldGetQuickStepSolver(w));
+        dWorldSetQuickStepSolver(w, dQuickStepBlockContacts);
+        CHECK_EQUAL(dQuickStepBlockContacts, dWorldGetQuickStepSolver(w));
+        dWorldSetQuickStepSolver(w, dQuickStepPGSCG);
+        CHECK_EQUAL(dQuickStepPGSCG, dWorldGetQuickStepSolver(w));
+        dWorldDestroy(w);
+    }
+
+    TEST(test_pgs_cg_solves_chains)
+    {
+        // the sweeps alone leave the chain links visibly falling after
+        // several times as many iterations
+        unsigned usedIterations;
+        CHECK(stepHangingChain(dQuickStepSOR, 160, &usedIterations) > REAL(1e-2));
+        CHECK_EQUAL(160u, usedIterations);
+        CHECK(stepHangingChain(dQuickStepPGSCG, 40, &usedIterations) < REAL(1e-4));
+        CHECK_EQUAL(40u, usedIterations);
+    }
+
+    TEST(test_pgs_cg_stops_when_converged)
+    {
+        unsigned usedIterations;
+        CHECK(stepHangingChain(dQuickStepPGSCG, 320, &usedIterations) < REAL(1e-4));
+        CHECK(usedIterations < 320u);
+    }
+
+    TEST(test_pgs_cg_leaves_contacts_to_the_sweeps)
+    {
+        // a resting box keeps still: its contact rows are not refined
+        CHECK(stepBoxOnSlope(dQuickStepPGSCG, 32, 0) < REAL(1e-4));
+    }
+
+    TEST(test_block_contacts_hold_on_slope)
+    {
+        // the friction rows converge together with the normal rows, so the
+        // box creeps less than with the scalar rows at the same iterations
+        CHECK(stepBoxOnSlope(dQuickStepBlockContacts, 8, 6) < stepBoxOnSlope(dQuickStepSOR, 8, 6));
+        CHECK(stepBoxOnSlope(dQuickStepBlockContacts, 16, 6) < stepBoxOnSlope(dQuickStepSOR, 16, 6));
+        CHECK(stepBoxOnSlope(dQuickStepBlockContacts, 64, 6) < REAL(1e-4));
+    }
+
+    TEST(test_block_contacts_slide_like_sor)
+    {
+        // past the friction limit the box slides at (pull - mu*g) either way
+        const dReal expected = REAL(0.5) * (9 - REAL(0.8) * REAL(9.81));
+        CHECK_CLOSE(expected, stepBoxOnSlope(dQuickStepSOR, 16, 9), REAL(0.05));
+        CHECK_CLOSE(expected, stepBoxOnSlope(dQuickStepBlockContacts, 16, 9), REAL(0.05));
+    }
+}
+
+
+SUITE (TestWorldQuickStepRowOrder)
+{
+    // Hangs a chain of boxes from the static environment, linked by ball
+    // and hinge joints in turn, so that the island's rows (grouped by joint
+    // type) are out of chain order, and takes one step from rest. Returns
+    // the fastest body's speed and the largest error of the joint forces
+    // against the weights the joints carry.
+    static dReal stepMixedChain(int solver, int rowOrder, int iterations, dReal *forceError)
+    {
+        const int chainLength = 12;
+        const dReal origin[3] = { 0, 0, 0 }, down[3] = { 0, 0, -1 };
+
+        dWorldID w = dWorldCreate();
+        dWorldSetGravity(w, 0, 0, REAL(-9.81));
+        dWorldSetERP(w, 0);
+        dWorldSetCFM(w, REAL(1e-9));
+        dWorldSetQuickStepNumIterations(w, iterations);
+        dWorldSetQuickStepSolver(w, solver);
+        dWorldSetQuickStepRowOrder(w, rowOrder);
+
+        dBodyID bodies[chainLength];
+        dJointID joints[chainLength];
+        dJointFeedback feedback[chainLength];
+        buildBoxChain(w, origin, down, chainLength, 1, bodies, joints);
+        for (int i = 0; i != chainLength; ++i) dJointSetFeedback(joints[i], feedback + i);
+
+        dWorldQuickStep(w, REAL(0.01));
+
+        dReal speed = 0;
+        *forceError = 0;
+        for (int i = 0; i != chainLength; ++i) {
+            dReal s = dCalcVectorLength3(dBodyGetLinearVel(bodies[i]));
+            if (s > speed) speed = s;
+            dReal e = dFabs(feedback[i].f1[2] - (chainLength - i) * REAL(9.81));
+            if (e > *forceError) *forceError = e;
+        }
+
+        dWorldDestroy(w);
+        return speed;
+    }
+
+    // Steps a stack of unit boxes resting on the ground and returns how far
+    // the top box has moved from where it started.
+    static dReal stepBoxStack(int solver, int rowOrder)
+    {
+        const int stackHeight = 5;
+
+        dWorldID w = dWorldCreate();
+        dWorldSetGravity(w, 0, 0, REAL(-9.81));
+        dWorldSetQuickStepSolver(w, solver);
+        dWorldSetQuickStepRowOrder(w, rowOrder);
+
+        dGeomID boxes[stackHeight];
+        buildBoxStack(w, stackHeight, boxes);
+        dGeomID ground = dCreatePlane(0, 0, 0, 1, 0);
+        quickStepBoxStack(w, boxes, stackHeight, ground, 100);
+
+        const dReal *top = dBodyGetPosition(dGeomGetBody(boxes[stackHeight - 1]));
+        dReal drift = dSqrt(top[0] * top[0] + top[1] * top[1]
+            + (top[2] - (stackHeight - REAL(0.5))) * (top[2] - (stackHeight - REAL(0.5))));
+
+        dGeomDestroy(ground);
+        for (int i = 0; i != stackHeight; ++i) dGeomDestroy(boxes[i]);
+        dWorldDestroy(w);
+        return drift;
+    }
+
+    TEST(test_quickstep_row_order_setting)
+    {
+        dWorldID w = dWorldCreate();
+        CHECK_EQUAL(dQuickStepRowsShuffled, dWorldGetQuickStepRowOrder(w));
+        dWorldSetQuickStepRowOrder(w, dQuickStepRowsByBody);
+        CHECK_EQUAL(dQuickStepRowsByBody, dWorldGetQuickStepRowOrder(w));
+        dWorldDestroy(w);
+    }
+
+    TEST(test_rows_by_body_solve_like_shuffled)
+    {
+        // the sweeps converge to the same solution in either order, and the
+        // forces come back for the right joints
+        dReal forceError;
+        CHECK(stepMixedChain(dQuickStepSOR, dQuickStepRowsShuffled, 400, &forceError) < REAL(1e-4));
+        CHECK(forceError < REAL(1e-2));
+        CHECK(stepMixedChain(dQuickStepSOR, dQuickStepRowsByBody, 400, &forceError) < REAL(1e-4));
+        CHECK(forceError < REAL(1e-2));
+    }
+
+    TEST(test_rows_by_body_hold_stacks)
+    {
+        CHECK(stepBoxStack(dQuickStepSOR, dQuickStepRowsShuffled) < REAL(0.02));
+        CHECK(stepBoxStack(dQuickStepSOR, dQuickStepRowsByBody) < REAL(0.02));
+    }
+
+    TEST(test_rows_by_body_keep_contact_blocks)
+    {
+        // the rows of a contact stay consecutive when ordered by body, and
+        // their friction rows still point at the normal row
+        CHECK(stepBoxStack(dQuickStepBlockContacts, dQuickStepRowsShuffled) < REAL(0.02));
+        CHECK(stepBoxStack(dQuickStepBlockContacts, dQuickStepRowsByBody) < REAL(0.02));
+    }
+}
+
+
+SUITE (TestWorldQuickStepMixedPrecision)
+{
+    const int stackHeight = 4;
+    const int chainLength = 10;
+
+    // Steps a stack of boxes on the ground next to a chain of boxes hanging
+    // from the static environment and swinging sideways, and stores the
+    // final body positions and the force on the top chain joint.
+    static void stepStackAndChain(int mixed, int solver, int steps, dVector3 *positions, dReal *topForce)
+    {
+        dRandSetSeed(1);
+
+        dWorldID w = dWorldCreate();
+        dWorldSetGravity(w, 0, 0, REAL(-9.81));
+        dWorldSetQuickStepSolver(w, solver);
+        dWorldSetQuickStepMixedPrecision(w, mixed);
+
+        dGeomID boxes[stackHeight];
+        buildBoxStack(w, stackHeight, boxes);
+        dGeomID ground = dCreatePlane(0, 0, 0, 1, 0);
+
+        // the chain starts out level, so it swings down
+        const dReal origin[3] = { 5, 0, 10 }, across[3] = { 0, 1, 0 };
+        dBodyID bodies[stackHeight + chainLength];
+        dJointID joints[chainLength];
+        dJointFeedback feedback;
+        for (int i = 0; i != stackHeight; ++i) bodies[i] = dGeomGetBody(boxes[i]);
+        buildBoxChain(w, origin, across, chainLength, 0, bodies + stackHeight, joints);
+        dJointSetFeedback(joints[0], &feedback);
+
+        quickStepBoxStack(w, boxes, stackHeight, ground, steps);
+
+        for (int i = 0; i != stackHeight + chainLength; ++i) {
+            const dReal *p = dBodyGetPosition(bodies[i]);
+            positions[i][0] = p[0];
+            positions[i][1] = p[1];
+            positions[i][2] = p[2];
+        }
+        *topForce = dCalcVectorLength3(feedback.f1);
+
+        dGeomDestroy(ground);
+        for (int i = 0; i != stackHeight; ++i) dGeomDestroy(boxes[i]);
+        dWorldDestroy(w);
+    }
+
+    // Returns the largest difference in body positions and the relative
+    // difference in the top chain joint force between the mixed and the
+    // full precision solutions.
+    static dReal compareMixedPrecision(int solver, int steps, dReal *forceError)
+    {
+        dVector3 full[stackHeight + chainLength], mixed[stackHeight + chainLength];
+        dReal fullForce, mixedForce;
+        stepStackAndChain(0, solver, steps, full, &fullForce);
+        stepStackAndChain(1, solver, steps, mixed, &mixedForce);
+
+        dReal positionError = 0;
+        for (int i = 0; i != stackHeight + chainLength; ++i) {
+            for (int k = 0; k != 3; ++k) {
+                dReal e = dFabs(full[i][k] - mixed[i][k]);
+                if (e > positionError) positionError = e;
+            }
+        }
+        *forceError = dFabs(fullForce - mixedForce) / fullForce;
+        return positionError;
+    }
+
+    TEST(test_quickstep_mixed_precision_setting)
+    {
+        dWorldID w = dWorldCreate();
+        CHECK_EQUAL(0, dWorldGetQuickStepMixedPrecision(w));
+        dWorldSetQuickStepMixedPrecision(w, 1);
+        CHECK_EQUAL(1, dWorldGetQuickStepMixedPrecision(w));
+        dWorldDestroy(w);
+    }
+
+    TEST(test_mixed_precision_step_matches_full_precision)
+    {
+        // the float rounding is orders of magnitude below the error of
+        // stopping after 20 iterations, which moves the bodies by about
+        // 1e-5 in the first step
+        dReal forceError;
+        CHECK(compareMixedPrecision(dQuickStepSOR, 1, &forceError) < REAL(1e-7));
+        CHECK(forceError < REAL(1e-5));
+        CHECK(compareMixedPrecision(dQuickStepBlockContacts, 1, &forceError) < REAL(1e-7));
+        CHECK(forceError < REAL(1e-5));
+        CHECK(compareMixedPrecision(dQuickStepPGSCG, 1, &forceError) < REAL(1e-7));
+        CHECK(forceError < REAL(1e-5));
+    }
+
+    TEST(test_mixed_precision_holds_stacks)
+    {
+        dVector3 positions[stackHeight + chainLength];
+        dReal topForce;
+        stepStackAndChain(1, dQuickStepSOR, 100, positions, &topForce);
+        const dReal *top = positions[stackHeight - 1];
+        CHECK_CLOSE(0, top[0], REAL(0.02));
+        CHECK_CLOSE(0, top[1], REAL(0.02));
+        CHECK_CLOSE(stackHeight - REAL(0.5), top[2], REAL(0.02));
+    }
+}
+
+
+SUITE (TestWorldIslandScheduling)
+{
+    const int pendulumCount = 12;
+    const int chainLength = 10;
+
+    // A body hanging from the static environment on a ball joint, a tiny
+    // island the stepper gets batched with its neighbours
+    static dBodyID buildPendulum(dWorldID w, int i)
+    {
+        dWorldSetGravity(w, 0, 0, REAL(-9.81));
+
+        dBodyID b = dBodyCreate(w);
+        dBodySetPosition(b, (dReal)(3 * i), REAL(0.5), 0);
+        dBodySetLinearVel(b, 0, 0, REAL(0.1) * i);
+        dJointID j = dJointCreateBall(w, 0);
+        dJointAttach(j, b, 0);
+        dJointSetBallAnchor(j, (dReal)(3 * i), 0, 0);
+        return b;
+    }
+
+    static void buildChain(dWorldID w)
+    {
+        dBodyID prev = 0;
+        for (int i = 0; i != chainLength; ++i) {
+            dBodyID b = dBodyCreate(w);
+            dBodySetPosition(b, 0, (dReal)(-1 - i), REAL(5.0));
+            dJointID j = dJointCreateHinge(w, 0);
+            dJointAttach(j, b, prev);
+            dJointSetHingeAnchor(j, 0, REAL(-0.5) - i, REAL(5.0));
+            dJointSetHingeAxis(j, 1, 0, 0);
+            prev = b;
+        }
+    }
+
+    TEST(test_batched_islands_step_like_separate_worlds)
+    {
+        for (int stepper = 0; stepper != 2; ++stepper) {
+            dWorldID w = dWorldCreate();
+            dBodyID bodies[pendulumCount];
+            dWorldID solo[pendulumCount];
+            dBodyID soloBodies[pendulumCount];
+            for (int i = 0; i != pendulumCount; ++i) {
+                bodies[i] = buildPendulum(w, i);
+                solo[i] = dWorldCreate();
+                soloBodies[i] = buildPendulum(solo[i], i);
+            }
+            buildChain(w);
+
+            for (int step = 0; step != 20; ++step) {
+                if (stepper == 0) {
+                    dWorldStep(w, REAL(0.01));
+                } else {
+                    dWorldSparseStep(w, REAL(0.01));
+                }
+                for (int i = 0; i != pendulumCount; ++i) {
+                    if (stepper == 0) {
+                        dWorldStep(solo[i], REAL(0.01));
+                    } else {
+                        dWorldSparseStep(solo[i], REAL(0.01));
+                    }
+                }
+            }
+
+            for (int i = 0; i != pendulumCount; ++i) {
+                CHECK_ARRAY_CLOSE(dBodyGetPosition(soloBodies[i]), dBodyGetPosition(bodies[i]), 3, REAL(1e-4));
+                CHECK_ARRAY_CLOSE(dBodyGetLinearVel(soloBodies[i]), dBodyGetLinearVel(bodies[i]), 3, REAL(1e-3));
+                dWorldDestroy(solo[i]);
+            }
+            dWorldDestroy(w);
+        }
+    }
+
+    TEST(test_batched_islands_counted_separately)
+    {
+        dWorldID w = dWorldCreate();
+        for (int i = 0; i != pendulumCount; ++i) {
+            buildPendulum(w, i);
+        }
+        buildChain(w);
+
+        dWorldSetStepStatsEnabled(w, 1);
+        dWorldQuickStep(w, REAL(0.01));
+
+        dWorldStepStats stats;
+        stats.struct_size = sizeof(stats);
+        CHECK_EQUAL(1, dWorldGetStepStats(w, &stats));
+        CHECK_EQUAL((unsigned)pendulumCount + 1, stats.island_count);
+        CHECK_EQUAL((unsigned)chainLength, stats.max_island_bodies);
+
+        unsigned islands = 0;
+        for (unsigned i = 0; i != stats.thread_count && i != dWORLDSTEPSTATS_MAX_THREADS; ++i) {
+            islands += stats.threads[i].island_count;
+        }
+        CHECK_EQUAL((unsigned)pendulumCount + 1, islands);
+
+        dWorldDestroy(w);
+    }
+}
+
+
+SUITE (TestWorldActiveSet)
+{
+    TEST(test_stepping_enables_attached_bodies)
+    {
+        dWorldID w = dWorldCreate();
+        dWorldSetGravity(w, 0, 0, REAL(-9.81));
+
+        // an enabled body at the end of a chain of disabled ones
+        dBodyID bodies[4];
+        for (int i = 0; i != 4; ++i) {
+            bodies[i] = dBodyCreate(w);
+            dBodySetPosition(bodies[i], (dReal)i, 0, 0);
+            if (i != 0) {
+                dJointID j = dJointCreateBall(w, 0);
+                dJointAttach(j, bodies[i - 1], bodies[i]);
+                dJointSetBallAnchor(j, REAL(0.5) + (i - 1), 0, 0);
+                dBodyDisable(bodies[i]);
+            }
+        }
+        // a disabled body attached by a disabled joint stays disabled
+        dBodyID loose = dBodyCreate(w);
+        dBodySetPosition(loose, -1, 0, 0);
+        dJointID looseJoint = dJointCreateBall(w, 0);
+        dJointAttach(looseJoint, bodies[0], loose);
+        dJointSetBallAnchor(looseJoint, REAL(-0.5), 0, 0);
+        dJointDisable(looseJoint);
+        dBodyDisable(loose);
+
+        dWorldStep(w, REAL(0.01));
+
+        for (int i = 0; i != 4; ++i) {
+            CHECK(dBodyIsEnabled(bodies[i]));
+            CHECK(dBodyGetPosition(bodies[i])[2] < 0);
+        }
+        CHECK(!dBodyIsEnabled(loose));
+        CHECK_EQUAL(0, dBodyGetPosition(loose)[2]);
+
+        dWorldDestroy(w);
+    }
+
+    TEST(test_disabled_bodies_are_skipped)
+    {
+        dWorldID w = dWorldCreate();
+        dWorldSetGravity(w, 0, 0, REAL(-9.81));
+        dWorldSetAutoDisableFlag(w, 1);
+        dWorldSetAutoDisableSteps(w, 2);
+        dWorldSetAutoDisableTime(w, 0);
+
+        const int count = 50;
+        dBodyID bodies[count];
+        for (int i = 0; i != count; ++i) {
+            bodies[i] = dBodyCreate(w);
+            dBodySetPosition(bodies[i], (dReal)i, 0, 0);
+            // bodies hanging from the environment do not fall asleep in mid air
+            dJointID j = dJointCreateBall(w, 0);
+            dJointAttach(j, bodies[i], 0);
+            dJointSetBallAnchor(j, (dReal)i, 0, 0);
+            if (i % 5 == 0) {
+                dBodySetAutoDisableFlag(bodies[i], 0);
+            }
+        }
+        dBodyDestroy(bodies[count - 1]);
+
+        for (int step = 0; step != 5; ++step) {
+            dWorldStep(w, REAL(0.01));
+        }
+
+        for (int i = 0; i != count - 1; ++i) {
+            CHECK_EQUAL(i % 5 == 0, dBodyIsEnabled(bodies[i]) != 0);
+        }
+
+        // an enabled body is stepped again
+        dBodyEnable(bodies[1]);
+        dBodySetLinearVel(bodies[1], 0, 1, 0);
+        dWorldStep(w, REAL(0.01));
+        CHECK(dBodyGetPosition(bodies[1])[1] != 0);
+        CHECK(dBodyIsEnabled(bodies[1]));
+        CHECK(!dBodyIsEnabled(bodies[2]));
+
+        dWorldDestroy(w);
+    }
+}
+
+
+SUITE (TestWorldIslandSleeping)
+{
+    // Two bodies floating in zero gravity, linked by a ball joint
+    static dJointID buildPair(dWorldID w, dBodyID *bodies)
+    {
+        dWorldSetAutoDisableFlag(w, 1);
+        dWorldSetAutoDisableSteps(w, 3);
+        dWorldSetAutoDisableTime(w, 0);
+        dWorldSetAutoDisableMode(w, dAutoDisableIslands);
+
+        for (int i = 0; i != 2; ++i) {
+            bodies[i] = dBodyCreate(w);
+            dBodySetPosition(bodies[i], (dReal)i, 0, 0);
+        }
+        dJointID j = dJointCreateBall(w, 0);
+        dJointAttach(j, bodies[0], bodies[1]);
+        dJointSetBallAnchor(j, REAL(0.5), 0, 0);
+        return j;
+    }
+
+    TEST(test_auto_disable_mode)
+    {
+        dWorldID w = dWorldCreate();
+        CHECK_EQUAL(dAutoDisableBodies, dWorldGetAutoDisableMode(w));
+        dWorldSetAutoDisableMode(w, dAutoDisableIslands);
+        CHECK_EQUAL(dAutoDisableIslands, dWorldGetAutoDisableMode(w));
+        dWorldDestroy(w);
+    }
+
+    TEST(test_island_sleeps_as_a_whole)
+    {
+        dWorldID w = dWorldCreate();
+        dBodyID bodies[2];
+        buildPair(w, bodies);
+
+        // one moving body keeps the other one awake
+        dBodySetAngularVel(bodies[1], 0, 0, 1);
+        for (int step = 0; step != 10; ++step) {
+            dWorldStep(w, REAL(0.01));
+            CHECK(dBodyIsEnabled(bodies[0]));
+            CHECK(dBodyIsEnabled(bodies[1]));
+        }
+
+        dBodySetAngularVel(bodies[0], 0, 0, 0);
+        dBodySetAngularVel(bodies[1], 0, 0, 0);
+        dBodySetLinearVel(bodies[0], 0, 0, 0);
+        dBodySetLinearVel(bodies[1], 0, 0, 0);
+        for (int step = 0; step != 4; ++step) {
+            dWorldStep(w, REAL(0.01));
+        }
+        CHECK(!dBodyIsEnabled(bodies[0]));
+        CHECK(!dBodyIsEnabled(bodies[1]));
+
+        dWorldDestroy(w);
+    }
+
+    TEST(test_waking_a_body_wakes_its_island)
+    {
+        dWorldID w = dWorldCreate();
+        dBodyID bodies[2];
+        dJointID j = buildPair(w, bodies);
+
+        for (int step = 0; step != 4; ++step) {
+            dWorldStep(w, REAL(0.01));
+        }
+        CHECK(!dBodyIsEnabled(bodies[0]));
+        CHECK(!dBodyIsEnabled(bodies[1]));
+
+        // the island is remembered without the joint, like with contacts
+        dJointDestroy(j);
+        dBodyEnable(bodies[0]);
+        CHECK(dBodyIsEnabled(bodies[1]));
+        CHECK_EQUAL(3, dBodyGetAutoDisableSteps(bodies[1]));
+
+        // a body that may not be disabled keeps the island awake
+        dJointID k = dJointCreateBall(w, 0);
+        dJointAttach(k, bodies[0], bodies[1]);
+        dJointSetBallAnchor(k, REAL(0.5), 0, 0);
+        dBodySetAutoDisableFlag(bodies[1], 0);
+        for (int step = 0; step != 10; ++step) {
+            dWorldStep(w, REAL(0.01));
+        }
+        CHECK(dBodyIsEnabled(bodies[0]));
+        CHECK(dBodyIsEnabled(bodies[1]));
+
+        dWorldDestroy(w);
+    }
+
+    TEST(test_sleeping_island_in_snapshot)
+    {
+        dWorldID w = dWorldCreate();
+        dBodyID bodies[3];
+        dJointID j = buildPair(w, bodies);
+        bodies[2] = dBodyCreate(w);
+
+        for (int step = 0; step != 4; ++step) {
+            dWorldStep(w, REAL(0.01));
+        }
+        CHECK(!dBodyIsEnabled(bodies[0]));
+
+        size_t size = dWorldGetStateSize(w);
+        void *buffer = malloc(size);
+        CHECK_EQUAL(size, dWorldSaveState(w, buffer, size));
+
+        dBodyEnable(bodies[1]);
+        CHECK(dBodyIsEnabled(bodies[0]));
+        CHECK_EQUAL(1, dWorldRestoreState(w, buffer, size));
+        CHECK(!dBodyIsEnabled(bodies[0]));
+        CHECK(!dBodyIsEnabled(bodies[1]));
+
+        dJointDestroy(j);
+        dBodyEnable(bodies[1]);
+        CHECK(dBodyIsEnabled(bodies[0]));
+
+        free(buffer);
+        dWorldDestroy(w);
+    }
+
+    TEST(test_destroying_a_sleeping_body)
+    {
+        dWorldID w = dWorldCreate();
+        dBodyID bodies[3];
+        buildPair(w, bodies);
+        bodies[2] = dBodyCreate(w);
+        dBodySetPosition(bodies[2], 2, 0, 0);
+        dJointID j = dJointCreateBall(w, 0);
+        dJointAttach(j, bodies[1], bodies[2]);
+        dJointSetBallAnchor(j, REAL(1.5), 0, 0);
+
+        for (int step = 0; step != 4; ++step) {
+            dWorldStep(w, REAL(0.01));
+        }
+        CHECK(!dBodyIsEnabled(bodies[2]));
+
+        // the rest of the island is still woken up together
+        dBodyDestroy(bodies[1]);
+        dBodyEnable(bodies[0]);
+        CHECK(dBodyIsEnabled(bodies[2]));
+        dWorldStep(w, REAL(0.01));
+
+        dWorldDestroy(w);
+    }
+}
+
+
+#if dBUILTIN_THREADING_IMPL_ENABLED
+SUITE (TestThreadPool)
+{
+    // Separate pendulums, one island each
+    static void buildPendulums(dWorldID w, dBodyID *bodies, int count)
+    {
+        dWorldSetGravity(w, 0, 0, REAL(-9.81));
+        for (int i = 0; i != count; ++i) {
+            dBodyID b = dBodyCreate(w);
+            dBodySetPosition(b, (dReal)i * 2, 1, 0);
+            dJointID j = dJointCreateBall(w, 0);
+            dJointAttach(j, b, 0);
+            dJointSetBallAnchor(j, (dReal)i * 2, 0, 0);
+            bodies[i] = b;
+        }
+    }
+
+    // A CPU the tests may run on, to pin the pool threads to
+    static int allowedCPU()
+    {
+#if defined(__linux__)
+        cpu_set_t allowed;
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+            for (int cpu = 0; cpu != CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &allowed)) return cpu;
+            }
+        }
+#endif
+        return 0;
+    }
+
+    TEST(test_configured_pool_steps_like_serial)
+    {
+        const int count = 16;
+        dWorldID serial = dWorldCreate();
+        dWorldID threaded = dWorldCreate();
+        dBodyID serialBodies[count], threadedBodies[count];
+        buildPendulums(serial, serialBodies, count);
+        buildPendulums(threaded, threadedBodies, count);
+
+        const int cpus[1] = { allowedCPU() };
+        dThreadingThreadPoolConfig config;
+        memset(&config, 0, sizeof(config));
+        config.struct_size = sizeof(config);
+        config.spin_count = 1000;
+        config.keep_hot = 1;
+        config.cpu_count = 1;
+        config.cpu_ids = cpus;
+
+        dThreadingImplementationID threading = dThreadingAllocateMultiThreadedImplementation();
+        dThreadingThreadPoolID pool = dThreadingAllocateThreadPoolWithConfig(2, 0, dAllocateFlagBasicData, &config);
+        CHECK(pool != NULL);
+        dThreadingThreadPoolServeMultiThreadedImplementation(pool, threading);
+        dWorldSetStepThreadingImplementation(threaded, dThreadingImplementationGetFunctions(threading), threading);
+        dWorldSetStepIslandsProcessingMaxThreadCount(threaded, 0);
+
+        dThreadingThreadPoolResetThreadStats(pool);
+        for (int step = 0; step != 20; ++step) {
+            dWorldQuickStep(serial, REAL(0.01));
+            dWorldQuickStep(threaded, REAL(0.01));
+        }
+        for (int i = 0; i != count; ++i) {
+            // the solver row order is randomized, and the islands draw from the
+            // shared random sequence in the order they are processed
+            CHECK_ARRAY_CLOSE(dBodyGetPosition(serialBodies[i]), dBodyGetPosition(threadedBodies[i]), 3, REAL(1e-4));
+        }
+
+        dWorldSetStepThreadingImplementation(threaded, NULL, NULL);
+        dThreadingImplementationShutdownProcessing(threading);
+        dThreadingThreadPoolWaitIdleState(pool);
+
+        unsigned long jobs = 0;
+        dThreadingThreadPoolThreadStats stats;
+        for (unsigned t = 0; t != 2; ++t) {
+            CHECK_EQUAL(1, dThreadingThreadPoolGetThreadStats(pool, t, &stats));
+            CHECK(stats.busy_time >= 0);
+            CHECK(stats.idle_time >= 0);
+            jobs += stats.job_count;
+        }
+        CHECK(jobs > 0);
+        CHECK_EQUAL(0, dThreadingThreadPoolGetThreadStats(pool, 2, &stats));
+
+        dThreadingThreadPoolResetThreadStats(pool);
+        CHECK_EQUAL(1, dThreadingThreadPoolGetThreadStats(pool, 0, &stats));
+        CHECK_EQUAL(0ul, stats.job_count);
+        CHECK_EQUAL(0.0, stats.busy_time);
+
+        dThreadingFreeThreadPool(pool);
+        dThreadingFreeImplementation(threading);
+        dWorldDestroy(threaded);
+        dWorldDestroy(serial);
+    }
+
+    TEST(test_stepper_memory_follows_island_sizes)
+    {
+        dWorldID w = dWorldCreate();
+        setCountingStepMemoryManager(w);
+
+        // one large island and many small ones
+        const int count = 16, chainLength = 100;
+        dBodyID bodies[count];
+        buildPendulums(w, bodies, count);
+        dBodyID prev = 0;
+        for (int i = 0; i != chainLength; ++i) {
+            dBodyID b = dBodyCreate(w);
+            dBodySetPosition(b, 0, (dReal)(-1 - i), 5);
+            dJointID j = dJointCreateHinge(w, 0);
+            dJointAttach(j, b, prev);
+            dJointSetHingeAnchor(j, 0, REAL(-0.5) - i, 5);
+            dJointSetHingeAxis(j, 1, 0, 0);
+            prev = b;
+        }
+
+        dThreadingImplementationID threading = dThreadingAllocateMultiThreadedImplementation();
+        dThreadingThreadPoolID pool = dThreadingAllocateThreadPool(4, 0, dAllocateFlagBasicData, NULL);
+        dThreadingThreadPoolServeMultiThreadedImplementation(pool, threading);
+        dWorldSetStepThreadingImplementation(w, dThreadingImplementationGetFunctions(threading), threading);
+
+        dWorldSetStepIslandsProcessingMaxThreadCount(w, 1);
+        dWorldStep(w, REAL(0.01));
+        size_t serialMemory = stepMemoryInUse();
+
+        // the extra arenas only need to fit the small islands, not the chain
+        dWorldSetStepIslandsProcessingMaxThreadCount(w, 4);
+        resetStepMemoryPeak();
+        dWorldStep(w, REAL(0.01));
+        CHECK(stepMemoryInUse() > serialMemory);
+        CHECK(stepMemoryPeak() < serialMemory + serialMemory / 2);
+
+        dWorldSetStepThreadingImplementation(w, NULL, NULL);
+        dThreadingImplementationShutdownProcessing(threading);
+        dThreadingThreadPoolWaitIdleState(pool);
+        dThreadingFreeThreadPool(pool);
+        dThreadingFreeImplementation(threading);
+        dWorldDestroy(w);
+        CHECK_EQUAL(0u, stepMemoryInUse());
+    }
+}
+#endif // #if dBUILTIN_THREADING_IMPL_ENABLED
+
+
+SUITE (TestStepperArenas)
+{
+    TEST(test_arenas_do_not_grow_when_large_island_finishes_first)
+    {
+        dWorldID w = dWorldCreate();
+        dxWorldProcessMemoryManager memmgr(&countingStepAlloc, &countingStepShrink, &countingStepFree);
+
+        // one large island and three small ones, the large one taken first
+        const unsigned threadCount = 4;
+        const size_t reqs[threadCount] = { 1024 * 1024, 1024, 1024, 1024 };
+
+        dxWorldProcessContext *context = new dxWorldProcessContext();
+        CHECK(context->EnsureStepperSyncObjectsAreAllocated(w));
+
+        size_t firstStepMemory = 0;
+        resetStepMemoryPeak();
+        for (int step = 0; step != 10; ++step) {
+            CHECK(context->ReallocateStepperMemArenas(w, threadCount, reqs, &memmgr, 1.0f, 0));
+            if (step == 0) {
+                firstStepMemory = stepMemoryInUse();
+            }
+            CHECK_EQUAL(firstStepMemory, stepMemoryInUse());
+
+            dxWorldProcessMemArena *arenas[threadCount];
+            for (unsigned i = 0; i != threadCount; ++i) {
+                arenas[i] = context->ObtainStepperMemArena();
+                CHECK(arenas[i] != NULL && arenas[i]->GetMemorySize() >= reqs[i]);
+            }
+
+            // the large island's job completes before the others
+            for (unsigned i = 0; i != threadCount; ++i) {
+                context->ReturnStepperMemArena(arenas[i]);
+            }
+        }
+
+        CHECK_EQUAL(firstStepMemory, stepMemoryPeak());
+
+        context->CleanupWorldReferences(w);
+        delete context;
+        CHECK_EQUAL(0u, stepMemoryInUse());
+
+        dWorldDestroy(w);
+    }
+}
+
+
+SUITE (TestWorldCCD)
+{
+    struct Scene {
+        dWorldID world;
+        dSpaceID space;
+        dJointGroupID contacts;
+    };
+
+    static void nearCallback(void *data, dGeomID o1, dGeomID o2)
+    {
+        Scene *scene = (Scene *)data;
+        dContact contact[4];
+        int n = dCollide(o1, o2, 4, &contact[0].geom, sizeof(dContact));
+        for (int i = 0; i != n; ++i) {
+            contact[i].surface.mode = 0;
+            contact[i].surface.mu = 0;
+            dJointID j = dJointCreateContact(scene->world, scene->contacts, &contact[i]);
+            dJointAttach(j, dGeomGetBody(contact[i].geom.g1), dGeomGetBody(contact[i].geom.g2));
+        }
+    }
+
+    // A small sphere shot at a thin static wall, moving five times its own
+    // size per step. Returns the sphere x position after the steps.
+    static dReal shootThroughWall(int ccd)
+    {
+        Scene scene;
+        scene.world = dWorldCreate();
+        scene.space = dHashSpaceCreate(0);
+        scene.contacts = dJointGroupCreate(0);
+
+        dGeomSetPosition(dCreateBox(scene.space, REAL(0.02), 2, 2), 2, 0, 0);
+
+        dBodyID b = dBodyCreate(scene.world);
+        dMass mass;
+        dMassSetSphere(&mass, 1, REAL(0.1));
+        dBodySetMass(b, &mass);
+        dBodySetPosition(b, REAL(0.5), 0, 0);
+        dBodySetLinearVel(b, 60, 0, 0);
+        dBodySetCCDMode(b, ccd);
+        dGeomSetBody(dCreateSphere(scene.space, REAL(0.1)), b);
+
+        const dReal stepsize = REAL(1.0) / 60;
+        dWorldSetCCDStepSize(scene.world, stepsize);
+        for (int step = 0; step != 10; ++step) {
+            dSpaceCollide(scene.space, &scene, &nearCallback);
+            dWorldQuickStep(scene.world, stepsize);
+            dJointGroupEmpty(scene.contacts);
+        }
+
+        dReal x = dBodyGetPosition(b)[0];
+        dJointGroupDestroy(scene.contacts);
+        dSpaceDestroy(scene.space);
+        dWorldDestroy(scene.world);
+        return x;
+    }
+
+    TEST(test_fast_sphere_tunnels_without_ccd)
+    {
+        CHECK(shootThroughWall(0) > REAL(2.1));
+    }
+
+    TEST(test_fast_sphere_stopped_by_ccd)
+    {
+        dReal x = shootThroughWall(1);
+        CHECK(x < REAL(2.0) - REAL(0.1));
+        CHECK(x > REAL(1.5));
+    }
+
+    TEST(test_speculative_contact_has_gap_depth)
+    {
+        dWorldID w = dWorldCreate();
+        dSpaceID space = dSimpleSpaceCreate(0);
+        dGeomID wall = dCreateBox(space, REAL(0.02), 2, 2);
+        dGeomSetPosition(wall, 2, 0, 0);
+
+        dBodyID b = dBodyCreate(w);
+        dBodySetPosition(b, REAL(1.5), 0, 0);
+        dBodySetLinearVel(b, 60, 0, 0);
+        dGeomID sphere = dCreateSphere(space, REAL(0.1));
+        dGeomSetBody(sphere, b);
+
+        dContactGeom contact[4];
+        CHECK_EQUAL(0, dCollide(sphere, wall, 4, contact, sizeof(dContactGeom)));
+
+        CHECK_EQUAL(0, dBodyGetCCDMode(b));
+        dWorldSetCCDStepSize(w, REAL(1.0) / 60);
+        dBodySetCCDMode(b, 1);
+        CHECK_EQUAL(1, dBodyGetCCDMode(b));
+        dReal aabb[6];
+        dGeomGetAABB(sphere, aabb);
+        CHECK_CLOSE(REAL(2.6), aabb[1], REAL(1e-4));
+        CHECK_CLOSE(REAL(1.4), aabb[0], REAL(1e-4));
+
+        int n = dCollide(sphere, wall, 4, contact, sizeof(dContactGeom));
+        CHECK(n > 0);
+        for (int i = 0; i != n; ++i) {
+            // sphere surface at 1.6, wall face at 1.99
+            CHECK_CLOSE(REAL(-0.39), contact[i].depth, REAL(1e-3));
+            CHECK_CLOSE(REAL(-1.0), contact[i].normal[0], REAL(1e-4));
+        }
+        n = dCollide(wall, sphere, 4, contact, sizeof(dContactGeom));
+        CHECK(n > 0);
+        CHECK_CLOSE(REAL(-0.39), contact[0].depth, REAL(1e-3));
+
+        // stepping stores the step size for the next sweep
+        dWorldQuickStep(w, REAL(0.01));
+        CHECK_EQUAL(REAL(0.01), dWorldGetCCDStepSize(w));
+
+        dSpaceDestroy(space);
+        dWorldDestroy(w);
+    }
+
+    TEST(test_speculative_contact_is_on_current_pose)
+    {
+        dWorldID w = dWorldCreate();
+        dSpaceID space = dSimpleSpaceCreate(0);
+        dGeomID wall = dCreateBox(space, REAL(0.02), 4, 4);
+        dGeomSetPosition(wall, 2, 0, 0);
+
+        // a glancing hit: the sphere also moves sideways by 0.6 in the step
+        dBodyID b = dBodyCreate(w);
+        dBodySetPosition(b, REAL(1.5), REAL(0.5), 0);
+        dBodySetLinearVel(b, 60, 36, 0);
+        dBodySetCCDMode(b, 1);
+        dWorldSetCCDStepSize(w, REAL(1.0) / 60);
+        dGeomID sphere = dCreateSphere(space, REAL(0.1));
+        dGeomSetBody(sphere, b);
+
+        dContactGeom contact[4];
+        for (int order = 0; order != 2; ++order) {
+            int n = order == 0 ? dCollide(sphere, wall, 4, contact, sizeof(dContactGeom))
+                               : dCollide(wall, sphere, 4, contact, sizeof(dContactGeom));
+            CHECK(n > 0);
+            for (int i = 0; i != n; ++i) {
+                // the point is ahead of the current center along the normal,
+                // so the normal gives the sphere no torque
+                CHECK_CLOSE(REAL(0.5), contact[i].pos[1], REAL(0.05));
+                CHECK_CLOSE(REAL(0.0), contact[i].pos[2], REAL(1e-4));
+                CHECK_CLOSE(REAL(-0.39), contact[i].depth, REAL(0.05));
+            }
+        }
+
+        // the sampling left the body where it was
+        CHECK_EQUAL(REAL(1.5), dBodyGetPosition(b)[0]);
+        CHECK_EQUAL(REAL(0.5), dBodyGetPosition(b)[1]);
+
+        dSpaceDestroy(space);
+        dWorldDestroy(w);
+    }
+
+    TEST(test_rays_are_not_swept)
+    {
+        dWorldID w = dWorldCreate();
+        dBodyID b = dBodyCreate(w);
+        dBodySetLinearVel(b, 60, 0, 0);
+        dBodySetCCDMode(b, 1);
+        dWorldSetCCDStepSize(w, REAL(1.0) / 60);
+        dGeomID box = dCreateBox(0, REAL(0.2), REAL(0.2), REAL(0.2));
+        dGeomSetBody(box, b);
+
+        // the ray passes where the box will be, but not where it is
+        dGeomID ray = dCreateRay(0, 10);
+        dGeomRaySet(ray, REAL(0.6), 5, 0, 0, -1, 0);
+        dContactGeom contact[4];
+        CHECK_EQUAL(0, dCollide(ray, box, 4, contact, sizeof(dContactGeom)));
+        CHECK_EQUAL(0, dCollide(box, ray, 4, contact, sizeof(dContactGeom)));
+
+        dGeomDestroy(ray);
+        dGeomDestroy(box);
+        dWorldDestroy(w);
+    }
+}
+
+
+SUITE (TestWorldState)
+{
+    struct Scene {
+        dWorldID world;
+        dSpaceID space;
+        dJointGroupID contacts;
+        dBodyID bodies[6];
+    };
+
+    static void nearCallback(void *data, dGeomID o1, dGeomID o2)
+    {
+        Scene *scene = (Scene *)data;
+        dContact contact[4];
+        int n = dCollide(o1, o2, 4, &contact[0].geom, sizeof(dContact));
+        for (int i = 0; i != n; ++i) {
+            contact[i].surface.mode = dContactApprox1;
+            contact[i].surface.mu = REAL(0.5);
+            dJointID j = dJointCreateContact(scene->world, scene->contacts, &contact[i]);
+            dJointAttach(j, dGeomGetBody(contact[i].geom.g1), dGeomGetBody(contact[i].geom.g2));
+        }
+    }
+
+    // A stack of boxes falling on the ground next to a hinged pair, with
+    // auto-disable on
+    static void buildScene(Scene &scene)
+    {
+        scene.world = dWorldCreate();
+        scene.space = dHashSpaceCreate(0);
+        scene.contacts = dJointGroupCreate(0);
+        dWorldSetGravity(scene.world, 0, 0, REAL(-9.81));
+        dWorldSetAutoDisableFlag(scene.world, 1);
+        dWorldSetAutoDisableAverageSamplesCount(scene.world, 4);
+        dCreatePlane(scene.space, 0, 0, 1, 0);
+
+        for (int i = 0; i != 6; ++i) {
+            dBodyID b = dBodyCreate(scene.world);
+            dMass mass;
+            dMassSetBox(&mass, 1, REAL(0.4), REAL(0.4), REAL(0.4));
+            dBodySetMass(b, &mass);
+            dBodySetPosition(b, REAL(0.05) * i, (i < 4) ? 0 : 2, REAL(0.3) + REAL(0.45) * (i % 4));
+            dBodySetAngularVel(b, 0, 0, REAL(0.3) * i);
+            dGeomSetBody(dCreateBox(scene.space, REAL(0.4), REAL(0.4), REAL(0.4)), b);
+            scene.bodies[i] = b;
+        }
+
+        dJointID hinge = dJointCreateHinge(scene.world, 0);
+        dJointAttach(hinge, scene.bodies[4], scene.bodies[5]);
+        dJointSetHingeAnchor(hinge, REAL(0.2), 2, REAL(0.5));
+        dJointSetHingeAxis(hinge, 0, 1, 0);
+    }
+
+    static void destroyScene(Scene &scene)
+    {
+        dJointGroupDestroy(scene.contacts);
+        dSpaceDestroy(scene.space);
+        dWorldDestroy(scene.world);
+    }
+
+    static void stepScene(Scene &scene, int steps)
+    {
+        for (int step = 0; step != steps; ++step) {
+            dSpaceCollide(scene.space, &scene, &nearCallback);
+            dWorldQuickStep(scene.world, REAL(0.01));
+            dJointGroupEmpty(scene.contacts);
+        }
+    }
+
+    TEST(test_restore_replays_steps_exactly)
+    {
+        Scene scene;
+        buildScene(scene);
+        stepScene(scene, 20);
+
+        size_t size = dWorldGetStateSize(scene.world);
+        char *state = new char[size];
+        CHECK_EQUAL((size_t)0, dWorldSaveState(scene.world, state, size - 1));
+        CHECK_EQUAL(size, dWorldSaveState(scene.world, state, size));
+
+        stepScene(scene, 30);
+        dReal pos[6][3], vel[6][3];
+        int enabled[6];
+        for (int i = 0; i != 6; ++i) {
+            memcpy(pos[i], dBodyGetPosition(scene.bodies[i]), sizeof(pos[i]));
+            memcpy(vel[i], dBodyGetAngularVel(scene.bodies[i]), sizeof(vel[i]));
+            enabled[i] = dBodyIsEnabled(scene.bodies[i]);
+        }
+
+        CHECK_EQUAL(1, dWorldRestoreState(scene.world, state, size));
+        stepScene(scene, 30);
+        for (int i = 0; i != 6; ++i) {
+            CHECK_ARRAY_EQUAL(pos[i], dBodyGetPosition(scene.bodies[i]), 3);
+            CHECK_ARRAY_EQUAL(vel[i], dBodyGetAngularVel(scene.bodies[i]), 3);
+            CHECK_EQUAL(enabled[i], dBodyIsEnabled(scene.bodies[i]));
+        }
+
+        // the state does not fit a world with other bodies
+        dBodyCreate(scene.world);
+        CHECK_EQUAL(0, dWorldRestoreState(scene.world, state, size));
+
+        delete[] state;
+        destroyScene(scene);
+    }
+}
+
+
+SUITE (TestWorldBodyStates)
+{
+    TEST(test_get_and_set_body_states)
+    {
+        const int count = 5;
+        const unsigned fields = dBodyStatePosition | dBodyStateQuaternion | dBodyStateLinearVel | dBodyStateAngularVel;
+        const int stride = 16;
+        CHECK_EQUAL(13, dBodyStateRecordSize(fields));
+        CHECK_EQUAL(12, dBodyStateRecordSize(dBodyStateRotation));
+
+        dWorldID w = dWorldCreate();
+        dBodyID bodies[count];
+        dReal states[count * stride];
+        for (int i = 0; i != count; ++i) {
+            bodies[i] = dBodyCreate(w);
+            dReal *record = states + i * stride;
+            record[0] = (dReal)i; record[1] = 1; record[2] = 2;
+            dQFromAxisAndAngle(record + 3, 0, 0, 1, REAL(0.1) * i);
+            record[7] = 0; record[8] = (dReal)i; record[9] = 0;
+            record[10] = 1; record[11] = 0; record[12] = (dReal)-i;
+        }
+        dWorldSetBodyStates(w, bodies, count, fields, states, stride);
+
+        for (int i = 0; i != count; ++i) {
+            const dReal *record = states + i * stride;
+            CHECK_ARRAY_CLOSE(record, dBodyGetPosition(bodies[i]), 3, REAL(1e-6));
+            CHECK_ARRAY_CLOSE(record + 3, dBodyGetQuaternion(bodies[i]), 4, REAL(1e-6));
+            CHECK_ARRAY_CLOSE(record + 7, dBodyGetLinearVel(bodies[i]), 3, REAL(1e-6));
+            CHECK_ARRAY_CLOSE(record + 10, dBodyGetAngularVel(bodies[i]), 3, REAL(1e-6));
+        }
+
+        dReal out[count * 12];
+        int indices[count];
+        const dBodyID picked[2] = { bodies[3], bodies[1] };
+        CHECK_EQUAL(2, dWorldGetBodyStates(w, picked, 2, dBodyStateRotation, out, 12, indices));
+        CHECK_EQUAL(0, indices[0]);
+        CHECK_EQUAL(1, indices[1]);
+        CHECK_ARRAY_EQUAL(dBodyGetRotation(bodies[3]), out, 12);
+        CHECK_ARRAY_EQUAL(dBodyGetRotation(bodies[1]), out + 12, 12);
+
+        // all bodies, most recently created first
+        CHECK_EQUAL(count, dWorldGetBodyStates(w, NULL, count, dBodyStatePosition, out, 3, indices));
+        for (int i = 0; i != count; ++i) {
+            CHECK_EQUAL(i, indices[i]);
+            CHECK_ARRAY_EQUAL(dBodyGetPosition(bodies[count - 1 - i]), out + i * 3, 3);
+        }
+
+        dWorldDestroy(w);
+    }
+
+    TEST(test_changed_only_body_states)
+    {
+        const int count = 4;
+        dWorldID w = dWorldCreate();
+        dBodyID bodies[count];
+        for (int i = 0; i != count; ++i) {
+            bodies[i] = dBodyCreate(w);
+        }
+
+        dReal out[count * 3];
+        int indices[count];
+        const unsigned fields = dBodyStatePosition | dBodyStateChangedOnly;
+        CHECK_EQUAL(count, dWorldGetBodyStates(w, bodies, count, fields, out, 3, indices));
+        CHECK_EQUAL(0, dWorldGetBodyStates(w, bodies, count, fields, out, 3, indices));
+
+        // disabled bodies are not stepped and do not change
+        dBodyDisable(bodies[1]);
+        dBodyDisable(bodies[2]);
+        dWorldSetGravity(w, 0, 0, -1);
+        dWorldQuickStep(w, REAL(0.01));
+        CHECK_EQUAL(2, dWorldGetBodyStates(w, bodies, count, fields, out, 3, indices));
+        CHECK_EQUAL(0, indices[0]);
+        CHECK_EQUAL(3, indices[1]);
+        CHECK_ARRAY_EQUAL(dBodyGetPosition(bodies[3]), out + 3, 3);
+
+        dBodySetPosition(bodies[2], 0, 0, 5);
+        CHECK_EQUAL(1, dWorldGetBodyStates(w, bodies, count, fields, out, 3, indices));
+        CHECK_EQUAL(2, indices[0]);
+        CHECK_EQUAL(REAL(5.0), out[2]);
+
+        dWorldDestroy(w);
+    }
+}